@@ -0,0 +1,401 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Audit log (--audit-log).
+ *
+ * Every rotation leaves one line in an append-only file. The rotation
+ * paths (the daemon's event loop, the worker pool's threads) only copy a
+ * fixed-size record into a bounded lock-free ring: each cell carries a
+ * sequence number, producers claim a position with one compare-and-swap
+ * on the tail and publish the cell by advancing its sequence (Vyukov's
+ * bounded queue, with a single consumer).
+ *
+ * One writer thread drains the ring, formats up to AUDIT_BATCH lines and
+ * hands them to the kernel with one writev(). Durability is group
+ * committed: fdatasync() runs at most once per fsync interval, covering
+ * every batch written since the previous one. The writer sleeps on an
+ * eventfd that producers only signal when it asked to be woken.
+ *
+ * A full ring either makes the producer wait for the writer, or drops the
+ * record and counts it; both are exported as metrics.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for snprintf
+#include <stdlib.h>                // for calloc, free
+#include <string.h>                // for strcmp
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <poll.h>                  // for poll
+#include <pthread.h>               // for the writer thread
+#include <sched.h>                 // for sched_yield
+#include <stdatomic.h>             // for the ring positions and counters
+#include <time.h>                  // for clock_gettime, gmtime_r
+#include <unistd.h>                // for write, fdatasync, close
+#include <net/if.h>                // for if_indextoname
+#include <sys/eventfd.h>           // for eventfd
+#include <sys/uio.h>               // for writev
+#include "audit.h"                 // for the declarations implemented here
+
+// Most lines handed to one writev()
+#define AUDIT_BATCH 256
+// Room for one formatted line
+#define AUDIT_LINE_SIZE 192
+
+/**
+* @brief One rotation, as copied by the rotation path.
+*/
+typedef struct audit_record {
+    int64 time_ns;                       // CLOCK_REALTIME when the rotation finished
+    const char *source;                  // Rotation path ("daemon", "parallel"), a string literal
+    int32 ifindex;                       // Interface index
+    char name[IFNAMSIZ];                 // Interface name, may be empty
+    MacAddress old_mac;                  // Address before the change
+    MacAddress new_mac;                  // Address applied
+    int error;                           // errno of the change, 0 on success
+    MacBackend backend;                  // How the change was applied
+} AuditRecord;
+
+/**
+* @brief One cell of the ring.
+*/
+typedef struct audit_cell {
+    _Atomic(int64) sequence;             // Position + 1 once published, position + ring size once consumed
+    AuditRecord record;                  // The record
+} AuditCell;
+
+/**
+* @brief An open audit log.
+*/
+struct audit_log {
+    AuditOptions options;                // Configuration
+    int fd;                              // The log file (O_APPEND)
+    int wake_fd;                         // eventfd: producers -> sleeping writer
+    AuditCell *cells;                    // The ring
+    int64 mask;                          // Ring size minus one
+    pthread_t writer;                    // Writer thread
+    atomic_bool sleeping;                // The writer waits for wake_fd
+    atomic_bool stopping;                // Asks the writer to drain and exit
+    _Alignas(64) _Atomic(int64) tail;    // Next position producers claim
+    _Alignas(64) int64 head;             // Next position the writer reads (writer only)
+    _Alignas(64) _Atomic(int64) records; // Records queued
+    _Atomic(int64) dropped;              // Records dropped on a full ring
+    _Atomic(int64) blocked;              // Records that waited for room
+    _Atomic(int64) written;              // Records written (updated by the writer)
+    _Atomic(int64) batches;              // writev() calls (updated by the writer)
+    _Atomic(int64) fsyncs;               // fdatasync() calls (updated by the writer)
+    _Atomic(int64) errors;               // Failed writes and syncs (updated by the writer)
+    char lines[AUDIT_BATCH][AUDIT_LINE_SIZE];  // Formatted batch (writer only)
+};
+
+/**
+ * @brief Parses "block" or "drop".
+ *
+ * @return int 0 on success, or -EINVAL.
+ */
+int parse_audit_overflow(const char *text, AuditOverflow *overflow) {
+    if (strcmp(text, "block") == 0) {
+        *overflow = AUDIT_BLOCK;
+    } else if (strcmp(text, "drop") == 0) {
+        *overflow = AUDIT_DROP;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/**
+ * @brief Wakes the writer if it is waiting for records.
+ */
+static void wake_writer(AuditLog *log) {
+    atomic_thread_fence(memory_order_seq_cst);            // Orders the publication before reading sleeping
+    if (atomic_load_explicit(&log->sleeping, memory_order_relaxed) && atomic_exchange(&log->sleeping, false)) {
+        int64 one = 1;
+        write(log->wake_fd, &one, sizeof(one));
+    }
+}
+
+/**
+ * @brief Queues the audit record of one rotation.
+ *
+ * Safe to call from any number of threads. Never blocks with the drop
+ * policy; with the block policy, waits while the ring is full.
+ *
+ * @param log The audit log, NULL to do nothing.
+ * @param rotation The finished rotation.
+ * @param source The rotation path, a string literal.
+ */
+void audit_rotation(AuditLog *log, const LinkRotation *rotation, const char *source) {
+    if (log == NULL) {
+        return;
+    }
+    bool waited = false;
+    int64 position = atomic_load_explicit(&log->tail, memory_order_relaxed);
+    AuditCell *cell;
+    for (;;) {
+        cell = &log->cells[position & log->mask];
+        int64 sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        long difference = (long)(sequence - position);
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&log->tail, &position, position + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;                                     // The cell is ours
+            }
+        } else if (difference < 0) {
+            // Full: the writer has not consumed the cell one lap ago yet
+            if (log->options.overflow == AUDIT_DROP) {
+                atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+                return;
+            }
+            if (!waited) {
+                atomic_fetch_add_explicit(&log->blocked, 1, memory_order_relaxed);
+                waited = true;
+            }
+            wake_writer(log);
+            sched_yield();
+            position = atomic_load_explicit(&log->tail, memory_order_relaxed);
+        } else {
+            position = atomic_load_explicit(&log->tail, memory_order_relaxed);  // Another producer took it
+        }
+    }
+
+    AuditRecord *record = &cell->record;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    record->time_ns = now.tv_sec * 1000000000UL + now.tv_nsec;
+    record->source = source;
+    record->ifindex = rotation->ifindex;
+    memcpy(record->name, rotation->name, IFNAMSIZ);
+    record->old_mac = rotation->old_mac;
+    record->new_mac = rotation->new_mac;
+    record->error = rotation->error;
+    record->backend = rotation->backend;
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+    atomic_fetch_add_explicit(&log->records, 1, memory_order_relaxed);
+    wake_writer(log);
+}
+
+/**
+ * @brief Takes the oldest published record off the ring (writer only).
+ *
+ * @return bool false if the ring is empty.
+ */
+static bool take_record(AuditLog *log, AuditRecord *record) {
+    AuditCell *cell = &log->cells[log->head & log->mask];
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != log->head + 1) {
+        return false;
+    }
+    *record = cell->record;
+    atomic_store_explicit(&cell->sequence, log->head + log->mask + 1, memory_order_release);
+    log->head++;
+    return true;
+}
+
+/**
+ * @brief Formats one record as a line of text. Records queued without a name (the daemon
+ * keeps none) are named here, off the rotation path.
+ *
+ * @return int Length of the line.
+ */
+static int format_record(const AuditRecord *record, char *line) {
+    time_t seconds = record->time_ns / 1000000000UL;
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+    char old_mac[MAC_STRING_LENGTH + 1], new_mac[MAC_STRING_LENGTH + 1];
+    mac_format(record->old_mac, old_mac);
+    mac_format(record->new_mac, new_mac);
+    char resolved[IFNAMSIZ];
+    const char *name = record->name[0] ? record->name : if_indextoname(record->ifindex, resolved);
+    int length = snprintf(line, AUDIT_LINE_SIZE,
+                          "%04d-%02d-%02dT%02d:%02d:%02d.%09luZ %s ifindex=%u name=%s old=%s new=%s backend=%s %s%s\n",
+                          utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec,
+                          record->time_ns % 1000000000UL, record->source, record->ifindex,
+                          name ? name : "-", old_mac, new_mac, backend_name(record->backend),
+                          record->error ? "error=" : "ok", record->error ? strerrorname_np(record->error) : "");
+    return length < AUDIT_LINE_SIZE ? length : AUDIT_LINE_SIZE - 1;
+}
+
+/**
+ * @brief Writes every line of a batch, resuming after short writes.
+ *
+ * @return bool false if the file refused them.
+ */
+static bool write_batch(int fd, struct iovec *lines, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, lines, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        while (count > 0 && (size_t)written >= lines->iov_len) {
+            written -= lines->iov_len;
+            lines++;
+            count--;
+        }
+        if (count > 0) {
+            lines->iov_base = (char *)lines->iov_base + written;
+            lines->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Writer thread: drains the ring in batches and group-commits them.
+ */
+static void *audit_writer(void *argument) {
+    AuditLog *log = argument;
+    struct iovec lines[AUDIT_BATCH];
+    bool dirty = false;                                    // Written since the last fdatasync()
+    int64 sync_due = 0;                                    // When the oldest unsynced batch must be synced
+    for (;;) {
+        int count = 0;
+        AuditRecord record;
+        while (count < AUDIT_BATCH && take_record(log, &record)) {
+            lines[count].iov_base = log->lines[count];
+            lines[count].iov_len = format_record(&record, log->lines[count]);
+            count++;
+        }
+        if (count > 0) {
+            if (!write_batch(log->fd, lines, count)) {
+                atomic_fetch_add_explicit(&log->errors, 1, memory_order_relaxed);
+            }
+            atomic_fetch_add_explicit(&log->written, count, memory_order_relaxed);
+            atomic_fetch_add_explicit(&log->batches, 1, memory_order_relaxed);
+            if (!dirty) {
+                dirty = true;
+                sync_due = monotonic_ns() + log->options.fsync_interval_ns;
+            }
+        }
+
+        bool stopping = atomic_load(&log->stopping) && count < AUDIT_BATCH;
+        if (dirty && (stopping || monotonic_ns() >= sync_due)) {
+            if (fdatasync(log->fd) < 0) {
+                atomic_fetch_add_explicit(&log->errors, 1, memory_order_relaxed);
+            }
+            atomic_fetch_add_explicit(&log->fsyncs, 1, memory_order_relaxed);
+            dirty = false;
+        }
+        if (count == AUDIT_BATCH) {
+            continue;                                      // More may be waiting
+        }
+        if (stopping) {
+            return NULL;
+        }
+
+        // Sleep until a producer publishes something, or the pending sync is due
+        atomic_store(&log->sleeping, true);
+        atomic_thread_fence(memory_order_seq_cst);        // Pairs with the fence in wake_writer()
+        AuditCell *next = &log->cells[log->head & log->mask];
+        if (atomic_load_explicit(&next->sequence, memory_order_acquire) == log->head + 1 ||
+            atomic_load(&log->stopping)) {
+            atomic_store(&log->sleeping, false);
+            continue;
+        }
+        int timeout = -1;
+        if (dirty) {
+            int64 now = monotonic_ns();
+            timeout = sync_due > now ? (int)((sync_due - now + 999999) / 1000000) : 0;
+        }
+        struct pollfd wake = { .fd = log->wake_fd, .events = POLLIN };
+        if (poll(&wake, 1, timeout) > 0) {
+            int64 wakeups;
+            read(log->wake_fd, &wakeups, sizeof(wakeups));
+        }
+        atomic_store(&log->sleeping, false);
+    }
+}
+
+/**
+ * @brief Opens (or creates) an audit log and starts its writer thread.
+ *
+ * @param options File, ring size, sync interval and overflow policy.
+ * @param log Receives the log.
+ * @return int 0 on success, or a negative errno.
+ */
+int audit_open(const AuditOptions *options, AuditLog **log) {
+    if (options->ring < 2 || (options->ring & (options->ring - 1)) != 0) {
+        return -EINVAL;
+    }
+    AuditLog *audit = calloc(1, sizeof(*audit));
+    if (audit == NULL) {
+        return -ENOMEM;
+    }
+    audit->options = *options;
+    audit->mask = options->ring - 1;
+    audit->cells = calloc(options->ring, sizeof(AuditCell));
+    audit->fd = open(options->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+    int result = audit->fd < 0 ? -errno : 0;
+    audit->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (result == 0 && audit->wake_fd < 0) {
+        result = -errno;
+    }
+    if (result == 0 && audit->cells == NULL) {
+        result = -ENOMEM;
+    }
+    if (result == 0) {
+        for (int64 i = 0; i <= audit->mask; i++) {
+            atomic_init(&audit->cells[i].sequence, i);
+        }
+        result = -pthread_create(&audit->writer, NULL, audit_writer, audit);
+    }
+    if (result < 0) {
+        if (audit->fd >= 0) close(audit->fd);
+        if (audit->wake_fd >= 0) close(audit->wake_fd);
+        free(audit->cells);
+        free(audit);
+        return result;
+    }
+    *log = audit;
+    return 0;
+}
+
+/**
+ * @brief Reads the counters of an audit log.
+ */
+void audit_stats(AuditLog *log, AuditStats *stats) {
+    stats->records = atomic_load_explicit(&log->records, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&log->dropped, memory_order_relaxed);
+    stats->blocked = atomic_load_explicit(&log->blocked, memory_order_relaxed);
+    stats->written = atomic_load_explicit(&log->written, memory_order_relaxed);
+    stats->batches = atomic_load_explicit(&log->batches, memory_order_relaxed);
+    stats->fsyncs = atomic_load_explicit(&log->fsyncs, memory_order_relaxed);
+    stats->errors = atomic_load_explicit(&log->errors, memory_order_relaxed);
+}
+
+/**
+ * @brief Writes and syncs every queued record, then closes the log (NULL is ignored).
+ *
+ * No rotation path may still be using it.
+ */
+void audit_close(AuditLog *log) {
+    if (log == NULL) {
+        return;
+    }
+    atomic_store(&log->stopping, true);
+    int64 one = 1;
+    write(log->wake_fd, &one, sizeof(one));
+    pthread_join(log->writer, NULL);
+    close(log->fd);
+    close(log->wake_fd);
+    free(log->cells);
+    free(log);
+}
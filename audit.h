@@ -0,0 +1,68 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_AUDIT_H
+#define MACMASQ_AUDIT_H
+
+// Including required C Header files
+#include "netlink.h"       // for LinkRotation
+
+// Records the ring holds when none is given (a power of two)
+#define AUDIT_DEFAULT_RING 65536
+// Longest time a written record waits for fsync when none is given, in milliseconds
+#define AUDIT_DEFAULT_FSYNC_MS 1000
+
+/**
+* @brief What a rotation path does when the ring is full.
+*/
+typedef enum audit_overflow {
+    AUDIT_BLOCK,                         // Wait for the writer to make room
+    AUDIT_DROP,                          // Drop the record and count it
+} AuditOverflow;
+
+/**
+* @brief Configuration of an audit log.
+*/
+typedef struct audit_options {
+    const char *path;                    // File records are appended to, NULL to disable auditing
+    int ring;                            // Records the ring holds (a power of two)
+    int64 fsync_interval_ns;             // Longest time a written record waits for fsync, 0 to sync every batch
+    AuditOverflow overflow;              // What to do when the ring is full
+} AuditOptions;
+
+/**
+* @brief Counters of an audit log.
+*/
+typedef struct audit_stats {
+    int64 records;                       // Records queued
+    int64 dropped;                       // Records dropped on a full ring
+    int64 blocked;                       // Records that waited for room
+    int64 written;                       // Records written
+    int64 batches;                       // writev() calls
+    int64 fsyncs;                        // fdatasync() calls
+    int64 errors;                        // Failed writes and syncs
+} AuditStats;
+
+typedef struct audit_log AuditLog;
+
+int parse_audit_overflow(const char *text, AuditOverflow *overflow);
+int audit_open(const AuditOptions *options, AuditLog **log);
+void audit_rotation(AuditLog *log, const LinkRotation *rotation, const char *source);
+void audit_stats(AuditLog *log, AuditStats *stats);
+void audit_close(AuditLog *log);
+
+#endif // MACMASQ_AUDIT_H
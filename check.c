@@ -0,0 +1,325 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Self-checks (make check).
+ *
+ * Exercises the state shared between runs and processes against files in a
+ * temporary directory, without touching a single interface: the address
+ * registry (reservation, settling, reclaiming the slots of processes and
+ * interfaces that are gone), the daemon's checkpoint (open, commit, resume,
+ * and a start that never commits) and policy compilation. Other processes
+ * holding reservations are forked children. Every failed expectation is
+ * reported with its line, and any of them makes the exit status non-zero.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for printf, fprintf, snprintf
+#include <stdlib.h>                // for mkdtemp
+#include <string.h>                // for strcmp, strcpy
+#include <errno.h>                 // for error number definitions
+#include <unistd.h>                // for fork, _exit, access, unlink, rmdir
+#include <net/if.h>                // for if_nametoindex, if_indextoname
+#include <net/if_arp.h>            // for ARPHRD_ETHER, ARPHRD_LOOPBACK
+#include <sys/wait.h>              // for waitpid
+#include "registry.h"              // for the address registry
+#include "checkpoint.h"            // for the daemon's checkpoint
+#include "policy.h"                // for policy_parse, policy_lookup
+
+// Counts one expectation, reporting it if it does not hold
+#define CHECK(condition) do {                                                      \
+        checks++;                                                                  \
+        if (!(condition)) {                                                        \
+            failures++;                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        }                                                                          \
+    } while (0)
+
+static int checks;                 // Expectations evaluated
+static int failures;               // Expectations that did not hold
+
+/*
+ * Address registry
+ */
+
+/**
+ * @brief Reserves an address from another process, which exits without settling it.
+ *
+ * @return int What registry_reserve() returned in the child, or -ECHILD if it could not run.
+ */
+static int reserve_elsewhere(const char *path, MacAddress mac) {
+    pid_t child = fork();
+    if (child == 0) {
+        MacRegistry registry;
+        if (registry_open(&registry, path) < 0) {
+            _exit(255);
+        }
+        _exit(-registry_reserve(&registry, mac) & 0xFF);
+    }
+    int status;
+    if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) == 255) {
+        return -ECHILD;
+    }
+    return -WEXITSTATUS(status);
+}
+
+/**
+ * @brief Returns an ifindex that no interface of this namespace has.
+ */
+static int32 unused_ifindex(void) {
+    char name[IFNAMSIZ];
+    int32 ifindex = 100000;
+    while (if_indextoname(ifindex, name) != NULL) {
+        ifindex++;
+    }
+    return ifindex;
+}
+
+/**
+ * @brief Checks reservations, settling and the reclaiming of stale slots.
+ */
+static void check_registry(const char *directory) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/registry", directory);
+    MacRegistry registry;
+    CHECK(registry_open(&registry, path) == 0);
+    if (registry.file == NULL) {
+        return;
+    }
+    int64 netns = registry_netns();
+    int32 loopback = if_nametoindex("lo");
+    MacAddress zero = {{ 0 }};
+    MacAddress a = {{ 0x02, 0x00, 0x00, 0x00, 0x00, 0x0A }};
+    MacAddress b = {{ 0x02, 0x00, 0x00, 0x00, 0x00, 0x0B }};
+    MacAddress c = {{ 0x02, 0x00, 0x00, 0x00, 0x00, 0x0C }};
+    MacAddress d = {{ 0x02, 0x00, 0x00, 0x00, 0x00, 0x0D }};
+    MacAddress e = {{ 0x02, 0x00, 0x00, 0x00, 0x00, 0x0E }};
+
+    // A pending reservation excludes everybody else, and lapses with its process
+    CHECK(registry_reserve(&registry, zero) == -EINVAL);
+    CHECK(registry_reserve(NULL, a) == 0);
+    CHECK(registry_reserve(&registry, a) == 0);
+    CHECK(reserve_elsewhere(path, a) == -EADDRINUSE);
+    CHECK(reserve_elsewhere(path, b) == 0);
+    CHECK(registry_reserve(&registry, b) == 0);
+
+    // Applying hands the address to the interface, which keeps it after this process lets go
+    LinkRotation rotation = { .ifindex = loopback, .old_mac = zero, .new_mac = a };
+    registry_settle(&registry, &rotation, netns);
+    CHECK(loopback != 0);
+    CHECK(reserve_elsewhere(path, a) == -EADDRINUSE);
+
+    // The next address of the interface frees its previous one
+    CHECK(registry_reserve(&registry, c) == 0);
+    rotation = (LinkRotation){ .ifindex = loopback, .old_mac = a, .new_mac = c };
+    registry_settle(&registry, &rotation, netns);
+    CHECK(reserve_elsewhere(path, a) == 0);
+    CHECK(reserve_elsewhere(path, c) == -EADDRINUSE);
+
+    // A failed rotation releases its reservation, and so does registry_release()
+    rotation = (LinkRotation){ .ifindex = loopback, .old_mac = c, .new_mac = b, .error = EIO };
+    registry_settle(&registry, &rotation, netns);
+    CHECK(reserve_elsewhere(path, b) == 0);
+    CHECK(reserve_elsewhere(path, c) == -EADDRINUSE);
+    CHECK(registry_reserve(&registry, d) == 0);
+    registry_release(&registry, d);
+    CHECK(reserve_elsewhere(path, d) == 0);
+
+    // An address applied to an interface that is gone is stale
+    CHECK(registry_reserve(&registry, e) == 0);
+    rotation = (LinkRotation){ .ifindex = unused_ifindex(), .old_mac = zero, .new_mac = e };
+    registry_settle(&registry, &rotation, netns);
+    CHECK(reserve_elsewhere(path, e) == 0);
+
+    // A random reservation redraws the lower bytes of a taken candidate
+    MacAddress drawn = c;
+    CHECK(registry_reserve_random(&registry, &drawn) == 0);
+    CHECK(!mac_equal(drawn, c));
+    CHECK(drawn.bytes[0] == c.bytes[0] && drawn.bytes[1] == c.bytes[1] && drawn.bytes[2] == c.bytes[2]);
+    registry_release(&registry, drawn);
+
+    registry_close(&registry);
+    unlink(path);
+}
+
+/*
+ * Checkpoint
+ */
+
+/**
+ * @brief Fills one record of the checkpoint.
+ */
+static void set_record(Checkpoint *checkpoint, int slot, int32 ifindex, int32 due_s, int8 last) {
+    CheckpointRecord *record = checkpoint_slot(checkpoint, slot);
+    *record = (CheckpointRecord){ .ifindex = ifindex, .rotated_s = 1, .due_s = due_s,
+                                  .address = {{ 0x02, 0, 0, 0, 0, last }}, .original = {{ 0x00, 0x11, 0x22, 0x33, 0x44, last }} };
+}
+
+/**
+ * @brief Checks that a run resumes the records of the last run that committed.
+ */
+static void check_checkpoint(const char *directory) {
+    char path[4096];
+    char new_path[4096];
+    char parent[4096];
+    snprintf(parent, sizeof(parent), "%s/run", directory);
+    snprintf(path, sizeof(path), "%s/run/checkpoint", directory);
+    snprintf(new_path, sizeof(new_path), "%s/run/checkpoint.new", directory);
+
+    // First run: nothing to resume, and the checkpoint is its own until it closes
+    Checkpoint *checkpoint = NULL;
+    Checkpoint *other = NULL;
+    CHECK(checkpoint_open(path, 7, 1000, &checkpoint) == 0);
+    if (checkpoint == NULL) {
+        return;
+    }
+    CHECK(checkpoint_previous_count(checkpoint) == 0);
+    CHECK(checkpoint_epoch(checkpoint) == 1000);
+    CHECK(checkpoint_open(path, 7, 1000, &other) == -EBUSY);
+    CHECK(checkpoint_reserve(checkpoint, 3) == 0);
+    set_record(checkpoint, 0, 5, 60, 0x05);
+    set_record(checkpoint, 2, 2, 90, 0x02);
+    CHECK(access(new_path, F_OK) == 0);
+    CHECK(checkpoint_commit(checkpoint) == 0);
+    CHECK(access(new_path, F_OK) < 0);
+    CHECK(checkpoint_commit(checkpoint) == 0);
+    checkpoint_close(checkpoint);
+
+    // Second run: resumes the records and the epoch, then stops before committing its own
+    checkpoint = NULL;
+    CHECK(checkpoint_open(path, 7, 2000, &checkpoint) == 0);
+    if (checkpoint == NULL) {
+        return;
+    }
+    CHECK(checkpoint_previous_count(checkpoint) == 2);
+    CHECK(checkpoint_epoch(checkpoint) == 1000);
+    const CheckpointRecord *record = checkpoint_previous(checkpoint, 5);
+    CHECK(record != NULL && record->due_s == 60 && record->address.bytes[5] == 0x05 &&
+          record->original.bytes[5] == 0x05);
+    record = checkpoint_previous(checkpoint, 2);
+    CHECK(record != NULL && record->due_s == 90 && record->address.bytes[5] == 0x02);
+    CHECK(checkpoint_previous(checkpoint, 3) == NULL);
+    CHECK(checkpoint_reserve(checkpoint, 1) == 0);
+    set_record(checkpoint, 0, 9, 30, 0x09);
+    checkpoint_close(checkpoint);
+    CHECK(access(new_path, F_OK) < 0);
+
+    // Third run: still finds the first run's records; another namespace finds none
+    checkpoint = NULL;
+    CHECK(checkpoint_open(path, 7, 3000, &checkpoint) == 0);
+    if (checkpoint != NULL) {
+        CHECK(checkpoint_previous_count(checkpoint) == 2);
+        CHECK(checkpoint_epoch(checkpoint) == 1000);
+        CHECK(checkpoint_previous(checkpoint, 9) == NULL);
+        checkpoint_close(checkpoint);
+    }
+    checkpoint = NULL;
+    CHECK(checkpoint_open(path, 8, 4000, &checkpoint) == 0);
+    if (checkpoint != NULL) {
+        CHECK(checkpoint_previous_count(checkpoint) == 0);
+        CHECK(checkpoint_epoch(checkpoint) == 4000);
+        checkpoint_close(checkpoint);
+    }
+
+    unlink(path);
+    rmdir(parent);
+}
+
+/*
+ * Policy
+ */
+
+/**
+ * @brief Builds the parts of an interface a policy looks at.
+ */
+static LinkInfo make_link(const char *name, int16 type, const char *kind, int32 group) {
+    LinkInfo link = { .type = type, .group = group, .flags = type == ARPHRD_LOOPBACK ? IFF_LOOPBACK : 0 };
+    strcpy(link.name, name);
+    strcpy(link.kind, kind);
+    return link;
+}
+
+/**
+ * @brief Checks that a compiled policy decides as its first matching line, and rejects bad lines.
+ */
+static void check_policy(void) {
+    static const char text[] =
+        "# Loopback stays as it is\n"
+        "lo      action=never\n"
+        "veth*   kind=veth interval=1h strategy=live\n"
+        "eth?    interval=1d address=keep-oui\n"
+        "wl*     group=5,7 action=never\n"
+        "*       kind=physical priority=bulk\n";
+    char error[256] = "";
+    Policy *policy = policy_parse(text, "check", error, sizeof(error));
+    CHECK(policy != NULL);
+    if (policy == NULL) {
+        fprintf(stderr, "%s\n", error);
+        return;
+    }
+    CHECK(policy->rule_count == 5);
+    CHECK(policy->rules[0].line == 2 && policy->rules[0].action == POLICY_NEVER);
+    CHECK(policy->rules[1].interval_ns == 3600000000000UL && policy->rules[1].strategy == STRATEGY_LIVE);
+    CHECK(policy->rules[2].address == ADDRESS_KEEP_OUI && policy->rules[2].priority == PRIORITY_NORMAL);
+    CHECK(policy->rules[4].priority == PRIORITY_BULK);
+
+    LinkInfo link = make_link("lo", ARPHRD_LOOPBACK, "", 0);
+    CHECK(policy_lookup(policy, &link) == 0);
+    link = make_link("veth3", ARPHRD_ETHER, "veth", 0);
+    CHECK(policy_lookup(policy, &link) == 1);
+    link = make_link("veth3", ARPHRD_ETHER, "", 0);
+    CHECK(policy_lookup(policy, &link) == 4);
+    link = make_link("eth0", ARPHRD_ETHER, "", 0);
+    CHECK(policy_lookup(policy, &link) == 2);
+    link = make_link("eth10", ARPHRD_ETHER, "", 0);
+    CHECK(policy_lookup(policy, &link) == 4);
+    link = make_link("wlan0", ARPHRD_ETHER, "", 7);
+    CHECK(policy_lookup(policy, &link) == 3);
+    link = make_link("wlan0", ARPHRD_ETHER, "", 6);
+    CHECK(policy_lookup(policy, &link) == 4);
+    link = make_link("bond0", ARPHRD_ETHER, "bond", 0);
+    CHECK(policy_lookup(policy, &link) == -1);
+    policy_free(policy);
+
+    CHECK(policy_parse("eth0 colour=red\n", "bad", error, sizeof(error)) == NULL);
+    CHECK(strcmp(error, "bad:1: unknown key") == 0);
+    CHECK(policy_parse("eth0 interval=1h\neth1 interval=soon\n", "bad", error, sizeof(error)) == NULL);
+    CHECK(strcmp(error, "bad:2: malformed interval") == 0);
+}
+
+/**
+ * @brief Runs every check in a fresh temporary directory.
+ *
+ * @return int 0 if every expectation held, 1 otherwise.
+ */
+int main(void) {
+    char directory[] = "/tmp/macmasq-check.XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        fprintf(stderr, "macmasq-check: mkdtemp: %s\n", strerror(errno));
+        return 1;
+    }
+    check_registry(directory);
+    check_checkpoint(directory);
+    check_policy();
+    rmdir(directory);
+
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,332 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checkpoint of the daemon's schedule, for warm restarts.
+ *
+ * The file is a header followed by one fixed-size record per daemon slot,
+ * mapped shared: the daemon updates a record with plain stores whenever
+ * the slot's schedule or address changes, and the page cache keeps it
+ * across a crash or a restart without a single system call.
+ *
+ * Deadlines are CLOCK_MONOTONIC, so the header carries the boot id and the
+ * namespace, and a checkpoint from another boot or namespace is ignored.
+ * Opening a valid one copies its records aside, sorted by ifindex: the
+ * daemon looks every interface of its first dump up there and keeps the
+ * deadlines of those that are still the same interface. It also keeps the
+ * epoch of the previous run, which rotation times are counted from.
+ *
+ * The new run writes its records to a file of its own next to the
+ * checkpoint, and renames it over the checkpoint once its first dump is
+ * recorded (checkpoint_commit()). Until then the previous run's file is
+ * left as it was, so a crash during startup does not lose its deadlines.
+ *
+ * An exclusive lock is held on the checkpoint for as long as it is open
+ * (on the previous file until the rename, then on the new one), so two
+ * daemons cannot share one checkpoint.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for fopen, fgets, snprintf, rename
+#include <stdlib.h>                // for calloc, malloc, qsort, bsearch, free
+#include <string.h>                // for memcpy, memcmp, strlen
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <unistd.h>                // for ftruncate, close, unlink
+#include <sys/file.h>              // for flock
+#include <sys/mman.h>              // for mmap, mremap
+#include <sys/stat.h>              // for fstat
+#include "checkpoint.h"            // for the checkpoint declared here
+
+// Identifies a checkpoint file ("MMQCHKPT")
+#define CHECKPOINT_MAGIC 0x54504B4843514D4DUL
+// Bumped whenever the layout of the records changes
+#define CHECKPOINT_VERSION 2
+// Bytes of a boot id kept (/proc/sys/kernel/random/boot_id is a 36-character UUID)
+#define CHECKPOINT_BOOT_ID 40
+
+/**
+* @brief First bytes of the checkpoint file.
+*/
+typedef struct checkpoint_header {
+    int64 magic;                         // CHECKPOINT_MAGIC
+    int32 version;                       // CHECKPOINT_VERSION
+    int32 record_size;                   // sizeof(CheckpointRecord)
+    int64 netns;                         // Inode of the namespace of the interfaces
+    int64 epoch_ns;                      // Start of the first run (CLOCK_MONOTONIC), origin of rotated_s
+    char boot_id[CHECKPOINT_BOOT_ID];    // Boot the deadlines belong to
+    int32 capacity;                      // Records that follow
+    int32 reserved;
+} CheckpointHeader;
+
+/**
+* @brief An open checkpoint.
+*/
+struct checkpoint {
+    int fd;                              // The file of this run, locked for as long as it is open
+    int previous_fd;                     // The checkpoint in place, locked until this run's file replaces it, or -1
+    char *path;                          // The checkpoint
+    char *new_path;                      // Where this run's file is until it replaces the checkpoint, NULL after
+    CheckpointHeader *header;            // The mapping: header, then capacity records
+    size_t size;                         // Bytes mapped
+    CheckpointRecord *previous;          // Records of the previous run, sorted by ifindex
+    int previous_count;                  // Entries of previous
+};
+
+/**
+ * @brief Reads the boot id of the running kernel (all zeroes if unknown).
+ */
+static void read_boot_id(char boot_id[CHECKPOINT_BOOT_ID]) {
+    memset(boot_id, 0, CHECKPOINT_BOOT_ID);
+    FILE *file = fopen("/proc/sys/kernel/random/boot_id", "re");
+    if (file != NULL) {
+        if (fgets(boot_id, CHECKPOINT_BOOT_ID, file) == NULL) {
+            memset(boot_id, 0, CHECKPOINT_BOOT_ID);
+        }
+        fclose(file);
+    }
+}
+
+/**
+ * @brief Orders records by ifindex.
+ */
+static int compare_records(const void *left, const void *right) {
+    int32 a = ((const CheckpointRecord *)left)->ifindex;
+    int32 b = ((const CheckpointRecord *)right)->ifindex;
+    return (a > b) - (a < b);
+}
+
+/**
+ * @brief Copies the records of a previous run aside, if the file holds one of this boot and namespace.
+ *
+ * @return int 0 (with or without a previous run), or -ENOMEM.
+ */
+static int load_previous(Checkpoint *checkpoint, const CheckpointHeader *expected, int64 *epoch_ns) {
+    struct stat status;
+    if (fstat(checkpoint->previous_fd, &status) < 0 || status.st_size < (off_t)sizeof(CheckpointHeader)) {
+        return 0;
+    }
+    CheckpointHeader *header = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, checkpoint->previous_fd, 0);
+    if (header == MAP_FAILED) {
+        return 0;
+    }
+    int result = 0;
+    if (header->magic == CHECKPOINT_MAGIC && header->version == CHECKPOINT_VERSION &&
+        header->record_size == sizeof(CheckpointRecord) && header->netns == expected->netns &&
+        memcmp(header->boot_id, expected->boot_id, CHECKPOINT_BOOT_ID) == 0 &&
+        (size_t)status.st_size >= sizeof(*header) + (size_t)header->capacity * sizeof(CheckpointRecord)) {
+        const CheckpointRecord *records = (const CheckpointRecord *)(header + 1);
+        checkpoint->previous = malloc((header->capacity + 1) * sizeof(CheckpointRecord));
+        if (checkpoint->previous == NULL) {
+            result = -ENOMEM;
+        }
+        for (int32 i = 0; result == 0 && i < header->capacity; i++) {
+            if (records[i].ifindex != 0) {
+                checkpoint->previous[checkpoint->previous_count++] = records[i];
+            }
+        }
+        qsort(checkpoint->previous, checkpoint->previous_count, sizeof(CheckpointRecord), compare_records);
+        *epoch_ns = header->epoch_ns;
+    }
+    munmap(header, status.st_size);
+    return result;
+}
+
+/**
+ * @brief Opens (creating if needed) a checkpoint, keeps its previous run aside and starts the new run's file.
+ *
+ * @param path The checkpoint file, normally CHECKPOINT_DEFAULT_PATH.
+ * @param netns Namespace of the daemon's interfaces.
+ * @param epoch_ns Start of the daemon (CLOCK_MONOTONIC), kept if there is no previous run.
+ * @param checkpoint Receives the open checkpoint.
+ * @return int 0 on success, -EBUSY if another daemon holds it, or a negative errno.
+ */
+int checkpoint_open(const char *path, int64 netns, int64 epoch_ns, Checkpoint **checkpoint) {
+    Checkpoint *opened = calloc(1, sizeof(*opened));
+    if (opened == NULL) {
+        return -ENOMEM;
+    }
+    opened->fd = -1;
+    opened->previous_fd = open_state_file(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (opened->previous_fd < 0) {
+        int result = opened->previous_fd;
+        free(opened);
+        return result;
+    }
+    if (flock(opened->previous_fd, LOCK_EX | LOCK_NB) < 0) {
+        int result = errno == EWOULDBLOCK ? -EBUSY : -errno;
+        checkpoint_close(opened);
+        return result;
+    }
+    size_t length = strlen(path);
+    opened->path = malloc(length + 1);
+    opened->new_path = malloc(length + sizeof(".new"));
+    if (opened->path == NULL || opened->new_path == NULL) {
+        checkpoint_close(opened);
+        return -ENOMEM;
+    }
+    memcpy(opened->path, path, length + 1);
+    snprintf(opened->new_path, length + sizeof(".new"), "%s.new", path);
+
+    CheckpointHeader header = { .magic = CHECKPOINT_MAGIC, .version = CHECKPOINT_VERSION,
+                                .record_size = sizeof(CheckpointRecord), .netns = netns };
+    read_boot_id(header.boot_id);
+    int result = load_previous(opened, &header, &epoch_ns);
+    header.epoch_ns = epoch_ns;
+
+    // The new run numbers its slots afresh, in a file of its own (one a crashed start left is reused)
+    opened->size = sizeof(header);
+    if (result == 0) {
+        opened->fd = open(opened->new_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (opened->fd < 0 || flock(opened->fd, LOCK_EX | LOCK_NB) < 0 || ftruncate(opened->fd, opened->size) < 0) {
+            result = -errno;
+        }
+    }
+    if (result == 0) {
+        opened->header = mmap(NULL, opened->size, PROT_READ | PROT_WRITE, MAP_SHARED, opened->fd, 0);
+        if (opened->header == MAP_FAILED) {
+            opened->header = NULL;
+            result = -errno;
+        }
+    }
+    if (result < 0) {
+        checkpoint_close(opened);
+        return result;
+    }
+    *opened->header = header;
+    *checkpoint = opened;
+    return 0;
+}
+
+/**
+ * @brief Returns the epoch the daemon counts rotation times from (the previous run's, if any).
+ */
+int64 checkpoint_epoch(const Checkpoint *checkpoint) {
+    return checkpoint->header->epoch_ns;
+}
+
+/**
+ * @brief Returns the number of interfaces the previous run left records for.
+ */
+int checkpoint_previous_count(const Checkpoint *checkpoint) {
+    return checkpoint->previous_count;
+}
+
+/**
+ * @brief Finds the record the previous run left for an ifindex.
+ *
+ * @return const CheckpointRecord* The record, or NULL if there is none.
+ */
+const CheckpointRecord *checkpoint_previous(const Checkpoint *checkpoint, int32 ifindex) {
+    if (checkpoint->previous_count == 0) {
+        return NULL;
+    }
+    CheckpointRecord key = { .ifindex = ifindex };
+    return bsearch(&key, checkpoint->previous, checkpoint->previous_count, sizeof(key), compare_records);
+}
+
+/**
+ * @brief Releases the records of the previous run, once every interface was looked up.
+ */
+void checkpoint_forget_previous(Checkpoint *checkpoint) {
+    free(checkpoint->previous);
+    checkpoint->previous = NULL;
+    checkpoint->previous_count = 0;
+}
+
+/**
+ * @brief Puts the new run's file in place of the checkpoint, once it holds a record for every interface.
+ *
+ * Until then the checkpoint keeps the previous run's records, for a start
+ * that does not get this far.
+ *
+ * @return int 0 on success (or if already done), or a negative errno.
+ */
+int checkpoint_commit(Checkpoint *checkpoint) {
+    if (checkpoint->new_path == NULL) {
+        return 0;
+    }
+    if (rename(checkpoint->new_path, checkpoint->path) < 0) {
+        return -errno;
+    }
+    free(checkpoint->new_path);
+    checkpoint->new_path = NULL;
+    close(checkpoint->previous_fd);      // The lock on the new file now guards the checkpoint
+    checkpoint->previous_fd = -1;
+    return 0;
+}
+
+/**
+ * @brief Makes room for a number of slots (new records are free).
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+int checkpoint_reserve(Checkpoint *checkpoint, int slots) {
+    if (slots <= (int)checkpoint->header->capacity) {
+        return 0;
+    }
+    size_t size = sizeof(CheckpointHeader) + (size_t)slots * sizeof(CheckpointRecord);
+    if (ftruncate(checkpoint->fd, size) < 0) {
+        return -errno;
+    }
+    void *header = mremap(checkpoint->header, checkpoint->size, size, MREMAP_MAYMOVE);
+    if (header == MAP_FAILED) {
+        return -errno;
+    }
+    checkpoint->header = header;
+    checkpoint->size = size;
+    checkpoint->header->capacity = slots;
+    return 0;
+}
+
+/**
+ * @brief Returns the record of a slot, which checkpoint_reserve() made room for.
+ */
+CheckpointRecord *checkpoint_slot(Checkpoint *checkpoint, int slot) {
+    return (CheckpointRecord *)(checkpoint->header + 1) + slot;
+}
+
+/**
+ * @brief Unmaps and closes a checkpoint (NULL is ignored).
+ *
+ * The committed records stay for the next run; a run that was not
+ * committed removes its file and leaves the previous run's in place.
+ */
+void checkpoint_close(Checkpoint *checkpoint) {
+    if (checkpoint == NULL) {
+        return;
+    }
+    if (checkpoint->header != NULL) {
+        munmap(checkpoint->header, checkpoint->size);
+    }
+    if (checkpoint->new_path != NULL && checkpoint->fd >= 0) {
+        unlink(checkpoint->new_path);
+    }
+    if (checkpoint->fd >= 0) {
+        close(checkpoint->fd);
+    }
+    if (checkpoint->previous_fd >= 0) {
+        close(checkpoint->previous_fd);
+    }
+    free(checkpoint->previous);
+    free(checkpoint->path);
+    free(checkpoint->new_path);
+    free(checkpoint);
+}
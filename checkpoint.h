@@ -0,0 +1,50 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_CHECKPOINT_H
+#define MACMASQ_CHECKPOINT_H
+
+// Including required C Header files
+#include "netlink.h"       // for MacAddress
+
+// Checkpoint used when none is given on the command line (on tmpfs: its deadlines do not outlive a boot either)
+#define CHECKPOINT_DEFAULT_PATH "/run/macmasq/checkpoint"
+
+/**
+* @brief What the daemon keeps of one interface across a restart (one record per slot).
+*/
+typedef struct checkpoint_record {
+    int32 ifindex;                       // Interface index, 0 for a free slot
+    int32 rotated_s;                     // Last successful rotation, in seconds since the epoch plus one, 0 if none
+    int32 due_s;                         // Next rotation, in seconds since the epoch plus one (rounded up), 0 if none
+    MacAddress address;                  // Current address
+    MacAddress original;                 // Permanent address, or the first one seen if unknown
+} CheckpointRecord;
+
+typedef struct checkpoint Checkpoint;
+
+int checkpoint_open(const char *path, int64 netns, int64 epoch_ns, Checkpoint **checkpoint);
+int64 checkpoint_epoch(const Checkpoint *checkpoint);
+int checkpoint_previous_count(const Checkpoint *checkpoint);
+const CheckpointRecord *checkpoint_previous(const Checkpoint *checkpoint, int32 ifindex);
+void checkpoint_forget_previous(Checkpoint *checkpoint);
+int checkpoint_commit(Checkpoint *checkpoint);
+int checkpoint_reserve(Checkpoint *checkpoint, int slots);
+CheckpointRecord *checkpoint_slot(Checkpoint *checkpoint, int slot);
+void checkpoint_close(Checkpoint *checkpoint);
+
+#endif // MACMASQ_CHECKPOINT_H
@@ -0,0 +1,372 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * RTNL contention benchmark (--bench-rtnl).
+ *
+ * Every rtnetlink change, and every address change through ioctl, runs
+ * under the kernel's RTNL lock, so a host where a routing daemon or a CNI
+ * plugin is busy makes rotations slower than a quiet test machine shows.
+ * This benchmark builds a private namespace holding the veth pairs to
+ * rotate, then measures each backend twice: alone, and while background
+ * threads in the same namespace add and delete routes, addresses and veth
+ * pairs as fast as the kernel lets them. The slowdown column is the ratio
+ * of the two throughputs.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for printf, snprintf
+#include <stdlib.h>                // for malloc, realloc, free, qsort
+#include <string.h>                // for strcmp, strncmp, memcpy
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <unistd.h>                // for close
+#include <time.h>                  // for nanosleep
+#include <sched.h>                 // for setns
+#include <pthread.h>               // for the background threads
+#include <stdatomic.h>             // for the counters shared with them
+#include <sys/ioctl.h>             // for SIOCGIFFLAGS
+#include <sys/socket.h>            // for socket
+#include <linux/rtnetlink.h>       // for RTM_NEWROUTE, RTM_NEWADDR
+#include "netlink.h"               // for the link setup and netlink_rotate
+#include "workpool.h"              // for ioctl_rotate and netns_create
+#include "contend.h"               // for the declarations implemented here
+
+// Pause before measuring, so that the background load is running at full speed
+#define CHURN_RAMP_MS 100
+
+/**
+* @brief One background thread.
+*/
+typedef struct churn_thread {
+    ChurnKind kind;                      // What it adds and deletes
+    int index;                           // Keeps its names and prefixes apart from the others'
+    int netns;                           // Namespace to work in
+    int32 device;                        // Interface routes and addresses are put on
+    atomic_bool *stop;                   // Set when the measurement is over
+    _Atomic(int64) operations;           // Requests the kernel carried out
+    pthread_t thread;
+} ChurnThread;
+
+/**
+* @brief Backends compared by the benchmark.
+*/
+typedef enum contention_backend {
+    CONTENTION_IOCTL,                    // ioctl_rotate(), one interface at a time
+    CONTENTION_NETLINK,                  // netlink_rotate() of one interface per round trip
+    CONTENTION_NETLINK_BATCH,            // netlink_rotate() of every interface at once
+    CONTENTION_BACKENDS,
+} ContentionBackend;
+
+/**
+ * @brief Parses a comma-separated list of background loads ("routes,addresses,links" or "all").
+ *
+ * @return int 0 on success, -EINVAL for an unknown name.
+ */
+int parse_churn_kinds(const char *text, int32 *churn) {
+    static const struct { const char *name; int32 kind; } names[] = {
+        { "routes", CHURN_ROUTES }, { "addresses", CHURN_ADDRESSES }, { "links", CHURN_LINKS }, { "all", CHURN_ALL },
+    };
+    *churn = 0;
+    while (*text) {
+        size_t length = strcspn(text, ",");
+        bool known = false;
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            if (strlen(names[i].name) == length && strncmp(text, names[i].name, length) == 0) {
+                *churn |= names[i].kind;
+                known = true;
+            }
+        }
+        if (!known) {
+            return -EINVAL;
+        }
+        text += length + (text[length] == ',');
+    }
+    return *churn ? 0 : -EINVAL;
+}
+
+/**
+ * @brief Background thread: adds and deletes one kind of object until told to stop.
+ */
+static void *churn_main(void *argument) {
+    ChurnThread *churn = argument;
+    setns(churn->netns, CLONE_NEWNET);
+    int socket_fd = netlink_open(0);
+    if (socket_fd < 0) {
+        return NULL;
+    }
+    char name[IFNAMSIZ], peer[IFNAMSIZ];
+    snprintf(name, sizeof(name), "mmq-c%d", churn->index);
+    snprintf(peer, sizeof(peer), "mmq-d%d", churn->index);
+    for (int32 i = 0; !atomic_load(churn->stop); i++) {
+        // 10.(100 + thread).x.y for routes, 10.(150 + thread).x.y for addresses
+        int8 address[4] = { 10, (int8)(churn->index + (churn->kind == CHURN_ROUTES ? 100 : 150)), (int8)(i >> 8), (int8)i };
+        int first, second;
+        if (churn->kind == CHURN_ROUTES) {
+            first = netlink_ipv4_route(socket_fd, RTM_NEWROUTE, address, 32, churn->device);
+            second = netlink_ipv4_route(socket_fd, RTM_DELROUTE, address, 32, churn->device);
+        } else if (churn->kind == CHURN_ADDRESSES) {
+            first = netlink_ipv4_address(socket_fd, RTM_NEWADDR, churn->device, address, 32);
+            second = netlink_ipv4_address(socket_fd, RTM_DELADDR, churn->device, address, 32);
+        } else {
+            first = netlink_add_veth(socket_fd, name, peer, -1);
+            int32 ifindex = if_nametoindex(name);
+            second = ifindex ? netlink_delete_link(socket_fd, ifindex) : -ENODEV;
+        }
+        atomic_fetch_add(&churn->operations, (first == 0) + (second == 0));
+    }
+    close(socket_fd);
+    return NULL;
+}
+
+/**
+ * @brief Creates veth pairs mmq-tN / mmq-pN, brings them up and describes the mmq-tN ends.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+static int create_targets(int socket_fd, LinkRotation *rotations, int count, NetlinkBatch *batch) {
+    netlink_batch_init(batch, socket_fd, NULL, NULL);
+    for (int i = 0; i < count; i++) {
+        char name[IFNAMSIZ], peer[IFNAMSIZ];
+        snprintf(name, sizeof(name), "mmq-t%d", i);
+        snprintf(peer, sizeof(peer), "mmq-p%d", i);
+        int result = netlink_add_veth(socket_fd, name, peer, -1);
+        if (result < 0) {
+            return result;
+        }
+        rotations[i].ifindex = if_nametoindex(name);
+        memcpy(rotations[i].name, name, IFNAMSIZ);
+        netlink_batch_set_flags(batch, rotations[i].ifindex, IFF_UP, IFF_UP, 0);
+        netlink_batch_set_flags(batch, if_nametoindex(peer), IFF_UP, IFF_UP, 0);
+    }
+    return netlink_batch_flush(batch);
+}
+
+/**
+ * @brief qsort() comparison of two latencies.
+ */
+static int compare_int64(const void *a, const void *b) {
+    int64 x = *(const int64 *)a, y = *(const int64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Sleeps for a number of milliseconds.
+ */
+static void pause_ms(int64 duration) {
+    struct timespec wait = { .tv_sec = duration / 1000, .tv_nsec = duration % 1000 * 1000000 };
+    nanosleep(&wait, NULL);
+}
+
+/**
+* @brief Outcome of one measurement.
+*/
+typedef struct contention_result {
+    double changes_per_s;                // Addresses changed per second
+    int64 p50_ns, p99_ns, max_ns;        // Latency of one call (a batch for CONTENTION_NETLINK_BATCH)
+    int64 failures;                      // Changes the kernel refused
+} ContentionResult;
+
+/**
+ * @brief Rotates the targets with one backend for the duration of a measurement.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+static int measure(ContentionBackend backend, LinkRotation *rotations, int count, int ioctl_fd,
+                   NetlinkBatch *batch, int64 duration_ns, ContentionResult *result) {
+    int64 capacity = 4096, calls = 0, changes = 0;
+    int64 *latencies = malloc(capacity * sizeof(int64));
+    memset(result, 0, sizeof(*result));
+    int64 started = monotonic_ns(), now = started;
+    for (int next = 0; latencies != NULL && now - started < duration_ns; next = (next + 1) % count) {
+        int first = backend == CONTENTION_NETLINK_BATCH ? 0 : next;
+        int members = backend == CONTENTION_NETLINK_BATCH ? count : 1;
+        for (int i = first; i < first + members; i++) {
+            if (!random_local_mac(&rotations[i].new_mac)) {
+                free(latencies);
+                return -EIO;
+            }
+        }
+        int64 call_started = monotonic_ns();
+        if (backend == CONTENTION_IOCTL) {
+            ioctl_rotate(ioctl_fd, &rotations[first]);
+        } else {
+            int error = netlink_rotate(batch, &rotations[first], members);
+            if (error < 0) {
+                free(latencies);
+                return error;
+            }
+        }
+        now = monotonic_ns();
+        for (int i = first; i < first + members; i++) {
+            result->failures += rotations[i].error != 0;
+        }
+        if (calls == capacity) {
+            int64 *grown = realloc(latencies, 2 * capacity * sizeof(int64));
+            if (grown == NULL) {
+                break;
+            }
+            latencies = grown;
+            capacity *= 2;
+        }
+        latencies[calls++] = now - call_started;
+        changes += members;
+    }
+    if (latencies == NULL) {
+        return -ENOMEM;
+    }
+    qsort(latencies, calls, sizeof(int64), compare_int64);
+    result->changes_per_s = changes / ((now - started) / 1e9);
+    result->p50_ns = calls ? latencies[(calls - 1) / 2] : 0;
+    result->p99_ns = calls ? latencies[(int64)((calls - 1) * 0.99)] : 0;
+    result->max_ns = calls ? latencies[calls - 1] : 0;
+    free(latencies);
+    return 0;
+}
+
+/**
+ * @brief Measures every backend with and without background rtnetlink load.
+ *
+ * Runs in a private network namespace (needs CAP_SYS_ADMIN and CAP_NET_ADMIN);
+ * the host's interfaces and routes are not touched.
+ *
+ * @param options Targets, duration and background load.
+ * @return int 0 on success, or a negative errno.
+ */
+int contention_bench(const ContentionOptions *options) {
+    int home = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    int netns = home < 0 ? -errno : netns_create();
+    if (netns < 0) {
+        if (home >= 0) close(home);
+        return netns;
+    }
+    int result = setns(netns, CLONE_NEWNET) < 0 ? -errno : 0;
+    int socket_fd = result == 0 ? netlink_open(0) : -1;
+    int ioctl_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    LinkRotation *rotations = calloc(options->interfaces, sizeof(*rotations));
+    NetlinkBatch *batch = malloc(sizeof(*batch));
+    ChurnThread *threads = calloc(3 * options->threads, sizeof(*threads));
+    if (result == 0 && socket_fd < 0) {
+        result = socket_fd;
+    } else if (result == 0 && (ioctl_fd < 0 || rotations == NULL || batch == NULL || threads == NULL)) {
+        result = ioctl_fd < 0 ? -errno : -ENOMEM;
+    }
+    if (result == 0) {
+        result = create_targets(socket_fd, rotations, options->interfaces, batch);
+    }
+    int32 device = 0;
+    if (result == 0) {
+        // Routes and addresses of the background load go on their own veth pair
+        result = netlink_add_veth(socket_fd, "mmq-churn", "mmq-churp", -1);
+        device = if_nametoindex("mmq-churn");
+        netlink_batch_init(batch, socket_fd, NULL, NULL);
+        netlink_batch_set_flags(batch, device, IFF_UP, IFF_UP, 0);
+        netlink_batch_set_flags(batch, if_nametoindex("mmq-churp"), IFF_UP, IFF_UP, 0);
+        netlink_batch_set_flags(batch, if_nametoindex("lo"), IFF_UP, IFF_UP, 0);
+        if (result == 0) {
+            result = netlink_batch_flush(batch);
+        }
+    }
+    for (int i = 0; result == 0 && i < options->interfaces; i++) {
+        struct ifreq request = { 0 };
+        memcpy(request.ifr_name, rotations[i].name, IFNAMSIZ);
+        result = ioctl(ioctl_fd, SIOCGIFFLAGS, &request) < 0 ? -errno : 0;
+        rotations[i].flags = (int32)(int16)request.ifr_flags;
+    }
+
+    atomic_bool stop;
+    int thread_count = 0;
+    for (int kind = CHURN_ROUTES; result == 0 && kind <= CHURN_LINKS; kind <<= 1) {
+        for (int i = 0; (options->churn & kind) && i < options->threads; i++) {
+            threads[thread_count++] = (ChurnThread){
+                .kind = kind, .index = i, .netns = netns, .device = device, .stop = &stop,
+            };
+        }
+    }
+
+    if (result == 0) {
+        printf("%d interfaces, %lu ms per run, background load:%s%s%s (%d thread%s each)\n",
+               options->interfaces, (unsigned long)(options->duration_ns / 1000000),
+               options->churn & CHURN_ROUTES ? " routes" : "", options->churn & CHURN_ADDRESSES ? " addresses" : "",
+               options->churn & CHURN_LINKS ? " links" : "", options->threads, options->threads == 1 ? "" : "s");
+        printf("%-14s %-6s %10s %9s %9s %9s %9s %12s\n", "backend", "load", "changes/s", "p50 us", "p99 us",
+               "max us", "slowdown", "background/s");
+        fflush(stdout);
+    }
+    static const char *const backend_names[CONTENTION_BACKENDS] = { "ioctl", "netlink", "netlink-batch" };
+    for (ContentionBackend backend = 0; result == 0 && backend < CONTENTION_BACKENDS; backend++) {
+        ContentionResult quiet, loaded;
+        netlink_batch_init(batch, socket_fd, NULL, NULL);
+        result = measure(backend, rotations, options->interfaces, ioctl_fd, batch, options->duration_ns, &quiet);
+        if (result < 0) {
+            break;
+        }
+
+        atomic_store(&stop, false);
+        int running = 0;
+        for (; running < thread_count; running++) {
+            atomic_store(&threads[running].operations, 0);
+            if (pthread_create(&threads[running].thread, NULL, churn_main, &threads[running]) != 0) {
+                break;
+            }
+        }
+        pause_ms(CHURN_RAMP_MS);
+        int64 background_started = monotonic_ns();
+        int64 operations_before = 0;
+        for (int i = 0; i < running; i++) {
+            operations_before += atomic_load(&threads[i].operations);
+        }
+        result = measure(backend, rotations, options->interfaces, ioctl_fd, batch, options->duration_ns, &loaded);
+        int64 operations = 0;
+        for (int i = 0; i < running; i++) {
+            operations += atomic_load(&threads[i].operations);
+        }
+        double background = (operations - operations_before) / ((monotonic_ns() - background_started) / 1e9);
+        atomic_store(&stop, true);
+        for (int i = 0; i < running; i++) {
+            pthread_join(threads[i].thread, NULL);
+        }
+        if (result < 0) {
+            break;
+        }
+
+        printf("%-14s %-6s %10.0f %9.1f %9.1f %9.1f %9s %12s\n", backend_names[backend], "quiet", quiet.changes_per_s,
+               quiet.p50_ns / 1e3, quiet.p99_ns / 1e3, quiet.max_ns / 1e3, "", "");
+        printf("%-14s %-6s %10.0f %9.1f %9.1f %9.1f %8.2fx %12.0f\n", backend_names[backend], "churn",
+               loaded.changes_per_s, loaded.p50_ns / 1e3, loaded.p99_ns / 1e3, loaded.max_ns / 1e3,
+               loaded.changes_per_s > 0 ? quiet.changes_per_s / loaded.changes_per_s : 0.0, background);
+        if (quiet.failures + loaded.failures) {
+            printf("%-14s (%lu changes refused by the kernel)\n", backend_names[backend],
+                   (unsigned long)(quiet.failures + loaded.failures));
+        }
+        fflush(stdout);
+    }
+
+    // Deleting the namespace deletes everything created in it
+    if (ioctl_fd >= 0) close(ioctl_fd);
+    if (socket_fd >= 0) close(socket_fd);
+    setns(home, CLONE_NEWNET);
+    close(home);
+    close(netns);
+    free(rotations);
+    free(batch);
+    free(threads);
+    return result;
+}
@@ -0,0 +1,56 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_CONTEND_H
+#define MACMASQ_CONTEND_H
+
+// Including required C Header files
+#include "macmasq.h"       // for the integer typedefs
+
+// Interfaces rotated when none is given on the command line
+#define CONTENTION_DEFAULT_INTERFACES 32
+// Most interfaces rotated
+#define CONTENTION_MAX_INTERFACES 4096
+// Length of every measurement, in milliseconds
+#define CONTENTION_DEFAULT_DURATION_MS 2000
+// Most background threads of one kind
+#define CONTENTION_MAX_THREADS 16
+
+/**
+* @brief Kinds of background rtnetlink load (a bitmask).
+*/
+typedef enum churn_kind {
+    CHURN_ROUTES = 1 << 0,               // Add and delete /32 routes
+    CHURN_ADDRESSES = 1 << 1,            // Add and delete IPv4 addresses
+    CHURN_LINKS = 1 << 2,                // Create and delete veth pairs
+    CHURN_ALL = CHURN_ROUTES | CHURN_ADDRESSES | CHURN_LINKS,
+} ChurnKind;
+
+/**
+* @brief Shape of an RTNL contention benchmark.
+*/
+typedef struct contention_options {
+    int interfaces;                      // veth pairs whose address is rotated
+    int64 duration_ns;                   // Length of every measurement
+    int32 churn;                         // ChurnKind bits of the background load
+    int threads;                         // Background threads per kind
+} ContentionOptions;
+
+int parse_churn_kinds(const char *text, int32 *churn);
+int contention_bench(const ContentionOptions *options);
+
+#endif // MACMASQ_CONTEND_H
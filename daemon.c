@@ -0,0 +1,1851 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The rotation daemon (--daemon).
+ *
+ * A single event loop owns every interface and its schedule. It listens to
+ * rtnetlink link events, a timerfd armed for the next due rotation, a
+ * signalfd, and an inotify watch on the policy file.
+ *
+ * Policy reloads are kept off that loop: a loader thread parses and
+ * compiles the new file, then publishes it through an atomic pointer and
+ * wakes the loop with an eventfd. The loop swaps the immutable compiled
+ * policy in with one pointer exchange, re-evaluates each interface against
+ * it, and reschedules only the interfaces whose effective rule changed. The
+ * old policy is freed after the swap, since the loop is its only reader.
+ *
+ * Each priority class of the policy has its own schedule. When rotations
+ * come due together, critical ones go first and bulk ones last, and a
+ * token bucket (--rate-limit, --rate-burst) caps the link changes sent per
+ * second. Bulk rotations never spend the last half of the burst, so a
+ * backlog of them drains at the steady rate and critical rotations that
+ * come due meanwhile still go out at once.
+ *
+ * With --opportunistic-window, a link that goes down by itself (carrier
+ * loss, an administrator, a migration) while its rotation is due within
+ * the window is rotated right away, at no outage of its own. The down and
+ * up the daemon causes itself while cycling a link are told apart by a
+ * state bit set when the cycle is sent.
+ *
+ * Those own downs and ups also feed a cost model: a moving average of the
+ * down window (own down event to the next running event) and of the
+ * end-to-end latency of every rotation, per driver. It lives in a side
+ * table, so each slot only holds a one-byte driver index; the downs being
+ * timed sit in a small fixed table of their own. A batch being sent anyway
+ * pulls forward cheap rotations due within the next second, while
+ * rotations expected to hold their link down for long go one at a time,
+ * each after the previous one's expected window.
+ *
+ * With a checkpoint (checkpoint.c), every change to an interface's schedule
+ * is also stored in a shared mapping. A restarted daemon looks every
+ * interface of its first dump up there. It keeps the deadline and the
+ * rotation history of each one that is still the same interface: the same
+ * ifindex, and the same permanent address or, without one, the address the
+ * previous run left. Only the interfaces that changed are scheduled anew.
+ *
+ * The kernel is reached through a backend (kernel.h) and every deadline is
+ * read from its clock, so the same scheduler also runs against the
+ * simulated kernel of sim.c, in virtual time, without the event loop.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for fprintf
+#include <stdlib.h>                // for malloc, realloc, free
+#include <string.h>                // for memset, strcmp, strerror
+#include <errno.h>                 // for error number definitions
+#include <unistd.h>                // for read, write, close
+#include <fcntl.h>                 // for fcntl
+#include <libgen.h>                // for dirname, basename
+#include <limits.h>                // for PATH_MAX
+#include <pthread.h>               // for the policy loader thread
+#include <signal.h>                // for sigprocmask
+#include <stdatomic.h>             // for the published policy pointer
+#include <sys/epoll.h>             // for epoll
+#include <sys/eventfd.h>           // for eventfd
+#include <sys/inotify.h>           // for inotify
+#include <sys/signalfd.h>          // for signalfd
+#include <sys/timerfd.h>           // for timerfd
+#include <net/if_arp.h>            // for ARPHRD_ETHER
+#include "kernel.h"                // for the kernel backend
+#include "policy.h"                // for policy files
+#include "metrics.h"               // for the metrics file
+#include "checkpoint.h"            // for warm restarts
+#include "daemon.h"                // for the daemon declared here
+
+// Most rotations applied in one netlink batch
+#define DAEMON_MAX_BATCH 1024
+// Delay before retrying a rotation that failed
+#define DAEMON_RETRY_NS (60UL * 1000000000UL)
+// Delay between two rolling members of the same master
+#define DAEMON_ROLLING_GAP_NS (5UL * 1000000000UL)
+// Expected down window below which a rotation is cheap enough to be sent early
+#define DAEMON_CHEAP_NS (1UL * 1000000UL)
+// Expected down window from which a rotation is expensive, and never overlaps another one
+#define DAEMON_EXPENSIVE_NS (5UL * 1000000UL)
+// How far ahead a batch pulls cheap rotations (rotation times are kept to the second anyway)
+#define DAEMON_PACK_NS 1000000000UL
+// Expected latency of a batch past which it pulls nothing more forward
+#define DAEMON_PACK_BUDGET_NS (10UL * 1000000UL)
+// Weight of the old average against one new sample in the cost model
+#define DAEMON_COST_WEIGHT 8
+// Drivers the cost model tells apart
+#define DAEMON_MAX_DRIVERS 32
+// Longest driver name kept (ETHTOOL_GDRVINFO reports 32 bytes)
+#define DAEMON_DRIVER_NAME 32
+// Down windows timed at once, a power of two (further ones go unmeasured)
+#define DAEMON_TIMING_SLOTS 4096
+
+// Bits of a link's state
+#define LINK_IN_USE 0x01                 // Slot holds an interface
+#define LINK_ETHER 0x02                  // ARPHRD_ETHER: the only type the daemon rotates
+#define LINK_CYCLING 0x04                // A down/set/up was sent: its down event is the daemon's own
+#define LINK_SEIZED 0x08                 // Brought forward because the link went down by itself
+#define LINK_TIMING 0x10                 // The daemon's own down was seen: the next up ends the down window
+// Rule of a link no rule of the running policy matches
+#define NO_RULE 0xFF
+// Driver of a link the full driver table has no entry for
+#define NO_DRIVER 0xFF
+
+/**
+* @brief Everything the daemon knows about its interfaces, one array per field, indexed by slot.
+*
+* Slots are dense and reused. Only what scheduling and rotating read is
+* kept, about 50 bytes per slot and under 64 per interface with the map
+* and the schedule heaps (a checkpoint maps 24 more): names, kinds and groups are reduced to a hash
+* that tells when an event calls for a new policy lookup, and reloads read
+* them from a fresh dump.
+*/
+typedef struct daemon_links {
+    int32 *ifindex;                      // Interface index
+    MacAddress *address;                 // Current address
+    MacAddress *original;                // Permanent address, or the first one seen if unknown
+    int64 *due_ns;                       // Next rotation (backend clock), meaningless when not scheduled
+    int32 *rotated_s;                    // Last successful rotation, in seconds since the daemon started plus one, 0 if none
+    int32 *flags;                        // IFF_* flags
+    int32 *master;                       // Ifindex of the master device, 0 if none
+    int32 *match_key;                    // Hash of the fields policy_lookup() reads
+    int *heap_index;                     // Position in the schedule heap, -1 if not scheduled; next free slot when free
+    int8 *priority;                      // Priority class of the heap the slot is scheduled in
+    int8 *rule;                          // Rule of the running policy, NO_RULE if none matches
+    int8 *state;                         // LINK_* bits
+    int8 *driver;                        // Entry of the driver table, NO_DRIVER if the table was full
+} DaemonLinks;
+
+// Bytes every slot takes in DaemonLinks (the heaps are counted by their own capacity)
+#define DAEMON_SLOT_BYTES (4 + 2 * sizeof(MacAddress) + 8 + 4 * 4 + sizeof(int) + 4)
+
+/**
+* @brief Cost model of one driver, shared by all its interfaces.
+*/
+typedef struct driver_cost {
+    char name[DAEMON_DRIVER_NAME];       // Driver (ETHTOOL_GDRVINFO), or the link kind if the backend cannot tell
+    int64 down_ns;                       // Moving average of the down window, 0 until measured
+    int64 total_ns;                      // Moving average of the end-to-end latency, 0 until measured
+} DriverCost;
+
+/**
+* @brief A down window being timed: from the daemon's own down to the link running again.
+*/
+typedef struct down_timing {
+    int slot;                            // Slot + 1, 0 for an empty entry
+    int64 since_ns;                      // When the down was reported (backend clock)
+} DownTiming;
+
+/**
+* @brief Counters exported as metrics.
+*/
+typedef struct daemon_stats {
+    int64 rotations;                     // Successful rotations
+    int64 rotation_failures;             // Rotations rejected by the kernel
+    int64 free_rotations;                // Successful rotations of links that were down anyway
+    int64 packed_rotations;              // Cheap rotations sent early in a batch going out anyway
+    int64 spread_rotations;              // Expensive rotations held back behind another one's down window
+    int64 resumed;                       // Interfaces whose schedule was taken over from the checkpoint
+    int64 batches;                       // Netlink batches sent
+    int64 link_events;                   // Link events received
+    int64 resyncs;                       // Full dumps after an event overrun
+    int64 reloads;                       // Policies swapped in
+    int64 reload_failures;               // Policy files that failed to load (updated by the loader)
+    int64 last_reload_parse_ns;          // Time the loader spent compiling the last policy
+    int64 last_reload_apply_ns;          // Time the event loop spent swapping and diffing it
+    int64 last_reload_rescheduled;       // Interfaces whose schedule the last reload changed
+    LatencyHistogram lateness;           // Rotation done minus rotation due
+    LatencyHistogram wait[PRIORITY_CLASSES];  // The same, by priority class
+    LatencyHistogram event_delay;        // Link event applied minus link event sent
+    int64 event_cpu_ns;                  // Real time spent reading and applying link events
+} DaemonStats;
+
+/**
+* @brief Slots of one priority class ordered by due time (binary min-heap).
+*/
+typedef struct schedule_heap {
+    int *slots;                          // The heap, grown with the class rather than with the slots
+    int size;                            // Entries in slots
+    int capacity;                        // Allocated entries of slots
+} ScheduleHeap;
+
+/**
+* @brief State of the running daemon.
+*/
+typedef struct rotation_daemon {
+    const DaemonOptions *options;        // Command-line configuration
+    char policy_directory[PATH_MAX];     // Directory watched with inotify
+    char policy_name[NAME_MAX + 1];      // Policy file name inside that directory
+
+    Policy *policy;                      // Running policy, read by the event loop only
+    _Atomic(Policy *) staged;            // Compiled by the loader, waiting to be swapped in
+    _Atomic(int64) staged_parse_ns;      // Compile time of the staged policy
+    atomic_bool stopping;                // Asks the loader thread to exit
+    pthread_t loader;                    // Policy loader thread
+
+    DaemonLinks links;                   // Interfaces, indexed by slot
+    int link_capacity;                   // Allocated slots
+    int link_count;                      // Slots in use
+    int free_slot;                       // First released slot, -1 if none
+    int64 epoch_ns;                      // Start of the daemon (backend clock), origin of rotated_s
+    int *slot_of;                        // Ifindex hash map: slot + 1, 0 for empty
+    int32 map_mask;                      // Map size minus one
+    ScheduleHeap heaps[PRIORITY_CLASSES];  // Scheduled slots of each priority class
+    bool out_of_memory;                  // A schedule heap could not grow: the daemon stops
+    int64 token_ns;                      // Credit one link change costs (1 s / rate limit), 0 without a limit
+    int64 credit_ns;                     // Credit of the rate limit at credit_at_ns
+    int64 credit_at_ns;                  // When credit_ns was brought up to date
+    int64 credit_max_ns;                 // Credit of a full burst
+    DriverCost drivers[DAEMON_MAX_DRIVERS];  // Cost model of every driver seen
+    int driver_count;                    // Entries in drivers
+    int64 spread_until_ns;               // Expected end of the last expensive rotation's down window
+    DownTiming timings[DAEMON_TIMING_SLOTS];  // Slots with LINK_TIMING (open addressing, linear probing)
+    int timing_count;                    // Entries in timings
+
+    Kernel *kernel;                      // Dumps, rotations, link events and the clock
+    int64 random;                        // State of the schedule's random generator
+    int epoll_fd;                        // Event loop
+    int timer_fd;                        // Fires when the next rotation is due
+    int signal_fd;                       // SIGINT, SIGTERM, SIGHUP
+    int inotify_fd;                      // Watches the policy directory
+    int reload_request_fd;               // Event loop -> loader: please reload
+    int reload_ready_fd;                 // Loader -> event loop: a policy is staged
+
+    AuditLog *audit;                     // Audit log, NULL if disabled
+    Checkpoint *checkpoint;              // Schedule kept for a warm restart, NULL if disabled
+    int64 netns;                         // Namespace of the interfaces, tags registry and journal entries
+    LinkRotation *rotations;             // Rotations of the current batch
+    int *rotation_slots;                 // Slot of each entry of rotations
+    DaemonStats stats;                   // Metrics
+    MetricsPage page;                    // Reused metrics buffer
+    int64 next_metrics_ns;               // When to publish metrics next
+} RotationDaemon;
+
+/**
+ * @brief Returns a uniformly distributed value in [0, bound) (splitmix64, seeded per daemon).
+ */
+static int64 random_below(RotationDaemon *daemon, int64 bound) {
+    int64 value = daemon->random += 0x9E3779B97F4A7C15UL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9UL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBUL;
+    value ^= value >> 31;
+    return bound ? value % bound : 0;
+}
+
+/*
+ * Ifindex -> slot map (open addressing, linear probing, backward-shift deletion)
+ */
+
+/**
+ * @brief Returns the home position of an ifindex in the map.
+ */
+static int32 map_home(const RotationDaemon *daemon, int32 ifindex) {
+    return (ifindex * 2654435761u) & daemon->map_mask;
+}
+
+/**
+ * @brief Finds the slot of an interface.
+ *
+ * @return int The slot, or -1 if the interface is unknown.
+ */
+static int find_slot(const RotationDaemon *daemon, int32 ifindex) {
+    for (int32 position = map_home(daemon, ifindex); daemon->slot_of[position] != 0;
+         position = (position + 1) & daemon->map_mask) {
+        int slot = daemon->slot_of[position] - 1;
+        if (daemon->links.ifindex[slot] == ifindex) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Inserts an ifindex -> slot pair (the ifindex must not be present).
+ */
+static void map_insert(RotationDaemon *daemon, int32 ifindex, int slot) {
+    int32 position = map_home(daemon, ifindex);
+    while (daemon->slot_of[position] != 0) {
+        position = (position + 1) & daemon->map_mask;
+    }
+    daemon->slot_of[position] = slot + 1;
+}
+
+/**
+ * @brief Removes an ifindex from the map, shifting later entries back into the gap.
+ */
+static void map_remove(RotationDaemon *daemon, int32 ifindex) {
+    int32 position = map_home(daemon, ifindex);
+    while (daemon->slot_of[position] != 0 && daemon->links.ifindex[daemon->slot_of[position] - 1] != ifindex) {
+        position = (position + 1) & daemon->map_mask;
+    }
+    if (daemon->slot_of[position] == 0) {
+        return;
+    }
+    int32 gap = position;
+    for (int32 next = (gap + 1) & daemon->map_mask; daemon->slot_of[next] != 0;
+         next = (next + 1) & daemon->map_mask) {
+        int32 home = map_home(daemon, daemon->links.ifindex[daemon->slot_of[next] - 1]);
+        // Move the entry back if its home is not inside (gap, next]
+        if (((next - home) & daemon->map_mask) >= ((next - gap) & daemon->map_mask)) {
+            daemon->slot_of[gap] = daemon->slot_of[next];
+            gap = next;
+        }
+    }
+    daemon->slot_of[gap] = 0;
+}
+
+/**
+ * @brief Doubles the map and re-inserts every interface.
+ *
+ * @return bool false if memory ran out.
+ */
+static bool map_grow(RotationDaemon *daemon) {
+    int32 size = (daemon->map_mask + 1) * 2;
+    int *slot_of = calloc(size, sizeof(int));
+    if (slot_of == NULL) {
+        return false;
+    }
+    free(daemon->slot_of);
+    daemon->slot_of = slot_of;
+    daemon->map_mask = size - 1;
+    for (int slot = 0; slot < daemon->link_capacity; slot++) {
+        if (daemon->links.state[slot] & LINK_IN_USE) {
+            map_insert(daemon, daemon->links.ifindex[slot], slot);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Stores the state of a slot in the checkpoint, if there is one.
+ */
+static void save_link(RotationDaemon *daemon, int slot) {
+    if (daemon->checkpoint == NULL) {
+        return;
+    }
+    const DaemonLinks *links = &daemon->links;
+    CheckpointRecord *record = checkpoint_slot(daemon->checkpoint, slot);
+    if (!(links->state[slot] & LINK_IN_USE)) {
+        record->ifindex = 0;
+        return;
+    }
+    record->ifindex = links->ifindex[slot];
+    record->rotated_s = links->rotated_s[slot];
+    // Rounded up: a resumed deadline may come late by under a second, never early
+    record->due_s = links->heap_index[slot] < 0 ? 0
+                  : (int32)((links->due_ns[slot] - daemon->epoch_ns + 999999999UL) / 1000000000UL) + 1;
+    record->address = links->address[slot];
+    record->original = links->original[slot];
+}
+
+/*
+ * Schedule (one binary min-heap of slots keyed by due time per priority class)
+ */
+
+/**
+ * @brief Stores a slot at a heap position and records the position in the slot.
+ */
+static void heap_place(RotationDaemon *daemon, ScheduleHeap *heap, int position, int slot) {
+    heap->slots[position] = slot;
+    daemon->links.heap_index[slot] = position;
+}
+
+/**
+ * @brief Restores the heap order around one position.
+ */
+static void heap_fix(RotationDaemon *daemon, ScheduleHeap *heap, int position) {
+    const int64 *due_ns = daemon->links.due_ns;
+    int slot = heap->slots[position];
+    int64 due = due_ns[slot];
+    // Move up while the parent is due later
+    while (position > 0) {
+        int parent = (position - 1) / 2;
+        if (due_ns[heap->slots[parent]] <= due) {
+            break;
+        }
+        heap_place(daemon, heap, position, heap->slots[parent]);
+        position = parent;
+    }
+    // Move down while a child is due earlier
+    for (;;) {
+        int child = position * 2 + 1;
+        if (child >= heap->size) {
+            break;
+        }
+        if (child + 1 < heap->size && due_ns[heap->slots[child + 1]] < due_ns[heap->slots[child]]) {
+            child++;
+        }
+        if (due_ns[heap->slots[child]] >= due) {
+            break;
+        }
+        heap_place(daemon, heap, position, heap->slots[child]);
+        position = child;
+    }
+    heap_place(daemon, heap, position, slot);
+}
+
+/**
+ * @brief Returns when the first rotation of a class is due, or ~0 if none is.
+ */
+static int64 class_due(const RotationDaemon *daemon, int priority) {
+    const ScheduleHeap *heap = &daemon->heaps[priority];
+    return heap->size > 0 ? daemon->links.due_ns[heap->slots[0]] : ~(int64)0;
+}
+
+/**
+ * @brief Returns when the first scheduled rotation is due, or ~0 if none is.
+ */
+static int64 next_due(const RotationDaemon *daemon) {
+    int64 next = ~(int64)0;
+    for (int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        int64 due = class_due(daemon, priority);
+        next = due < next ? due : next;
+    }
+    return next;
+}
+
+/**
+ * @brief Returns the number of scheduled interfaces, all classes together.
+ */
+static int scheduled_count(const RotationDaemon *daemon) {
+    int count = 0;
+    for (int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        count += daemon->heaps[priority].size;
+    }
+    return count;
+}
+
+/**
+ * @brief Counts the entries of a heap that are due, from one position down.
+ *
+ * Children are never due before their parent, so only due entries are visited.
+ */
+static int64 due_below(const RotationDaemon *daemon, const ScheduleHeap *heap, int position, int64 now) {
+    if (position >= heap->size || daemon->links.due_ns[heap->slots[position]] > now) {
+        return 0;
+    }
+    return 1 + due_below(daemon, heap, position * 2 + 1, now) + due_below(daemon, heap, position * 2 + 2, now);
+}
+
+/**
+ * @brief Removes an interface from the schedule.
+ */
+static void unschedule(RotationDaemon *daemon, int slot) {
+    int position = daemon->links.heap_index[slot];
+    if (position < 0) {
+        return;
+    }
+    ScheduleHeap *heap = &daemon->heaps[daemon->links.priority[slot]];
+    daemon->links.heap_index[slot] = -1;
+    int last = heap->slots[--heap->size];
+    if (position < heap->size) {
+        heap_place(daemon, heap, position, last);
+        heap_fix(daemon, heap, position);
+    }
+    save_link(daemon, slot);
+}
+
+/**
+ * @brief Schedules (or reschedules) an interface in the heap of its priority class.
+ *
+ * A heap grows by doubling as its class fills, so the classes together
+ * hold about one entry per scheduled slot rather than one each. If it
+ * cannot grow, the interface stays unscheduled and out_of_memory is set.
+ */
+static void schedule(RotationDaemon *daemon, int slot, int64 due_ns, RotationPriority priority) {
+    DaemonLinks *links = &daemon->links;
+    if (links->heap_index[slot] >= 0 && links->priority[slot] != priority) {
+        unschedule(daemon, slot);                          // The rule moved it to another class
+    }
+    ScheduleHeap *heap = &daemon->heaps[priority];
+    if (links->heap_index[slot] < 0 && heap->size == heap->capacity) {
+        int capacity = heap->capacity ? heap->capacity * 2 : 256;
+        int *slots = realloc(heap->slots, capacity * sizeof(int));
+        if (slots == NULL) {
+            daemon->out_of_memory = true;
+            return;
+        }
+        heap->slots = slots;
+        heap->capacity = capacity;
+    }
+    links->due_ns[slot] = due_ns;
+    if (links->heap_index[slot] < 0) {
+        links->priority[slot] = (int8)priority;
+        links->heap_index[slot] = heap->size++;
+        heap->slots[links->heap_index[slot]] = slot;
+    }
+    heap_fix(daemon, heap, links->heap_index[slot]);
+    save_link(daemon, slot);
+}
+
+/*
+ * Rate limit (token bucket, in nanoseconds of credit)
+ */
+
+/**
+ * @brief Returns the credit a class needs to send one more change.
+ */
+static int64 credit_needed(const RotationDaemon *daemon, int priority) {
+    if (priority != PRIORITY_BULK) {
+        return daemon->token_ns;
+    }
+    int64 reserve = daemon->credit_max_ns / daemon->token_ns / 2 * daemon->token_ns;
+    return reserve + daemon->token_ns;
+}
+
+/**
+ * @brief Brings the credit of the rate limit up to a point in time.
+ */
+static void refill_credit(RotationDaemon *daemon, int64 now) {
+    if (daemon->token_ns == 0 || now <= daemon->credit_at_ns) {
+        return;
+    }
+    daemon->credit_ns += now - daemon->credit_at_ns;
+    if (daemon->credit_ns > daemon->credit_max_ns) {
+        daemon->credit_ns = daemon->credit_max_ns;
+    }
+    daemon->credit_at_ns = now;
+}
+
+/**
+ * @brief Takes the credit of one change for a class, if the rate limit allows it.
+ */
+static bool take_token(RotationDaemon *daemon, int priority) {
+    if (daemon->token_ns == 0) {
+        return true;
+    }
+    if (daemon->credit_ns < credit_needed(daemon, priority)) {
+        return false;
+    }
+    daemon->credit_ns -= daemon->token_ns;
+    return true;
+}
+
+/**
+ * @brief Returns when the daemon next has a rotation to send, or ~0 if none is scheduled.
+ *
+ * That is the first due time, or later if the rate limit has no credit
+ * left for the class that is due.
+ */
+static int64 next_rotation(const RotationDaemon *daemon) {
+    if (daemon->token_ns == 0) {
+        return next_due(daemon);
+    }
+    int64 next = ~(int64)0;
+    for (int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        int64 due = class_due(daemon, priority);
+        int64 needed = credit_needed(daemon, priority);
+        if (due != ~(int64)0 && daemon->credit_ns < needed) {
+            int64 funded = daemon->credit_at_ns + needed - daemon->credit_ns;
+            due = funded > due ? funded : due;
+        }
+        next = due < next ? due : next;
+    }
+    return next;
+}
+
+/**
+ * @brief Tells whether IFF_* flags describe a link that passes traffic.
+ */
+static bool link_running(int32 flags) {
+    return (flags & IFF_UP) && (flags & IFF_RUNNING);
+}
+
+/*
+ * Cost model (moving averages of the down window and end-to-end latency, per driver)
+ */
+
+/**
+ * @brief Folds one sample into a moving average (the first sample starts it).
+ */
+static int64 moving_average(int64 average, int64 sample) {
+    sample += sample == 0;                                 // 0 means no sample yet
+    if (average == 0) {
+        return sample;
+    }
+    return (int64)((long)average + ((long)sample - (long)average) / DAEMON_COST_WEIGHT);
+}
+
+/**
+ * @brief Finds the driver table entry of a new interface, adding one for a new driver.
+ *
+ * @return int8 The entry, or NO_DRIVER if the table is full.
+ */
+static int8 driver_of(RotationDaemon *daemon, const LinkInfo *info) {
+    char name[DAEMON_DRIVER_NAME];
+    if (kernel_driver(daemon->kernel, info, name, sizeof(name)) < 0 || name[0] == '\0') {
+        snprintf(name, sizeof(name), "%s", policy_kind_name(info));
+    }
+    for (int driver = 0; driver < daemon->driver_count; driver++) {
+        if (strcmp(daemon->drivers[driver].name, name) == 0) {
+            return (int8)driver;
+        }
+    }
+    if (daemon->driver_count == DAEMON_MAX_DRIVERS) {
+        return NO_DRIVER;
+    }
+    DriverCost *cost = &daemon->drivers[daemon->driver_count];
+    memset(cost, 0, sizeof(*cost));
+    memcpy(cost->name, name, sizeof(name));
+    return (int8)daemon->driver_count++;
+}
+
+/**
+ * @brief Returns the cost model of an interface's driver, or NULL.
+ */
+static DriverCost *driver_cost(RotationDaemon *daemon, int slot) {
+    int8 driver = daemon->links.driver[slot];
+    return driver != NO_DRIVER ? &daemon->drivers[driver] : NULL;
+}
+
+/**
+ * @brief Records how long the daemon's own down/set/up kept a link down.
+ */
+static void learn_down_window(RotationDaemon *daemon, int slot, int64 window_ns) {
+    DriverCost *cost = driver_cost(daemon, slot);
+    if (cost != NULL) {
+        cost->down_ns = moving_average(cost->down_ns, window_ns);
+    }
+}
+
+/**
+ * @brief Records the end-to-end latency of one rotation.
+ */
+static void learn_latency(RotationDaemon *daemon, int slot, int64 latency_ns) {
+    DriverCost *cost = driver_cost(daemon, slot);
+    if (cost != NULL) {
+        cost->total_ns = moving_average(cost->total_ns, latency_ns);
+    }
+}
+
+/**
+ * @brief Returns how long a rotation is expected to keep its link down.
+ *
+ * That is its driver's average. A live change, or a link that is not
+ * running, has no down window. With no sample yet, DAEMON_CHEAP_NS:
+ * neither pulled forward nor spread.
+ */
+static int64 expected_outage(RotationDaemon *daemon, int slot, const PolicyRule *rule) {
+    if (rule->strategy == STRATEGY_LIVE || !link_running(daemon->links.flags[slot])) {
+        return 0;
+    }
+    DriverCost *cost = driver_cost(daemon, slot);
+    return cost != NULL && cost->down_ns != 0 ? cost->down_ns : DAEMON_CHEAP_NS;
+}
+
+/**
+ * @brief Returns the expected end-to-end latency of a rotation, DAEMON_CHEAP_NS if unknown.
+ */
+static int64 expected_latency(RotationDaemon *daemon, int slot) {
+    DriverCost *cost = driver_cost(daemon, slot);
+    return cost != NULL && cost->total_ns != 0 ? cost->total_ns : DAEMON_CHEAP_NS;
+}
+
+/**
+ * @brief Returns the home position of a slot in the table of timed downs.
+ */
+static int timing_home(int slot) {
+    return (int)((slot * 2654435761u) & (DAEMON_TIMING_SLOTS - 1));
+}
+
+/**
+ * @brief Starts timing a link's down window.
+ *
+ * Does nothing when the table is three quarters full: that down goes unmeasured.
+ */
+static void start_timing(RotationDaemon *daemon, int slot, int64 since_ns) {
+    if ((daemon->timing_count + 1) * 4 > DAEMON_TIMING_SLOTS * 3) {
+        return;
+    }
+    int position = timing_home(slot);
+    while (daemon->timings[position].slot != 0) {
+        position = (position + 1) & (DAEMON_TIMING_SLOTS - 1);
+    }
+    daemon->timings[position] = (DownTiming){ .slot = slot + 1, .since_ns = since_ns };
+    daemon->timing_count++;
+    daemon->links.state[slot] |= LINK_TIMING;
+}
+
+/**
+ * @brief Stops timing a link's down window, shifting later entries back into the gap.
+ *
+ * @return int64 When the down was reported, or 0 if it was not being timed.
+ */
+static int64 stop_timing(RotationDaemon *daemon, int slot) {
+    if (!(daemon->links.state[slot] & LINK_TIMING)) {
+        return 0;
+    }
+    daemon->links.state[slot] &= ~LINK_TIMING;
+    int gap = timing_home(slot);
+    while (daemon->timings[gap].slot != slot + 1) {
+        gap = (gap + 1) & (DAEMON_TIMING_SLOTS - 1);
+    }
+    int64 since_ns = daemon->timings[gap].since_ns;
+    for (int next = (gap + 1) & (DAEMON_TIMING_SLOTS - 1); daemon->timings[next].slot != 0;
+         next = (next + 1) & (DAEMON_TIMING_SLOTS - 1)) {
+        int home = timing_home(daemon->timings[next].slot - 1);
+        // Move the entry back if its home is not inside (gap, next]
+        if (((next - home) & (DAEMON_TIMING_SLOTS - 1)) >= ((next - gap) & (DAEMON_TIMING_SLOTS - 1))) {
+            daemon->timings[gap] = daemon->timings[next];
+            gap = next;
+        }
+    }
+    daemon->timings[gap].slot = 0;
+    daemon->timing_count--;
+    return since_ns;
+}
+
+/*
+ * Interfaces
+ */
+
+/**
+ * @brief Returns a rule of a policy by index, or NULL for NO_RULE.
+ */
+static const PolicyRule *policy_rule(const Policy *policy, int8 rule) {
+    return rule != NO_RULE ? &policy->rules[rule] : NULL;
+}
+
+/**
+ * @brief Returns the rule of the running policy for an interface, or NULL.
+ */
+static const PolicyRule *rule_of(const RotationDaemon *daemon, int slot) {
+    return policy_rule(daemon->policy, daemon->links.rule[slot]);
+}
+
+/**
+ * @brief Looks an interface up in a policy.
+ */
+static int8 lookup_rule(const Policy *policy, const LinkInfo *info) {
+    int rule = policy_lookup(policy, info);
+    return rule >= 0 ? (int8)rule : NO_RULE;
+}
+
+/**
+ * @brief Hashes the fields of an interface that decide its rule (FNV-1a).
+ */
+static int32 match_key(const LinkInfo *info) {
+    int32 hash = 2166136261u;
+    const char *fields[] = { info->name, info->kind, info->slave_kind };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        for (const char *c = fields[i]; *c; c++) {
+            hash = (hash ^ (int8)*c) * 16777619u;
+        }
+        hash = (hash ^ 0xFF) * 16777619u;                  // Keeps "ab" + "c" apart from "a" + "bc"
+    }
+    return (hash ^ info->group) * 16777619u;
+}
+
+/**
+ * @brief Tells whether the daemon should rotate an interface under a rule.
+ */
+static bool wants_rotation(const RotationDaemon *daemon, int slot, const PolicyRule *rule) {
+    return rule != NULL && rule->action == POLICY_ROTATE && (daemon->links.state[slot] & LINK_ETHER);
+}
+
+/**
+ * @brief Schedules an interface according to its rule, or unschedules it.
+ *
+ * An interface rotated before keeps its cadence (last rotation + interval,
+ * to the second); one never rotated is placed at a random point of its
+ * first interval so that a daemon start does not rotate everything at once.
+ */
+static void schedule_by_rule(RotationDaemon *daemon, int slot, int64 now) {
+    const PolicyRule *rule = rule_of(daemon, slot);
+    if (!wants_rotation(daemon, slot, rule)) {
+        unschedule(daemon, slot);
+        return;
+    }
+    int32 rotated_s = daemon->links.rotated_s[slot];
+    int64 due = rotated_s ? daemon->epoch_ns + (rotated_s - 1) * 1000000000UL + rule->interval_ns
+                          : now + random_below(daemon, rule->interval_ns);
+    schedule(daemon, slot, due < now ? now : due, rule->priority);
+}
+
+/**
+ * @brief Grows every per-slot array to a new capacity.
+ *
+ * @return bool false if memory ran out (the arrays that did grow are kept).
+ */
+static bool grow_links(RotationDaemon *daemon, int capacity) {
+    DaemonLinks *links = &daemon->links;
+    struct { void **array; size_t size; } arrays[] = {
+        { (void **)&links->ifindex, sizeof(int32) },
+        { (void **)&links->address, sizeof(MacAddress) },
+        { (void **)&links->original, sizeof(MacAddress) },
+        { (void **)&links->due_ns, sizeof(int64) },
+        { (void **)&links->rotated_s, sizeof(int32) },
+        { (void **)&links->flags, sizeof(int32) },
+        { (void **)&links->master, sizeof(int32) },
+        { (void **)&links->match_key, sizeof(int32) },
+        { (void **)&links->heap_index, sizeof(int) },
+        { (void **)&links->priority, sizeof(int8) },
+        { (void **)&links->rule, sizeof(int8) },
+        { (void **)&links->state, sizeof(int8) },
+        { (void **)&links->driver, sizeof(int8) },
+    };
+    for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        void *grown = realloc(*arrays[i].array, capacity * arrays[i].size);
+        if (grown == NULL) {
+            return false;
+        }
+        *arrays[i].array = grown;
+    }
+    memset(links->state + daemon->link_capacity, 0, capacity - daemon->link_capacity);
+    daemon->link_capacity = capacity;
+    int result = daemon->checkpoint ? checkpoint_reserve(daemon->checkpoint, capacity) : 0;
+    if (result < 0) {
+        // The daemon runs on without it; the next start is a cold one
+        fprintf(stderr, "macmasq: checkpoint: %s, the schedule is no longer kept\n", strerror(-result));
+        checkpoint_close(daemon->checkpoint);
+        daemon->checkpoint = NULL;
+    }
+    return true;
+}
+
+/**
+ * @brief Copies the fields of a dump or event the daemon keeps.
+ */
+static void store_link(RotationDaemon *daemon, int slot, const LinkInfo *info) {
+    DaemonLinks *links = &daemon->links;
+    if (info->has_address) {
+        links->address[slot] = info->address;
+    }
+    if (info->has_perm_address) {
+        links->original[slot] = info->perm_address;
+    }
+    links->flags[slot] = info->flags;
+    links->master[slot] = info->master;
+    links->state[slot] = (links->state[slot] & ~LINK_ETHER) | LINK_IN_USE | (info->type == ARPHRD_ETHER ? LINK_ETHER : 0);
+    save_link(daemon, slot);
+}
+
+/**
+ * @brief Brings a rotation forward when its link just went down by itself.
+ *
+ * Only rotations due within the opportunistic window are brought forward.
+ */
+static void seize_link_down(RotationDaemon *daemon, int slot, int64 now) {
+    DaemonLinks *links = &daemon->links;
+    if (links->heap_index[slot] < 0 || (long)(links->due_ns[slot] - now) > (long)daemon->options->opportunistic_ns) {
+        return;
+    }
+    links->state[slot] |= LINK_SEIZED;
+    schedule(daemon, slot, now < links->due_ns[slot] ? now : links->due_ns[slot], links->priority[slot]);
+}
+
+/**
+ * @brief Follows a link going down or coming back.
+ *
+ * The down of the daemon's own down/set/up starts a down window, which
+ * the link running again ends; any other down may bring its rotation
+ * forward.
+ */
+static void link_changed(RotationDaemon *daemon, int slot, bool was_running, int64 now, int64 sent_ns) {
+    DaemonLinks *links = &daemon->links;
+    bool running = link_running(links->flags[slot]);
+    if (was_running && !running) {
+        stop_timing(daemon, slot);
+        if (links->state[slot] & LINK_CYCLING) {
+            links->state[slot] &= ~LINK_CYCLING;
+            start_timing(daemon, slot, sent_ns);
+            return;
+        }
+        if (daemon->options->opportunistic_ns > 0) {
+            seize_link_down(daemon, slot, now);
+        }
+    } else if (!was_running && running && (links->state[slot] & LINK_TIMING)) {
+        int64 since_ns = stop_timing(daemon, slot);
+        learn_down_window(daemon, slot, sent_ns > since_ns ? sent_ns - since_ns : 0);
+    }
+}
+
+/**
+ * @brief Takes a new interface's schedule over from the previous run's checkpoint.
+ *
+ * The record must be of the same interface: the same ifindex, and the same
+ * permanent address or, for interfaces without one, the address the
+ * previous run left it with. A deadline further away than the interval of
+ * the interface's rule (the policy changed meanwhile) is not kept.
+ *
+ * @return bool true if the interface was taken over (and scheduled).
+ */
+static bool resume_link(RotationDaemon *daemon, int slot, const LinkInfo *info, int64 now) {
+    const CheckpointRecord *record = daemon->checkpoint ? checkpoint_previous(daemon->checkpoint, info->ifindex) : NULL;
+    if (record == NULL) {
+        return false;
+    }
+    bool same = info->has_perm_address ? mac_equal(info->perm_address, record->original)
+                                       : info->has_address && mac_equal(info->address, record->address);
+    if (!same) {
+        return false;
+    }
+    DaemonLinks *links = &daemon->links;
+    links->original[slot] = record->original;
+    links->rotated_s[slot] = record->rotated_s;
+    daemon->stats.resumed++;
+    const PolicyRule *rule = rule_of(daemon, slot);
+    int64 due = record->due_s ? daemon->epoch_ns + (record->due_s - 1) * 1000000000UL : 0;
+    if (due != 0 && wants_rotation(daemon, slot, rule) && due <= now + rule->interval_ns) {
+        schedule(daemon, slot, due < now ? now : due, rule->priority);
+    } else {
+        schedule_by_rule(daemon, slot, now);
+    }
+    return true;
+}
+
+/**
+ * @brief Adds a new interface or refreshes a known one.
+ *
+ * @param sent_ns When the kernel reported the link (the time of a dump for dumped links).
+ * @return bool false if memory ran out.
+ */
+static bool upsert_link(RotationDaemon *daemon, const LinkInfo *info, int64 now, int64 sent_ns) {
+    DaemonLinks *links = &daemon->links;
+    int slot = find_slot(daemon, info->ifindex);
+    if (slot >= 0) {
+        bool was_running = link_running(links->flags[slot]);
+        store_link(daemon, slot, info);
+        link_changed(daemon, slot, was_running, now, sent_ns);
+        int32 key = match_key(info);
+        if (key != links->match_key[slot]) {
+            // Renamed, or a predicate changed: evaluate the rule again
+            links->match_key[slot] = key;
+            int8 rule = lookup_rule(daemon->policy, info);
+            bool changed = !policy_rule_equivalent(rule_of(daemon, slot), policy_rule(daemon->policy, rule));
+            links->rule[slot] = rule;
+            if (changed) {
+                schedule_by_rule(daemon, slot, now);
+            }
+        }
+        return true;
+    }
+
+    // New interface: find a slot, growing the tables if needed (map load at most 3/4)
+    if ((int32)(daemon->link_count + 1) * 4 > (daemon->map_mask + 1) * 3 && !map_grow(daemon)) {
+        return false;
+    }
+    if (daemon->free_slot >= 0) {
+        slot = daemon->free_slot;
+        daemon->free_slot = links->heap_index[slot];
+    } else {
+        if (daemon->link_capacity == daemon->link_count &&
+            !grow_links(daemon, daemon->link_capacity ? daemon->link_capacity * 2 : 256)) {
+            return false;
+        }
+        slot = daemon->link_count;
+    }
+
+    links->ifindex[slot] = info->ifindex;
+    links->address[slot] = info->address;
+    links->original[slot] = info->address;                // Until the permanent address is known
+    links->rotated_s[slot] = 0;
+    links->heap_index[slot] = -1;
+    links->match_key[slot] = match_key(info);
+    links->rule[slot] = lookup_rule(daemon->policy, info);
+    links->driver[slot] = driver_of(daemon, info);
+    store_link(daemon, slot, info);
+    daemon->link_count++;
+    map_insert(daemon, info->ifindex, slot);
+    if (!resume_link(daemon, slot, info, now)) {
+        schedule_by_rule(daemon, slot, now);
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the memory held by the per-interface tables, the schedule and the ifindex map.
+ */
+static int64 state_bytes(const RotationDaemon *daemon) {
+    int64 bytes = (int64)daemon->link_capacity * DAEMON_SLOT_BYTES + (int64)(daemon->map_mask + 1) * sizeof(int);
+    for (int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        bytes += (int64)daemon->heaps[priority].capacity * sizeof(int);
+    }
+    if (daemon->checkpoint != NULL) {
+        bytes += (int64)daemon->link_capacity * sizeof(CheckpointRecord);   // Written often, so resident
+    }
+    return bytes;
+}
+
+/**
+ * @brief Forgets an interface that disappeared.
+ */
+static void remove_link(RotationDaemon *daemon, int32 ifindex) {
+    int slot = find_slot(daemon, ifindex);
+    if (slot < 0) {
+        return;
+    }
+    unschedule(daemon, slot);
+    stop_timing(daemon, slot);
+    map_remove(daemon, ifindex);
+    daemon->links.state[slot] = 0;
+    save_link(daemon, slot);
+    daemon->links.heap_index[slot] = daemon->free_slot;   // Free slots are chained through heap_index
+    daemon->free_slot = slot;
+    daemon->link_count--;
+}
+
+/**
+* @brief Links seen during a resynchronisation dump.
+*/
+typedef struct resync_context {
+    RotationDaemon *daemon;              // The daemon
+    int64 now;                           // Time of the dump
+    int8 *seen;                          // One flag per slot
+    int seen_capacity;                   // Slots covered by seen
+} ResyncContext;
+
+/**
+ * @brief Records one dumped interface.
+ */
+static void resync_visit(const LinkInfo *info, void *context) {
+    ResyncContext *resync = context;
+    upsert_link(resync->daemon, info, resync->now, resync->now);
+    int slot = find_slot(resync->daemon, info->ifindex);
+    if (slot >= 0 && slot < resync->seen_capacity) {
+        resync->seen[slot] = 1;
+    }
+}
+
+/**
+ * @brief Reconciles the daemon with a full dump of the namespace.
+ *
+ * Used at start-up and whenever link events were lost (ENOBUFS).
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+static int resync_links(RotationDaemon *daemon) {
+    // Interfaces added during the dump land in new slots, which are never released below
+    ResyncContext resync = { .daemon = daemon, .now = kernel_now(daemon->kernel), .seen_capacity = daemon->link_capacity };
+    resync.seen = calloc(resync.seen_capacity + 1, 1);
+    if (resync.seen == NULL) {
+        return -ENOMEM;
+    }
+    int result = kernel_dump_links(daemon->kernel, resync_visit, &resync);
+    if (result == 0) {
+        for (int slot = 0; slot < resync.seen_capacity; slot++) {
+            if ((daemon->links.state[slot] & LINK_IN_USE) && !resync.seen[slot]) {
+                remove_link(daemon, daemon->links.ifindex[slot]);
+            }
+        }
+    }
+    free(resync.seen);
+    return result == 0 && daemon->out_of_memory ? -ENOMEM : result;
+}
+
+/**
+* @brief Progress of one drain of the link events.
+*/
+typedef struct event_context {
+    RotationDaemon *daemon;              // The daemon
+    bool out_of_memory;                  // An interface could not be added
+} EventContext;
+
+/**
+ * @brief Applies one link event.
+ */
+static void apply_link_event(const LinkEvent *event, void *context) {
+    EventContext *events = context;
+    RotationDaemon *daemon = events->daemon;
+    daemon->stats.link_events++;
+    int64 now = kernel_now(daemon->kernel);
+    histogram_add(&daemon->stats.event_delay, now > event->time_ns ? now - event->time_ns : 0);
+    if (event->deleted) {
+        remove_link(daemon, event->link.ifindex);
+    } else if (!upsert_link(daemon, &event->link, now, event->time_ns)) {
+        events->out_of_memory = true;
+    }
+}
+
+/**
+ * @brief Drains the pending link events.
+ *
+ * @return int 0 on success, or a negative errno on a backend failure.
+ */
+static int handle_link_events(RotationDaemon *daemon) {
+    EventContext events = { .daemon = daemon };
+    for (;;) {
+        int64 started = monotonic_ns();
+        int result = kernel_read_events(daemon->kernel, apply_link_event, &events);
+        daemon->stats.event_cpu_ns += monotonic_ns() - started;
+        if (events.out_of_memory) {
+            return -ENOMEM;
+        }
+        if (result != -ENOBUFS) {
+            return result;
+        }
+        // Events were dropped: the only safe recovery is a full dump
+        daemon->stats.resyncs++;
+        if ((result = resync_links(daemon)) < 0) {
+            return result;
+        }
+    }
+}
+
+/*
+ * Rotations
+ */
+
+/**
+ * @brief Rotates every interface that is due, as far as the rate limit allows.
+ *
+ * Due interfaces are changed together in netlink batches, critical ones
+ * first and bulk ones last. Only one rolling member of a given master goes
+ * per batch; the others are pushed back by DAEMON_ROLLING_GAP_NS. An
+ * expensive rotation waits until the expected down window of the previous
+ * one is over. A batch that goes out anyway then takes the cheap rotations
+ * found at the top of the schedules, up to DAEMON_PACK_NS early, until its
+ * expected latency reaches DAEMON_PACK_BUDGET_NS.
+ */
+static void run_due_rotations(RotationDaemon *daemon) {
+    DaemonLinks *links = &daemon->links;
+    int64 now = kernel_now(daemon->kernel);
+    refill_credit(daemon, now);
+    for (;;) {
+        int count = 0;
+        int32 masters[DAEMON_MAX_BATCH];                   // Masters with a rolling member in this batch
+        int master_count = 0;
+        int64 batch_ns = 0;                                // Expected latency of the batch
+        for (int pass = 0; pass < 2 && (pass == 0 || count > 0); pass++) {
+            int64 horizon = pass == 0 ? now : now + DAEMON_PACK_NS;
+            for (int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+                while (count < DAEMON_MAX_BATCH && class_due(daemon, priority) <= horizon) {
+                    int slot = daemon->heaps[priority].slots[0];
+                    const PolicyRule *rule = rule_of(daemon, slot);
+                    int64 outage = links->state[slot] & LINK_SEIZED ? 0 : expected_outage(daemon, slot, rule);
+                    bool early = links->due_ns[slot] > now;
+                    if (early && (outage >= DAEMON_CHEAP_NS || batch_ns >= DAEMON_PACK_BUDGET_NS)) {
+                        break;                             // Waits for its own due time
+                    }
+                    int32 master = links->master[slot];
+                    if (rule->strategy == STRATEGY_ROLLING && master != 0) {
+                        bool busy = false;
+                        for (int i = 0; i < master_count && !busy; i++) {
+                            busy = masters[i] == master;
+                        }
+                        if (busy) {
+                            schedule(daemon, slot, now + DAEMON_ROLLING_GAP_NS, priority);
+                            continue;
+                        }
+                    }
+                    if (outage >= DAEMON_EXPENSIVE_NS && daemon->spread_until_ns > now) {
+                        daemon->stats.spread_rotations++;
+                        schedule(daemon, slot, daemon->spread_until_ns, priority);
+                        continue;
+                    }
+                    // The name is not kept: backends that need it (ioctl) look it up
+                    LinkInfo original = { .perm_address = links->original[slot], .has_perm_address = true };
+                    MacAddress new_mac;
+                    if (!policy_new_address(rule, &original, &new_mac)) {
+                        schedule(daemon, slot, now + DAEMON_RETRY_NS, priority);   // No randomness yet
+                        continue;
+                    }
+                    int reserved = registry_reserve_random(daemon->options->registry, &new_mac);
+                    if (reserved < 0) {
+                        // Applying an address the registry did not give us could collide with another process
+                        daemon->stats.rotation_failures++;
+                        if (!daemon->options->quiet) {
+                            fprintf(stderr, "macmasq: ifindex %u: registry: %s\n", links->ifindex[slot],
+                                    strerror(-reserved));
+                        }
+                        schedule(daemon, slot, now + DAEMON_RETRY_NS, priority);
+                        continue;
+                    }
+                    if (!take_token(daemon, priority)) {
+                        registry_release(daemon->options->registry, new_mac);
+                        break;                             // Waits in its heap for more credit
+                    }
+                    if (rule->strategy == STRATEGY_ROLLING && master != 0) {
+                        masters[master_count++] = master;
+                    }
+                    if (outage >= DAEMON_EXPENSIVE_NS) {
+                        daemon->spread_until_ns = now + outage;
+                    }
+                    daemon->stats.packed_rotations += early;
+                    batch_ns += expected_latency(daemon, slot);
+                    unschedule(daemon, slot);
+
+                    LinkRotation *rotation = &daemon->rotations[count];
+                    memset(rotation, 0, sizeof(*rotation));
+                    rotation->ifindex = links->ifindex[slot];
+                    rotation->flags = links->flags[slot];
+                    rotation->old_mac = links->address[slot];
+                    rotation->new_mac = new_mac;
+                    rotation->live = rule->strategy == STRATEGY_LIVE;
+                    rotation->backend = daemon->options->backend;
+                    stop_timing(daemon, slot);                     // Its last down, if still timed, is stale
+                    links->state[slot] &= ~LINK_CYCLING;
+                    if (!rotation->live && link_running(rotation->flags)) {
+                        links->state[slot] |= LINK_CYCLING;        // Only a running link reports a down
+                    }
+                    daemon->rotation_slots[count++] = slot;
+                }
+            }
+        }
+        if (count == 0) {
+            break;
+        }
+
+        int result = kernel_rotate(daemon->kernel, daemon->rotations, count, daemon->options->backend);
+        daemon->stats.batches++;
+        int64 done = kernel_now(daemon->kernel);
+        for (int i = 0; i < count; i++) {
+            int slot = daemon->rotation_slots[i];
+            LinkRotation *rotation = &daemon->rotations[i];
+            int64 due = links->due_ns[slot];                // Kept by unschedule()
+            histogram_add(&daemon->stats.lateness, done > due ? done - due : 0);  // Packed ones went early
+            histogram_add(&daemon->stats.wait[links->priority[slot]], done > due ? done - due : 0);
+            // Every entry of a batch waits for the whole batch: each is charged its share
+            learn_latency(daemon, slot, rotation->backend == BACKEND_NETLINK_BATCH ? rotation->total_ns / count
+                                                                                  : rotation->total_ns);
+            bool seized = links->state[slot] & LINK_SEIZED;
+            links->state[slot] &= ~LINK_SEIZED;
+            if (result < 0 && rotation->error == 0) {
+                rotation->error = -result;
+            }
+            registry_settle(daemon->options->registry, rotation, daemon->netns);
+            journal_record(daemon->options->journal, rotation, daemon->netns);
+            audit_rotation(daemon->audit, rotation, "daemon");
+            if (rotation->error != 0) {
+                daemon->stats.rotation_failures++;
+                if (!daemon->options->quiet) {
+                    fprintf(stderr, "macmasq: ifindex %u: %s\n", rotation->ifindex, strerror(rotation->error));
+                }
+                schedule(daemon, slot, done + DAEMON_RETRY_NS, links->priority[slot]);
+                continue;
+            }
+            daemon->stats.rotations++;
+            if (seized && !link_running(rotation->flags)) {
+                daemon->stats.free_rotations++;
+            }
+            links->address[slot] = rotation->new_mac;
+            links->rotated_s[slot] = (int32)((done - daemon->epoch_ns) / 1000000000UL) + 1;
+            schedule_by_rule(daemon, slot, done);
+        }
+    }
+}
+
+/*
+ * Policy reloads
+ */
+
+/**
+ * @brief Loader thread: compiles the policy file whenever the event loop asks.
+ */
+static void *policy_loader(void *argument) {
+    RotationDaemon *daemon = argument;
+    for (;;) {
+        int64 requests;
+        if (read(daemon->reload_request_fd, &requests, sizeof(requests)) < 0 && errno == EINTR) {
+            continue;
+        }
+        if (atomic_load(&daemon->stopping)) {
+            return NULL;
+        }
+
+        char error[256];
+        int64 started = monotonic_ns();
+        Policy *policy = policy_load(daemon->options->policy_path, error, sizeof(error));
+        if (policy == NULL) {
+            __atomic_fetch_add(&daemon->stats.reload_failures, 1, __ATOMIC_RELAXED);
+            fprintf(stderr, "macmasq: keeping the running policy: %s\n", error);
+            continue;
+        }
+        atomic_store(&daemon->staged_parse_ns, monotonic_ns() - started);
+        // A policy staged earlier but not swapped in yet is simply superseded
+        policy_free(atomic_exchange(&daemon->staged, policy));
+        int64 one = 1;
+        write(daemon->reload_ready_fd, &one, sizeof(one));
+    }
+}
+
+/**
+ * @brief Asks the loader thread to compile the policy file again.
+ */
+static void request_reload(RotationDaemon *daemon) {
+    int64 one = 1;
+    write(daemon->reload_request_fd, &one, sizeof(one));
+}
+
+/**
+* @brief Rules of the staged policy, collected from a dump before it is swapped in.
+*/
+typedef struct reload_context {
+    RotationDaemon *daemon;              // The daemon
+    const Policy *next;                  // The staged policy
+    int8 *rules;                         // Rule of every slot under next, RULE_UNSEEN if not dumped
+} ReloadContext;
+
+// Slot the reload dump did not list (the interface is being deleted)
+#define RULE_UNSEEN 0xFE
+
+/**
+ * @brief Looks one dumped interface up in the staged policy.
+ */
+static void reload_visit(const LinkInfo *info, void *context) {
+    ReloadContext *reload = context;
+    int slot = find_slot(reload->daemon, info->ifindex);
+    if (slot >= 0) {                                       // Unknown ones come with their RTM_NEWLINK
+        reload->rules[slot] = lookup_rule(reload->next, info);
+    }
+}
+
+/**
+ * @brief Swaps in the staged policy and reschedules the interfaces it affects.
+ *
+ * The daemon does not keep names, kinds or groups, so they are read from a
+ * fresh dump. If the dump fails, the running policy stays.
+ */
+static void swap_policy(RotationDaemon *daemon) {
+    int64 pending;
+    read(daemon->reload_ready_fd, &pending, sizeof(pending));
+    Policy *next = atomic_exchange(&daemon->staged, NULL);
+    if (next == NULL) {
+        return;
+    }
+
+    int64 started = monotonic_ns();
+    ReloadContext reload = { .daemon = daemon, .next = next, .rules = malloc(daemon->link_capacity + 1) };
+    int result = reload.rules ? 0 : -ENOMEM;
+    if (result == 0) {
+        memset(reload.rules, RULE_UNSEEN, daemon->link_capacity);
+        result = kernel_dump_links(daemon->kernel, reload_visit, &reload);
+    }
+    if (result < 0) {
+        __atomic_fetch_add(&daemon->stats.reload_failures, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "macmasq: keeping the running policy: link dump: %s\n", strerror(-result));
+        free(reload.rules);
+        policy_free(next);
+        return;
+    }
+
+    int64 now = kernel_now(daemon->kernel);
+    Policy *previous = daemon->policy;
+    daemon->policy = next;
+    int rescheduled = 0;
+    for (int slot = 0; slot < daemon->link_capacity; slot++) {
+        if (!(daemon->links.state[slot] & LINK_IN_USE)) {
+            continue;
+        }
+        const PolicyRule *old_rule = policy_rule(previous, daemon->links.rule[slot]);
+        daemon->links.rule[slot] = reload.rules[slot] == RULE_UNSEEN ? NO_RULE : reload.rules[slot];
+        if (!policy_rule_equivalent(old_rule, rule_of(daemon, slot))) {
+            schedule_by_rule(daemon, slot, now);
+            rescheduled++;
+        }
+    }
+    free(reload.rules);
+    policy_free(previous);                                 // The event loop was its only reader
+
+    daemon->stats.reloads++;
+    daemon->stats.last_reload_parse_ns = atomic_load(&daemon->staged_parse_ns);
+    daemon->stats.last_reload_apply_ns = monotonic_ns() - started;
+    daemon->stats.last_reload_rescheduled = rescheduled;
+    daemon->next_metrics_ns = 0;                           // Publish the reload right away
+    fprintf(stderr, "macmasq: policy reloaded (%d rules, %d interfaces rescheduled, parse %lu us, swap %lu us)\n",
+            next->rule_count, rescheduled, daemon->stats.last_reload_parse_ns / 1000,
+            daemon->stats.last_reload_apply_ns / 1000);
+}
+
+/**
+ * @brief Reads inotify events and requests a reload if the policy file changed.
+ */
+static void handle_inotify(RotationDaemon *daemon) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t received;
+    while ((received = read(daemon->inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *cursor = buffer; cursor < buffer + received;) {
+            const struct inotify_event *event = (const struct inotify_event *)cursor;
+            if (event->len > 0 && strcmp(event->name, daemon->policy_name) == 0) {
+                changed = true;                            // Written in place or renamed over
+            }
+            cursor += sizeof(*event) + event->len;
+        }
+    }
+    if (changed) {
+        request_reload(daemon);
+    }
+}
+
+/*
+ * Metrics
+ */
+
+/**
+ * @brief Writes the metrics file.
+ */
+static void publish_metrics(RotationDaemon *daemon) {
+    MetricsPage *page = &daemon->page;
+    DaemonStats *stats = &daemon->stats;
+    metrics_begin(page);
+    metrics_gauge(page, "macmasq_interfaces", "Interfaces known to the daemon", daemon->link_count);
+    metrics_gauge(page, "macmasq_scheduled_interfaces", "Interfaces with a pending rotation", scheduled_count(daemon));
+    metrics_gauge(page, "macmasq_state_bytes", "Memory of the per-interface state, checkpoint included", state_bytes(daemon));
+    metrics_counter(page, "macmasq_rotations_total", "Successful rotations", stats->rotations);
+    metrics_counter(page, "macmasq_rotation_failures_total", "Rotations rejected by the kernel",
+                    stats->rotation_failures);
+    metrics_counter(page, "macmasq_free_rotations_total", "Rotations done while the link was down by itself",
+                    stats->free_rotations);
+    metrics_counter(page, "macmasq_batches_total", "Netlink batches sent", stats->batches);
+    metrics_gauge(page, "macmasq_resumed_interfaces", "Interfaces whose schedule was taken over from the checkpoint",
+                  stats->resumed);
+    metrics_counter(page, "macmasq_packed_rotations_total", "Cheap rotations sent early with a batch going out anyway",
+                    stats->packed_rotations);
+    metrics_counter(page, "macmasq_spread_rotations_total",
+                    "Expensive rotations held back until another one's expected down window was over",
+                    stats->spread_rotations);
+    metrics_counter(page, "macmasq_link_events_total", "Link events received", stats->link_events);
+    metrics_counter(page, "macmasq_resyncs_total", "Full link dumps after lost events", stats->resyncs);
+    metrics_gauge(page, "macmasq_rotation_lateness_p99_ns", "99th percentile of rotation time past its due time",
+                  histogram_percentile(&stats->lateness, 0.99));
+    const char *classes[PRIORITY_CLASSES];
+    int64 depths[PRIORITY_CLASSES];
+    int64 waits[PRIORITY_CLASSES];
+    int64 now = kernel_now(daemon->kernel);
+    for (int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        classes[priority] = priority_name(priority);
+        depths[priority] = due_below(daemon, &daemon->heaps[priority], 0, now);
+        waits[priority] = histogram_percentile(&stats->wait[priority], 0.99);
+    }
+    metrics_labeled(page, "macmasq_rotation_queue_depth", "gauge", "Rotations due and not yet sent, by priority class",
+                    "class", classes, depths, PRIORITY_CLASSES);
+    metrics_labeled(page, "macmasq_rotation_wait_p99_ns", "gauge",
+                    "99th percentile of rotation time past its due time, by priority class",
+                    "class", classes, waits, PRIORITY_CLASSES);
+    const char *drivers[DAEMON_MAX_DRIVERS];
+    int64 down_ns[DAEMON_MAX_DRIVERS];
+    int64 total_ns[DAEMON_MAX_DRIVERS];
+    for (int driver = 0; driver < daemon->driver_count; driver++) {
+        drivers[driver] = daemon->drivers[driver].name;
+        down_ns[driver] = daemon->drivers[driver].down_ns;
+        total_ns[driver] = daemon->drivers[driver].total_ns;
+    }
+    metrics_labeled(page, "macmasq_driver_down_window_ns", "gauge",
+                    "Moving average of the time a down/set/up keeps a link down, by driver",
+                    "driver", drivers, down_ns, daemon->driver_count);
+    metrics_labeled(page, "macmasq_driver_rotation_latency_ns", "gauge",
+                    "Moving average of the end-to-end latency of a rotation, by driver",
+                    "driver", drivers, total_ns, daemon->driver_count);
+    metrics_gauge(page, "macmasq_link_event_delay_p99_ns", "99th percentile of link event time before it is applied",
+                  histogram_percentile(&stats->event_delay, 0.99));
+    metrics_gauge(page, "macmasq_policy_rules", "Rules in the running policy", daemon->policy->rule_count);
+    metrics_counter(page, "macmasq_policy_reloads_total", "Policies swapped in", stats->reloads);
+    metrics_counter(page, "macmasq_policy_reload_failures_total", "Policy files that failed to load",
+                    __atomic_load_n(&stats->reload_failures, __ATOMIC_RELAXED));
+    metrics_gauge(page, "macmasq_policy_reload_parse_ns", "Time spent compiling the last policy (loader thread)",
+                  stats->last_reload_parse_ns);
+    metrics_gauge(page, "macmasq_policy_reload_apply_ns", "Time the event loop spent swapping in the last policy",
+                  stats->last_reload_apply_ns);
+    metrics_gauge(page, "macmasq_policy_reload_rescheduled", "Interfaces rescheduled by the last reload",
+                  stats->last_reload_rescheduled);
+    if (daemon->audit != NULL) {
+        AuditStats audit;
+        audit_stats(daemon->audit, &audit);
+        metrics_counter(page, "macmasq_audit_records_total", "Audit records queued", audit.records);
+        metrics_counter(page, "macmasq_audit_written_total", "Audit records written", audit.written);
+        metrics_counter(page, "macmasq_audit_dropped_total", "Audit records dropped on a full ring", audit.dropped);
+        metrics_counter(page, "macmasq_audit_blocked_total", "Audit records that waited for room in the ring",
+                        audit.blocked);
+        metrics_counter(page, "macmasq_audit_fsyncs_total", "Group commits of the audit log", audit.fsyncs);
+        metrics_counter(page, "macmasq_audit_errors_total", "Failed audit log writes and syncs", audit.errors);
+    }
+    int result = metrics_publish(page, daemon->options->metrics_path);
+    if (result < 0) {
+        fprintf(stderr, "macmasq: %s: %s\n", daemon->options->metrics_path, strerror(-result));
+    }
+}
+
+/*
+ * Event loop
+ */
+
+/**
+ * @brief Arms the timerfd for the next due rotation or metrics update.
+ */
+static void arm_timer(RotationDaemon *daemon) {
+    int64 next = 0;
+    if (scheduled_count(daemon) > 0) {
+        next = next_rotation(daemon);
+    }
+    if (daemon->options->metrics_path && (next == 0 || daemon->next_metrics_ns < next)) {
+        next = daemon->next_metrics_ns;
+    }
+    struct itimerspec timer = { { 0, 0 }, { 0, 0 } };      // A zero value disarms the timer
+    if (next != 0) {
+        timer.it_value.tv_sec = next / 1000000000;
+        timer.it_value.tv_nsec = next % 1000000000;
+    }
+    timerfd_settime(daemon->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+}
+
+/**
+ * @brief Registers a file descriptor with the event loop.
+ */
+static int watch_fd(RotationDaemon *daemon, int fd) {
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+    return epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/**
+ * @brief Allocates the rotation buffers and the ifindex map, and seeds the schedule.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+static int prepare_daemon(RotationDaemon *daemon, const DaemonOptions *options, Kernel *kernel) {
+    daemon->options = options;
+    daemon->kernel = kernel;
+    atomic_init(&daemon->staged, NULL);
+    atomic_init(&daemon->stopping, false);
+    daemon->random = options->seed;
+    if (daemon->random == 0) {
+        random_bytes(&daemon->random, sizeof(daemon->random));
+    }
+    daemon->rotations = malloc(DAEMON_MAX_BATCH * sizeof(*daemon->rotations));
+    daemon->rotation_slots = malloc(DAEMON_MAX_BATCH * sizeof(int));
+    daemon->slot_of = calloc(256, sizeof(int));
+    daemon->map_mask = 255;
+    daemon->free_slot = -1;
+    daemon->epoch_ns = kernel_now(kernel);
+    if (options->rate_limit > 0) {
+        int64 burst = options->rate_burst > 0 ? (int64)options->rate_burst : options->rate_limit;
+        daemon->token_ns = 1000000000UL / options->rate_limit;
+        daemon->token_ns += daemon->token_ns == 0;         // Above 1e9 per second, one nanosecond each
+        daemon->credit_max_ns = burst * daemon->token_ns;
+        daemon->credit_ns = daemon->credit_max_ns;
+        daemon->credit_at_ns = daemon->epoch_ns;
+    }
+    daemon->netns = options->registry || options->journal ? registry_netns() : 0;
+    if (options->audit.path != NULL) {
+        int result = audit_open(&options->audit, &daemon->audit);
+        if (result < 0) {
+            fprintf(stderr, "macmasq: %s: %s\n", options->audit.path, strerror(-result));
+            return result;
+        }
+    }
+    if (!daemon->rotations || !daemon->rotation_slots || !daemon->slot_of) {
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens the checkpoint and takes the epoch of the previous run over.
+ *
+ * A checkpoint that cannot be opened only costs the next restart its warm
+ * start: the daemon runs without one.
+ */
+static void open_checkpoint(RotationDaemon *daemon) {
+    int result = checkpoint_open(daemon->options->checkpoint_path, registry_netns(), daemon->epoch_ns,
+                                 &daemon->checkpoint);
+    if (result < 0) {
+        fprintf(stderr, "macmasq: checkpoint %s: %s, the schedule is not kept\n", daemon->options->checkpoint_path,
+                strerror(-result));
+        return;
+    }
+    daemon->epoch_ns = checkpoint_epoch(daemon->checkpoint);    // rotated_s of the previous run stays valid
+}
+
+/**
+ * @brief Replaces the previous run's checkpoint with this run's, once the first resync recorded every interface.
+ *
+ * If that fails, the previous run's checkpoint stays and this run's records
+ * are dropped on exit, as if the daemon ran without one.
+ */
+static void commit_checkpoint(RotationDaemon *daemon) {
+    int result = checkpoint_commit(daemon->checkpoint);
+    if (result < 0) {
+        fprintf(stderr, "macmasq: checkpoint %s: %s, the schedule is not kept\n", daemon->options->checkpoint_path,
+                strerror(-result));
+    }
+}
+
+/**
+ * @brief Opens every file descriptor and starts the loader thread.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+static int open_daemon(RotationDaemon *daemon) {
+    char copy[PATH_MAX];
+    snprintf(copy, sizeof(copy), "%s", daemon->options->policy_path);
+    snprintf(daemon->policy_directory, sizeof(daemon->policy_directory), "%s", dirname(copy));
+    snprintf(copy, sizeof(copy), "%s", daemon->options->policy_path);
+    snprintf(daemon->policy_name, sizeof(daemon->policy_name), "%s", basename(copy));
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    sigprocmask(SIG_BLOCK, &signals, NULL);                // Also inherited by the loader thread
+
+    daemon->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    daemon->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    daemon->signal_fd = signalfd(-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK);
+    daemon->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    daemon->reload_request_fd = eventfd(0, EFD_CLOEXEC);
+    daemon->reload_ready_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (daemon->epoll_fd < 0 || daemon->timer_fd < 0 || daemon->signal_fd < 0 || daemon->inotify_fd < 0 ||
+        daemon->reload_request_fd < 0 || daemon->reload_ready_fd < 0) {
+        return -errno;
+    }
+    if (inotify_add_watch(daemon->inotify_fd, daemon->policy_directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        return -errno;
+    }
+    int fds[] = { daemon->kernel->event_fd, daemon->timer_fd, daemon->signal_fd, daemon->inotify_fd, daemon->reload_ready_fd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (watch_fd(daemon, fds[i]) < 0) {
+            return -errno;
+        }
+    }
+
+    int result = pthread_create(&daemon->loader, NULL, policy_loader, daemon);
+    return -result;
+}
+
+/**
+ * @brief Stops the loader thread and releases everything.
+ */
+static void close_daemon(RotationDaemon *daemon, bool loader_started) {
+    if (loader_started) {
+        atomic_store(&daemon->stopping, true);
+        request_reload(daemon);
+        pthread_join(daemon->loader, NULL);
+    }
+    policy_free(atomic_exchange(&daemon->staged, NULL));
+    policy_free(daemon->policy);
+    int fds[] = { daemon->epoll_fd, daemon->timer_fd, daemon->signal_fd, daemon->inotify_fd,
+                  daemon->reload_request_fd, daemon->reload_ready_fd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] > 0) {
+            close(fds[i]);
+        }
+    }
+    metrics_free(&daemon->page);
+    audit_close(daemon->audit);                            // Writes and syncs what is still queued
+    checkpoint_close(daemon->checkpoint);                  // Its records stay for the next start
+    void *arrays[] = { daemon->links.ifindex, daemon->links.address, daemon->links.original, daemon->links.due_ns,
+                       daemon->links.rotated_s, daemon->links.flags, daemon->links.master, daemon->links.match_key,
+                       daemon->links.heap_index, daemon->links.priority, daemon->links.rule, daemon->links.state,
+                       daemon->links.driver };
+    for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        free(arrays[i]);
+    }
+    free(daemon->slot_of);
+    for (int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        free(daemon->heaps[priority].slots);
+    }
+    free(daemon->rotations);
+    free(daemon->rotation_slots);
+}
+
+/**
+ * @brief Runs the rotation daemon until SIGINT or SIGTERM.
+ *
+ * SIGHUP, or any write to the policy file, reloads the policy.
+ *
+ * @param options Configuration.
+ * @return int 0 on a clean shutdown, or a negative errno.
+ */
+int run_daemon(const DaemonOptions *options) {
+    RotationDaemon *daemon = calloc(1, sizeof(*daemon));
+    if (daemon == NULL) {
+        return -ENOMEM;
+    }
+
+    char error[256];
+    daemon->policy = policy_load(options->policy_path, error, sizeof(error));
+    if (daemon->policy == NULL) {
+        fprintf(stderr, "macmasq: %s\n", error);
+        free(daemon);
+        return -EINVAL;
+    }
+
+    Kernel *kernel = NULL;
+    int result = linux_kernel_open(&kernel);
+    if (result == 0) {
+        result = prepare_daemon(daemon, options, kernel);
+    }
+    if (result == 0 && options->checkpoint_path != NULL) {
+        open_checkpoint(daemon);
+    }
+    if (result == 0) {
+        result = open_daemon(daemon);
+    }
+    bool loader_started = result == 0;
+    if (result == 0) {
+        result = resync_links(daemon);
+    }
+    if (result == 0) {
+        fprintf(stderr, "macmasq: daemon started with %d interfaces, %d scheduled, %lu resumed from the checkpoint\n",
+                daemon->link_count, scheduled_count(daemon), daemon->stats.resumed);
+    }
+    if (result == 0 && daemon->checkpoint != NULL) {
+        commit_checkpoint(daemon);
+    }
+    if (daemon->checkpoint != NULL) {
+        checkpoint_forget_previous(daemon->checkpoint);   // Later interfaces are new ones
+    }
+
+    bool running = result == 0;
+    while (running) {
+        int64 now = kernel_now(kernel);
+        if (options->metrics_path && now >= daemon->next_metrics_ns) {
+            publish_metrics(daemon);
+            daemon->next_metrics_ns = now + options->metrics_interval_ns;
+        }
+        arm_timer(daemon);
+
+        struct epoll_event events[8];
+        int ready = epoll_wait(daemon->epoll_fd, events, 8, -1);
+        if (ready < 0 && errno != EINTR) {
+            result = -errno;
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == kernel->event_fd) {
+                if ((result = handle_link_events(daemon)) < 0) {
+                    running = false;
+                }
+            } else if (fd == daemon->timer_fd) {
+                int64 expirations;
+                read(daemon->timer_fd, &expirations, sizeof(expirations));
+            } else if (fd == daemon->signal_fd) {
+                struct signalfd_siginfo signal_info;
+                while (read(daemon->signal_fd, &signal_info, sizeof(signal_info)) == sizeof(signal_info)) {
+                    if (signal_info.ssi_signo == SIGHUP) {
+                        request_reload(daemon);
+                    } else {
+                        running = false;
+                    }
+                }
+            } else if (fd == daemon->inotify_fd) {
+                handle_inotify(daemon);
+            } else if (fd == daemon->reload_ready_fd) {
+                swap_policy(daemon);
+            }
+        }
+        run_due_rotations(daemon);
+        if (daemon->out_of_memory) {
+            result = -ENOMEM;
+            running = false;
+        }
+    }
+
+    if (result < 0) {
+        fprintf(stderr, "macmasq: daemon: %s\n", strerror(-result));
+    }
+    close_daemon(daemon, loader_started);
+    kernel_close(kernel);
+    free(daemon);
+    return result;
+}
+
+/**
+ * @brief Runs the scheduler against a backend with a virtual clock, without the event loop.
+ *
+ * The daemon dumps the links, then alternates between draining link
+ * events, rotating whatever is due and idling the backend up to the next
+ * deadline, until duration_ns of the backend's time has passed and the
+ * backend has no more events to come (a replay), then drains the last
+ * events. There is no policy reload, signal or metrics file.
+ *
+ * @param options Configuration (backend and seed; the paths are ignored).
+ * @param policy The policy, still owned by the caller.
+ * @param kernel A backend implementing idle (see sim.c).
+ * @param duration_ns Backend time to simulate at least.
+ * @param report Receives the counters.
+ * @return int 0 on success, or a negative errno.
+ */
+int simulate_daemon(const DaemonOptions *options, Policy *policy, Kernel *kernel, int64 duration_ns,
+                    DaemonReport *report) {
+    if (kernel->ops->idle == NULL) {
+        return -EINVAL;
+    }
+    RotationDaemon *daemon = calloc(1, sizeof(*daemon));
+    if (daemon == NULL) {
+        return -ENOMEM;
+    }
+    daemon->policy = policy;
+    int64 started = monotonic_ns();
+    int result = prepare_daemon(daemon, options, kernel);
+    if (result == 0) {
+        result = resync_links(daemon);
+    }
+    int64 end = kernel_now(kernel) + duration_ns;
+    for (;;) {
+        bool pending = kernel->ops->pending != NULL && kernel->ops->pending(kernel);
+        if (result < 0 || (kernel_now(kernel) >= end && !pending)) {
+            break;
+        }
+        if ((result = handle_link_events(daemon)) < 0) {
+            break;
+        }
+        run_due_rotations(daemon);
+        if (daemon->out_of_memory) {
+            result = -ENOMEM;
+            break;
+        }
+        int64 next = next_rotation(daemon);
+        kernel->ops->idle(kernel, next < end || pending ? next : end);  // A replay stops idling at its next event
+    }
+    if (result == 0) {
+        result = handle_link_events(daemon);               // Events sent by the last idle
+    }
+
+    memset(report, 0, sizeof(*report));
+    report->interfaces = daemon->link_count;
+    report->rotations = daemon->stats.rotations;
+    report->rotation_failures = daemon->stats.rotation_failures;
+    report->free_rotations = daemon->stats.free_rotations;
+    report->packed_rotations = daemon->stats.packed_rotations;
+    report->spread_rotations = daemon->stats.spread_rotations;
+    report->batches = daemon->stats.batches;
+    report->link_events = daemon->stats.link_events;
+    report->resyncs = daemon->stats.resyncs;
+    report->lateness = daemon->stats.lateness;
+    report->event_delay = daemon->stats.event_delay;
+    memcpy(report->wait, daemon->stats.wait, sizeof(report->wait));
+    report->event_cpu_ns = daemon->stats.event_cpu_ns;
+    report->state_bytes = state_bytes(daemon);
+    report->checkpoint_bytes = (int64)daemon->link_capacity * sizeof(CheckpointRecord);
+    report->loop_ns = monotonic_ns() - started;
+    daemon->policy = NULL;                                 // Owned by the caller
+    close_daemon(daemon, false);
+    free(daemon);
+    return result;
+}
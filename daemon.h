@@ -0,0 +1,77 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_DAEMON_H
+#define MACMASQ_DAEMON_H
+
+// Including required C Header files
+#include "kernel.h"        // for Kernel
+#include "policy.h"        // for Policy
+#include "metrics.h"       // for LatencyHistogram
+#include "audit.h"         // for AuditOptions
+#include "registry.h"      // for MacRegistry
+#include "journal.h"       // for Journal
+
+// Default period between two updates of the metrics file
+#define DAEMON_DEFAULT_METRICS_INTERVAL_S 10
+
+/**
+* @brief Configuration of the rotation daemon.
+*/
+typedef struct daemon_options {
+    const char *policy_path;             // Policy file, watched for changes
+    const char *metrics_path;            // Prometheus text file, NULL to disable
+    int64 metrics_interval_ns;           // Period between two metrics updates
+    MacBackend backend;                  // How rotations are applied
+    int64 seed;                          // Seeds the spread of first rotations, 0 for a random seed
+    bool quiet;                          // Do not report every failed rotation
+    int64 rate_limit;                    // Most link changes per second, 0 for no limit
+    int rate_burst;                      // Changes the limit lets through at once, 0 for one second's worth
+    int64 opportunistic_ns;              // Rotations due this soon go when their link goes down by itself, 0 to wait
+    AuditOptions audit;                  // Audit log of every rotation (path NULL to disable)
+    MacRegistry *registry;               // Host-wide address registry, NULL to reserve nothing
+    Journal *journal;                    // Journal of original addresses, NULL to record nothing
+    const char *checkpoint_path;         // Schedule kept for a warm restart, NULL to start cold
+} DaemonOptions;
+
+/**
+* @brief What a simulated daemon run did.
+*/
+typedef struct daemon_report {
+    int64 interfaces;                    // Interfaces known at the end
+    int64 rotations;                     // Successful rotations
+    int64 rotation_failures;             // Rotations rejected by the kernel
+    int64 free_rotations;                // Successful rotations of links that were already down
+    int64 packed_rotations;              // Cheap rotations sent early with a batch going out anyway
+    int64 spread_rotations;              // Expensive rotations held back behind another one's down window
+    int64 batches;                       // Calls to the backend
+    int64 link_events;                   // Link events processed
+    int64 resyncs;                       // Full dumps after lost events
+    int64 loop_ns;                       // Real time the daemon took (CPU cost of the scheduler)
+    int64 event_cpu_ns;                  // Real time spent reading and applying link events
+    int64 state_bytes;                   // Memory of the per-interface tables, schedule and ifindex map
+    int64 checkpoint_bytes;              // What a checkpoint would map on top (the simulator keeps none)
+    LatencyHistogram lateness;           // Rotation done minus due, in the backend's clock
+    LatencyHistogram event_delay;        // Link event applied minus sent, in the backend's clock
+    LatencyHistogram wait[PRIORITY_CLASSES];  // Lateness of each priority class
+} DaemonReport;
+
+int run_daemon(const DaemonOptions *options);
+int simulate_daemon(const DaemonOptions *options, Policy *policy, Kernel *kernel, int64 duration_ns,
+                    DaemonReport *report);
+
+#endif // MACMASQ_DAEMON_H
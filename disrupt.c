@@ -0,0 +1,550 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Disruption benchmark (--bench-disruption).
+ *
+ * Two private network namespaces are joined by a veth pair (mmq-tx in the
+ * sender's, mmq-rx in the receiver's, 10.213.0.1/30 and 10.213.0.2/30).
+ * A sender thread paces sequence-numbered, timestamped UDP frames with
+ * sendmmsg(); a receiver thread reads them from a TPACKET_V3 ring, behind
+ * a BPF filter on the destination port. Meanwhile the sender's address is
+ * rotated every interval with each strategy in turn:
+ *
+ *   ioctl     SIOCSIFFLAGS down, SIOCSIFHWADDR, SIOCSIFFLAGS up
+ *   netlink   down, set, up as one RTM_SETLINK batch
+ *   live      RTM_SETLINK of the address alone, interface kept up
+ *
+ * Frames are counted from the end of a warm-up to the end of a quiet tail
+ * after the last rotation. Lost frames are those sent (or refused by the
+ * sender's stack) and never captured; the longest gap is the longest time
+ * between two consecutive captured frames, i.e. the worst outage.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for printf
+#include <stdlib.h>                // for calloc, free, qsort
+#include <string.h>                // for memset, memcpy
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <unistd.h>                // for close
+#include <time.h>                  // for clock_nanosleep
+#include <poll.h>                  // for poll
+#include <sched.h>                 // for setns
+#include <pthread.h>               // for the sender and receiver threads
+#include <stdatomic.h>             // for the flags shared with the threads
+#include <arpa/inet.h>             // for htons
+#include <netinet/in.h>            // for sockaddr_in
+#include <sys/mman.h>              // for mmap
+#include <sys/socket.h>            // for sendmmsg
+#include <sys/ioctl.h>             // for SIOCGIFFLAGS
+#include <linux/if_packet.h>       // for TPACKET_V3
+#include <linux/if_ether.h>        // for ETH_P_ALL
+#include <linux/filter.h>          // for the classic BPF filter
+#include <linux/rtnetlink.h>       // for RTM_NEWADDR
+#include "netlink.h"               // for the link setup and netlink_rotate
+#include "workpool.h"              // for ioctl_rotate and netns_create
+#include "disrupt.h"               // for the declarations implemented here
+
+// UDP port the probes are sent to
+#define PROBE_PORT 47213
+// Probes per sendmmsg()
+#define PROBE_BATCH 16
+// Traffic before the first rotation and after the last one, in milliseconds
+#define WARMUP_MS 300
+#define TAIL_MS 500
+// Geometry of the receive ring (room for a few hundred milliseconds of probes)
+#define RING_BLOCK_SIZE (1 << 17)
+#define RING_BLOCK_COUNT 64
+#define RING_FRAME_SIZE 256
+// Bytes of every probe copied into the ring
+#define RING_SNAPLEN 128
+
+/**
+* @brief Payload of every probe.
+*/
+typedef struct probe {
+    int32 run;                           // Run (mode) the probe belongs to
+    int32 reserved;
+    int64 seq;                           // Position in the run
+    int64 sent_ns;                       // monotonic_ns() just before sendmmsg()
+} Probe;
+
+/**
+* @brief A way of rotating the address (the strategies compared).
+*/
+typedef enum rotation_mode {
+    MODE_IOCTL,
+    MODE_NETLINK,
+    MODE_LIVE,
+    MODE_COUNT,
+} RotationMode;
+
+static const char *const mode_names[MODE_COUNT] = { "ioctl", "netlink", "live" };
+
+/**
+* @brief State shared by the benchmark and its threads.
+*/
+typedef struct bench {
+    int tx_netns;                        // Sender's namespace
+    int rx_netns;                        // Receiver's namespace
+    int32 rx_ifindex;                    // mmq-rx
+    int64 rate;                          // Probes per second
+    int64 capacity;                      // Entries of arrival and latency
+    int64 *arrival;                      // Capture time of every probe of the run, 0 if lost
+    int64 *latency;                      // Its one-way latency
+    int32 run;                           // Current run
+    atomic_bool stop_sender;
+    atomic_bool stop_receiver;
+    _Atomic(int64) next_seq;             // Next probe the sender will number
+    _Atomic(int64) send_errors;          // Probes refused by the sender's stack
+    int64 capture_drops;                 // Probes the ring had no room for
+    int error;                           // First setup failure of a thread (negative errno)
+} Bench;
+
+/*
+ * Setup
+ */
+
+/**
+ * @brief Gives an interface of the current namespace an address and brings it (and lo) up.
+ *
+ * @return int The interface's ifindex, or a negative errno.
+ */
+static int configure_end(const char *name, int8 host) {
+    int socket_fd = netlink_open(0);
+    if (socket_fd < 0) {
+        return socket_fd;
+    }
+    int32 ifindex = if_nametoindex(name);
+    int8 address[4] = { 10, 213, 0, host };
+    int result = ifindex ? netlink_ipv4_address(socket_fd, RTM_NEWADDR, ifindex, address, 30) : -ENODEV;
+    NetlinkBatch *batch = result == 0 ? malloc(sizeof(*batch)) : NULL;
+    if (result == 0 && batch == NULL) {
+        result = -ENOMEM;
+    }
+    if (result == 0) {
+        netlink_batch_init(batch, socket_fd, NULL, NULL);
+        netlink_batch_set_flags(batch, if_nametoindex("lo"), IFF_UP, IFF_UP, 0);
+        netlink_batch_set_flags(batch, ifindex, IFF_UP, IFF_UP, 0);
+        result = netlink_batch_flush(batch);
+    }
+    free(batch);
+    close(socket_fd);
+    return result < 0 ? result : (int)ifindex;
+}
+
+/*
+ * Threads
+ */
+
+/**
+ * @brief Sender thread: paces probes at the configured rate until asked to stop.
+ */
+static void *sender_main(void *argument) {
+    Bench *bench = argument;
+    setns(bench->tx_netns, CLONE_NEWNET);
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in receiver = {
+        .sin_family = AF_INET,
+        .sin_port = htons(PROBE_PORT),
+        .sin_addr.s_addr = htonl(0x0AD50002),              // 10.213.0.2
+    };
+    if (fd < 0 || connect(fd, (struct sockaddr *)&receiver, sizeof(receiver)) < 0) {
+        bench->error = -errno;
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+
+    Probe probes[PROBE_BATCH];
+    struct iovec vectors[PROBE_BATCH];
+    struct mmsghdr messages[PROBE_BATCH];
+    memset(messages, 0, sizeof(messages));
+    for (int i = 0; i < PROBE_BATCH; i++) {
+        vectors[i] = (struct iovec){ .iov_base = &probes[i], .iov_len = sizeof(Probe) };
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int64 started = monotonic_ns();
+    int64 seq = 0;
+    while (!atomic_load(&bench->stop_sender) && seq + PROBE_BATCH <= (int64)bench->capacity) {
+        int64 due = started + seq * 1000000000 / bench->rate;
+        struct timespec wake = { .tv_sec = due / 1000000000, .tv_nsec = due % 1000000000 };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+        int64 now = monotonic_ns();
+        for (int i = 0; i < PROBE_BATCH; i++) {
+            probes[i] = (Probe){ .run = bench->run, .seq = seq + i, .sent_ns = now };
+        }
+        int sent = sendmmsg(fd, messages, PROBE_BATCH, MSG_DONTWAIT);
+        atomic_fetch_add(&bench->send_errors, PROBE_BATCH - (sent < 0 ? 0 : sent));
+        seq += PROBE_BATCH;
+        atomic_store(&bench->next_seq, seq);
+    }
+    close(fd);
+    return NULL;
+}
+
+/**
+ * @brief Opens the receive ring on mmq-rx, letting only UDP probes in.
+ *
+ * @return int The socket, or a negative errno.
+ */
+static int open_probe_ring(int32 ifindex, char **ring) {
+    int fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),            // EtherType
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 8),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),            // IP protocol
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),            // Fragment offset
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1FFF, 4, 0),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),           // IP header length
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),            // UDP destination port
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PROBE_PORT, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, RING_SNAPLEN),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog filter = { .len = sizeof(code) / sizeof(code[0]), .filter = code };
+    int version = TPACKET_V3;
+    struct tpacket_req3 request = {
+        .tp_block_size = RING_BLOCK_SIZE,
+        .tp_block_nr = RING_BLOCK_COUNT,
+        .tp_frame_size = RING_FRAME_SIZE,
+        .tp_frame_nr = RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_COUNT,
+        .tp_retire_blk_tov = 1,
+    };
+    struct sockaddr_ll address = { .sll_family = AF_PACKET, .sll_protocol = htons(ETH_P_ALL), .sll_ifindex = (int)ifindex };
+    *ring = MAP_FAILED;
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) == 0 &&
+        setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == 0 &&
+        setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) == 0) {
+        *ring = mmap(NULL, (size_t)RING_BLOCK_SIZE * RING_BLOCK_COUNT, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (*ring == MAP_FAILED || bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        int error = errno;
+        if (*ring != MAP_FAILED) {
+            munmap(*ring, (size_t)RING_BLOCK_SIZE * RING_BLOCK_COUNT);
+        }
+        close(fd);
+        return -error;
+    }
+    return fd;
+}
+
+/**
+ * @brief Records every probe of the filled blocks of the ring and returns the blocks.
+ */
+static void drain_probes(Bench *bench, char *ring, int *block, int64 realtime_offset) {
+    for (;;) {
+        struct tpacket_block_desc *descriptor = (void *)(ring + (size_t)*block * RING_BLOCK_SIZE);
+        if (!(__atomic_load_n(&descriptor->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            return;
+        }
+        struct tpacket3_hdr *frame = (void *)((char *)descriptor + descriptor->hdr.bh1.offset_to_first_pkt);
+        for (int32 i = 0; i < descriptor->hdr.bh1.num_pkts; i++) {
+            const int8 *ethernet = (const int8 *)frame + frame->tp_mac;
+            int32 offset = 14 + (ethernet[14] & 0x0F) * 4 + 8;   // Ethernet, IPv4 and UDP headers
+            if (frame->tp_snaplen >= offset + sizeof(Probe)) {
+                Probe probe;
+                memcpy(&probe, ethernet + offset, sizeof(probe));
+                int64 arrival = (int64)frame->tp_sec * 1000000000 + frame->tp_nsec - realtime_offset;
+                if (probe.run == bench->run && probe.seq < bench->capacity && arrival > probe.sent_ns) {
+                    bench->arrival[probe.seq] = arrival;
+                    bench->latency[probe.seq] = arrival - probe.sent_ns;
+                }
+            }
+            frame = (void *)((char *)frame + frame->tp_next_offset);
+        }
+        __atomic_store_n(&descriptor->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        *block = (*block + 1) % RING_BLOCK_COUNT;
+    }
+}
+
+/**
+ * @brief Returns CLOCK_REALTIME minus CLOCK_MONOTONIC, in nanoseconds.
+ */
+static int64 realtime_offset(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64)now.tv_sec * 1000000000 + now.tv_nsec - monotonic_ns();
+}
+
+/**
+ * @brief Receiver thread: captures probes until asked to stop.
+ */
+static void *receiver_main(void *argument) {
+    Bench *bench = argument;
+    setns(bench->rx_netns, CLONE_NEWNET);
+    // A bound socket keeps the stack from answering every probe with an ICMP error
+    int sink = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_port = htons(PROBE_PORT) };
+    char *ring = NULL;
+    int fd = open_probe_ring(bench->rx_ifindex, &ring);
+    if (fd < 0 || sink < 0 || bind(sink, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        bench->error = fd < 0 ? fd : -errno;
+        if (fd >= 0) {
+            munmap(ring, (size_t)RING_BLOCK_SIZE * RING_BLOCK_COUNT);
+            close(fd);
+        }
+        if (sink >= 0) close(sink);
+        return NULL;
+    }
+
+    int64 offset = realtime_offset();
+    int block = 0;
+    struct pollfd pollfd = { .fd = fd, .events = POLLIN };
+    while (!atomic_load(&bench->stop_receiver)) {
+        poll(&pollfd, 1, 10);
+        drain_probes(bench, ring, &block, offset);
+    }
+    drain_probes(bench, ring, &block, offset);
+    struct tpacket_stats_v3 stats;
+    socklen_t length = sizeof(stats);
+    if (getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &stats, &length) == 0) {
+        bench->capture_drops = stats.tp_drops;
+    }
+    munmap(ring, (size_t)RING_BLOCK_SIZE * RING_BLOCK_COUNT);
+    close(fd);
+    close(sink);
+    return NULL;
+}
+
+/*
+ * Runs
+ */
+
+/**
+ * @brief qsort() comparison of two latencies.
+ */
+static int compare_int64(const void *a, const void *b) {
+    int64 x = *(const int64 *)a, y = *(const int64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Sleeps for a number of nanoseconds.
+ */
+static void pause_ns(int64 duration) {
+    struct timespec wait = { .tv_sec = duration / 1000000000, .tv_nsec = duration % 1000000000 };
+    nanosleep(&wait, NULL);
+}
+
+/**
+ * @brief Applies one new address to mmq-tx in one of the modes.
+ *
+ * @return int 0 on success, or a positive errno.
+ */
+static int rotate(RotationMode mode, int ioctl_fd, NetlinkBatch *batch, int32 ifindex, int64 *elapsed) {
+    LinkRotation rotation = {
+        .ifindex = ifindex,
+        .name = "mmq-tx",
+        .live = mode == MODE_LIVE,
+    };
+    if (!random_local_mac(&rotation.new_mac)) {
+        return EIO;
+    }
+    struct ifreq request = { .ifr_name = "mmq-tx" };
+    if (ioctl(ioctl_fd, SIOCGIFFLAGS, &request) < 0) {
+        return errno;
+    }
+    rotation.flags = (int32)(int16)request.ifr_flags;
+    int64 started = monotonic_ns();
+    if (mode == MODE_IOCTL) {
+        ioctl_rotate(ioctl_fd, &rotation);
+    } else {
+        int result = netlink_rotate(batch, &rotation, 1);
+        if (result < 0) {
+            rotation.error = -result;
+        }
+    }
+    *elapsed += monotonic_ns() - started;
+    return rotation.error;
+}
+
+/**
+ * @brief Runs one mode under load and prints its line of the report.
+ *
+ * @return int 0 on success, or a negative errno if the threads could not run.
+ */
+static int run_mode(Bench *bench, RotationMode mode, const DisruptionOptions *options,
+                        int ioctl_fd, NetlinkBatch *batch, int32 tx_ifindex) {
+    memset(bench->arrival, 0, bench->capacity * sizeof(int64));
+    memset(bench->latency, 0, bench->capacity * sizeof(int64));
+    bench->run++;
+    atomic_store(&bench->send_errors, 0);
+    bench->capture_drops = 0;
+    bench->error = 0;
+    atomic_store(&bench->stop_sender, false);
+    atomic_store(&bench->stop_receiver, false);
+    atomic_store(&bench->next_seq, 0);
+
+    pthread_t receiver, sender;
+    if (pthread_create(&receiver, NULL, receiver_main, bench) != 0) {
+        return -EAGAIN;
+    }
+    pause_ns(20000000);                                    // Let the ring be bound before the first probe
+    if (pthread_create(&sender, NULL, sender_main, bench) != 0) {
+        atomic_store(&bench->stop_receiver, true);
+        pthread_join(receiver, NULL);
+        return -EAGAIN;
+    }
+
+    pause_ns(WARMUP_MS * 1000000UL);
+    int64 first = atomic_load(&bench->next_seq);
+    int64 errors_before = atomic_load(&bench->send_errors);
+    int64 rotate_ns = 0;
+    int error = 0;
+    int done = 0;
+    for (; done < options->rotations && error == 0; done++) {
+        pause_ns(options->interval_ns / 2);
+        error = rotate(mode, ioctl_fd, batch, tx_ifindex, &rotate_ns);
+        pause_ns(options->interval_ns / 2);
+    }
+    pause_ns(TAIL_MS * 1000000UL);
+    int64 last = atomic_load(&bench->next_seq);
+    int64 send_errors = atomic_load(&bench->send_errors) - errors_before;
+    atomic_store(&bench->stop_sender, true);
+    pthread_join(sender, NULL);
+    pause_ns(50000000);                                    // Let the last probes reach the ring
+    atomic_store(&bench->stop_receiver, true);
+    pthread_join(receiver, NULL);
+    if (bench->error < 0) {
+        return bench->error;
+    }
+    if (error != 0) {
+        printf("%-8s  rotation failed: %s\n", mode_names[mode], strerror(error));
+        return 0;
+    }
+
+    // Losses, the longest gap between two captured probes, and latency percentiles
+    int64 received = 0, gap = 0, previous = 0;
+    int64 *latencies = bench->latency;                     // Compacted in place
+    for (int64 seq = first; seq < last; seq++) {
+        if (bench->arrival[seq] == 0) {
+            continue;
+        }
+        if (previous && bench->arrival[seq] > previous && bench->arrival[seq] - previous > gap) {
+            gap = bench->arrival[seq] - previous;
+        }
+        previous = bench->arrival[seq];
+        latencies[received++] = bench->latency[seq];
+    }
+    int64 sent = last - first;
+    int64 lost = sent - received;
+    qsort(latencies, received, sizeof(int64), compare_int64);
+    #define PERCENTILE(p) (received ? latencies[(int64)((received - 1) * (p))] / 1e3 : 0.0)
+    printf("%-8s %9lu %8lu %7.3f%% %10.2f %8.1f %8.1f %8.1f %9.1f %9.1f %8lu\n",
+           mode_names[mode], (unsigned long)sent, (unsigned long)lost, sent ? 100.0 * lost / sent : 0.0,
+           gap / 1e6, PERCENTILE(0.5), PERCENTILE(0.99), PERCENTILE(0.999), PERCENTILE(1.0),
+           rotate_ns / 1e3 / done, (unsigned long)send_errors);
+    #undef PERCENTILE
+    if (bench->capture_drops) {
+        printf("%-8s (%lu probes dropped by the capture ring, counted as lost)\n",
+               mode_names[mode], (unsigned long)bench->capture_drops);
+    }
+    return 0;
+}
+
+/**
+ * @brief Measures the traffic lost while the sender's address is rotated with each strategy.
+ *
+ * Needs CAP_SYS_ADMIN (namespaces) and CAP_NET_ADMIN/CAP_NET_RAW in them;
+ * nothing outside the two private namespaces is touched.
+ *
+ * @param options Rate, rotations per strategy and interval.
+ * @return int 0 on success, or a negative errno.
+ */
+int disruption_bench(const DisruptionOptions *options) {
+    int home = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (home < 0) {
+        return -errno;
+    }
+    Bench bench = { .rate = options->rate, .tx_netns = -1, .rx_netns = -1 };
+    int64 duration_ms = WARMUP_MS + TAIL_MS + options->rotations * options->interval_ns / 1000000 + 1000;
+    bench.capacity = options->rate * duration_ms / 1000 + PROBE_BATCH;
+    bench.arrival = calloc(bench.capacity, sizeof(int64));
+    bench.latency = calloc(bench.capacity, sizeof(int64));
+    int result = bench.arrival && bench.latency ? 0 : -ENOMEM;
+    if (result == 0) {
+        result = bench.tx_netns = netns_create();
+    }
+    if (result >= 0) {
+        result = bench.rx_netns = netns_create();
+    }
+
+    // Everything from here on happens in the sender's namespace
+    int socket_fd = -1, ioctl_fd = -1;
+    int32 tx_ifindex = 0;
+    NetlinkBatch *batch = NULL;
+    if (result >= 0 && setns(bench.tx_netns, CLONE_NEWNET) < 0) {
+        result = -errno;
+    }
+    if (result >= 0) {
+        result = socket_fd = netlink_open(0);
+    }
+    if (result >= 0) {
+        result = netlink_add_veth(socket_fd, "mmq-tx", "mmq-rx", bench.rx_netns);
+    }
+    if (result >= 0) {
+        result = configure_end("mmq-tx", 1);
+        tx_ifindex = result;
+    }
+    if (result >= 0) {
+        result = setns(bench.rx_netns, CLONE_NEWNET) < 0 ? -errno : configure_end("mmq-rx", 2);
+        bench.rx_ifindex = result;
+        setns(bench.tx_netns, CLONE_NEWNET);
+    }
+    if (result >= 0) {
+        ioctl_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        batch = malloc(sizeof(*batch));
+        result = ioctl_fd < 0 ? -errno : batch == NULL ? -ENOMEM : 0;
+    }
+
+    if (result >= 0) {
+        netlink_batch_init(batch, socket_fd, NULL, NULL);
+        pause_ns(100000000);                               // Carrier and IPv6 autoconfiguration
+        printf("%lu probes/s, %d rotations every %lu ms per strategy (gap in ms, latency and rotation in us)\n",
+               (unsigned long)options->rate, options->rotations, (unsigned long)(options->interval_ns / 1000000));
+        printf("%-8s %9s %8s %8s %10s %8s %8s %8s %9s %9s %8s\n", "strategy", "sent", "lost", "loss",
+               "gap", "p50", "p99", "p99.9", "max", "rotate", "refused");
+        fflush(stdout);
+        for (RotationMode mode = 0; mode < MODE_COUNT && result >= 0; mode++) {
+            result = run_mode(&bench, mode, options, ioctl_fd, batch, tx_ifindex);
+            fflush(stdout);
+        }
+    }
+
+    if (tx_ifindex) {
+        netlink_delete_link(socket_fd, tx_ifindex);
+    }
+    if (ioctl_fd >= 0) close(ioctl_fd);
+    if (socket_fd >= 0) close(socket_fd);
+    setns(home, CLONE_NEWNET);
+    if (bench.tx_netns >= 0) close(bench.tx_netns);
+    if (bench.rx_netns >= 0) close(bench.rx_netns);
+    close(home);
+    free(batch);
+    free(bench.arrival);
+    free(bench.latency);
+    return result < 0 ? result : 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_DISRUPT_H
+#define MACMASQ_DISRUPT_H
+
+// Including required C Header files
+#include "macmasq.h"       // for the integer typedefs
+
+// Frames sent per second when none is given on the command line
+#define DISRUPTION_DEFAULT_RATE 50000
+// Rotations per strategy
+#define DISRUPTION_DEFAULT_ROTATIONS 5
+// Time between two rotations, in milliseconds
+#define DISRUPTION_DEFAULT_INTERVAL_MS 500
+
+/**
+* @brief Load and pace of a disruption benchmark.
+*/
+typedef struct disruption_options {
+    int64 rate;                          // UDP frames sent per second
+    int rotations;                       // Rotations per strategy
+    int64 interval_ns;                   // Time between two rotations
+} DisruptionOptions;
+
+int disruption_bench(const DisruptionOptions *options);
+
+#endif // MACMASQ_DISRUPT_H
@@ -0,0 +1,268 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Journal of the address every interface had before macmasq first changed
+ * it, for interfaces that report no permanent address (veth, bridges,
+ * macvlan and other software devices).
+ *
+ * The file is a header followed by fixed-size records appended with one
+ * write() each, which O_APPEND keeps whole when several processes append
+ * at once. Only the first record of an interface counts: it holds the
+ * address from before any change. Records are keyed by network namespace
+ * and ifindex, and carry the name as a check against reused indexes.
+ *
+ * Opening reads every record into memory and indexes them in an
+ * open-addressing table, so a process rotating many interfaces writes one
+ * record per interface it is the first to change and nothing after that.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdlib.h>                // for malloc, realloc, free
+#include <string.h>                // for memcpy, strncmp
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <unistd.h>                // for read, write, close
+#include <sys/file.h>              // for flock
+#include "journal.h"               // for the journal declared here
+
+// Identifies a journal file ("MMQJOURN")
+#define JOURNAL_MAGIC 0x4E52554F4A514D4DUL
+// Bumped whenever the layout of the records changes
+#define JOURNAL_VERSION 1
+
+/**
+* @brief First bytes of the journal file.
+*/
+typedef struct journal_header {
+    int64 magic;                         // JOURNAL_MAGIC
+    int32 version;                       // JOURNAL_VERSION
+    int32 record_size;                   // sizeof(JournalRecord)
+} JournalHeader;
+
+/**
+* @brief The original address of one interface.
+*/
+typedef struct journal_record {
+    int64 netns;                         // Inode of the network namespace
+    int32 ifindex;                       // Interface index within it
+    char name[IFNAMSIZ];                 // Interface name when the record was written
+    MacAddress original;                 // Address before the first change
+    int8 reserved[2];
+} JournalRecord;
+
+/**
+ * @brief Returns the home position of an interface in the index.
+ */
+static int index_home(const Journal *journal, int64 netns, int32 ifindex) {
+    return (int)(((netns << 32 | ifindex) * 0x9E3779B97F4A7C15UL) >> 32) & journal->index_mask;
+}
+
+/**
+ * @brief Finds the first record of an interface.
+ *
+ * @return int Its position in records, or -1 if there is none.
+ */
+static int find_record(const Journal *journal, int64 netns, int32 ifindex) {
+    for (int at = index_home(journal, netns, ifindex);; at = (at + 1) & journal->index_mask) {
+        int record = journal->index[at];
+        if (record < 0 || (journal->records[record].netns == netns && journal->records[record].ifindex == ifindex)) {
+            return record;
+        }
+    }
+}
+
+/**
+ * @brief Doubles the room for records and rebuilds the index at twice that size.
+ *
+ * @return int 0 on success, or -ENOMEM.
+ */
+static int grow_records(Journal *journal) {
+    int capacity = journal->capacity ? journal->capacity * 2 : 64;
+    JournalRecord *records = realloc(journal->records, capacity * sizeof(*records));
+    if (records != NULL) {
+        journal->records = records;
+    }
+    int *index = malloc(2 * capacity * sizeof(*index));
+    if (records == NULL || index == NULL) {
+        free(index);
+        return -ENOMEM;
+    }
+    free(journal->index);
+    journal->capacity = capacity;
+    journal->index = index;
+    journal->index_mask = 2 * capacity - 1;
+    memset(index, 0xFF, 2 * capacity * sizeof(*index));
+    for (int i = 0; i < journal->count; i++) {
+        int at = index_home(journal, records[i].netns, records[i].ifindex);
+        while (index[at] >= 0 && (records[index[at]].netns != records[i].netns ||
+                                  records[index[at]].ifindex != records[i].ifindex)) {
+            at = (at + 1) & journal->index_mask;
+        }
+        if (index[at] < 0) {
+            index[at] = i;                                 // Only the first record of an interface is indexed
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Adds a record to memory and, unless its interface already has one, to the index.
+ *
+ * @return int 0 on success, or -ENOMEM.
+ */
+static int add_record(Journal *journal, const JournalRecord *record) {
+    int result = journal->count == journal->capacity ? grow_records(journal) : 0;
+    if (result < 0) {
+        return result;
+    }
+    int position = journal->count++;
+    journal->records[position] = *record;
+    int at = index_home(journal, record->netns, record->ifindex);
+    while (journal->index[at] >= 0) {
+        const JournalRecord *other = &journal->records[journal->index[at]];
+        if (other->netns == record->netns && other->ifindex == record->ifindex) {
+            return 0;                                      // Not the first record of the interface
+        }
+        at = (at + 1) & journal->index_mask;
+    }
+    journal->index[at] = position;
+    return 0;
+}
+
+/**
+ * @brief Opens (creating if needed) a journal and reads its records.
+ *
+ * @param journal Receives the open journal.
+ * @param path The journal file, normally JOURNAL_DEFAULT_PATH.
+ * @return int 0 on success, or a negative errno.
+ */
+int journal_open(Journal *journal, const char *path) {
+    memset(journal, 0, sizeof(*journal));
+    journal->fd = open_state_file(path, O_RDWR | O_APPEND | O_CLOEXEC | O_CREAT, 0644);
+    if (journal->fd < 0) {
+        return journal->fd;
+    }
+    pthread_mutex_init(&journal->lock, NULL);
+
+    // The lock only keeps two processes from both writing the header of a new file
+    int result = 0;
+    while (flock(journal->fd, LOCK_EX) < 0) {
+        if (errno != EINTR) {
+            result = -errno;
+            break;
+        }
+    }
+    JournalHeader header;
+    ssize_t got = result == 0 ? pread(journal->fd, &header, sizeof(header), 0) : 0;
+    if (result == 0 && got == 0) {
+        header = (JournalHeader){ .magic = JOURNAL_MAGIC, .version = JOURNAL_VERSION,
+                                  .record_size = sizeof(JournalRecord) };
+        if (write(journal->fd, &header, sizeof(header)) != sizeof(header)) {
+            result = -EIO;
+        }
+    } else if (result == 0 && (got != sizeof(header) || header.magic != JOURNAL_MAGIC ||
+                               header.version != JOURNAL_VERSION || header.record_size != sizeof(JournalRecord))) {
+        result = -EINVAL;
+    }
+    flock(journal->fd, LOCK_UN);
+
+    // Read every complete record; a torn one at the end is ignored
+    JournalRecord record;
+    for (off_t offset = sizeof(header); result == 0; offset += sizeof(record)) {
+        got = pread(journal->fd, &record, sizeof(record), offset);
+        if (got != sizeof(record)) {
+            result = got < 0 ? -errno : 0;
+            break;
+        }
+        result = add_record(journal, &record);
+    }
+    if (result == 0 && journal->index == NULL) {
+        result = grow_records(journal);                    // Empty journal: allocate the index
+    }
+    if (result < 0) {
+        journal_close(journal);
+    }
+    return result;
+}
+
+/**
+ * @brief Records the address an interface had before a successful change,
+ * if nothing is known about the interface yet.
+ *
+ * @param journal An open journal, or NULL to record nothing.
+ * @param rotation The rotation, after it was applied.
+ * @param netns Namespace of the interface, as returned by registry_netns().
+ */
+void journal_record(Journal *journal, const LinkRotation *rotation, int64 netns) {
+    static const MacAddress zero = { { 0 } };
+    if (journal == NULL || journal->fd < 0 || rotation->error != 0 || rotation->ifindex == 0 ||
+        mac_equal(rotation->old_mac, zero)) {
+        return;
+    }
+    pthread_mutex_lock(&journal->lock);
+    if (find_record(journal, netns, rotation->ifindex) < 0) {
+        JournalRecord record = { .netns = netns, .ifindex = rotation->ifindex, .original = rotation->old_mac };
+        memcpy(record.name, rotation->name, IFNAMSIZ);
+        if (write(journal->fd, &record, sizeof(record)) == sizeof(record)) {
+            add_record(journal, &record);
+        }
+    }
+    pthread_mutex_unlock(&journal->lock);
+}
+
+/**
+ * @brief Finds the original address of an interface.
+ *
+ * @param journal An open journal, or NULL.
+ * @param netns Namespace of the interface.
+ * @param ifindex Index of the interface.
+ * @param name Current name; a record written under another name belongs to an earlier interface.
+ * @param original Receives the address.
+ * @return bool true if the journal knows the interface.
+ */
+bool journal_lookup(Journal *journal, int64 netns, int32 ifindex, const char *name, MacAddress *original) {
+    if (journal == NULL || journal->fd < 0) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->lock);
+    int record = find_record(journal, netns, ifindex);
+    bool found = record >= 0 && strncmp(journal->records[record].name, name, IFNAMSIZ) == 0;
+    if (found) {
+        *original = journal->records[record].original;
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return found;
+}
+
+/**
+ * @brief Closes a journal and frees its records.
+ */
+void journal_close(Journal *journal) {
+    if (journal->fd >= 0) {
+        close(journal->fd);
+        pthread_mutex_destroy(&journal->lock);
+        journal->fd = -1;
+    }
+    free(journal->records);
+    free(journal->index);
+    journal->records = NULL;
+    journal->index = NULL;
+}
@@ -0,0 +1,48 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_JOURNAL_H
+#define MACMASQ_JOURNAL_H
+
+// Including required C Header files
+#include <pthread.h>       // for pthread_mutex_t
+#include "netlink.h"       // for LinkRotation
+
+// Journal used when none is given on the command line (on tmpfs: it lives exactly as long as the changed addresses)
+#define JOURNAL_DEFAULT_PATH "/run/macmasq/journal"
+
+struct journal_record;
+
+/**
+* @brief An open journal of original addresses, with an index of its records.
+*/
+typedef struct journal {
+    int fd;                              // The journal, opened for appending
+    pthread_mutex_t lock;                // Serializes the workers of --parallel
+    struct journal_record *records;      // Every record of the file, oldest first
+    int count;                           // Entries of records
+    int capacity;                        // Allocated entries of records
+    int *index;                          // Open-addressing index of records by namespace and ifindex, -1 if empty
+    int index_mask;                      // Entries of index minus one
+} Journal;
+
+int journal_open(Journal *journal, const char *path);
+void journal_record(Journal *journal, const LinkRotation *rotation, int64 netns);
+bool journal_lookup(Journal *journal, int64 netns, int32 ifindex, const char *name, MacAddress *original);
+void journal_close(Journal *journal);
+
+#endif // MACMASQ_JOURNAL_H
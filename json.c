@@ -0,0 +1,176 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <string.h>        // for memcpy, strlen, strerror
+#include <errno.h>         // for EINTR
+#include <unistd.h>        // for write
+#include "json.h"          // for the JSON writer declared here
+
+/**
+ * @brief Prepares a writer.
+ *
+ * @param writer The writer to initialise.
+ * @param fd Destination file descriptor.
+ * @param buffer Output buffer, at least JSON_RECORD_MAX bytes long.
+ * @param capacity Size of buffer.
+ */
+void json_writer_init(JsonWriter *writer, int fd, char *buffer, size_t capacity) {
+    writer->fd = fd;
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    writer->length = 0;
+    writer->error = 0;
+}
+
+/**
+ * @brief Writes out everything buffered so far.
+ *
+ * @return int 0 on success, or a negative errno if write() failed.
+ */
+int json_writer_flush(JsonWriter *writer) {
+    size_t offset = 0;
+    while (offset < writer->length) {
+        ssize_t written = write(writer->fd, writer->buffer + offset, writer->length - offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;                  // Retry when interrupted by a signal
+            writer->error = errno;
+            break;
+        }
+        offset += (size_t)written;
+    }
+    writer->length = 0;
+    return writer->error ? -writer->error : 0;
+}
+
+/**
+ * @brief Appends raw bytes to the buffer.
+ */
+static void put(JsonWriter *writer, const char *text, size_t length) {
+    memcpy(writer->buffer + writer->length, text, length);
+    writer->length += length;
+}
+
+/**
+ * @brief Appends a null-terminated literal to the buffer.
+ */
+static void put_literal(JsonWriter *writer, const char *text) {
+    put(writer, text, strlen(text));
+}
+
+/**
+ * @brief Appends a quoted and escaped JSON string.
+ */
+static void put_string(JsonWriter *writer, const char *text) {
+    static const char hex[] = "0123456789abcdef";
+    put(writer, "\"", 1);
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            char escaped[2] = { '\\', (char)*c };
+            put(writer, escaped, 2);
+        } else if (*c < 0x20) {
+            char escaped[6] = { '\\', 'u', '0', '0', hex[*c >> 4], hex[*c & 0xF] };
+            put(writer, escaped, 6);
+        } else {
+            put(writer, (const char *)c, 1);
+        }
+    }
+    put(writer, "\"", 1);
+}
+
+/**
+ * @brief Appends an unsigned integer.
+ */
+static void put_uint(JsonWriter *writer, int64 value) {
+    writer->length += format_uint(writer->buffer + writer->length, value);
+}
+
+/**
+ * @brief Appends a nanosecond duration, or null when it was not measured.
+ */
+static void put_duration(JsonWriter *writer, int64 value) {
+    if (value == 0) {
+        put_literal(writer, "null");
+    } else {
+        put_uint(writer, value);
+    }
+}
+
+/**
+ * @brief Appends a quoted MAC address, or null for the all-zero (unknown) address.
+ */
+static void put_mac(JsonWriter *writer, MacAddress mac) {
+    static const MacAddress unknown;
+    if (mac_equal(mac, unknown)) {
+        put_literal(writer, "null");
+        return;
+    }
+    char text[MAC_STRING_LENGTH + 1];
+    mac_format(mac, text);
+    put(writer, "\"", 1);
+    put(writer, text, MAC_STRING_LENGTH);
+    put(writer, "\"", 1);
+}
+
+/**
+ * @brief Appends one NDJSON record describing a MAC change.
+ *
+ * Example (on one line):
+ *   {"ifindex":3,"ifname":"eth0","old_mac":"52:54:00:12:34:56","new_mac":"7E:...",
+ *    "backend":"ioctl","timings_ns":{"down":21000,"set":4000,"up":30500,"total":61000},
+ *    "errno":0,"error":null,"retries":0}
+ *
+ * @param writer The writer to append to.
+ * @param rotation The change to describe.
+ */
+void json_write_rotation(JsonWriter *writer, const LinkRotation *rotation) {
+    if (writer->capacity - writer->length < JSON_RECORD_MAX) {
+        json_writer_flush(writer);                         // Make room for a worst case record
+    }
+    put_literal(writer, "{\"ifindex\":");
+    put_uint(writer, rotation->ifindex);
+    put_literal(writer, ",\"ifname\":");
+    put_string(writer, rotation->name);
+    put_literal(writer, ",\"old_mac\":");
+    put_mac(writer, rotation->old_mac);
+    put_literal(writer, ",\"new_mac\":");
+    put_mac(writer, rotation->new_mac);
+    put_literal(writer, ",\"backend\":\"");
+    put_literal(writer, backend_name(rotation->backend));
+    put_literal(writer, "\",\"timings_ns\":{\"down\":");
+    put_duration(writer, rotation->down_ns);
+    put_literal(writer, ",\"set\":");
+    put_duration(writer, rotation->set_ns);
+    put_literal(writer, ",\"up\":");
+    put_duration(writer, rotation->up_ns);
+    put_literal(writer, ",\"total\":");
+    put_duration(writer, rotation->total_ns);
+    put_literal(writer, "},\"errno\":");
+    put_uint(writer, (int64)rotation->error);
+    put_literal(writer, ",\"error\":");
+    if (rotation->error != 0) {
+        put_string(writer, strerror(rotation->error));
+    } else {
+        put_literal(writer, "null");
+    }
+    put_literal(writer, ",\"retries\":");
+    put_uint(writer, (int64)rotation->retries);
+    put_literal(writer, "}\n");
+}
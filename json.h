@@ -0,0 +1,48 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_JSON_H
+#define MACMASQ_JSON_H
+
+// Including required C Header files
+#include "netlink.h"       // for LinkRotation
+
+// Default size of the output buffer of a JSON writer
+#define JSON_WRITER_BUFFER_SIZE 65536
+// Upper bound on the length of one record; the buffer is flushed when less room is left
+#define JSON_RECORD_MAX 1024
+
+/**
+* @brief Buffered NDJSON output over a caller-supplied buffer.
+*
+* Records are formatted straight into the buffer and handed to write()
+* only when it fills up or on an explicit flush: nothing is allocated per
+* record and stdio is not involved.
+*/
+typedef struct json_writer {
+    int fd;                              // Destination file descriptor
+    char *buffer;                        // Output buffer, owned by the caller
+    size_t capacity;                     // Size of buffer
+    size_t length;                       // Bytes waiting in buffer
+    int error;                           // First errno returned by write(), 0 if none
+} JsonWriter;
+
+void json_writer_init(JsonWriter *writer, int fd, char *buffer, size_t capacity);
+void json_write_rotation(JsonWriter *writer, const LinkRotation *rotation);
+int json_writer_flush(JsonWriter *writer);
+
+#endif // MACMASQ_JSON_H
@@ -0,0 +1,270 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Kernel backends.
+ *
+ * The daemon reaches the kernel through four operations only: dump the
+ * links, apply a set of rotations with one of the backends (ioctl, netlink
+ * one request per round trip, netlink batch), drain link events, and read
+ * the clock its deadlines are expressed in. A backend may also name the
+ * driver of a link, by which the daemon keeps its cost model. This file
+ * holds the real implementation; sim.c holds an in-memory kernel with a virtual clock that
+ * implements the same operations, so that the scheduler can run against a
+ * million interfaces without privileges.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for snprintf
+#include <stdlib.h>                // for malloc, free
+#include <string.h>                // for memset, memcpy
+#include <errno.h>                 // for error number definitions
+#include <unistd.h>                // for close
+#include <sys/socket.h>            // for socket, recv, setsockopt
+#include <sys/ioctl.h>             // for ioctl
+#include <net/if.h>                // for if_indextoname, struct ifreq
+#include <linux/netlink.h>         // for netlink message definitions
+#include <linux/rtnetlink.h>       // for RTMGRP_LINK, RTM_NEWLINK, RTM_DELLINK
+#include <linux/ethtool.h>         // for ETHTOOL_GDRVINFO
+#include <linux/sockios.h>         // for SIOCETHTOOL
+#include "workpool.h"              // for ioctl_rotate
+#include "kernel.h"                // for the declarations implemented here
+
+// Receive buffer requested for the event socket, to ride out bursts of link events
+#define KERNEL_EVENT_BUFFER (4 << 20)
+
+/**
+* @brief The running kernel, reached through rtnetlink and ioctl.
+*/
+typedef struct linux_kernel {
+    Kernel base;                         // Operations and event fd (an RTMGRP_LINK socket)
+    int request_fd;                      // rtnetlink socket for dumps and changes
+    int ioctl_fd;                        // Datagram socket for SIOCSIFFLAGS / SIOCSIFHWADDR
+    NetlinkBatch batch;                  // Reused for every netlink rotation
+    char buffer[65536] __attribute__((aligned(8)));  // Receives link events
+} LinuxKernel;
+
+/**
+ * @brief Returns CLOCK_MONOTONIC.
+ */
+static int64 linux_now(Kernel *kernel) {
+    (void)kernel;
+    return monotonic_ns();
+}
+
+/**
+ * @brief Dumps the links of the current namespace.
+ */
+static int linux_dump_links(Kernel *kernel, link_visitor visit, void *context) {
+    LinuxKernel *linux_kernel = (LinuxKernel *)kernel;
+    return netlink_dump_links(linux_kernel->request_fd, visit, context);
+}
+
+/**
+ * @brief Applies rotations with the requested backend.
+ */
+static int linux_rotate(Kernel *kernel, LinkRotation *rotations, int count, MacBackend backend) {
+    LinuxKernel *linux_kernel = (LinuxKernel *)kernel;
+    switch (backend) {
+    case BACKEND_IOCTL:
+        for (int i = 0; i < count; i++) {
+            LinkRotation *rotation = &rotations[i];
+            int32 flags = rotation->flags;
+            int64 started = monotonic_ns();
+            if (rotation->live) {
+                rotation->flags &= ~IFF_UP;                // Neither down nor up around the change
+            }
+            if (rotation->name[0] == '\0' && if_indextoname(rotation->ifindex, rotation->name) == NULL) {
+                rotation->error = errno;                   // The daemon passes ifindexes only
+                rotation->flags = flags;
+                continue;
+            }
+            ioctl_rotate(linux_kernel->ioctl_fd, rotation);
+            rotation->flags = flags;
+            rotation->total_ns = monotonic_ns() - started;
+        }
+        return 0;
+    case BACKEND_NETLINK:
+        for (int i = 0; i < count; i++) {
+            int result = netlink_rotate(&linux_kernel->batch, &rotations[i], 1);
+            if (result < 0 && rotations[i].error == 0) {
+                rotations[i].error = -result;
+            }
+            rotations[i].backend = BACKEND_NETLINK;
+        }
+        return 0;
+    case BACKEND_NETLINK_BATCH:
+        return netlink_rotate(&linux_kernel->batch, rotations, count);
+    }
+    return -EINVAL;
+}
+
+/**
+ * @brief Drains the RTMGRP_LINK socket.
+ */
+static int linux_read_events(Kernel *kernel, link_event_visitor visit, void *context) {
+    LinuxKernel *linux_kernel = (LinuxKernel *)kernel;
+    for (;;) {
+        ssize_t received = recv(kernel->event_fd, linux_kernel->buffer, sizeof(linux_kernel->buffer), MSG_DONTWAIT);
+        if (received < 0) {
+            if (errno == EINTR) continue;                  // Retry when interrupted by a signal
+            if (errno == EAGAIN) return 0;                 // Drained
+            return -errno;                                 // ENOBUFS: events were dropped
+        }
+        LinkEvent event;
+        event.time_ns = monotonic_ns();
+        int remaining = (int)received;
+        for (struct nlmsghdr *header = (struct nlmsghdr *)linux_kernel->buffer; NLMSG_OK(header, remaining);
+             header = NLMSG_NEXT(header, remaining)) {
+            if (header->nlmsg_type != RTM_NEWLINK && header->nlmsg_type != RTM_DELLINK) {
+                continue;
+            }
+            netlink_parse_link(header, &event.link);
+            event.deleted = header->nlmsg_type == RTM_DELLINK;
+            visit(&event, context);
+        }
+    }
+}
+
+/**
+ * @brief Reads the driver of a link (ETHTOOL_GDRVINFO).
+ */
+static int linux_driver(Kernel *kernel, const LinkInfo *link, char *driver, int size) {
+    LinuxKernel *linux_kernel = (LinuxKernel *)kernel;
+    struct ethtool_drvinfo info = { .cmd = ETHTOOL_GDRVINFO };
+    struct ifreq request;
+    memset(&request, 0, sizeof(request));
+    memcpy(request.ifr_name, link->name, IFNAMSIZ - 1);   // Both are IFNAMSIZ bytes, NUL-terminated
+    request.ifr_data = (char *)&info;
+    if (ioctl(linux_kernel->ioctl_fd, SIOCETHTOOL, &request) < 0) {
+        return -errno;
+    }
+    snprintf(driver, size, "%.*s", (int)sizeof(info.driver), info.driver);
+    return 0;
+}
+
+/**
+ * @brief Closes the sockets.
+ */
+static void linux_close(Kernel *kernel) {
+    LinuxKernel *linux_kernel = (LinuxKernel *)kernel;
+    int fds[] = { linux_kernel->request_fd, linux_kernel->ioctl_fd, kernel->event_fd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    free(linux_kernel);
+}
+
+static const KernelOps linux_ops = {
+    .name = "linux",
+    .now = linux_now,
+    .dump_links = linux_dump_links,
+    .rotate = linux_rotate,
+    .read_events = linux_read_events,
+    .idle = NULL,
+    .pending = NULL,
+    .driver = linux_driver,
+    .close = linux_close,
+};
+
+/**
+ * @brief Opens the backend of the running kernel (current network namespace).
+ *
+ * @param kernel Receives the backend; its event_fd is an RTMGRP_LINK socket.
+ * @return int 0 on success, or a negative errno.
+ */
+int linux_kernel_open(Kernel **kernel) {
+    LinuxKernel *linux_kernel = malloc(sizeof(*linux_kernel));
+    if (linux_kernel == NULL) {
+        return -ENOMEM;
+    }
+    linux_kernel->base.ops = &linux_ops;
+    linux_kernel->request_fd = netlink_open(0);
+    linux_kernel->base.event_fd = netlink_open(RTMGRP_LINK);
+    linux_kernel->ioctl_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    int result = linux_kernel->request_fd < 0 ? (int)linux_kernel->request_fd
+               : linux_kernel->base.event_fd < 0 ? (int)linux_kernel->base.event_fd
+               : linux_kernel->ioctl_fd < 0 ? -errno : 0;
+    if (result < 0) {
+        linux_close(&linux_kernel->base);
+        return result;
+    }
+    int size = KERNEL_EVENT_BUFFER;
+    if (setsockopt(linux_kernel->base.event_fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(linux_kernel->base.event_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    netlink_batch_init(&linux_kernel->batch, linux_kernel->request_fd, NULL, NULL);
+    *kernel = &linux_kernel->base;
+    return 0;
+}
+
+/**
+ * @brief Returns the backend's current time.
+ */
+int64 kernel_now(Kernel *kernel) {
+    return kernel->ops->now(kernel);
+}
+
+/**
+ * @brief Calls visit for every link of the namespace.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+int kernel_dump_links(Kernel *kernel, link_visitor visit, void *context) {
+    return kernel->ops->dump_links(kernel, visit, context);
+}
+
+/**
+ * @brief Applies a set of MAC changes with one backend (per-rotation errors land in each entry).
+ *
+ * @return int 0 if the requests were delivered, or a negative errno.
+ */
+int kernel_rotate(Kernel *kernel, LinkRotation *rotations, int count, MacBackend backend) {
+    return kernel->ops->rotate(kernel, rotations, count, backend);
+}
+
+/**
+ * @brief Calls visit for every pending link event, without blocking.
+ *
+ * @return int 0 once drained, -ENOBUFS if events were lost (dump again), or a negative errno.
+ */
+int kernel_read_events(Kernel *kernel, link_event_visitor visit, void *context) {
+    return kernel->ops->read_events(kernel, visit, context);
+}
+
+/**
+ * @brief Names the driver of a link, for backends that can tell.
+ *
+ * @return int 0 on success, -EOPNOTSUPP if the backend cannot tell, or a negative errno.
+ */
+int kernel_driver(Kernel *kernel, const LinkInfo *link, char *driver, int size) {
+    return kernel->ops->driver ? kernel->ops->driver(kernel, link, driver, size) : -EOPNOTSUPP;
+}
+
+/**
+ * @brief Releases a backend (NULL is ignored).
+ */
+void kernel_close(Kernel *kernel) {
+    if (kernel != NULL) {
+        kernel->ops->close(kernel);
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_KERNEL_H
+#define MACMASQ_KERNEL_H
+
+// Including required C Header files
+#include "netlink.h"       // for LinkInfo and LinkRotation
+
+typedef struct kernel Kernel;
+
+/**
+* @brief One link notification (RTM_NEWLINK or RTM_DELLINK).
+*/
+typedef struct link_event {
+    LinkInfo link;                       // State of the link after the change
+    bool deleted;                        // True for RTM_DELLINK
+    int64 time_ns;                       // When the kernel sent it (the backend's clock)
+} LinkEvent;
+
+// Called once for every link event read from the backend
+typedef void (*link_event_visitor)(const LinkEvent *event, void *context);
+
+/**
+* @brief What a kernel backend implements.
+*/
+typedef struct kernel_ops {
+    const char *name;                                            // "linux", "sim"
+    int64 (*now)(Kernel *kernel);                                // Clock every deadline is expressed in
+    int (*dump_links)(Kernel *kernel, link_visitor visit, void *context);
+    int (*rotate)(Kernel *kernel, LinkRotation *rotations, int count, MacBackend backend);
+    int (*read_events)(Kernel *kernel, link_event_visitor visit, void *context);
+    int64 (*idle)(Kernel *kernel, int64 until_ns);               // Virtual clocks only, NULL otherwise
+    bool (*pending)(Kernel *kernel);                             // Events still to come (replays), may be NULL
+    int (*driver)(Kernel *kernel, const LinkInfo *link, char *driver, int size);  // Driver of a link, may be NULL
+    void (*close)(Kernel *kernel);
+} KernelOps;
+
+/**
+* @brief A kernel backend: the real one, or a simulation.
+*/
+struct kernel {
+    const KernelOps *ops;                // Implementation
+    int event_fd;                        // Readable when read_events has work, -1 if the backend has no fd
+};
+
+int linux_kernel_open(Kernel **kernel);
+
+int64 kernel_now(Kernel *kernel);
+int kernel_dump_links(Kernel *kernel, link_visitor visit, void *context);
+int kernel_rotate(Kernel *kernel, LinkRotation *rotations, int count, MacBackend backend);
+int kernel_read_events(Kernel *kernel, link_event_visitor visit, void *context);
+int kernel_driver(Kernel *kernel, const LinkInfo *link, char *driver, int size);
+void kernel_close(Kernel *kernel);
+
+#endif // MACMASQ_KERNEL_H
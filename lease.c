@@ -0,0 +1,710 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Lease allocator over one block of 2^24 addresses (the three bytes that
+ * follow an OUI), shared by every macmasq process on the host through one
+ * mmap'd file.
+ *
+ * Two bitmap levels track the block: one bit per address, and one summary
+ * bit per 64-bit bitmap word that is full. The first free address is found
+ * by skipping full summary words and taking the lowest clear bit of a
+ * summary word and then of the bitmap word it points to. A hint remembers
+ * the lowest summary word that may have room, which makes allocation O(1)
+ * amortized.
+ *
+ * Leases with an expiry are records chained into a timing wheel indexed by
+ * expiry second. The wheel is advanced lazily by whichever process touches
+ * the file next, so expiry needs no background process.
+ *
+ * Processes serialize on flock(), which the kernel releases when a holder
+ * dies. Every change that could be torn by a crash is bracketed by an
+ * intent record in the header; the next process to take the lock sees it,
+ * undoes the interrupted operation and rebuilds the derived state (summary,
+ * counters, free record list) from the bitmap and the wheel.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdlib.h>                // for calloc, free
+#include <string.h>                // for memcpy, memcmp
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <unistd.h>                // for close, ftruncate
+#include <time.h>                  // for clock_gettime
+#include <sys/file.h>              // for flock
+#include <sys/mman.h>              // for mmap
+#include <sys/stat.h>              // for fstat
+#include "lease.h"                 // for the allocator declared here
+
+// Identifies a lease file ("MMQLEASE")
+#define LEASE_MAGIC 0x455341454C514D4DUL
+// Bumped whenever the layout of the file changes
+#define LEASE_VERSION 1
+// A bitmap or summary word with every bit set
+#define LEASE_FULL (~0UL)
+
+/**
+* @brief Operation in progress, recorded so that a crash can be repaired.
+*/
+typedef enum lease_intent {
+    INTENT_NONE,                         // Nothing in progress
+    INTENT_ALLOC,                        // Allocating intent_offset (undone on recovery)
+    INTENT_FREE,                         // Releasing intent_offset (completed on recovery)
+    INTENT_RENEW,                        // Moving the expiry of intent_offset to intent_expires
+} LeaseIntent;
+
+/**
+* @brief First page of the lease file.
+*/
+typedef struct lease_header {
+    int64 magic;                         // LEASE_MAGIC once the file is initialised
+    int32 version;                       // LEASE_VERSION
+    int8 block[3];                       // OUI of the block
+    int8 reserved;
+    int64 used;                          // Addresses leased
+    int64 timed;                         // Records chained into the wheel
+    int64 recoveries;                    // Interrupted operations repaired
+    int64 wheel_tick;                    // Last tick the wheel was advanced to, 0 before the first
+    int32 hint;                          // Lowest summary word that may have a clear bit
+    int32 free_record;                   // Head of the free record list, 0 if empty
+    int32 record_high;                   // Records ever used (records 1..record_high)
+    int32 intent_kind;                   // LeaseIntent of the operation in progress
+    int32 intent_offset;                 // Address the operation is about
+    int32 reserved2;
+    int64 intent_expires;                // New expiry of an INTENT_RENEW
+} LeaseHeader;
+
+/**
+* @brief A lease with an expiry, chained into one wheel slot.
+*/
+typedef struct lease_record {
+    int32 offset;                        // Address within the block
+    int32 next;                          // Next record of the slot (or of the free list), 0 at the end
+    int64 expires;                       // Expiry, in CLOCK_REALTIME seconds
+} LeaseRecord;
+
+/**
+* @brief Layout of the lease file, mapped as a whole.
+*/
+typedef struct lease_file {
+    union {
+        LeaseHeader header;
+        char page[4096];                 // Keeps the bitmaps page aligned
+    };
+    int64 summary[LEASE_SUMMARY_WORDS];  // Bit set when the matching bitmap word is full
+    int64 words[LEASE_WORDS];            // Bit set when the matching address is leased
+    int32 wheel[LEASE_WHEEL_SLOTS];      // First record of each slot, 0 if empty
+    LeaseRecord records[LEASE_MAX_TIMED + 1]; // Record 0 is never used
+} LeaseFile;
+
+/**
+ * @brief Reads the wall clock in seconds; leases outlive reboots, so the monotonic clock will not do.
+ */
+static int64 now_s(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64)now.tv_sec;
+}
+
+/**
+ * @brief Returns the wheel slot of an expiry.
+ */
+static int32 wheel_slot(int64 expires) {
+    return (int32)((expires / LEASE_TICK_S) % LEASE_WHEEL_SLOTS);
+}
+
+/**
+ * @brief Records the operation about to start.
+ *
+ * The kind is written last, with release ordering, so that a reader never
+ * sees a kind with the offset of an older operation.
+ */
+static void begin_intent(LeaseFile *file, LeaseIntent kind, int32 offset, int64 expires) {
+    file->header.intent_offset = offset;
+    file->header.intent_expires = expires;
+    __atomic_store_n(&file->header.intent_kind, kind, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Marks the operation in progress as complete.
+ */
+static void end_intent(LeaseFile *file) {
+    __atomic_store_n(&file->header.intent_kind, INTENT_NONE, __ATOMIC_RELEASE);
+}
+
+/*
+ * Bitmaps
+ */
+
+static bool is_leased(const LeaseFile *file, int32 offset) {
+    return (file->words[offset >> 6] >> (offset & 63)) & 1;
+}
+
+static void mark_leased(LeaseFile *file, int32 offset) {
+    int32 word = offset >> 6;
+    file->words[word] |= 1UL << (offset & 63);
+    if (file->words[word] == LEASE_FULL) {
+        file->summary[word >> 6] |= 1UL << (word & 63);
+    }
+}
+
+static void mark_free(LeaseFile *file, int32 offset) {
+    int32 word = offset >> 6;
+    file->words[word] &= ~(1UL << (offset & 63));
+    file->summary[word >> 6] &= ~(1UL << (word & 63));
+    if ((int32)(word >> 6) < file->header.hint) {
+        file->header.hint = word >> 6;
+    }
+}
+
+/**
+ * @brief Finds the lowest free address of the block.
+ *
+ * @return int64 The offset, or LEASE_BLOCK_SIZE if the block is exhausted.
+ */
+static int64 find_free(LeaseFile *file) {
+    for (int32 index = file->header.hint; index < LEASE_SUMMARY_WORDS; index++) {
+        int64 summary = file->summary[index];
+        if (summary == LEASE_FULL) {
+            continue;                                      // 4096 addresses all taken
+        }
+        file->header.hint = index;
+        int32 word = index * 64 + __builtin_ctzl(~summary);
+        return (int64)word * 64 + __builtin_ctzl(~file->words[word]);
+    }
+    file->header.hint = LEASE_SUMMARY_WORDS;
+    return LEASE_BLOCK_SIZE;
+}
+
+/*
+ * Timing wheel
+ */
+
+/**
+ * @brief Takes an unused record.
+ *
+ * @return int32 The record, or 0 if LEASE_MAX_TIMED leases already expire.
+ */
+static int32 take_record(LeaseFile *file) {
+    int32 record = file->header.free_record;
+    if (record != 0) {
+        file->header.free_record = file->records[record].next;
+        return record;
+    }
+    if (file->header.record_high < LEASE_MAX_TIMED) {
+        return ++file->header.record_high;
+    }
+    return 0;
+}
+
+/**
+ * @brief Chains a record into the slot of its expiry.
+ */
+static void link_record(LeaseFile *file, int32 record) {
+    int32 slot = wheel_slot(file->records[record].expires);
+    file->records[record].next = file->wheel[slot];
+    file->wheel[slot] = record;
+}
+
+/**
+ * @brief Detaches a record from a slot, given its predecessor (0 for the head).
+ */
+static void unlink_record(LeaseFile *file, int32 slot, int32 previous, int32 record) {
+    if (previous != 0) {
+        file->records[previous].next = file->records[record].next;
+    } else {
+        file->wheel[slot] = file->records[record].next;
+    }
+}
+
+/**
+ * @brief Detaches a record and returns it to the free list.
+ */
+static void release_record(LeaseFile *file, int32 slot, int32 previous, int32 record) {
+    unlink_record(file, slot, previous, record);
+    file->records[record].next = file->header.free_record;
+    file->header.free_record = record;
+    file->header.timed--;
+}
+
+/**
+ * @brief Finds the record of a leased address.
+ *
+ * Records move between slots lazily, so every slot is searched.
+ *
+ * @return int32 The record, or 0 if the lease does not expire.
+ */
+static int32 find_record(const LeaseFile *file, int32 offset, int32 *slot, int32 *previous) {
+    for (int32 index = 0; index < LEASE_WHEEL_SLOTS; index++) {
+        int32 before = 0;
+        for (int32 record = file->wheel[index]; record != 0; record = file->records[record].next) {
+            if (file->records[record].offset == offset) {
+                *slot = index;
+                *previous = before;
+                return record;
+            }
+            before = record;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Expires the due records of one slot and moves the others to their own slot.
+ *
+ * A slot holds records of every lap of the wheel, and records whose expiry
+ * was changed in place; both are sorted out here.
+ */
+static void visit_slot(LeaseFile *file, int32 slot, int64 now) {
+    int32 previous = 0;
+    int32 record = file->wheel[slot];
+    while (record != 0) {
+        LeaseRecord *lease = &file->records[record];
+        int32 next = lease->next;
+        if (lease->expires <= now) {
+            begin_intent(file, INTENT_FREE, lease->offset, 0);
+            release_record(file, slot, previous, record);
+            mark_free(file, lease->offset);
+            file->header.used--;
+            end_intent(file);
+        } else if (wheel_slot(lease->expires) != slot) {
+            begin_intent(file, INTENT_RENEW, lease->offset, lease->expires);
+            unlink_record(file, slot, previous, record);
+            link_record(file, record);
+            end_intent(file);
+        } else {
+            previous = record;
+        }
+        record = next;
+    }
+}
+
+/**
+ * @brief Advances the wheel to the current time, expiring what is due.
+ */
+static void advance_wheel(LeaseFile *file, int64 now) {
+    int64 tick = now / LEASE_TICK_S;
+    int64 last = file->header.wheel_tick;
+    if (last != 0 && tick > last) {
+        int64 count = tick - last;
+        if (count > LEASE_WHEEL_SLOTS) {
+            count = LEASE_WHEEL_SLOTS;                     // One full lap sees every record
+        }
+        for (int64 step = 1; step <= count; step++) {
+            visit_slot(file, (int32)((last + step) % LEASE_WHEEL_SLOTS), now);
+        }
+    }
+    file->header.wheel_tick = tick;
+}
+
+/*
+ * Crash recovery
+ */
+
+/**
+ * @brief Repairs the file after a process died in the middle of an operation.
+ *
+ * Allocations are undone (the caller never learned the address) and
+ * releases are completed. The wheel is then walked to drop records of free
+ * addresses and to find the reachable ones; everything else derived
+ * (summary, counters, free list, hint) is rebuilt from the bitmap and the
+ * wheel.
+ *
+ * @return int 0 on success, or -ENOMEM.
+ */
+static int recover(LeaseFile *file) {
+    LeaseHeader *header = &file->header;
+    int32 kind = __atomic_load_n(&header->intent_kind, __ATOMIC_ACQUIRE);
+    int32 offset = header->intent_offset;
+    if (offset >= LEASE_BLOCK_SIZE) {
+        return -EINVAL;
+    }
+    if (kind == INTENT_ALLOC || kind == INTENT_FREE) {
+        file->words[offset >> 6] &= ~(1UL << (offset & 63));
+    }
+    if (header->record_high > LEASE_MAX_TIMED) {
+        header->record_high = LEASE_MAX_TIMED;
+    }
+
+    int8 *reachable = calloc(LEASE_MAX_TIMED + 1, 1);
+    if (reachable == NULL) {
+        return -ENOMEM;
+    }
+    int64 timed = 0;
+    bool renewed = false;
+    for (int32 slot = 0; slot < LEASE_WHEEL_SLOTS; slot++) {
+        int32 previous = 0;
+        for (int32 record = file->wheel[slot]; record != 0;) {
+            LeaseRecord *lease = &file->records[record];
+            if (record > header->record_high || reachable[record] || lease->offset >= LEASE_BLOCK_SIZE) {
+                // A torn list: cut it here, the records past this point are collected below
+                if (previous != 0) file->records[previous].next = 0; else file->wheel[slot] = 0;
+                break;
+            }
+            int32 next = lease->next;
+            if (!is_leased(file, lease->offset)) {
+                unlink_record(file, slot, previous, record);
+            } else {
+                reachable[record] = 1;
+                timed++;
+                renewed |= kind == INTENT_RENEW && lease->offset == offset;
+                previous = record;
+            }
+            record = next;
+        }
+    }
+    header->free_record = 0;
+    for (int32 record = header->record_high; record > 0; record--) {
+        if (!reachable[record]) {
+            file->records[record].next = header->free_record;
+            header->free_record = record;
+        }
+    }
+    free(reachable);
+    header->timed = timed;
+
+    int64 used = 0;
+    for (int32 index = 0; index < LEASE_SUMMARY_WORDS; index++) {
+        int64 summary = 0;
+        for (int32 bit = 0; bit < 64; bit++) {
+            int64 word = file->words[index * 64 + bit];
+            used += __builtin_popcountl(word);
+            summary |= (int64)(word == LEASE_FULL) << bit;
+        }
+        file->summary[index] = summary;
+    }
+    header->used = used;
+    header->hint = 0;
+
+    // A lease whose record was lost while being moved gets it back
+    if (kind == INTENT_RENEW && !renewed && is_leased(file, offset)) {
+        int32 record = take_record(file);
+        if (record != 0) {
+            file->records[record].offset = offset;
+            file->records[record].expires = header->intent_expires;
+            link_record(file, record);
+            header->timed++;
+        }
+    }
+    header->recoveries++;
+    end_intent(file);
+    return 0;
+}
+
+/*
+ * Locking
+ */
+
+/**
+ * @brief Takes the file lock and brings the file up to date.
+ *
+ * @return int 0 with the lock held, or a negative errno without it.
+ */
+static int lock_pool(LeasePool *pool, int64 now) {
+    while (flock(pool->fd, LOCK_EX) < 0) {
+        if (errno != EINTR) {
+            return -errno;
+        }
+    }
+    if (__atomic_load_n(&pool->file->header.intent_kind, __ATOMIC_ACQUIRE) != INTENT_NONE) {
+        int result = recover(pool->file);
+        if (result < 0) {
+            flock(pool->fd, LOCK_UN);
+            return result;
+        }
+    }
+    advance_wheel(pool->file, now);
+    return 0;
+}
+
+static void unlock_pool(LeasePool *pool) {
+    flock(pool->fd, LOCK_UN);
+}
+
+/**
+ * @brief Maps an address to its offset in the block.
+ *
+ * @return int64 The offset, or LEASE_BLOCK_SIZE if the address is outside the block.
+ */
+static int64 offset_of(const LeaseFile *file, MacAddress mac) {
+    if (memcmp(mac.bytes, file->header.block, 3) != 0) {
+        return LEASE_BLOCK_SIZE;
+    }
+    return ((int64)mac.bytes[3] << 16) | ((int64)mac.bytes[4] << 8) | mac.bytes[5];
+}
+
+/*
+ * Public interface
+ */
+
+/**
+ * @brief Opens (or creates) a lease file.
+ *
+ * @param pool Receives the open file.
+ * @param path Lease file; its directory is created if missing.
+ * @param block OUI of the block (first three bytes). Required to create the
+ *              file; when given for an existing file it must match.
+ * @return int 0 on success, -ENOENT if the file does not exist and no block
+ *             was given, -EINVAL if the file is not a lease file or belongs
+ *             to another block, or another negative errno.
+ */
+int lease_pool_open(LeasePool *pool, const char *path, const MacAddress *block) {
+    pool->file = NULL;
+    if (block != NULL && (block->bytes[0] & 0x01)) {
+        return -EINVAL;                                    // Multicast OUIs cannot be assigned to interfaces
+    }
+    pool->fd = open_state_file(path, O_RDWR | O_CLOEXEC | (block ? O_CREAT : 0), 0644);
+    if (pool->fd < 0) {
+        return pool->fd;
+    }
+
+    int result = 0;
+    while (flock(pool->fd, LOCK_EX) < 0) {
+        if (errno != EINTR) {
+            result = -errno;
+            break;
+        }
+    }
+    struct stat status;
+    if (result == 0 && fstat(pool->fd, &status) < 0) {
+        result = -errno;
+    }
+    if (result == 0 && status.st_size == 0 && block == NULL) {
+        result = -ENOENT;
+    } else if (result == 0 && status.st_size == 0 && ftruncate(pool->fd, sizeof(LeaseFile)) < 0) {
+        result = -errno;
+    } else if (result == 0 && status.st_size != 0 && status.st_size != sizeof(LeaseFile)) {
+        result = -EINVAL;
+    }
+    if (result == 0) {
+        pool->file = mmap(NULL, sizeof(LeaseFile), PROT_READ | PROT_WRITE, MAP_SHARED, pool->fd, 0);
+        if (pool->file == MAP_FAILED) {
+            pool->file = NULL;
+            result = -errno;
+        }
+    }
+    if (result == 0) {
+        LeaseHeader *header = &pool->file->header;
+        if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != LEASE_MAGIC) {
+            // New file, or one whose creator died before finishing: the rest is still zero
+            if (block == NULL) {
+                result = -ENOENT;
+            } else {
+                memcpy(header->block, block->bytes, 3);
+                header->version = LEASE_VERSION;
+                __atomic_store_n(&header->magic, LEASE_MAGIC, __ATOMIC_RELEASE);
+            }
+        } else if (header->version != LEASE_VERSION ||
+                   (block != NULL && memcmp(header->block, block->bytes, 3) != 0)) {
+            result = -EINVAL;
+        }
+    }
+    flock(pool->fd, LOCK_UN);
+    if (result < 0) {
+        lease_pool_close(pool);
+    }
+    return result;
+}
+
+/**
+ * @brief Leases the lowest free addresses of the block, under one lock.
+ *
+ * @param pool The lease file.
+ * @param ttl_s Lifetime of the leases in seconds, 0 for leases that last until freed.
+ * @param macs Receives the addresses.
+ * @param count Number of addresses wanted.
+ * @return int Number of addresses leased (fewer than count only when the
+ *             block or the expiry table filled up), or a negative errno.
+ */
+int lease_alloc_batch(LeasePool *pool, int64 ttl_s, MacAddress *macs, int count) {
+    int64 now = now_s();
+    int result = lock_pool(pool, now);
+    if (result < 0) {
+        return result;
+    }
+    LeaseFile *file = pool->file;
+    int leased = 0;
+    while (leased < count) {
+        int64 offset = find_free(file);
+        if (offset == LEASE_BLOCK_SIZE) {
+            break;
+        }
+        begin_intent(file, INTENT_ALLOC, (int32)offset, 0);
+        if (ttl_s != 0) {
+            int32 record = take_record(file);
+            if (record == 0) {
+                end_intent(file);
+                break;
+            }
+            file->records[record].offset = (int32)offset;
+            file->records[record].expires = now + ttl_s;
+            link_record(file, record);
+            file->header.timed++;
+        }
+        mark_leased(file, (int32)offset);
+        file->header.used++;
+        end_intent(file);
+
+        MacAddress *mac = &macs[leased++];
+        memcpy(mac->bytes, file->header.block, 3);
+        mac->bytes[3] = (unsigned char)(offset >> 16);
+        mac->bytes[4] = (unsigned char)(offset >> 8);
+        mac->bytes[5] = (unsigned char)offset;
+    }
+    unlock_pool(pool);
+    return leased;
+}
+
+/**
+ * @brief Leases the lowest free address of the block.
+ *
+ * @param pool The lease file.
+ * @param ttl_s Lifetime of the lease in seconds, 0 for a lease that lasts until freed.
+ * @param mac Receives the address.
+ * @return int 0 on success, -ENOSPC if the block (or the expiry table) is full, or a negative errno.
+ */
+int lease_alloc(LeasePool *pool, int64 ttl_s, MacAddress *mac) {
+    int result = lease_alloc_batch(pool, ttl_s, mac, 1);
+    return result == 0 ? -ENOSPC : result < 0 ? result : 0;
+}
+
+/**
+ * @brief Returns a leased address to the block.
+ *
+ * @return int 0 on success, -EINVAL if the address is outside the block,
+ *             -ENOENT if it is not leased, or a negative errno.
+ */
+int lease_free(LeasePool *pool, MacAddress mac) {
+    int64 offset = offset_of(pool->file, mac);
+    if (offset == LEASE_BLOCK_SIZE) {
+        return -EINVAL;
+    }
+    int result = lock_pool(pool, now_s());
+    if (result < 0) {
+        return result;
+    }
+    LeaseFile *file = pool->file;
+    if (!is_leased(file, (int32)offset)) {
+        unlock_pool(pool);
+        return -ENOENT;
+    }
+    begin_intent(file, INTENT_FREE, (int32)offset, 0);
+    int32 slot, previous;
+    int32 record = find_record(file, (int32)offset, &slot, &previous);
+    if (record != 0) {
+        release_record(file, slot, previous, record);
+    }
+    mark_free(file, (int32)offset);
+    file->header.used--;
+    end_intent(file);
+    unlock_pool(pool);
+    return 0;
+}
+
+/**
+ * @brief Changes the lifetime of a leased address, counted from now.
+ *
+ * @param ttl_s New lifetime in seconds, 0 to keep the address until freed.
+ * @return int 0 on success, -EINVAL if the address is outside the block,
+ *             -ENOENT if it is not leased, -ENOSPC if the expiry table is
+ *             full, or a negative errno.
+ */
+int lease_renew(LeasePool *pool, MacAddress mac, int64 ttl_s) {
+    int64 offset = offset_of(pool->file, mac);
+    if (offset == LEASE_BLOCK_SIZE) {
+        return -EINVAL;
+    }
+    int64 now = now_s();
+    int result = lock_pool(pool, now);
+    if (result < 0) {
+        return result;
+    }
+    LeaseFile *file = pool->file;
+    if (!is_leased(file, (int32)offset)) {
+        unlock_pool(pool);
+        return -ENOENT;
+    }
+    int32 slot, previous;
+    int32 record = find_record(file, (int32)offset, &slot, &previous);
+    begin_intent(file, INTENT_RENEW, (int32)offset, ttl_s ? now + ttl_s : 0);
+    if (ttl_s == 0) {
+        if (record != 0) {
+            release_record(file, slot, previous, record);
+        }
+    } else if (record != 0) {
+        // Moved to the right slot when its current slot comes round
+        file->records[record].expires = now + ttl_s;
+        if (wheel_slot(now + ttl_s) != slot) {
+            unlink_record(file, slot, previous, record);
+            link_record(file, record);
+        }
+    } else if ((record = take_record(file)) != 0) {
+        file->records[record].offset = (int32)offset;
+        file->records[record].expires = now + ttl_s;
+        link_record(file, record);
+        file->header.timed++;
+    } else {
+        result = -ENOSPC;
+    }
+    end_intent(file);
+    unlock_pool(pool);
+    return result;
+}
+
+/**
+ * @brief Reads the counters of a lease file.
+ *
+ * The bitmap is counted with popcount as a consistency check of the
+ * counter the allocator maintains.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+int lease_status(LeasePool *pool, LeaseStatus *status) {
+    int result = lock_pool(pool, now_s());
+    if (result < 0) {
+        return result;
+    }
+    const LeaseFile *file = pool->file;
+    memset(&status->block, 0, sizeof(status->block));
+    memcpy(status->block.bytes, file->header.block, 3);
+    status->used = file->header.used;
+    status->timed = file->header.timed;
+    status->recoveries = file->header.recoveries;
+    status->counted = 0;
+    for (int32 word = 0; word < LEASE_WORDS; word++) {
+        status->counted += __builtin_popcountl(file->words[word]);
+    }
+    unlock_pool(pool);
+    return 0;
+}
+
+/**
+ * @brief Unmaps and closes a lease file.
+ */
+void lease_pool_close(LeasePool *pool) {
+    if (pool->file != NULL) {
+        munmap(pool->file, sizeof(LeaseFile));
+        pool->file = NULL;
+    }
+    if (pool->fd >= 0) {
+        close(pool->fd);
+        pool->fd = -1;
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_LEASE_H
+#define MACMASQ_LEASE_H
+
+// Including required C Header files
+#include "macmasq.h"       // for MacAddress and the integer typedefs
+
+// Lease file used when none is given on the command line
+#define LEASE_DEFAULT_PATH "/var/lib/macmasq/leases"
+// Addresses in a block: the three bytes following the OUI
+#define LEASE_BLOCK_SIZE (1UL << 24)
+// Bitmap words (64 addresses each) and summary words (64 bitmap words each)
+#define LEASE_WORDS (LEASE_BLOCK_SIZE / 64)
+#define LEASE_SUMMARY_WORDS (LEASE_WORDS / 64)
+// Slots of the expiry timing wheel and the time covered by one slot
+#define LEASE_WHEEL_SLOTS 4096
+#define LEASE_TICK_S 1
+// Leases with an expiry that can be outstanding at once
+#define LEASE_MAX_TIMED 65536
+
+/**
+* @brief Counters describing a lease file.
+*/
+typedef struct lease_status {
+    MacAddress block;                    // OUI of the block (last three bytes zero)
+    int64 used;                          // Addresses leased, as tracked by the allocator
+    int64 counted;                       // Addresses leased, counted from the bitmap
+    int64 timed;                         // Leases that expire
+    int64 recoveries;                    // Interrupted operations repaired so far
+} LeaseStatus;
+
+struct lease_file;
+
+/**
+* @brief An open lease file, mapped into memory.
+*/
+typedef struct lease_pool {
+    int fd;                              // The lease file, also used for locking
+    struct lease_file *file;             // Shared mapping of the file
+} LeasePool;
+
+int lease_pool_open(LeasePool *pool, const char *path, const MacAddress *block);
+int lease_alloc(LeasePool *pool, int64 ttl_s, MacAddress *mac);
+int lease_alloc_batch(LeasePool *pool, int64 ttl_s, MacAddress *macs, int count);
+int lease_free(LeasePool *pool, MacAddress mac);
+int lease_renew(LeasePool *pool, MacAddress mac, int64 ttl_s);
+int lease_status(LeasePool *pool, LeaseStatus *status);
+void lease_pool_close(LeasePool *pool);
+
+#endif // MACMASQ_LEASE_H
@@ -0,0 +1,687 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Lease allocator served over a Unix or TCP socket (--lease-serve), its
+ * client, and a benchmark of both (--lease-bench).
+ *
+ * The protocol is binary and pipelined: a client may send any number of
+ * requests before reading a reply, and replies come back in request order.
+ * All integers are in network byte order.
+ *
+ *   request: op (1) | reserved (1) | count (2) | id (4) | ttl_s (4) | count * 6 address bytes
+ *   reply:   op (1) | errno (1)    | count (2) | id (4) | count * 6 address bytes
+ *
+ * An ALLOC request carries no addresses and its reply carries the leased
+ * ones; FREE and RENEW requests carry addresses and their replies carry
+ * none. In every reply, count is the number of addresses the server
+ * handled and errno the first failure (0 if none).
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for snprintf, fprintf, printf
+#include <stdlib.h>                // for malloc, free, qsort
+#include <string.h>                // for memcpy, memmove, strchr
+#include <errno.h>                 // for error number definitions
+#include <unistd.h>                // for read, close
+#include <pthread.h>               // for the benchmark clients
+#include <signal.h>                // for sigprocmask
+#include <netdb.h>                 // for getaddrinfo
+#include <arpa/inet.h>             // for htons, htonl
+#include <netinet/in.h>            // for IPPROTO_TCP
+#include <netinet/tcp.h>           // for TCP_NODELAY
+#include <sys/epoll.h>             // for epoll
+#include <sys/signalfd.h>          // for signalfd
+#include <sys/socket.h>            // for socket, send, recv
+#include <sys/un.h>                // for sockaddr_un
+#include "leasenet.h"              // for the declarations implemented here
+
+// Sizes of the fixed part of a request and a reply
+#define LEASE_REQUEST_SIZE 12
+#define LEASE_REPLY_SIZE 8
+// Largest request a connection must be able to buffer
+#define LEASE_INPUT_SIZE (LEASE_REQUEST_SIZE + LEASE_NET_MAX_BATCH * 6)
+// Pending reply bytes above which a connection stops reading requests
+#define LEASE_OUTPUT_HIGH 65536
+#define LEASE_OUTPUT_SIZE (LEASE_OUTPUT_HIGH + LEASE_REPLY_SIZE + LEASE_NET_MAX_BATCH * 6)
+
+/**
+* @brief One client connection of the server.
+*/
+typedef struct lease_connection {
+    int fd;                              // The socket
+    size_t input_length;                 // Bytes buffered in input
+    size_t output_length;                // Reply bytes not sent yet
+    size_t output_sent;                  // Bytes of output already sent
+    int32 events;                        // Events currently registered with epoll
+    char input[LEASE_INPUT_SIZE];        // Partial requests
+    char output[LEASE_OUTPUT_SIZE];      // Replies waiting for the socket
+} LeaseConnection;
+
+/*
+ * Endpoints
+ */
+
+/**
+ * @brief Opens a listening or connected socket for "PATH" (Unix, contains a '/') or "HOST:PORT" (TCP).
+ *
+ * An empty HOST listens on every address.
+ *
+ * @return int The socket, or a negative errno (-EINVAL for a malformed address).
+ */
+static int open_endpoint(const char *address, bool listening) {
+    if (strchr(address, '/') != NULL) {
+        struct sockaddr_un name = { .sun_family = AF_UNIX };
+        if (strlen(address) >= sizeof(name.sun_path)) {
+            return -EINVAL;
+        }
+        strcpy(name.sun_path, address);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -errno;
+        }
+        if (listening) {
+            unlink(address);                               // A socket left by a previous server
+        }
+        int result = listening ? bind(fd, (struct sockaddr *)&name, sizeof(name))
+                               : connect(fd, (struct sockaddr *)&name, sizeof(name));
+        if (result < 0 || (listening && listen(fd, SOMAXCONN) < 0)) {
+            result = -errno;
+            close(fd);
+            return result;
+        }
+        return fd;
+    }
+
+    const char *colon = strrchr(address, ':');
+    if (colon == NULL || colon - address >= 256) {
+        return -EINVAL;
+    }
+    char host[256];
+    memcpy(host, address, colon - address);
+    host[colon - address] = '\0';
+    struct addrinfo hints = { .ai_socktype = SOCK_STREAM, .ai_flags = listening ? AI_PASSIVE : 0 };
+    struct addrinfo *found;
+    if (getaddrinfo(host[0] ? host : NULL, colon + 1, &hints, &found) != 0) {
+        return -EINVAL;
+    }
+    int fd = -EADDRNOTAVAIL;
+    for (struct addrinfo *candidate = found; candidate != NULL; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            fd = -errno;
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        int result = listening ? bind(fd, candidate->ai_addr, candidate->ai_addrlen)
+                               : connect(fd, candidate->ai_addr, candidate->ai_addrlen);
+        if (result == 0 && (!listening || listen(fd, SOMAXCONN) == 0)) {
+            break;
+        }
+        result = -errno;
+        close(fd);
+        fd = result;
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+/**
+ * @brief Sends a whole buffer on a blocking socket.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+static int send_all(int fd, const void *data, size_t length) {
+    const char *cursor = data;
+    while (length > 0) {
+        ssize_t sent = send(fd, cursor, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;                  // Retry when interrupted by a signal
+            return -errno;
+        }
+        cursor += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+/**
+ * @brief Receives exactly length bytes from a blocking socket.
+ *
+ * @return int 0 on success, -ECONNRESET if the peer closed, or a negative errno.
+ */
+static int receive_all(int fd, void *data, size_t length) {
+    char *cursor = data;
+    while (length > 0) {
+        ssize_t got = recv(fd, cursor, length, 0);
+        if (got < 0) {
+            if (errno == EINTR) continue;                  // Retry when interrupted by a signal
+            return -errno;
+        }
+        if (got == 0) {
+            return -ECONNRESET;
+        }
+        cursor += got;
+        length -= (size_t)got;
+    }
+    return 0;
+}
+
+/*
+ * Server
+ */
+
+/**
+ * @brief Appends a reply header to a connection's output.
+ */
+static char *append_reply(LeaseConnection *connection, int8 op, int error, int count, int32 id) {
+    char *reply = connection->output + connection->output_length;
+    int16 wire_count = htons((int16)count);
+    int32 wire_id = htonl(id);
+    reply[0] = (char)op;
+    reply[1] = (char)error;
+    memcpy(reply + 2, &wire_count, 2);
+    memcpy(reply + 4, &wire_id, 4);
+    connection->output_length += LEASE_REPLY_SIZE;
+    return reply + LEASE_REPLY_SIZE;
+}
+
+/**
+ * @brief Handles every complete request buffered by a connection, as long as replies fit.
+ *
+ * @return int 0 on success, or -EPROTO if the client broke the protocol.
+ */
+static int serve_requests(LeaseConnection *connection, LeasePool *pool, int64 *served) {
+    size_t position = 0;
+    while (connection->input_length - position >= LEASE_REQUEST_SIZE) {
+        const char *request = connection->input + position;
+        int8 op = (int8)request[0];
+        int16 count;
+        int32 id, ttl_s;
+        memcpy(&count, request + 2, 2);
+        memcpy(&id, request + 4, 4);
+        memcpy(&ttl_s, request + 8, 4);
+        count = ntohs(count);
+        id = ntohl(id);
+        ttl_s = ntohl(ttl_s);
+        if (count > LEASE_NET_MAX_BATCH || op < LEASE_OP_ALLOC || op > LEASE_OP_RENEW) {
+            return -EPROTO;
+        }
+        size_t size = LEASE_REQUEST_SIZE + (op == LEASE_OP_ALLOC ? 0 : count * 6UL);
+        if (connection->input_length - position < size || connection->output_length > LEASE_OUTPUT_HIGH) {
+            break;                                         // Wait for the rest, or for the client to read
+        }
+
+        if (op == LEASE_OP_ALLOC) {
+            MacAddress macs[LEASE_NET_MAX_BATCH];
+            int leased = lease_alloc_batch(pool, ttl_s, macs, count);
+            int error = leased < 0 ? -leased : leased < count ? ENOSPC : 0;
+            leased = leased < 0 ? 0 : leased;
+            char *payload = append_reply(connection, op, error, leased, id);
+            for (int i = 0; i < leased; i++) {
+                memcpy(payload + i * 6, macs[i].bytes, 6);
+            }
+            connection->output_length += leased * 6UL;
+            *served += leased;
+        } else {
+            int done = 0, error = 0;
+            for (int i = 0; i < count; i++) {
+                MacAddress mac;
+                memcpy(mac.bytes, request + LEASE_REQUEST_SIZE + i * 6, 6);
+                int result = op == LEASE_OP_FREE ? lease_free(pool, mac) : lease_renew(pool, mac, ttl_s);
+                if (result == 0) {
+                    done++;
+                } else if (error == 0) {
+                    error = -result;
+                }
+            }
+            append_reply(connection, op, error, done, id);
+            *served += done;
+        }
+        position += size;
+    }
+    memmove(connection->input, connection->input + position, connection->input_length - position);
+    connection->input_length -= position;
+    return 0;
+}
+
+/**
+ * @brief Sends as much pending output as the socket takes.
+ *
+ * @return int 0 on success, or a negative errno if the connection failed.
+ */
+static int flush_output(LeaseConnection *connection) {
+    while (connection->output_sent < connection->output_length) {
+        ssize_t sent = send(connection->fd, connection->output + connection->output_sent,
+                            connection->output_length - connection->output_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) continue;                  // Retry when interrupted by a signal
+            if (errno == EAGAIN) break;                    // The rest goes out on EPOLLOUT
+            return -errno;
+        }
+        connection->output_sent += (size_t)sent;
+    }
+    if (connection->output_sent == connection->output_length) {
+        connection->output_sent = connection->output_length = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads, serves and replies on a ready connection.
+ *
+ * @return int 0 to keep the connection, or a negative errno to close it.
+ */
+static int service_connection(int epoll_fd, LeaseConnection *connection, LeasePool *pool, int64 *served) {
+    int result = flush_output(connection);
+    if (result < 0) {
+        return result;
+    }
+    if (connection->output_length <= LEASE_OUTPUT_HIGH) {
+        ssize_t got = recv(connection->fd, connection->input + connection->input_length,
+                           LEASE_INPUT_SIZE - connection->input_length, MSG_DONTWAIT);
+        if (got == 0) {
+            return -ECONNRESET;
+        }
+        if (got < 0 && errno != EAGAIN && errno != EINTR) {
+            return -errno;
+        }
+        if (got > 0) {
+            connection->input_length += (size_t)got;
+        }
+    }
+    if ((result = serve_requests(connection, pool, served)) < 0 || (result = flush_output(connection)) < 0) {
+        return result;
+    }
+
+    // Stop reading while the client is not reading its replies
+    int32 events = (connection->output_length <= LEASE_OUTPUT_HIGH ? EPOLLIN : 0) |
+                   (connection->output_length > 0 ? EPOLLOUT : 0);
+    if (events != connection->events) {
+        struct epoll_event event = { .events = events, .data.ptr = connection };
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+    }
+    return 0;
+}
+
+/**
+ * @brief Serves a lease pool on a socket until SIGINT or SIGTERM.
+ *
+ * @param address "PATH" for a Unix socket, "[HOST]:PORT" for TCP.
+ * @param pool The lease file the addresses come from.
+ * @return int 0 on a clean shutdown, or a negative errno.
+ */
+int lease_serve(const char *address, LeasePool *pool) {
+    int listen_fd = open_endpoint(address, true);
+    if (listen_fd < 0) {
+        return listen_fd;
+    }
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    // The listening socket and the signalfd are told apart from connections by these markers
+    static char listen_marker, signal_marker;
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &listen_marker };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.ptr = &signal_marker;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event);
+    fprintf(stderr, "macmasq: serving leases on %s\n", address);
+
+    int64 connections = 0, served = 0;
+    int64 started = monotonic_ns();
+    bool running = true;
+    while (running) {
+        struct epoll_event events[64];
+        int ready = epoll_wait(epoll_fd, events, 64, -1);
+        for (int i = 0; i < ready; i++) {
+            void *source = events[i].data.ptr;
+            if (source == &signal_marker) {
+                running = false;
+            } else if (source == &listen_marker) {
+                int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+                LeaseConnection *connection = fd >= 0 ? malloc(sizeof(*connection)) : NULL;
+                if (connection == NULL) {
+                    if (fd >= 0) close(fd);
+                    continue;
+                }
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));   // Fails harmlessly on Unix sockets
+                connection->fd = fd;
+                connection->input_length = connection->output_length = connection->output_sent = 0;
+                connection->events = EPOLLIN;
+                struct epoll_event added = { .events = EPOLLIN, .data.ptr = connection };
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &added);
+                connections++;
+            } else {
+                LeaseConnection *connection = source;
+                if (service_connection(epoll_fd, connection, pool, &served) < 0) {
+                    close(connection->fd);                 // Also removes it from epoll
+                    free(connection);
+                }
+            }
+        }
+    }
+
+    int64 elapsed_ms = (monotonic_ns() - started) / 1000000;
+    fprintf(stderr, "macmasq: served %lu addresses to %lu connections in %lu ms\n", served, connections, elapsed_ms);
+    close(epoll_fd);
+    close(signal_fd);
+    close(listen_fd);
+    if (strchr(address, '/') != NULL) {
+        unlink(address);
+    }
+    return 0;
+}
+
+/*
+ * Client
+ */
+
+/**
+ * @brief Sends one request.
+ */
+static int send_request(LeaseClient *client, LeaseOp op, const MacAddress *macs, int count) {
+    char request[LEASE_INPUT_SIZE];
+    int16 wire_count = htons((int16)count);
+    int32 wire_id = htonl(client->next_id++);
+    int32 wire_ttl = htonl((int32)client->ttl_s);
+    request[0] = (char)op;
+    request[1] = 0;
+    memcpy(request + 2, &wire_count, 2);
+    memcpy(request + 4, &wire_id, 4);
+    memcpy(request + 8, &wire_ttl, 4);
+    size_t length = LEASE_REQUEST_SIZE;
+    if (op != LEASE_OP_ALLOC) {
+        for (int i = 0; i < count; i++) {
+            memcpy(request + length + i * 6, macs[i].bytes, 6);
+        }
+        length += count * 6UL;
+    }
+    client->round_trips++;
+    return send_all(client->fd, request, length);
+}
+
+/**
+ * @brief Reads one reply; the addresses of an ALLOC reply are added to the cache.
+ *
+ * @return int Addresses the server handled, or a negative errno if it handled none.
+ */
+static int receive_reply(LeaseClient *client) {
+    char header[LEASE_REPLY_SIZE];
+    int result = receive_all(client->fd, header, sizeof(header));
+    if (result < 0) {
+        return result;
+    }
+    int16 count;
+    memcpy(&count, header + 2, 2);
+    count = ntohs(count);
+    if (count > LEASE_NET_MAX_BATCH) {
+        return -EPROTO;
+    }
+    if (header[0] == LEASE_OP_ALLOC) {
+        client->pending = false;
+        char payload[LEASE_NET_MAX_BATCH * 6];
+        if ((result = receive_all(client->fd, payload, count * 6UL)) < 0) {
+            return result;
+        }
+        for (int i = 0; i < count && client->cached < client->reserve * 2; i++) {
+            memcpy(client->cache[client->cached++].bytes, payload + i * 6, 6);
+        }
+    }
+    return count == 0 && header[1] != 0 ? -(int)(int8)header[1] : count;
+}
+
+/**
+ * @brief Connects to a lease server.
+ *
+ * @param client Receives the connection.
+ * @param address "PATH" for a Unix socket, "HOST:PORT" for TCP.
+ * @param reserve Addresses requested per round trip (at most LEASE_NET_MAX_BATCH).
+ * @param ttl_s Lifetime requested for each lease, 0 for none.
+ * @return int 0 on success, or a negative errno.
+ */
+int lease_client_connect(LeaseClient *client, const char *address, int reserve, int64 ttl_s) {
+    client->reserve = reserve < 1 ? 1 : reserve > LEASE_NET_MAX_BATCH ? LEASE_NET_MAX_BATCH : reserve;
+    client->ttl_s = ttl_s;
+    client->cached = 0;
+    client->pending = false;
+    client->next_id = 0;
+    client->round_trips = 0;
+    client->cache = malloc(client->reserve * 2 * sizeof(MacAddress));
+    if (client->cache == NULL) {
+        return -ENOMEM;
+    }
+    client->fd = open_endpoint(address, false);
+    if (client->fd < 0) {
+        free(client->cache);
+        return client->fd;
+    }
+    return 0;
+}
+
+/**
+ * @brief Hands out one leased address, from the local reservation when possible.
+ *
+ * @return int 0 on success, -ENOSPC if the server has no address left, or a negative errno.
+ */
+int lease_client_alloc(LeaseClient *client, MacAddress *mac) {
+    if (client->cached <= client->reserve / 2 && !client->pending) {
+        int result = send_request(client, LEASE_OP_ALLOC, NULL, client->reserve);
+        if (result < 0) {
+            return result;
+        }
+        client->pending = true;                            // Its reply is read once the cache runs dry
+    }
+    if (client->cached == 0) {
+        int result = receive_reply(client);
+        if (result < 0) {
+            return result;
+        }
+        if (client->cached == 0) {
+            return -ENOSPC;
+        }
+    }
+    // The cache is used as a stack: handing out the newest first keeps the refill a plain append
+    *mac = client->cache[--client->cached];
+    return 0;
+}
+
+/**
+ * @brief Frees or renews addresses on the server, LEASE_NET_MAX_BATCH per request.
+ *
+ * @param op LEASE_OP_FREE or LEASE_OP_RENEW (which uses the client's ttl_s).
+ * @return int Addresses the server handled, or a negative errno.
+ */
+int lease_client_request(LeaseClient *client, LeaseOp op, const MacAddress *macs, int count) {
+    if (client->pending) {
+        int result = receive_reply(client);                // Replies come back in order
+        if (result < 0) {
+            return result;
+        }
+    }
+    // Pipeline every chunk, then collect the replies
+    int chunks = 0;
+    for (int offset = 0; offset < count; offset += LEASE_NET_MAX_BATCH) {
+        int size = count - offset < LEASE_NET_MAX_BATCH ? count - offset : LEASE_NET_MAX_BATCH;
+        int result = send_request(client, op, macs + offset, size);
+        if (result < 0) {
+            return result;
+        }
+        chunks++;
+    }
+    int handled = 0, error = 0;
+    for (int i = 0; i < chunks; i++) {
+        int result = receive_reply(client);
+        if (result < 0 && (result == -ECONNRESET || result == -EPROTO)) {
+            return result;
+        }
+        if (result < 0) {
+            error = result;
+        } else {
+            handled += result;
+        }
+    }
+    return handled == 0 && error ? error : handled;
+}
+
+/**
+ * @brief Returns the unused reservation to the server and disconnects.
+ */
+void lease_client_close(LeaseClient *client) {
+    if (client->pending) {
+        receive_reply(client);
+    }
+    if (client->cached > 0) {
+        lease_client_request(client, LEASE_OP_FREE, client->cache, client->cached);
+    }
+    close(client->fd);
+    free(client->cache);
+}
+
+/*
+ * Benchmark
+ */
+
+/**
+* @brief Work and results of one benchmark client.
+*/
+typedef struct bench_client {
+    const LeaseBenchOptions *options;    // Benchmark configuration
+    pthread_barrier_t *start;            // Releases every client at once
+    pthread_barrier_t *done;             // Holds the frees until every client has allocated
+    MacAddress *addresses;               // Addresses this client leased
+    int64 *latencies;                    // Time of each allocation, in ns
+    int64 finished_ns;                   // When the last allocation returned
+    int64 round_trips;                   // Requests the client sent
+    int error;                           // First failure, as a negative errno
+} BenchClient;
+
+/**
+ * @brief Benchmark client thread: allocates, then frees everything it got.
+ */
+static void *bench_client(void *argument) {
+    BenchClient *bench = argument;
+    LeaseClient client;
+    bench->error = lease_client_connect(&client, bench->options->address, bench->options->reserve, 0);
+    pthread_barrier_wait(bench->start);
+    if (bench->error < 0) {
+        pthread_barrier_wait(bench->done);
+        return NULL;
+    }
+    int allocated = 0;
+    while (allocated < bench->options->allocations) {
+        int64 started = monotonic_ns();
+        int result = lease_client_alloc(&client, &bench->addresses[allocated]);
+        bench->latencies[allocated] = monotonic_ns() - started;
+        if (result < 0) {
+            bench->error = result;
+            break;
+        }
+        allocated++;
+    }
+    bench->finished_ns = monotonic_ns();
+    bench->round_trips = client.round_trips;
+    pthread_barrier_wait(bench->done);                     // Freed addresses would be handed out again
+    lease_client_request(&client, LEASE_OP_FREE, bench->addresses, allocated);
+    lease_client_close(&client);
+    return NULL;
+}
+
+static int compare_int64(const void *a, const void *b) {
+    int64 x = *(const int64 *)a, y = *(const int64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Runs many concurrent clients against a lease server and prints the results.
+ *
+ * Every client allocates its addresses as fast as it can; the addresses of
+ * all clients are then checked for duplicates and returned to the server.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+int lease_bench(const LeaseBenchOptions *options) {
+    int clients = options->clients, allocations = options->allocations;
+    int64 total = (int64)clients * allocations;
+    BenchClient *benches = calloc(clients, sizeof(*benches));
+    pthread_t *threads = calloc(clients, sizeof(*threads));
+    MacAddress *addresses = malloc(total * sizeof(*addresses));
+    int64 *latencies = malloc(total * sizeof(*latencies));
+    if (benches == NULL || threads == NULL || addresses == NULL || latencies == NULL) {
+        free(benches); free(threads); free(addresses); free(latencies);
+        return -ENOMEM;
+    }
+
+    pthread_barrier_t start, done;
+    pthread_barrier_init(&start, NULL, clients + 1);
+    pthread_barrier_init(&done, NULL, clients);
+    for (int i = 0; i < clients; i++) {
+        benches[i] = (BenchClient){ .options = options, .start = &start, .done = &done,
+                                    .addresses = addresses + (int64)i * allocations,
+                                    .latencies = latencies + (int64)i * allocations };
+        pthread_create(&threads[i], NULL, bench_client, &benches[i]);
+    }
+    pthread_barrier_wait(&start);
+    int64 started = monotonic_ns();
+    int64 finished = started, round_trips = 0;
+    int error = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        if (benches[i].finished_ns > finished) finished = benches[i].finished_ns;
+        round_trips += benches[i].round_trips;
+        if (benches[i].error < 0 && error == 0) error = benches[i].error;
+    }
+    pthread_barrier_destroy(&start);
+    pthread_barrier_destroy(&done);
+
+    if (error == 0) {
+        // Duplicates show up as equal neighbours once the 48-bit values are sorted
+        int64 *packed = malloc(total * sizeof(int64));
+        int64 duplicates = 0;
+        if (packed != NULL) {
+            for (int64 i = 0; i < total; i++) {
+                int64 key = 0;
+                for (int b = 0; b < 6; b++) key = key << 8 | addresses[i].bytes[b];
+                packed[i] = key;
+            }
+            qsort(packed, total, sizeof(int64), compare_int64);
+            for (int64 i = 1; i < total; i++) duplicates += packed[i] == packed[i - 1];
+            free(packed);
+        }
+        qsort(latencies, total, sizeof(int64), compare_int64);
+        double seconds = (finished - started) / 1e9;
+        printf("%d clients x %d allocations (reserve %d): %.0f allocations/s, %lu round trips, "
+               "latency p50 %lu ns p99 %lu ns max %lu us, %lu duplicates\n",
+               clients, allocations, options->reserve, total / seconds, round_trips,
+               latencies[total / 2], latencies[total * 99 / 100], latencies[total - 1] / 1000, duplicates);
+    }
+    free(benches);
+    free(threads);
+    free(addresses);
+    free(latencies);
+    return error;
+}
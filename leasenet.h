@@ -0,0 +1,74 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_LEASENET_H
+#define MACMASQ_LEASENET_H
+
+// Including required C Header files
+#include "macmasq.h"       // for MacAddress and the integer typedefs
+#include "lease.h"         // for LeasePool
+
+// Most addresses carried by one request or reply
+#define LEASE_NET_MAX_BATCH 1024
+// Addresses a client reserves per round trip unless told otherwise
+#define LEASE_NET_DEFAULT_RESERVE 64
+
+/**
+* @brief Operations of the lease protocol.
+*/
+typedef enum lease_op {
+    LEASE_OP_ALLOC = 1,                  // Lease count addresses
+    LEASE_OP_FREE = 2,                   // Release the count addresses that follow
+    LEASE_OP_RENEW = 3,                  // Give the count addresses that follow a new lifetime
+} LeaseOp;
+
+/**
+* @brief Client side of a connection to a lease server.
+*
+* Addresses are fetched in batches of reserve and served from a local
+* cache. The next batch is requested when half the cache is used, so the
+* round trip overlaps with the allocations still served locally.
+*/
+typedef struct lease_client {
+    int fd;                              // Connection to the server
+    int64 ttl_s;                         // Lifetime requested for each lease
+    int reserve;                         // Addresses requested per round trip
+    MacAddress *cache;                   // Reserved addresses not handed out yet
+    int cached;                          // Entries of cache
+    bool pending;                        // An ALLOC request is in flight
+    int32 next_id;                       // Identifier of the next request
+    int64 round_trips;                   // Requests sent
+} LeaseClient;
+
+/**
+* @brief Options of the lease benchmark.
+*/
+typedef struct lease_bench_options {
+    const char *address;                 // Server to benchmark
+    int clients;                         // Concurrent clients
+    int allocations;                     // Addresses allocated by each client
+    int reserve;                         // Client reservation size
+} LeaseBenchOptions;
+
+int lease_serve(const char *address, LeasePool *pool);
+int lease_client_connect(LeaseClient *client, const char *address, int reserve, int64 ttl_s);
+int lease_client_alloc(LeaseClient *client, MacAddress *mac);
+int lease_client_request(LeaseClient *client, LeaseOp op, const MacAddress *macs, int count);
+void lease_client_close(LeaseClient *client);
+int lease_bench(const LeaseBenchOptions *options);
+
+#endif // MACMASQ_LEASENET_H
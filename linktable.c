@@ -0,0 +1,162 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdlib.h>        // for malloc, realloc, calloc, free
+#include <string.h>        // for memcmp, strnlen
+#include <errno.h>         // for ENOMEM
+#include "linktable.h"     // for the link table declared here
+
+/**
+ * @brief Hashes an interface name with FNV-1a.
+ */
+static int32 hash_name(const char *name, size_t length) {
+    int32 hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Spreads an ifindex over the index slots.
+ */
+static int32 hash_ifindex(int32 ifindex) {
+    return ifindex * 2654435761u;                          // Knuth multiplicative hash
+}
+
+/**
+ * @brief Appends one dumped interface to the table.
+ */
+static void append_link(const LinkInfo *link, void *context) {
+    LinkTable *table = context;
+    if (table->count == table->capacity) {
+        int capacity = table->capacity ? table->capacity * 2 : 64;
+        LinkInfo *links = realloc(table->links, (size_t)capacity * sizeof(*links));
+        if (links == NULL) {
+            table->out_of_memory = true;                   // Reported by link_table_load()
+            return;
+        }
+        table->links = links;
+        table->capacity = capacity;
+    }
+    table->links[table->count++] = *link;
+}
+
+/**
+ * @brief Replaces the content of the table with a fresh dump of the namespace.
+ *
+ * @param table The table to fill (zero-initialised or previously loaded).
+ * @param socket_fd An rtnetlink socket with no outstanding requests.
+ * @return int 0 on success, or a negative errno on failure.
+ */
+int link_table_load(LinkTable *table, int socket_fd) {
+    table->count = 0;
+    table->out_of_memory = false;
+    int result = netlink_dump_links(socket_fd, append_link, table);
+    if (result < 0) {
+        return result;
+    }
+    if (table->out_of_memory) {
+        return -ENOMEM;
+    }
+
+    // Size both indexes for a load factor of at most one half
+    int32 slots = 16;
+    while (slots < (int32)table->count * 2) {
+        slots *= 2;
+    }
+    free(table->by_name);
+    free(table->by_ifindex);
+    table->by_name = calloc(slots, sizeof(int32));
+    table->by_ifindex = calloc(slots, sizeof(int32));
+    if (table->by_name == NULL || table->by_ifindex == NULL) {
+        return -ENOMEM;
+    }
+    table->slot_mask = slots - 1;
+
+    for (int i = 0; i < table->count; i++) {
+        const LinkInfo *link = &table->links[i];
+        int32 slot = hash_name(link->name, strnlen(link->name, IFNAMSIZ)) & table->slot_mask;
+        while (table->by_name[slot] != 0) {
+            slot = (slot + 1) & table->slot_mask;          // Linear probing
+        }
+        table->by_name[slot] = i + 1;
+        slot = hash_ifindex(link->ifindex) & table->slot_mask;
+        while (table->by_ifindex[slot] != 0) {
+            slot = (slot + 1) & table->slot_mask;
+        }
+        table->by_ifindex[slot] = i + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Looks an interface up by name.
+ *
+ * @param table A loaded table.
+ * @param name The name to look for (need not be null-terminated).
+ * @param length Length of name.
+ * @return LinkInfo* The interface, or NULL if it is unknown.
+ */
+LinkInfo *link_table_find_name(const LinkTable *table, const char *name, size_t length) {
+    if (table->by_name == NULL || length >= IFNAMSIZ) {
+        return NULL;
+    }
+    for (int32 slot = hash_name(name, length) & table->slot_mask; table->by_name[slot] != 0;
+         slot = (slot + 1) & table->slot_mask) {
+        LinkInfo *link = &table->links[table->by_name[slot] - 1];
+        if (memcmp(link->name, name, length) == 0 && link->name[length] == '\0') {
+            return link;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Looks an interface up by ifindex.
+ *
+ * @param table A loaded table.
+ * @param ifindex The ifindex to look for.
+ * @return LinkInfo* The interface, or NULL if it is unknown.
+ */
+LinkInfo *link_table_find_ifindex(const LinkTable *table, int32 ifindex) {
+    if (table->by_ifindex == NULL) {
+        return NULL;
+    }
+    for (int32 slot = hash_ifindex(ifindex) & table->slot_mask; table->by_ifindex[slot] != 0;
+         slot = (slot + 1) & table->slot_mask) {
+        LinkInfo *link = &table->links[table->by_ifindex[slot] - 1];
+        if (link->ifindex == ifindex) {
+            return link;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Releases the memory held by a table.
+ */
+void link_table_free(LinkTable *table) {
+    free(table->links);
+    free(table->by_name);
+    free(table->by_ifindex);
+    memset(table, 0, sizeof(*table));
+}
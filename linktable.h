@@ -0,0 +1,44 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_LINKTABLE_H
+#define MACMASQ_LINKTABLE_H
+
+// Including required C Header files
+#include "netlink.h"       // for LinkInfo
+
+/**
+* @brief Every interface of a namespace, indexed by name and by ifindex.
+*
+* Both indexes are open-addressing hash tables holding positions in links.
+*/
+typedef struct link_table {
+    LinkInfo *links;                     // Interfaces in dump order
+    int count;                           // Number of entries in links
+    int capacity;                        // Allocated entries in links
+    int32 *by_name;                      // Name index (position + 1, 0 for an empty slot)
+    int32 *by_ifindex;                   // Ifindex index (position + 1, 0 for an empty slot)
+    int32 slot_mask;                     // Number of slots in each index minus one
+    bool out_of_memory;                  // Set when the last load could not store every link
+} LinkTable;
+
+int link_table_load(LinkTable *table, int socket_fd);
+LinkInfo *link_table_find_name(const LinkTable *table, const char *name, size_t length);
+LinkInfo *link_table_find_ifindex(const LinkTable *table, int32 ifindex);
+void link_table_free(LinkTable *table);
+
+#endif // MACMASQ_LINKTABLE_H
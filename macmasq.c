@@ -20,9 +20,9 @@
 
 // Including required C Header files
 #include <stdio.h>         // for standard input/output functions
-#include <stdlib.h>        // for standard library functions (rand, srand, EXIT_SUCCESS, EXIT_FAILURE, etc.)
+#include <stdlib.h>        // for standard library functions (EXIT_SUCCESS, EXIT_FAILURE, etc.)
 #include <stdbool.h>       // for Boolean type support
-#include <unistd.h>        // for POSIX API functions (getpid, close, etc.)
+#include <unistd.h>        // for POSIX API functions (close, etc.)
 #include <string.h>        // for string manipulation functions (strncpy, memcpy, etc.)
 #include <errno.h>         // for error number definitions for error handling
 #include <assert.h>        // for assert function for debugging
@@ -31,141 +31,1919 @@
 #include <net/if.h>        // for network interface definitions (struct ifreq, etc.)
 #include <net/if_arp.h>    // for ARP protocol definitions (hardware types, etc.)
 #include <netinet/in.h>    // for definitions for internet operations
+#include <getopt.h>        // for getopt_long
+#include <fnmatch.h>       // for fnmatch
+#include "macmasq.h"       // for MacAddress and the shared helpers
+#include "netlink.h"       // for the rtnetlink helpers
+#include "udev.h"          // for the udev event helpers
+#include "stream.h"        // for the --stdin command stream
+#include "json.h"          // for the NDJSON result writer
+#include "linktable.h"     // for the interface cache
+#include "policy.h"        // for policy files
+#include "daemon.h"        // for the rotation daemon
+#include "lease.h"         // for the lease allocator
+#include "leasenet.h"      // for the lease server and its client
+#include "sticky.h"        // for sticky per-network addresses
+#include "workpool.h"      // for the adaptive worker pool
+#include "ttff.h"          // for --measure-ttff
+#include "disrupt.h"       // for the disruption benchmark
+#include "contend.h"       // for the RTNL contention benchmark
+#include "sim.h"           // for the simulated kernel benchmark
+#include "trace.h"         // for --record-trace and --replay-trace
+#include "audit.h"         // for --audit-log
+#include "registry.h"      // for the host-wide address registry
+#include "journal.h"       // for the journal of original addresses
+#include "plan.h"          // for --plan and --apply-plan
+#include "outage.h"        // for --max-outage and the capability cache
+#include "checkpoint.h"    // for the daemon's warm restarts
 
-// Defining required data types (for 64 bit systems)
-typedef unsigned char int8;                // Define int8 as unsigned char
-typedef unsigned short int int16;          // Define int16 as unsigned short int
-typedef unsigned int int32;                // Define int32 as unsigned int
-typedef unsigned long int int64;           // Define int64 as unsigned long int
+// Number of times SIOCSIFHWADDR is retried when the driver reports a transient error
+#define IOCTL_SET_RETRIES 3
+// Pause between two SIOCSIFHWADDR attempts, in microseconds
+#define IOCTL_RETRY_DELAY_US 10000
 
 /**
-* @brief A structure to store a MAC address
-*/
-typedef struct store_mac {               
-    unsigned char bytes[6];              // Array to store 6 bytes representing the MAC address
-} MacAddress;                            // Alias the structure to MacAddress
-
-/**
- * @brief Generates a random MAC address.
- *
- * This function creates a random MAC address by generating 6 random bytes.
- * It then sets the locally administered bit and clears the multicast bit in the first byte.
- *
- * @param void (nothing)
- * @return MacAddress The generated random MAC address.
- */
-MacAddress generate_mac_address(void) {
-    MacAddress mac_addr;                    // Declare a variable to hold the MAC address
-    for (int i = 0; i < 6; i++) {           // Loop through each of the 6 bytes
-        mac_addr.bytes[i] = rand() % 256;   // Assign a random value (0-255) to each byte
-    }
-    // Set the locally administered bit and clear the multicast bit in the first byte
-    mac_addr.bytes[0] = (mac_addr.bytes[0] & 0xFE) | 0x02;  // Adjust first byte according to MAC standards
-    // Return the generated MAC address
-    return mac_addr;                     
-}
-
-/**
- * @brief Changes the MAC address of the specified network interface.
+ * @brief Changes the MAC address of the specified network interface and records how it went.
  *
  * This function brings the network interface down, changes its MAC address,
- * and then brings it back up.
+ * and then brings it back up. Some drivers briefly answer EBUSY or EAGAIN
+ * right after going down, so the address change itself is retried a few times.
  *
  * @param interface_name A string representing the network interface name.
  * @param new_mac The new MAC address to apply.
+ * @param trace Receives the ifindex, old address, per-phase timings, errno and retry count.
  * @return true if the MAC address was changed successfully, false otherwise.
  */
-bool change_mac_address(const char *interface_name, MacAddress new_mac) {
+bool change_mac_address_traced(const char *interface_name, MacAddress new_mac, LinkRotation *trace) {
     struct ifreq interface_request;      // Declare structure to hold interface request parameters
     int socket_fd;                       // Declare variable to hold the socket file descriptor
     int original_flags;                  // Declare variable to store original interface flags
+    int64 started = monotonic_ns();      // Start of the whole change
+    int64 phase_started;                 // Start of the current phase
+
+    // Describe the change before anything can fail
+    memset(trace, 0, sizeof(*trace));                                   // Clear every field
+    strncpy(trace->name, interface_name, IFNAMSIZ - 1);                 // Copy the interface name
+    trace->new_mac = new_mac;                                           // Remember the requested address
+    trace->backend = BACKEND_IOCTL;                                     // This path only uses ioctl
 
     // Create a socket for performing ioctl operations
     socket_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);  // Open a socket with IPv4, datagram type, and IP protocol
     if (socket_fd < 0) {                // Check if socket creation failed
+        trace->error = errno;           // Record the failure
         perror("socket");               // Print error message to stderr
         return false;                   // Return false indicating failure
     }
 
     // Set the interface name in the request structure
+    memset(&interface_request, 0, sizeof(interface_request));           // Start from a clean request
     strncpy(interface_request.ifr_name, interface_name, IFNAMSIZ - 1);  // Copy the interface name into the structure
     interface_request.ifr_name[IFNAMSIZ - 1] = '\0';                    // Ensure the interface name is null-terminated
 
+    // Record the interface index and current address for reporting (failures are not fatal)
+    if (ioctl(socket_fd, SIOCGIFINDEX, &interface_request) == 0) {
+        trace->ifindex = interface_request.ifr_ifindex;                 // Store the interface index
+    }
+    if (ioctl(socket_fd, SIOCGIFHWADDR, &interface_request) == 0) {
+        memcpy(trace->old_mac.bytes, interface_request.ifr_hwaddr.sa_data, 6);  // Store the current address
+    }
+
     // Retrieve current interface flags using ioctl
     if (ioctl(socket_fd, SIOCGIFFLAGS, &interface_request) < 0) {
+        trace->error = errno;               // Record the failure
         perror("ioctl (SIOCGIFFLAGS)");     // Print error message if retrieval fails
         close(socket_fd);                   // Close the socket
         return false;                       // Return false indicating failure
     }
     // Store the original interface flags
     original_flags = interface_request.ifr_flags;  
+    trace->flags = (int32)original_flags;
 
     // Bring the interface down by clearing the IFF_UP flag
     interface_request.ifr_flags &= ~IFF_UP;  // Modify flags to disable (bring down) the interface
     // Apply the new flags to bring the interface down
+    phase_started = monotonic_ns();
     if (ioctl(socket_fd, SIOCSIFFLAGS, &interface_request) < 0) {  
+        trace->error = errno;                   // Record the failure
         perror("ioctl (SIOCSIFFLAGS - down)");  // Print error message if operation fails
         close(socket_fd);                       // Close the socket
         return false;                           // Return false indicating failure
     }
+    trace->down_ns = monotonic_ns() - phase_started;
 
     // Set the hardware address family to Ethernet and copy the new MAC address bytes
     interface_request.ifr_hwaddr.sa_family = ARPHRD_ETHER;              // Set the hardware address family to Ethernet
     memcpy(interface_request.ifr_hwaddr.sa_data, new_mac.bytes, 6);     // Copy the new MAC address bytes into the request
 
-    // Change the MAC address using ioctl
-    if (ioctl(socket_fd, SIOCSIFHWADDR, &interface_request) < 0) {
+    // Change the MAC address using ioctl, retrying transient driver errors
+    phase_started = monotonic_ns();
+    int set_result;
+    while ((set_result = ioctl(socket_fd, SIOCSIFHWADDR, &interface_request)) < 0 &&
+           (errno == EBUSY || errno == EAGAIN) && trace->retries < IOCTL_SET_RETRIES) {
+        trace->retries++;                   // Count the repeated attempt
+        usleep(IOCTL_RETRY_DELAY_US);       // Give the driver time to settle
+    }
+    trace->set_ns = monotonic_ns() - phase_started;
+    if (set_result < 0) {
+        trace->error = errno;                                   // Record the failure
         perror("ioctl (SIOCSIFHWADDR)");                        // Print error message if MAC address change fails
         interface_request.ifr_flags = original_flags;           // Restore original interface flags
         ioctl(socket_fd, SIOCSIFFLAGS, &interface_request);     // Bring the interface back up before exiting
         close(socket_fd);                                       // Close the socket
+        trace->total_ns = monotonic_ns() - started;
         return false;                                           // Return false indicating failure
     }
 
     // Bring the interface back up by restoring the original flags
     interface_request.ifr_flags = original_flags;   // Reset the interface flags to their original state
     // Apply the flags to bring the interface up
+    phase_started = monotonic_ns();
     if (ioctl(socket_fd, SIOCSIFFLAGS, &interface_request) < 0) {   
+        trace->error = errno;                   // Record the failure
         perror("ioctl (SIOCSIFFLAGS - up)");    // Print error message if operation fails
         close(socket_fd);                       // Close the socket
+        trace->total_ns = monotonic_ns() - started;
         return false;                           // Return false indicating failure
     }
+    trace->up_ns = monotonic_ns() - phase_started;
 
     close(socket_fd);                  // Close the socket as it is no longer needed
+    trace->total_ns = monotonic_ns() - started;
     return true;                       // Return true indicating the MAC address was changed successfully
 }
 
+/**
+ * @brief Changes the MAC address of the specified network interface.
+ *
+ * This function brings the network interface down, changes its MAC address,
+ * and then brings it back up.
+ *
+ * @param interface_name A string representing the network interface name.
+ * @param new_mac The new MAC address to apply.
+ * @return true if the MAC address was changed successfully, false otherwise.
+ */
+bool change_mac_address(const char *interface_name, MacAddress new_mac) {
+    LinkRotation trace;                // Timings are collected but not reported
+    return change_mac_address_traced(interface_name, new_mac, &trace);
+}
+
+// Maximum number of interfaces handled by --all-physical
+#define MAX_PHYSICAL_LINKS 4096
+
+// NDJSON output (--json): one preallocated writer shared by every mode
+static char json_buffer[JSON_WRITER_BUFFER_SIZE];
+static JsonWriter json_output;
+static bool json_mode = false;
+
+// Host-wide address registry, NULL with --no-registry or when it cannot be opened
+static MacRegistry registry_storage = { .fd = -1 };
+static MacRegistry *registry = NULL;
+
+/**
+ * @brief Opens the address registry; without it, addresses are applied unreserved.
+ *
+ * @param path The registry file.
+ */
+static void open_registry(const char *path) {
+    int result = registry_open(&registry_storage, path);
+    if (result < 0) {
+        fprintf(stderr, "macmasq: registry %s: %s, addresses are not reserved\n", path, strerror(-result));
+        return;
+    }
+    registry = &registry_storage;
+}
+
+// Journal of original addresses, NULL when it cannot be opened
+static Journal journal_storage = { .fd = -1 };
+static Journal *journal = NULL;
+
+/**
+ * @brief Opens the journal of original addresses; without it, only permanent addresses can be restored.
+ *
+ * @param path The journal file.
+ */
+static void open_journal(const char *path) {
+    int result = journal_open(&journal_storage, path);
+    if (result < 0) {
+        fprintf(stderr, "macmasq: journal %s: %s, original addresses are not recorded\n", path, strerror(-result));
+        return;
+    }
+    journal = &journal_storage;
+}
+
+/**
+ * @brief Prints the command-line usage to stderr.
+ *
+ * @param program The name the tool was invoked as.
+ */
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s INTERFACE\n", program);
+    fprintf(stderr, "       %s --all-physical\n", program);
+    fprintf(stderr, "       %s --restore-permanent [PATTERN]   put back the permanent (or journaled original) addresses\n", program);
+    fprintf(stderr, "       %s --plan FILE [--policy FILE] [--netns NAME]... [--netns-all] [PATTERN]   write a rotation plan\n", program);
+    fprintf(stderr, "       %s --show-plan FILE | --apply-plan FILE   review or apply it (done interfaces are skipped)\n", program);
+    fprintf(stderr, "       %s --udev   (IFINDEX, INTERFACE and ACTION taken from the environment)\n", program);
+    fprintf(stderr, "       %s --stdin [--batch-size N] [--batch-window-us N]\n", program);
+    fprintf(stderr, "           reads lines \"INTERFACE [XX:XX:XX:XX:XX:XX|random|restore]\"\n");
+    fprintf(stderr, "       %s --policy FILE [--apply]   explain (or apply) a policy file\n", program);
+    fprintf(stderr, "       %s --policy FILE --daemon [--metrics FILE] [--metrics-interval S] [--backend ioctl|netlink|netlink-batch]\n", program);
+    fprintf(stderr, "           rotate on the policy schedule, reloading FILE whenever it changes\n");
+    fprintf(stderr, "           --rate-limit N [--rate-burst N]   send at most N link changes per second (also with --bench-sim)\n");
+    fprintf(stderr, "           --opportunistic-window S   rotate a link that goes down by itself if due within S seconds\n");
+    fprintf(stderr, "           --checkpoint FILE | --no-checkpoint   keep the schedule in FILE for a warm restart (default %s)\n",
+            CHECKPOINT_DEFAULT_PATH);
+    fprintf(stderr, "           --audit-log FILE [--audit-fsync-ms N] [--audit-overflow block|drop] [--audit-ring N]\n");
+    fprintf(stderr, "           appends a line per rotation to FILE (also with --parallel)\n");
+    fprintf(stderr, "       %s [--lease-file FILE] [--lease-block XX:XX:XX] --lease-alloc [--lease-ttl S] [INTERFACE]\n", program);
+    fprintf(stderr, "       %s [--lease-file FILE] --lease-free MAC | --lease-renew MAC [--lease-ttl S] | --lease-status\n", program);
+    fprintf(stderr, "       %s [--lease-file FILE] --lease-serve PATH|[HOST]:PORT   serve the lease file\n", program);
+    fprintf(stderr, "           --lease-server PATH|HOST:PORT makes --lease-alloc/--lease-free/--lease-renew use a server\n");
+    fprintf(stderr, "       %s --lease-bench PATH|HOST:PORT [--bench-clients N] [--bench-allocs N] [--lease-reserve N]\n", program);
+    fprintf(stderr, "       %s --sticky [--sticky-file FILE] INTERFACE   reuse the address used before on this network\n", program);
+    fprintf(stderr, "       %s --parallel [--workers N] [--backend ioctl|netlink] [--netns NAME]... [--netns-all] [PATTERN]\n", program);
+    fprintf(stderr, "           rotate the matching (default: physical) interfaces with adaptive concurrency\n");
+    fprintf(stderr, "       %s --bench-disruption [--bench-rate PPS] [--bench-rotations N] [--bench-interval-ms N]\n", program);
+    fprintf(stderr, "           frames lost while a veth address is rotated with each strategy (private namespaces)\n");
+    fprintf(stderr, "       %s --bench-rtnl [--churn routes,addresses,links] [--churn-threads N] [--bench-interfaces N] [--bench-duration-ms N]\n", program);
+    fprintf(stderr, "           throughput and latency of every backend with and without background rtnetlink load\n");
+    fprintf(stderr, "       %s --bench-sim [--policy FILE] [--backend B] [--sim-interfaces N] [--sim-duration S] [--sim-seed N] [--sim-rtnl-load PCT]\n", program);
+    fprintf(stderr, "           run the daemon against a simulated kernel in virtual time (no privileges needed)\n");
+    fprintf(stderr, "       %s --record-trace FILE [--record-duration S]   record the links and link events to FILE\n", program);
+    fprintf(stderr, "       %s --replay-trace FILE [--replay-speed original|max|N] [--policy FILE] [--backend B] [--sim-seed N] [--sim-rtnl-load PCT]\n", program);
+    fprintf(stderr, "           feed a recorded trace to the daemon on a simulated kernel, report event delay and throughput\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --json   print one NDJSON record per interface instead of text\n");
+    fprintf(stderr, "  --measure-ttff [--ttff-timeout S]   with INTERFACE, time the change up to the first frame sent\n");
+    fprintf(stderr, "  --max-outage MS [--capability-cache FILE]   with INTERFACE, put the old address back if the interface\n");
+    fprintf(stderr, "           is not running again within MS, and remember its driver as slow (default %s)\n", CAPABILITY_DEFAULT_PATH);
+    fprintf(stderr, "  --registry FILE | --no-registry   reserve new addresses host-wide in FILE (default %s)\n", REGISTRY_DEFAULT_PATH);
+    fprintf(stderr, "  --journal FILE   record original addresses in FILE (default %s)\n", JOURNAL_DEFAULT_PATH);
+}
+
+/**
+ * @brief Prints the outcome of a set of MAC changes, as text or NDJSON.
+ *
+ * @param rotations The changes.
+ * @param count Number of entries in rotations.
+ * @return int EXIT_SUCCESS if every change succeeded, EXIT_FAILURE otherwise.
+ */
+static int report_rotations(const LinkRotation *rotations, int count) {
+    int status = EXIT_SUCCESS;
+    for (int i = 0; i < count; i++) {
+        char mac[MAC_STRING_LENGTH + 1];
+        if (rotations[i].error != 0) {
+            status = EXIT_FAILURE;
+        }
+        if (json_mode) {
+            json_write_rotation(&json_output, &rotations[i]);
+            continue;
+        }
+        if (rotations[i].error != 0) {
+            fprintf(stderr, "%s: %s\n", rotations[i].name, strerror(rotations[i].error));
+            continue;
+        }
+        mac_format(rotations[i].new_mac, mac);
+        printf("%s: New MAC: %s\n", rotations[i].name, mac);
+    }
+    json_writer_flush(&json_output);
+    return status;
+}
+
+/**
+ * @brief Randomizes the MAC address of every physical interface in one netlink batch.
+ *
+ * @return int EXIT_SUCCESS if every interface was changed, EXIT_FAILURE otherwise.
+ */
+static int rotate_all_physical(void) {
+    int socket_fd = netlink_open(0);
+    if (socket_fd < 0) {
+        fprintf(stderr, "netlink: %s\n", strerror(-socket_fd));
+        return EXIT_FAILURE;
+    }
+
+    LinkRotation *rotations = calloc(MAX_PHYSICAL_LINKS, sizeof(*rotations));
+    NetlinkBatch *batch = malloc(sizeof(*batch));
+    if (rotations == NULL || batch == NULL) {
+        perror("malloc");
+        free(rotations);
+        free(batch);
+        close(socket_fd);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    int count = collect_physical_links(socket_fd, rotations, MAX_PHYSICAL_LINKS);
+    bool truncated = count > MAX_PHYSICAL_LINKS;
+    if (truncated) {
+        fprintf(stderr, "macmasq: %d physical interfaces, only the first %d are changed\n", count, MAX_PHYSICAL_LINKS);
+        count = MAX_PHYSICAL_LINKS;
+    }
+    if (count < 0) {
+        fprintf(stderr, "link dump: %s\n", strerror(-count));
+        status = EXIT_FAILURE;
+    } else {
+        for (int i = 0; i < count; i++) {
+            int reserved = registry_reserve_random(registry, &rotations[i].new_mac);
+            if (reserved < 0) {
+                rotations[i].error = -reserved;            // Not reserved, so not sent (ifindex 0)
+                rotations[i].ifindex = 0;
+            }
+        }
+        netlink_batch_init(batch, socket_fd, NULL, NULL);
+        int result = netlink_rotate(batch, rotations, count);
+        if (result < 0) {
+            fprintf(stderr, "netlink batch: %s\n", strerror(-result));
+            status = EXIT_FAILURE;
+        }
+        int64 netns = registry_netns();
+        for (int i = 0; i < count; i++) {
+            if (result == 0) {
+                registry_settle(registry, &rotations[i], netns);
+                journal_record(journal, &rotations[i], netns);
+            } else {
+                registry_release(registry, rotations[i].new_mac);
+            }
+        }
+        if (result == 0) {
+            status = report_rotations(rotations, count);
+        }
+        if (truncated) {
+            status = EXIT_FAILURE;                         // The interfaces past the limit were not changed
+        }
+    }
+
+    free(rotations);
+    free(batch);
+    close(socket_fd);
+    return status;
+}
+
+/**
+ * @brief Puts the factory address back on every targeted interface in one netlink batch.
+ *
+ * Permanent addresses come from IFLA_PERM_ADDRESS in the same RTM_GETLINK
+ * dump that lists the interfaces. Interfaces without one (software devices)
+ * fall back to the journal of original addresses. Interfaces already at
+ * their target are left alone.
+ *
+ * @param pattern Interface name pattern (fnmatch), or NULL for every physical interface.
+ * @return int EXIT_SUCCESS if every targeted interface has its original address, EXIT_FAILURE otherwise.
+ */
+static int restore_permanent(const char *pattern) {
+    static const MacAddress zero = { { 0 } };
+    int socket_fd = netlink_open(0);
+    if (socket_fd < 0) {
+        fprintf(stderr, "netlink: %s\n", strerror(-socket_fd));
+        return EXIT_FAILURE;
+    }
+    LinkTable links = { 0 };
+    int result = link_table_load(&links, socket_fd);
+    LinkRotation *rotations = result == 0 ? calloc(links.count + 1, sizeof(*rotations)) : NULL;
+    NetlinkBatch *batch = malloc(sizeof(*batch));
+    if (result < 0 || rotations == NULL || batch == NULL) {
+        fprintf(stderr, "link dump: %s\n", strerror(result < 0 ? -result : ENOMEM));
+        free(rotations);
+        free(batch);
+        link_table_free(&links);
+        close(socket_fd);
+        return EXIT_FAILURE;
+    }
+
+    int64 netns = registry_netns();
+    int count = 0;
+    int unchanged = 0;
+    for (int i = 0; i < links.count; i++) {
+        const LinkInfo *link = &links.links[i];
+        if (link->type != ARPHRD_ETHER ||
+            (pattern != NULL ? fnmatch(pattern, link->name, 0) != 0 : !link_is_physical(link))) {
+            continue;
+        }
+        LinkRotation *rotation = &rotations[count];
+        memcpy(rotation->name, link->name, IFNAMSIZ);
+        if (link->has_perm_address && !mac_equal(link->perm_address, zero)) {
+            rotation->new_mac = link->perm_address;
+        } else if (!journal_lookup(journal, netns, link->ifindex, link->name, &rotation->new_mac)) {
+            rotation->error = EADDRNOTAVAIL;               // Nothing known to restore to (ifindex stays 0)
+            count++;
+            continue;
+        }
+        if (mac_equal(link->address, rotation->new_mac)) {
+            unchanged++;
+            continue;
+        }
+        if (registry_reserve(registry, rotation->new_mac) == -EADDRINUSE) {
+            rotation->error = EADDRINUSE;
+            count++;
+            continue;
+        }
+        rotation->ifindex = link->ifindex;
+        rotation->flags = link->flags;
+        rotation->old_mac = link->address;
+        count++;
+    }
+
+    int status = EXIT_SUCCESS;
+    netlink_batch_init(batch, socket_fd, NULL, NULL);
+    result = netlink_rotate(batch, rotations, count);
+    if (result < 0) {
+        fprintf(stderr, "netlink batch: %s\n", strerror(-result));
+        status = EXIT_FAILURE;
+    }
+    for (int i = 0; i < count; i++) {
+        if (rotations[i].ifindex == 0) {
+            continue;                                      // Never queued
+        } else if (result == 0) {
+            registry_settle(registry, &rotations[i], netns);
+        } else {
+            registry_release(registry, rotations[i].new_mac);
+        }
+    }
+    if (result == 0) {
+        status = report_rotations(rotations, count);
+        if (unchanged > 0 && !json_mode) {
+            fprintf(stderr, "macmasq: %d interfaces already had their original address\n", unchanged);
+        }
+    }
+
+    free(rotations);
+    free(batch);
+    link_table_free(&links);
+    close(socket_fd);
+    return status;
+}
+
+/**
+ * @brief Reads the current address of an interface (SIOCGIFHWADDR).
+ *
+ * @return true if it could be read.
+ */
+static bool read_address(const char *interface, MacAddress *mac) {
+    struct ifreq request = { 0 };
+    memcpy(request.ifr_name, interface, strnlen(interface, IFNAMSIZ - 1));
+    int ioctl_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    bool found = ioctl_fd >= 0 && ioctl(ioctl_fd, SIOCGIFHWADDR, &request) == 0;
+    if (found) {
+        memcpy(mac->bytes, request.ifr_hwaddr.sa_data, 6);
+    }
+    if (ioctl_fd >= 0) {
+        close(ioctl_fd);
+    }
+    return found;
+}
+
+/**
+ * @brief Handles one udev event for a network device (RUN+="macmasq --udev").
+ *
+ * The device is addressed by the IFINDEX udev passes in the environment, and
+ * the time spent is reported on stderr so that slow events show up in the
+ * udev log.
+ *
+ * @return int EXIT_SUCCESS if the event was handled or ignored, EXIT_FAILURE otherwise.
+ */
+static int handle_udev_event(void) {
+    UdevEvent event;
+    if (!udev_event_from_environment(&event)) {
+        fprintf(stderr, "macmasq: IFINDEX and ACTION must be set by udev\n");
+        return EXIT_FAILURE;
+    }
+    if (!udev_event_wants_rotation(&event)) {
+        return EXIT_SUCCESS;           // Only new devices are randomized
+    }
+
+    LinkRotation result;
+    MacAddress new_mac;
+    if (!random_local_mac(&new_mac)) {
+        perror("getrandom");
+        return EXIT_FAILURE;
+    }
+    int reserved = registry_reserve_random(registry, &new_mac);
+    if (reserved < 0) {
+        fprintf(stderr, "macmasq: udev %s %s ifindex %u: registry: %s\n",
+                event.action, event.interface, event.ifindex, strerror(-reserved));
+        return EXIT_FAILURE;
+    }
+    MacAddress old_mac = {{0}};
+    read_address(event.interface, &old_mac);              // udev_rotate() does not query it
+    udev_rotate(&event, new_mac, &result);
+    result.old_mac = old_mac;
+    int64 netns = registry_netns();
+    registry_settle(registry, &result, netns);
+    journal_record(journal, &result, netns);
+    if (json_mode) {
+        json_write_rotation(&json_output, &result);
+        json_writer_flush(&json_output);
+    }
+    if (result.error != 0) {
+        fprintf(stderr, "macmasq: udev %s %s ifindex %u: %s\n",
+                event.action, event.interface, event.ifindex, strerror(result.error));
+        return EXIT_FAILURE;
+    }
+
+    char mac[MAC_STRING_LENGTH + 1];
+    mac_format(result.new_mac, mac);
+    fprintf(stderr, "macmasq: udev %s %s ifindex %u %s in %lu us\n",
+            event.action, event.interface, event.ifindex, mac, result.total_ns / 1000);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prints the rule deciding for every interface, and the cost of the lookups.
+ *
+ * @param policy A compiled policy.
+ * @param links Every interface of the namespace.
+ * @return int EXIT_SUCCESS.
+ */
+static int explain_policy(const Policy *policy, const LinkTable *links) {
+    for (int i = 0; i < links->count; i++) {
+        const LinkInfo *link = &links->links[i];
+        int rule = policy_lookup(policy, link);
+        if (rule < 0) {
+            printf("%-16s %-10s no matching rule\n", link->name, policy_kind_name(link));
+            continue;
+        }
+        const PolicyRule *match = &policy->rules[rule];
+        printf("%-16s %-10s line %d (%s): action=%s interval=%lus address=%s strategy=%s priority=%s\n",
+               link->name, policy_kind_name(link), match->line, match->pattern,
+               policy_action_name(match->action), match->interval_ns / 1000000000UL,
+               address_mode_name(match->address), strategy_name(match->strategy),
+               priority_name(match->priority));
+    }
+
+    // Measure the decision table over at least 100000 lookups
+    if (links->count > 0) {
+        int rounds = (100000 + links->count - 1) / links->count;
+        int64 checksum = 0;            // Keeps the compiler from dropping the loop
+        int64 started = monotonic_ns();
+        for (int round = 0; round < rounds; round++) {
+            for (int i = 0; i < links->count; i++) {
+                checksum += (int64)policy_lookup(policy, &links->links[i]);
+            }
+        }
+        int64 elapsed = monotonic_ns() - started;
+        int64 lookups = (int64)rounds * (int64)links->count;
+        printf("%lu lookups in %lu us (%.1f ns per lookup, checksum %lu)\n",
+               lookups, elapsed / 1000, (double)elapsed / (double)lookups, checksum);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Rotates every interface whose policy rule says so.
+ *
+ * Interfaces are changed in netlink batches. Members of the same master
+ * whose rule uses the rolling strategy are spread over successive batches,
+ * so that only one of them is down at any time.
+ *
+ * @param policy A compiled policy.
+ * @param links Every interface of the namespace.
+ * @param socket_fd The rtnetlink socket the table was loaded with.
+ * @return int EXIT_SUCCESS if every change succeeded, EXIT_FAILURE otherwise.
+ */
+static int apply_policy(const Policy *policy, const LinkTable *links, int socket_fd) {
+    LinkRotation *rotations = calloc(links->count + 1, sizeof(*rotations));
+    int *waves = calloc(links->count + 1, sizeof(*waves));
+    NetlinkBatch *batch = malloc(sizeof(*batch));
+    if (rotations == NULL || waves == NULL || batch == NULL) {
+        perror("malloc");
+        free(rotations);
+        free(waves);
+        free(batch);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    int count = 0;
+    int wave_count = 1;
+    for (int i = 0; i < links->count; i++) {
+        const LinkInfo *link = &links->links[i];
+        int rule = policy_lookup(policy, link);
+        if (rule < 0 || policy->rules[rule].action == POLICY_NEVER || link->type != ARPHRD_ETHER) {
+            continue;
+        }
+        const PolicyRule *match = &policy->rules[rule];
+        LinkRotation *rotation = &rotations[count];
+        rotation->ifindex = link->ifindex;
+        memcpy(rotation->name, link->name, IFNAMSIZ);
+        rotation->flags = link->flags;
+        rotation->old_mac = link->address;
+        if (!policy_new_address(match, link, &rotation->new_mac)) {
+            perror("getrandom");
+            status = EXIT_FAILURE;
+            wave_count = 0;                    // Nothing is sent, every reservation is released
+            break;
+        }
+        int reserved = registry_reserve_random(registry, &rotation->new_mac);
+        rotation->live = match->strategy == STRATEGY_LIVE;
+        waves[count] = 0;
+        if (reserved < 0) {
+            rotation->error = -reserved;       // Not reserved, so not sent (ifindex 0)
+            rotation->ifindex = 0;
+        } else if (match->strategy == STRATEGY_ROLLING && link->master != 0) {
+            // One more wave for every earlier rolling member of the same master
+            for (int j = 0; j < count; j++) {
+                const LinkInfo *other = link_table_find_ifindex(links, rotations[j].ifindex);
+                if (other != NULL && other->master == link->master && waves[j] >= waves[count]) {
+                    waves[count] = waves[j] + 1;
+                }
+            }
+            if (waves[count] + 1 > wave_count) {
+                wave_count = waves[count] + 1;
+            }
+        }
+        count++;
+    }
+
+    // Run every wave as its own batch
+    int64 netns = registry_netns();
+    LinkRotation *wave = calloc(count + 1, sizeof(*wave));
+    netlink_batch_init(batch, socket_fd, NULL, NULL);
+    int w = 0;
+    for (; wave != NULL && w < wave_count; w++) {
+        int members = 0;
+        for (int i = 0; i < count; i++) {
+            if (waves[i] == w) {
+                wave[members++] = rotations[i];
+            }
+        }
+        int result = netlink_rotate(batch, wave, members);
+        if (result < 0) {
+            fprintf(stderr, "netlink batch: %s\n", strerror(-result));
+            status = EXIT_FAILURE;
+            break;
+        }
+        for (int i = 0, m = 0; i < count; i++) {
+            if (waves[i] == w) {
+                rotations[i] = wave[m++];          // Copy the outcome back in interface order
+                registry_settle(registry, &rotations[i], netns);
+                journal_record(journal, &rotations[i], netns);
+            }
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (waves[i] >= w) {
+            registry_release(registry, rotations[i].new_mac);  // Never sent
+        }
+    }
+    if (wave == NULL) {
+        perror("malloc");
+        status = EXIT_FAILURE;
+    }
+    if (status == EXIT_SUCCESS) {
+        status = report_rotations(rotations, count);
+    }
+
+    free(wave);
+    free(rotations);
+    free(waves);
+    free(batch);
+    return status;
+}
+
+/**
+ * @brief Loads a policy file and explains or applies it to every interface.
+ *
+ * @param path The policy file.
+ * @param apply Rotate the interfaces instead of only explaining the decisions.
+ * @return int EXIT_SUCCESS if successful, EXIT_FAILURE otherwise.
+ */
+static int run_policy(const char *path, bool apply) {
+    char error[256];
+    int64 started = monotonic_ns();
+    Policy *policy = policy_load(path, error, sizeof(error));
+    if (policy == NULL) {
+        fprintf(stderr, "macmasq: %s\n", error);
+        return EXIT_FAILURE;
+    }
+    int64 compiled = monotonic_ns() - started;
+
+    int socket_fd = netlink_open(0);
+    if (socket_fd < 0) {
+        fprintf(stderr, "netlink: %s\n", strerror(-socket_fd));
+        policy_free(policy);
+        return EXIT_FAILURE;
+    }
+    LinkTable links = { 0 };
+    int result = link_table_load(&links, socket_fd);
+    int status = EXIT_FAILURE;
+    if (result < 0) {
+        fprintf(stderr, "link dump: %s\n", strerror(-result));
+    } else if (apply) {
+        status = apply_policy(policy, &links, socket_fd);
+    } else {
+        printf("%d rules compiled in %lu us (%d trie nodes, %d byte classes)\n",
+               policy->rule_count, compiled / 1000, policy->node_count, policy->class_count);
+        status = explain_policy(policy, &links);
+    }
+
+    link_table_free(&links);
+    close(socket_fd);
+    policy_free(policy);
+    return status;
+}
+
+/**
+ * @brief Gives an interface the address it used the last time it was on the same network.
+ *
+ * A network seen for the first time gets a new random address, which is
+ * remembered for the next visit.
+ *
+ * @param interface The interface.
+ * @param path The sticky table.
+ * @return int EXIT_SUCCESS if successful, EXIT_FAILURE otherwise.
+ */
+static int run_sticky(const char *interface, const char *path) {
+    int32 ifindex = if_nametoindex(interface);
+    if (ifindex == 0) {
+        fprintf(stderr, "macmasq: %s: %s\n", interface, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    int socket_fd = netlink_open(0);
+    if (socket_fd < 0) {
+        fprintf(stderr, "netlink: %s\n", strerror(-socket_fd));
+        return EXIT_FAILURE;
+    }
+    NetworkFingerprint fingerprint;
+    int result = network_fingerprint(socket_fd, ifindex, interface, &fingerprint);
+    close(socket_fd);
+    if (result < 0) {
+        fprintf(stderr, "macmasq: %s: no default gateway, DHCP lease or SSID identifies the network\n", interface);
+        return EXIT_FAILURE;
+    }
+
+    char network[160];
+    network_fingerprint_format(&fingerprint, network, sizeof(network));
+    MacAddress mac;
+    bool known;
+    if ((result = sticky_address(path, interface, &fingerprint, &mac, &known)) < 0) {
+        fprintf(stderr, "macmasq: %s: %s\n", path, result == -EINVAL ? "not a sticky table" : strerror(-result));
+        return EXIT_FAILURE;
+    }
+
+    char text[MAC_STRING_LENGTH + 1];
+    mac_format(mac, text);
+    MacAddress current;
+    if (read_address(interface, &current) && mac_equal(current, mac)) {
+        // Already there: leave the link alone rather than drop the connection for nothing
+        printf("%s: Known network, MAC already in use: %s (%s)\n", interface, text, network);
+        return EXIT_SUCCESS;
+    }
+    if ((result = registry_reserve(registry, mac)) < 0) {
+        fprintf(stderr, "%s: %s: %s\n", interface, text,
+                result == -EADDRINUSE ? "held by another process or interface" : strerror(-result));
+        return EXIT_FAILURE;
+    }
+    LinkRotation trace;
+    bool changed = change_mac_address_traced(interface, mac, &trace);
+    int64 netns = registry_netns();
+    registry_settle(registry, &trace, netns);
+    journal_record(journal, &trace, netns);
+    if (!changed) {
+        fprintf(stderr, "%s: %s\n", interface, strerror(trace.error));
+        return EXIT_FAILURE;
+    }
+    printf("%s: %s MAC: %s (%s)\n", interface, known ? "Known network," : "New network, new", text, network);
+    return EXIT_SUCCESS;
+}
+
+/**
+* @brief Operation requested on the lease file.
+*/
+typedef enum lease_mode {
+    LEASE_NONE,                          // No lease option given
+    LEASE_ALLOC,                         // --lease-alloc
+    LEASE_FREE,                          // --lease-free MAC
+    LEASE_RENEW,                         // --lease-renew MAC
+    LEASE_STATUS,                        // --lease-status
+    LEASE_SERVE,                         // --lease-serve ADDRESS
+    LEASE_BENCH,                         // --lease-bench ADDRESS
+} LeaseMode;
+
+/**
+* @brief A lease command assembled from the command line.
+*/
+typedef struct lease_command {
+    LeaseMode mode;                      // What to do
+    const char *path;                    // Lease file
+    const char *block;                   // "XX:XX:XX" OUI, needed to create the file
+    const char *address;                 // Address given to --lease-free or --lease-renew
+    int64 ttl_s;                         // Lease lifetime, 0 for no expiry
+    const char *interface;               // Interface receiving an allocated address, or NULL
+    const char *server;                  // Lease server to use instead of the file, or to run
+    LeaseBenchOptions bench;             // Settings of --lease-bench
+} LeaseCommand;
+
+/**
+ * @brief Applies a freshly leased address to the interface of a lease command, if it names one.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+static int apply_lease(const LeaseCommand *command, MacAddress address) {
+    LinkRotation trace;
+    if (command->interface == NULL) {
+        return 0;
+    }
+    bool changed = change_mac_address_traced(command->interface, address, &trace);
+    journal_record(journal, &trace, registry_netns());
+    return changed ? 0 : -trace.error;
+}
+
+/**
+ * @brief Runs a lease command against the lease file (or serves the file with --lease-serve).
+ *
+ * @return int 0 on success, a negative errno, or 1 if the failure was already reported.
+ */
+static int run_lease_file(const LeaseCommand *command, const MacAddress *block, MacAddress *address) {
+    LeasePool pool;
+    int result = lease_pool_open(&pool, command->path, block);
+    if (result == -ENOENT && block == NULL) {
+        fprintf(stderr, "macmasq: %s: no lease file, create it with --lease-block XX:XX:XX\n", command->path);
+        return 1;
+    }
+    if (result < 0) {
+        fprintf(stderr, "macmasq: %s: %s\n", command->path,
+                result == -EINVAL ? "not a lease file for this block" : strerror(-result));
+        return 1;
+    }
+
+    LeaseStatus status;
+    switch (command->mode) {
+    case LEASE_ALLOC:
+        result = lease_alloc(&pool, command->ttl_s, address);
+        if (result == 0 && (result = apply_lease(command, *address)) < 0) {
+            lease_free(&pool, *address);               // The lease would otherwise leak
+        }
+        break;
+    case LEASE_FREE:
+        result = lease_free(&pool, *address);
+        break;
+    case LEASE_RENEW:
+        result = lease_renew(&pool, *address, command->ttl_s);
+        break;
+    case LEASE_SERVE:
+        result = lease_serve(command->server, &pool);
+        if (result < 0) {
+            fprintf(stderr, "macmasq: %s: %s\n", command->server, strerror(-result));
+            result = 1;
+        }
+        break;
+    default:
+        result = lease_status(&pool, &status);
+        if (result == 0) {
+            char oui[MAC_STRING_LENGTH + 1];
+            mac_format(status.block, oui);
+            oui[8] = '\0';
+            printf("block %s leased %lu (bitmap %lu) expiring %lu recoveries %lu\n",
+                   oui, status.used, status.counted, status.timed, status.recoveries);
+        }
+        break;
+    }
+    lease_pool_close(&pool);
+    return result;
+}
+
+/**
+ * @brief Runs a lease command through a lease server.
+ *
+ * @return int 0 on success, a negative errno, or 1 if the failure was already reported.
+ */
+static int run_lease_client(const LeaseCommand *command, MacAddress *address) {
+    if (command->mode == LEASE_STATUS) {
+        fprintf(stderr, "macmasq: --lease-status reads the lease file, run it on the server\n");
+        return 1;
+    }
+    LeaseClient client;
+    int result = lease_client_connect(&client, command->server, 1, command->ttl_s);
+    if (result < 0) {
+        fprintf(stderr, "macmasq: %s: %s\n", command->server, strerror(-result));
+        return 1;
+    }
+    if (command->mode == LEASE_ALLOC) {
+        result = lease_client_alloc(&client, address);
+        if (result == 0 && (result = apply_lease(command, *address)) < 0) {
+            lease_client_request(&client, LEASE_OP_FREE, address, 1);
+        }
+    } else {
+        result = lease_client_request(&client, command->mode == LEASE_FREE ? LEASE_OP_FREE : LEASE_OP_RENEW,
+                                      address, 1);
+        result = result < 0 ? result : 0;
+    }
+    lease_client_close(&client);
+    return result;
+}
+
+/**
+ * @brief Runs a lease command, against the lease file or a lease server.
+ *
+ * An address allocated for an interface is returned to the block if the
+ * interface refuses it.
+ *
+ * @return int EXIT_SUCCESS if successful, EXIT_FAILURE otherwise.
+ */
+static int run_lease(const LeaseCommand *command) {
+    MacAddress block = {{0}};
+    MacAddress address = {{0}};
+    if (command->block != NULL) {
+        char text[MAC_STRING_LENGTH + 1];
+        int length = snprintf(text, sizeof(text), "%s:00:00:00", command->block);
+        if (length != MAC_STRING_LENGTH || !mac_parse(text, MAC_STRING_LENGTH, &block) || (block.bytes[0] & 0x01)) {
+            fprintf(stderr, "macmasq: invalid lease block \"%s\" (expected a unicast XX:XX:XX)\n", command->block);
+            return EXIT_FAILURE;
+        }
+    }
+    if (command->address != NULL &&
+        !mac_parse(command->address, strlen(command->address), &address)) {
+        fprintf(stderr, "macmasq: invalid MAC address \"%s\"\n", command->address);
+        return EXIT_FAILURE;
+    }
+
+    if (command->mode == LEASE_BENCH) {
+        int result = lease_bench(&command->bench);
+        if (result < 0) {
+            fprintf(stderr, "macmasq: %s: %s\n", command->bench.address, strerror(-result));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    int result;
+    if (command->server != NULL && command->mode != LEASE_SERVE) {
+        result = run_lease_client(command, &address);
+    } else {
+        result = run_lease_file(command, command->block ? &block : NULL, &address);
+    }
+    if (result == 1) {
+        return EXIT_FAILURE;                           // Already reported
+    }
+
+    if (result < 0) {
+        const char *subject = command->interface ? command->interface : command->address ? command->address : command->path;
+        fprintf(stderr, "macmasq: %s: %s\n", subject,
+                result == -EINVAL ? "address outside the lease block" :
+                result == -ENOENT ? "address not leased" : strerror(-result));
+        return EXIT_FAILURE;
+    }
+    if (command->mode == LEASE_ALLOC) {
+        char mac[MAC_STRING_LENGTH + 1];
+        mac_format(address, mac);
+        if (command->interface != NULL) {
+            printf("%s: New MAC: %s\n", command->interface, mac);
+        } else {
+            printf("%s\n", mac);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prints one line of a --measure-ttff timeline.
+ */
+static void print_ttff_event(FILE *output, const char *event, int64 offset_ns, const char *missing) {
+    if (offset_ns == 0 && missing != NULL) {
+        fprintf(output, "  %-12s %s\n", event, missing);
+    } else {
+        fprintf(output, "  %-12s %10.3f ms\n", event, offset_ns / 1e6);
+    }
+}
+
+/**
+ * @brief Prints the timeline of a --measure-ttff change, up to the first frame with the new address.
+ */
+static void print_ttff_timeline(FILE *output, const TtffTimeline *timeline, int64 timeout_ns) {
+    print_ttff_event(output, "invoke", 0, NULL);
+    print_ttff_event(output, "down", timeline->down_ns, "-");
+    print_ttff_event(output, "set", timeline->set_ns, "-");
+    print_ttff_event(output, "up", timeline->up_ns, "-");
+    print_ttff_event(output, "carrier", timeline->carrier_ns, "not seen");
+    if (timeline->first_frame_ns == 0) {
+        fprintf(output, "  %-12s none within %.1f s (captured on %s)\n", "first frame", timeout_ns / 1e9,
+                timeline->capture);
+    } else {
+        fprintf(output, "  %-12s %10.3f ms (captured on %s)\n", "first frame", timeline->first_frame_ns / 1e6,
+                timeline->capture);
+    }
+}
+
+/**
+ * @brief Changes the MAC address of an interface while watching for the first frame that leaves with it.
+ *
+ * @param interface The interface.
+ * @param new_mac The address to apply.
+ * @param timeout_ns Longest wait for the first frame.
+ * @param trace Receives the outcome (a capture that cannot start fails the change before it is made).
+ * @param timeline Receives the timeline of the change.
+ * @return true if the address was changed.
+ */
+static bool change_mac_address_ttff(const char *interface, MacAddress new_mac, int64 timeout_ns,
+                                    LinkRotation *trace, TtffTimeline *timeline) {
+    TtffCapture *capture;
+    int result = ttff_start(interface, new_mac, timeout_ns, &capture);
+    if (result < 0) {
+        memset(trace, 0, sizeof(*trace));
+        strncpy(trace->name, interface, IFNAMSIZ - 1);
+        trace->new_mac = new_mac;
+        trace->error = -result;
+        fprintf(stderr, "macmasq: capture on %s: %s\n", interface, strerror(-result));
+        return false;
+    }
+    int64 invoked = monotonic_ns();
+    bool changed = change_mac_address_traced(interface, new_mac, trace);
+    ttff_finish(capture, invoked, trace, timeline);
+    return changed;
+}
+
+/**
+ * @brief Sets the address of an interface without taking it down (SIOCSIFHWADDR while up).
+ *
+ * @return true if the driver accepted the change.
+ */
+static bool change_mac_address_live(const char *interface, MacAddress new_mac, LinkRotation *trace) {
+    struct ifreq request;
+    memset(&request, 0, sizeof(request));
+    strncpy(request.ifr_name, interface, IFNAMSIZ - 1);
+    memset(trace, 0, sizeof(*trace));
+    memcpy(trace->name, request.ifr_name, IFNAMSIZ);
+    trace->new_mac = new_mac;
+    trace->live = true;
+    trace->backend = BACKEND_IOCTL;
+    int64 started = monotonic_ns();
+    int socket_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0) {
+        trace->error = errno;
+        return false;
+    }
+    if (ioctl(socket_fd, SIOCGIFINDEX, &request) == 0) {
+        trace->ifindex = request.ifr_ifindex;
+    }
+    if (ioctl(socket_fd, SIOCGIFHWADDR, &request) == 0) {
+        memcpy(trace->old_mac.bytes, request.ifr_hwaddr.sa_data, 6);
+    }
+    request.ifr_hwaddr.sa_family = ARPHRD_ETHER;
+    memcpy(request.ifr_hwaddr.sa_data, new_mac.bytes, 6);
+    trace->error = ioctl(socket_fd, SIOCSIFHWADDR, &request) < 0 ? errno : 0;
+    trace->set_ns = trace->total_ns = monotonic_ns() - started;
+    close(socket_fd);
+    return trace->error == 0;
+}
+
+/**
+ * @brief Changes the address of one interface without letting its outage exceed a budget (--max-outage).
+ *
+ * A driver the capability cache knows as slow gets a live change first,
+ * which costs no outage at all. If it refuses and a budget is set, the
+ * address is kept. Otherwise the interface is cycled under an outage
+ * watch; if it does not run again within the budget, its old address and
+ * flags are put back and its driver is marked slow.
+ *
+ * @param interface The interface.
+ * @param new_mac The address to apply.
+ * @param budget_ns Longest outage allowed, 0 for no limit.
+ * @param cache_path The capability cache.
+ * @param trace Receives the outcome (ETIMEDOUT if the change was rolled back).
+ * @return true if the new address was applied and kept.
+ */
+static bool change_mac_address_budgeted(const char *interface, MacAddress new_mac, int64 budget_ns,
+                                        const char *cache_path, LinkRotation *trace) {
+    char driver[DRIVER_NAME_SIZE] = "";
+    DriverCapability capability;
+    if (driver_name(interface, driver) == 0 && capability_lookup(cache_path, driver, &capability) == 0 &&
+        capability.slow) {
+        if (change_mac_address_live(interface, new_mac, trace)) {
+            return true;
+        }
+        if (budget_ns > 0) {
+            fprintf(stderr, "%s: driver %s took %.0f ms to come back before and refuses a live change, keeping the address\n",
+                    interface, driver, capability.outage_ns / 1e6);
+            return false;
+        }
+    }
+    if (budget_ns == 0) {
+        return change_mac_address_traced(interface, new_mac, trace);
+    }
+
+    OutageWatch *watch;
+    int result = outage_watch_start(interface, budget_ns, &watch);
+    if (result < 0) {
+        memset(trace, 0, sizeof(*trace));
+        strncpy(trace->name, interface, IFNAMSIZ - 1);
+        trace->new_mac = new_mac;
+        trace->error = -result;
+        fprintf(stderr, "%s: cannot watch the outage: %s\n", interface, strerror(-result));
+        return false;
+    }
+    bool changed = change_mac_address_traced(interface, new_mac, trace);
+    int64 outage_ns;
+    if (outage_watch_finish(watch, trace, &outage_ns) == -ETIMEDOUT) {
+        // The old address is unknown if SIOCGIFHWADDR failed: never put 00:00:00:00:00:00 on the link
+        static const MacAddress zero = { { 0 } };
+        LinkRotation rollback;
+        bool known = !mac_equal(trace->old_mac, zero);
+        bool restored = known && change_mac_address_traced(interface, trace->old_mac, &rollback);
+        fprintf(stderr, "%s: still down after %.1f ms (budget %.1f ms), %s\n", interface, outage_ns / 1e6,
+                budget_ns / 1e6, restored ? "old address put back" :
+                known ? "old address could not be put back" : "old address unknown, nothing put back");
+        if (driver[0] != '\0' && (result = capability_mark_slow(cache_path, driver, outage_ns)) < 0) {
+            fprintf(stderr, "macmasq: capability cache %s: %s\n", cache_path, strerror(-result));
+        }
+        trace->error = ETIMEDOUT;
+        return false;
+    }
+    return changed;
+}
+
+/**
+ * @brief Computes the rotation of every targeted interface and writes it as a plan (--plan).
+ *
+ * @param options Targets and the plan file; the policy is loaded here.
+ * @param policy_path Policy drawing the addresses and strategies, NULL for random cycles.
+ * @return int EXIT_SUCCESS if the plan was written, EXIT_FAILURE otherwise.
+ */
+static int write_plan(PlanOptions *options, const char *policy_path) {
+    Policy *policy = NULL;
+    if (policy_path != NULL) {
+        char error[256];
+        policy = policy_load(policy_path, error, sizeof(error));
+        if (policy == NULL) {
+            fprintf(stderr, "macmasq: %s\n", error);
+            return EXIT_FAILURE;
+        }
+    }
+    options->policy = policy;
+    int entries, namespaces;
+    int result = plan_write(options, &entries, &namespaces);
+    policy_free(policy);
+    if (result < 0) {
+        fprintf(stderr, "macmasq: plan %s: %s\n", options->path, strerror(-result));
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "macmasq: planned %d interfaces in %d namespaces into %s\n", entries, namespaces, options->path);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Applies a plan written by --plan (--apply-plan).
+ *
+ * @return int EXIT_SUCCESS if every interface of the plan has its new address, EXIT_FAILURE otherwise.
+ */
+static int apply_plan(const PlanApplyOptions *options) {
+    PlanReport report;
+    int result = plan_apply(options, &report);
+    if (result < 0) {
+        fprintf(stderr, "macmasq: plan %s: %s\n", options->path, strerror(-result));
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "macmasq: %d of %d interfaces in %d namespaces changed in %d batches (%.1f ms), "
+            "%d already done, %d changed since the plan, %d failed\n",
+            report.applied, report.entries, report.namespaces, report.batches, report.elapsed_ns / 1e6,
+            report.skipped, report.stale, report.failed);
+    return report.stale > 0 || report.failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+* @brief What --parallel rotates, and how.
+*/
+typedef struct parallel_command {
+    const char *pattern;               // Interface name pattern, NULL for physical interfaces
+    const char **netns;                // Namespaces named with --netns
+    int netns_count;                   // Entries of netns
+    bool netns_all;                    // Every namespace of "ip netns" (--netns-all)
+    int workers;                       // Threads of the pool
+    MacBackend backend;                // BACKEND_IOCTL or BACKEND_NETLINK
+    AuditOptions audit;                // Audit log of every rotation (path NULL to disable)
+    MacRegistry *registry;             // Host-wide address registry, NULL to reserve nothing
+    Journal *journal;                  // Journal of original addresses, NULL to record nothing
+} ParallelCommand;
+
+/**
+ * @brief Rotates many interfaces, possibly across namespaces, with the adaptive worker pool.
+ *
+ * The concurrency the pool settled on is reported on stderr.
+ *
+ * @return int EXIT_SUCCESS if every change succeeded, EXIT_FAILURE otherwise.
+ */
+static int run_parallel(const ParallelCommand *command) {
+    WorkSet set = { 0 };
+    int result = 0;
+    const char *failed = NULL;
+    for (int i = 0; i < command->netns_count && result == 0; i++) {
+        result = work_set_add_netns(&set, command->netns[i]);
+        failed = command->netns[i];
+    }
+    if (result == 0 && command->netns_all) {
+        result = work_set_add_all_netns(&set);
+        failed = NETNS_RUN_DIR;
+    }
+    if (result == 0 && set.netns_count == 0) {
+        result = work_set_add_netns(&set, NULL);       // The current namespace
+    }
+    if (result == 0) {
+        result = work_set_collect(&set, command->pattern);
+        failed = "link dump";
+    }
+    AuditLog *audit = NULL;
+    if (result == 0 && command->audit.path != NULL) {
+        result = audit_open(&command->audit, &audit);
+        failed = command->audit.path;
+    }
+    WorkPoolReport report;
+    if (result == 0) {
+        result = work_pool_run(&set, command->workers, command->backend, audit, command->registry,
+                               command->journal, &report);
+        failed = "worker pool";
+    }
+    audit_close(audit);                                // Every record is written and synced once the pool is done
+    if (result < 0) {
+        fprintf(stderr, "macmasq: %s: %s\n", failed, strerror(-result));
+        work_set_free(&set);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int i = 0; i < set.count; i++) {
+        const LinkRotation *rotation = &set.rotations[i];
+        const char *netns = set.netns_names[set.netns_of[i]];
+        char mac[MAC_STRING_LENGTH + 1];
+        if (rotation->error != 0) {
+            status = EXIT_FAILURE;
+        }
+        if (json_mode) {
+            json_write_rotation(&json_output, rotation);
+        } else if (rotation->error != 0) {
+            fprintf(stderr, "%s%s%s%s: %s\n", rotation->name, *netns ? " (netns " : "", netns, *netns ? ")" : "",
+                    strerror(rotation->error));
+        } else {
+            mac_format(rotation->new_mac, mac);
+            printf("%s%s%s%s: New MAC: %s\n", rotation->name, *netns ? " (netns " : "", netns, *netns ? ")" : "", mac);
+        }
+    }
+    json_writer_flush(&json_output);
+
+    double seconds = report.elapsed_ns / 1e9;
+    fprintf(stderr, "macmasq: %d interfaces in %d namespaces in %.1f ms (%.0f/s) with %s\n",
+            set.count, set.netns_count, report.elapsed_ns / 1e6, seconds > 0 ? set.count / seconds : 0.0,
+            backend_name(report.backend));
+    fprintf(stderr, "macmasq: concurrency settled at %d of %d workers (peak %d, mean %.1f, %d up, %d down), "
+            "latency p50 %.1f us p99 %.1f us, %ld steals\n",
+            report.final_limit, report.workers, report.peak_limit, report.mean_limit, report.increases,
+            report.decreases, report.p50_ns / 1e3, report.p99_ns / 1e3, (long)report.steals);
+    work_set_free(&set);
+    return status;
+}
+
 /**
  * @brief Main function to change the MAC address of a specified network interface.
  *
  * This program generates a random MAC address and attempts to apply it to the given
  * network interface. It prints the new MAC address if successful, or an error message otherwise.
+ * With --all-physical, every physical interface is randomized in a single netlink batch.
  *
  * @param argc The number of command-line arguments.
  * @param argv Array of command-line argument strings.
  * @return (int) EXIT_SUCCESS if successful, EXIT_FAILURE otherwise.
  */
 int main(int argc, char **argv) {
+    // Values of the options without a short letter (every letter is taken)
+    enum {
+        OPTION_AUDIT_LOG = 256,
+        OPTION_AUDIT_FSYNC_MS,
+        OPTION_AUDIT_OVERFLOW,
+        OPTION_AUDIT_RING,
+        OPTION_REGISTRY,
+        OPTION_NO_REGISTRY,
+        OPTION_JOURNAL,
+        OPTION_RESTORE_PERMANENT,
+        OPTION_PLAN,
+        OPTION_APPLY_PLAN,
+        OPTION_SHOW_PLAN,
+        OPTION_RATE_LIMIT,
+        OPTION_RATE_BURST,
+        OPTION_OPPORTUNISTIC_WINDOW,
+        OPTION_MAX_OUTAGE,
+        OPTION_CAPABILITY_CACHE,
+        OPTION_CHECKPOINT,
+        OPTION_NO_CHECKPOINT,
+    };
+    // Long options understood by the tool
+    static const struct option long_options[] = {
+        { "all-physical", no_argument, NULL, 'A' },
+        { "udev",         no_argument, NULL, 'U' },
+        { "stdin",        no_argument, NULL, 'S' },
+        { "batch-size",   required_argument, NULL, 'B' },
+        { "batch-window-us", required_argument, NULL, 'W' },
+        { "json",         no_argument, NULL, 'J' },
+        { "policy",       required_argument, NULL, 'P' },
+        { "apply",        no_argument, NULL, 'a' },
+        { "daemon",       no_argument, NULL, 'D' },
+        { "metrics",      required_argument, NULL, 'M' },
+        { "metrics-interval", required_argument, NULL, 'I' },
+        { "lease-file",   required_argument, NULL, 'L' },
+        { "lease-block",  required_argument, NULL, 'O' },
+        { "lease-alloc",  no_argument, NULL, 'l' },
+        { "lease-free",   required_argument, NULL, 'f' },
+        { "lease-renew",  required_argument, NULL, 'r' },
+        { "lease-ttl",    required_argument, NULL, 't' },
+        { "lease-status", no_argument, NULL, 's' },
+        { "sticky",       no_argument, NULL, 'Y' },
+        { "sticky-file",  required_argument, NULL, 'y' },
+        { "lease-serve",  required_argument, NULL, 'V' },
+        { "lease-server", required_argument, NULL, 'C' },
+        { "lease-reserve", required_argument, NULL, 'R' },
+        { "lease-bench",  required_argument, NULL, 'K' },
+        { "bench-clients", required_argument, NULL, 'c' },
+        { "bench-allocs", required_argument, NULL, 'n' },
+        { "parallel",     no_argument, NULL, 'Q' },
+        { "workers",      required_argument, NULL, 'w' },
+        { "backend",      required_argument, NULL, 'b' },
+        { "netns",        required_argument, NULL, 'N' },
+        { "netns-all",    no_argument, NULL, 'E' },
+        { "measure-ttff", no_argument, NULL, 'T' },
+        { "ttff-timeout", required_argument, NULL, 'i' },
+        { "bench-disruption", no_argument, NULL, 'X' },
+        { "bench-rate",   required_argument, NULL, 'p' },
+        { "bench-rotations", required_argument, NULL, 'o' },
+        { "bench-interval-ms", required_argument, NULL, 'v' },
+        { "bench-rtnl",   no_argument, NULL, 'G' },
+        { "churn",        required_argument, NULL, 'u' },
+        { "churn-threads", required_argument, NULL, 'j' },
+        { "bench-interfaces", required_argument, NULL, 'x' },
+        { "bench-duration-ms", required_argument, NULL, 'd' },
+        { "bench-sim",    no_argument, NULL, 'Z' },
+        { "sim-interfaces", required_argument, NULL, 'z' },
+        { "sim-duration", required_argument, NULL, 'm' },
+        { "sim-seed",     required_argument, NULL, 'e' },
+        { "sim-rtnl-load", required_argument, NULL, 'k' },
+        { "record-trace", required_argument, NULL, 'F' },
+        { "record-duration", required_argument, NULL, 'g' },
+        { "replay-trace", required_argument, NULL, 'H' },
+        { "replay-speed", required_argument, NULL, 'q' },
+        { "audit-log",    required_argument, NULL, OPTION_AUDIT_LOG },
+        { "audit-fsync-ms", required_argument, NULL, OPTION_AUDIT_FSYNC_MS },
+        { "audit-overflow", required_argument, NULL, OPTION_AUDIT_OVERFLOW },
+        { "audit-ring",   required_argument, NULL, OPTION_AUDIT_RING },
+        { "registry",     required_argument, NULL, OPTION_REGISTRY },
+        { "no-registry",  no_argument, NULL, OPTION_NO_REGISTRY },
+        { "journal",      required_argument, NULL, OPTION_JOURNAL },
+        { "restore-permanent", no_argument, NULL, OPTION_RESTORE_PERMANENT },
+        { "plan",         required_argument, NULL, OPTION_PLAN },
+        { "apply-plan",   required_argument, NULL, OPTION_APPLY_PLAN },
+        { "show-plan",    required_argument, NULL, OPTION_SHOW_PLAN },
+        { "rate-limit",   required_argument, NULL, OPTION_RATE_LIMIT },
+        { "rate-burst",   required_argument, NULL, OPTION_RATE_BURST },
+        { "opportunistic-window", required_argument, NULL, OPTION_OPPORTUNISTIC_WINDOW },
+        { "max-outage",   required_argument, NULL, OPTION_MAX_OUTAGE },
+        { "capability-cache", required_argument, NULL, OPTION_CAPABILITY_CACHE },
+        { "checkpoint",   required_argument, NULL, OPTION_CHECKPOINT },
+        { "no-checkpoint", no_argument, NULL, OPTION_NO_CHECKPOINT },
+        { "help",         no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    bool all_physical = false;         // Randomize every physical interface
+    bool restore = false;              // Put the original addresses back (--restore-permanent)
+    bool udev = false;                 // Handle the udev event described by the environment
+    bool from_stdin = false;           // Apply the commands read from stdin
+    const char *policy_path = NULL;    // Policy file to explain or apply
+    bool apply_policy_now = false;     // Apply the policy instead of explaining it
+    bool daemon = false;               // Keep running and rotate on the policy schedule
+    bool sticky = false;               // Reuse the address remembered for the attached network
+    const char *sticky_path = STICKY_DEFAULT_PATH;
+    LeaseCommand lease = {             // Lease file operation
+        .mode = LEASE_NONE,
+        .path = LEASE_DEFAULT_PATH,
+        .bench = { .clients = 64, .allocations = 10000, .reserve = LEASE_NET_DEFAULT_RESERVE },
+    };
+    bool parallel = false;             // Rotate with the adaptive worker pool
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    ParallelCommand parallel_command = {
+        .netns = calloc(argc, sizeof(char *)),
+        .workers = processors > 0 && processors * 2 < WORK_POOL_MAX_WORKERS ? (int)processors * 2 : WORK_POOL_MAX_WORKERS,
+        .backend = BACKEND_NETLINK,
+    };
+    bool measure_ttff = false;         // Time the change up to the first frame with the new address
+    int64 ttff_timeout_ns = TTFF_DEFAULT_TIMEOUT_S * 1000000000UL;
+    bool disruption = false;           // Run the disruption benchmark
+    DisruptionOptions disruption_options = {
+        .rate = DISRUPTION_DEFAULT_RATE,
+        .rotations = DISRUPTION_DEFAULT_ROTATIONS,
+        .interval_ns = DISRUPTION_DEFAULT_INTERVAL_MS * 1000000UL,
+    };
+    bool contention = false;           // Run the RTNL contention benchmark
+    ContentionOptions contention_options = {
+        .interfaces = CONTENTION_DEFAULT_INTERFACES,
+        .duration_ns = CONTENTION_DEFAULT_DURATION_MS * 1000000UL,
+        .churn = CHURN_ALL,
+        .threads = 1,
+    };
+    DaemonOptions daemon_options = {   // Configuration of --daemon
+        .metrics_interval_ns = DAEMON_DEFAULT_METRICS_INTERVAL_S * 1000000000UL,
+        .backend = BACKEND_NETLINK_BATCH,
+        .checkpoint_path = CHECKPOINT_DEFAULT_PATH,
+    };
+    bool simulation = false;           // Run the daemon against the simulated kernel
+    SimBenchOptions sim_options = {
+        .sim = {
+            .interfaces = SIM_DEFAULT_INTERFACES,
+            .seed = 1,
+            .rtnl_load = SIM_DEFAULT_RTNL_LOAD,
+            .event_queue = SIM_DEFAULT_EVENT_QUEUE,
+        },
+        .duration_ns = SIM_DEFAULT_DURATION_S * 1000000000UL,
+        .all_backends = true,
+    };
+    const char *record_path = NULL;    // Record the link events to this trace
+    int64 record_duration_ns = 0;      // Length of the recording, 0 until interrupted
+    TraceReplayOptions replay_options = {  // Replay of a trace (trace_path is NULL without --replay-trace)
+        .speed = 1,
+        .backend = BACKEND_NETLINK_BATCH,
+    };
+    AuditOptions audit_options = {     // Audit log of --daemon and --parallel
+        .ring = AUDIT_DEFAULT_RING,
+        .fsync_interval_ns = AUDIT_DEFAULT_FSYNC_MS * 1000000UL,
+        .overflow = AUDIT_BLOCK,
+    };
+    const char *registry_path = REGISTRY_DEFAULT_PATH;  // Address registry, NULL with --no-registry
+    const char *journal_path = JOURNAL_DEFAULT_PATH;    // Journal of original addresses
+    const char *plan_path = NULL;      // Write a plan here (--plan)
+    const char *apply_plan_path = NULL;  // Apply this plan (--apply-plan)
+    const char *show_plan_path = NULL; // Print this plan (--show-plan)
+    int64 max_outage_ns = 0;           // Outage budget of a single interface change, 0 for none
+    const char *capability_path = CAPABILITY_DEFAULT_PATH;  // Drivers known to be slow to come back
+    bool backend_given = false;        // --backend was used
+    MacBackend backend = BACKEND_NETLINK;
+    StreamOptions stream_options = {   // Batching of the --stdin commands
+        .batch_size = STREAM_DEFAULT_BATCH_SIZE,
+        .window_ns = STREAM_DEFAULT_WINDOW_US * 1000UL,
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (option) {
+        case 'A':
+            all_physical = true;
+            break;
+        case 'U':
+            udev = true;
+            break;
+        case 'S':
+            from_stdin = true;
+            break;
+        case 'B':
+            stream_options.batch_size = atoi(optarg);
+            break;
+        case 'W':
+            stream_options.window_ns = strtoul(optarg, NULL, 10) * 1000UL;
+            break;
+        case 'J':
+            json_mode = true;
+            break;
+        case 'P':
+            policy_path = optarg;
+            break;
+        case 'a':
+            apply_policy_now = true;
+            break;
+        case 'D':
+            daemon = true;
+            break;
+        case 'M':
+            daemon_options.metrics_path = optarg;
+            break;
+        case 'I':
+            daemon_options.metrics_interval_ns = strtoul(optarg, NULL, 10) * 1000000000UL;
+            break;
+        case 'L':
+            lease.path = optarg;
+            break;
+        case 'O':
+            lease.block = optarg;
+            break;
+        case 'l':
+            lease.mode = LEASE_ALLOC;
+            break;
+        case 'f':
+            lease.mode = LEASE_FREE;
+            lease.address = optarg;
+            break;
+        case 'r':
+            lease.mode = LEASE_RENEW;
+            lease.address = optarg;
+            break;
+        case 't':
+            lease.ttl_s = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            lease.mode = LEASE_STATUS;
+            break;
+        case 'Y':
+            sticky = true;
+            break;
+        case 'y':
+            sticky_path = optarg;
+            break;
+        case 'V':
+            lease.mode = LEASE_SERVE;
+            lease.server = optarg;
+            break;
+        case 'C':
+            lease.server = optarg;
+            break;
+        case 'R':
+            lease.bench.reserve = atoi(optarg);
+            break;
+        case 'K':
+            lease.mode = LEASE_BENCH;
+            lease.bench.address = optarg;
+            break;
+        case 'c':
+            lease.bench.clients = atoi(optarg);
+            break;
+        case 'n':
+            lease.bench.allocations = atoi(optarg);
+            break;
+        case 'Q':
+            parallel = true;
+            break;
+        case 'w':
+            parallel_command.workers = atoi(optarg);
+            break;
+        case 'b':
+            for (backend = BACKEND_IOCTL; backend <= BACKEND_NETLINK_BATCH; backend++) {
+                if (strcmp(optarg, backend_name(backend)) == 0) {
+                    break;
+                }
+            }
+            if (backend > BACKEND_NETLINK_BATCH) {
+                fprintf(stderr, "macmasq: unknown backend \"%s\" (expected ioctl, netlink or netlink-batch)\n", optarg);
+                return EXIT_FAILURE;
+            }
+            backend_given = true;
+            break;
+        case 'N':
+            parallel_command.netns[parallel_command.netns_count++] = optarg;
+            break;
+        case 'E':
+            parallel_command.netns_all = true;
+            break;
+        case 'T':
+            measure_ttff = true;
+            break;
+        case 'i':
+            ttff_timeout_ns = (int64)(atof(optarg) * 1e9);
+            break;
+        case 'X':
+            disruption = true;
+            break;
+        case 'p':
+            disruption_options.rate = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            disruption_options.rotations = atoi(optarg);
+            break;
+        case 'v':
+            disruption_options.interval_ns = strtoul(optarg, NULL, 10) * 1000000UL;
+            break;
+        case 'G':
+            contention = true;
+            break;
+        case 'u':
+            if (parse_churn_kinds(optarg, &contention_options.churn) < 0) {
+                fprintf(stderr, "macmasq: unknown background load \"%s\" (expected routes, addresses, links or all)\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'j':
+            contention_options.threads = atoi(optarg);
+            break;
+        case 'x':
+            contention_options.interfaces = atoi(optarg);
+            break;
+        case 'd':
+            contention_options.duration_ns = strtoul(optarg, NULL, 10) * 1000000UL;
+            break;
+        case 'Z':
+            simulation = true;
+            break;
+        case 'z':
+            sim_options.sim.interfaces = atoi(optarg);
+            break;
+        case 'm':
+            sim_options.duration_ns = strtoul(optarg, NULL, 10) * 1000000000UL;
+            break;
+        case 'e':
+            sim_options.sim.seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'k':
+            sim_options.sim.rtnl_load = atoi(optarg);
+            break;
+        case 'F':
+            record_path = optarg;
+            break;
+        case OPTION_AUDIT_LOG:
+            audit_options.path = optarg;
+            break;
+        case OPTION_AUDIT_FSYNC_MS:
+            audit_options.fsync_interval_ns = strtoul(optarg, NULL, 10) * 1000000UL;
+            break;
+        case OPTION_AUDIT_OVERFLOW:
+            if (parse_audit_overflow(optarg, &audit_options.overflow) < 0) {
+                fprintf(stderr, "macmasq: --audit-overflow must be block or drop\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPTION_AUDIT_RING:
+            audit_options.ring = atoi(optarg);
+            if (audit_options.ring < 2 || (audit_options.ring & (audit_options.ring - 1)) != 0) {
+                fprintf(stderr, "macmasq: --audit-ring must be a power of two\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPTION_REGISTRY:
+            registry_path = optarg;
+            break;
+        case OPTION_NO_REGISTRY:
+            registry_path = NULL;
+            break;
+        case OPTION_JOURNAL:
+            journal_path = optarg;
+            break;
+        case OPTION_RESTORE_PERMANENT:
+            restore = true;
+            break;
+        case OPTION_PLAN:
+            plan_path = optarg;
+            break;
+        case OPTION_APPLY_PLAN:
+            apply_plan_path = optarg;
+            break;
+        case OPTION_SHOW_PLAN:
+            show_plan_path = optarg;
+            break;
+        case OPTION_RATE_LIMIT:
+            daemon_options.rate_limit = strtoul(optarg, NULL, 10);
+            sim_options.rate_limit = daemon_options.rate_limit;
+            break;
+        case OPTION_RATE_BURST:
+            daemon_options.rate_burst = atoi(optarg);
+            sim_options.rate_burst = daemon_options.rate_burst;
+            break;
+        case OPTION_OPPORTUNISTIC_WINDOW:
+            daemon_options.opportunistic_ns = strtoul(optarg, NULL, 10) * 1000000000UL;
+            replay_options.opportunistic_ns = daemon_options.opportunistic_ns;
+            break;
+        case OPTION_MAX_OUTAGE:
+            max_outage_ns = strtoul(optarg, NULL, 10) * 1000000UL;
+            break;
+        case OPTION_CAPABILITY_CACHE:
+            capability_path = optarg;
+            break;
+        case OPTION_CHECKPOINT:
+            daemon_options.checkpoint_path = optarg;
+            break;
+        case OPTION_NO_CHECKPOINT:
+            daemon_options.checkpoint_path = NULL;
+            break;
+        case 'g':
+            record_duration_ns = strtoul(optarg, NULL, 10) * 1000000000UL;
+            break;
+        case 'H':
+            replay_options.trace_path = optarg;
+            break;
+        case 'q':
+            replay_options.speed = strcmp(optarg, "original") == 0 ? 1 : strcmp(optarg, "max") == 0 ? 0 : atof(optarg);
+            if (replay_options.speed <= 0 && strcmp(optarg, "max") != 0) {
+                fprintf(stderr, "macmasq: --replay-speed must be original, max or a positive factor\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    json_writer_init(&json_output, STDOUT_FILENO, json_buffer, sizeof(json_buffer));
+    if (json_mode) {
+        stream_options.json = &json_output;
+    }
+    daemon_options.audit = audit_options;
+    parallel_command.audit = audit_options;
+    if (backend_given) {
+        parallel_command.backend = backend;
+        daemon_options.backend = backend;
+        sim_options.backend = backend;
+        sim_options.all_backends = false;
+        replay_options.backend = backend;
+    }
+
+    if (contention) {
+        if (contention_options.interfaces < 1 || contention_options.interfaces > CONTENTION_MAX_INTERFACES ||
+            contention_options.threads < 1 || contention_options.threads > CONTENTION_MAX_THREADS ||
+            contention_options.duration_ns == 0) {
+            fprintf(stderr, "macmasq: --bench-interfaces (at most %d), --churn-threads (at most %d) and --bench-duration-ms must be positive\n",
+                    CONTENTION_MAX_INTERFACES, CONTENTION_MAX_THREADS);
+            return EXIT_FAILURE;
+        }
+        int result = contention_bench(&contention_options);
+        if (result < 0) {
+            fprintf(stderr, "macmasq: RTNL contention benchmark: %s\n", strerror(-result));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (simulation) {
+        if (sim_options.sim.interfaces < 1 || sim_options.sim.interfaces > SIM_MAX_INTERFACES ||
+            sim_options.duration_ns == 0 || sim_options.sim.rtnl_load < 0 || sim_options.sim.rtnl_load > 90) {
+            fprintf(stderr, "macmasq: --sim-interfaces (at most %d) and --sim-duration must be positive, --sim-rtnl-load at most 90\n",
+                    SIM_MAX_INTERFACES);
+            return EXIT_FAILURE;
+        }
+        sim_options.policy_path = policy_path;
+        int result = sim_bench(&sim_options);
+        if (result < 0) {
+            fprintf(stderr, "macmasq: simulated daemon benchmark: %s\n", strerror(-result));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (record_path != NULL) {
+        int result = trace_record(record_path, record_duration_ns);
+        if (result < 0) {
+            fprintf(stderr, "macmasq: recording %s: %s\n", record_path, strerror(-result));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (replay_options.trace_path != NULL) {
+        if (sim_options.sim.rtnl_load < 0 || sim_options.sim.rtnl_load > 90) {
+            fprintf(stderr, "macmasq: --sim-rtnl-load must be at most 90\n");
+            return EXIT_FAILURE;
+        }
+        replay_options.sim = sim_options.sim;
+        replay_options.policy_path = policy_path;
+        int result = trace_replay(&replay_options);
+        if (result < 0) {
+            fprintf(stderr, "macmasq: replaying %s: %s\n", replay_options.trace_path, strerror(-result));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (disruption) {
+        if (disruption_options.rate < 1000 || disruption_options.rotations < 1 || disruption_options.interval_ns == 0) {
+            fprintf(stderr, "macmasq: --bench-rate must be at least 1000, --bench-rotations and --bench-interval-ms positive\n");
+            return EXIT_FAILURE;
+        }
+        int result = disruption_bench(&disruption_options);
+        if (result < 0) {
+            fprintf(stderr, "macmasq: disruption benchmark: %s\n", strerror(-result));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (show_plan_path != NULL) {
+        int result = plan_show(show_plan_path, stdout);
+        if (result < 0) {
+            fprintf(stderr, "macmasq: plan %s: %s\n", show_plan_path, strerror(-result));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (plan_path != NULL) {
+        PlanOptions plan_options = {
+            .path = plan_path,
+            .pattern = optind < argc ? argv[optind] : NULL,
+            .netns = parallel_command.netns,
+            .netns_count = parallel_command.netns_count,
+            .netns_all = parallel_command.netns_all,
+        };
+        return write_plan(&plan_options, policy_path);
+    }
+    // Every mode below applies addresses, except the lease commands (whose addresses are unique anyway)
+    if (registry_path != NULL && lease.mode == LEASE_NONE) {
+        open_registry(registry_path);
+        parallel_command.registry = registry;
+        daemon_options.registry = registry;
+        stream_options.registry = registry;
+    }
+    if ((lease.mode == LEASE_NONE && (policy_path == NULL || apply_policy_now || daemon)) ||
+        (lease.mode == LEASE_ALLOC && optind < argc)) {
+        open_journal(journal_path);
+        parallel_command.journal = journal;
+        daemon_options.journal = journal;
+        stream_options.journal = journal;
+    }
+    if (sticky) {
+        if (optind >= argc) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return run_sticky(argv[optind], sticky_path);
+    }
+    if (restore) {
+        return restore_permanent(optind < argc ? argv[optind] : NULL);
+    }
+    if (apply_plan_path != NULL) {
+        PlanApplyOptions apply_options = {
+            .path = apply_plan_path,
+            .registry = registry,
+            .journal = journal,
+            .json = json_mode ? &json_output : NULL,
+        };
+        return apply_plan(&apply_options);
+    }
+    if (parallel) {
+        if (parallel_command.backend == BACKEND_NETLINK_BATCH) {
+            fprintf(stderr, "macmasq: --parallel takes --backend ioctl or netlink\n");
+            return EXIT_FAILURE;
+        }
+        if (parallel_command.workers < 1 || parallel_command.workers > WORK_POOL_MAX_WORKERS) {
+            fprintf(stderr, "macmasq: --workers must be between 1 and %d\n", WORK_POOL_MAX_WORKERS);
+            return EXIT_FAILURE;
+        }
+        parallel_command.pattern = optind < argc ? argv[optind] : NULL;
+        return run_parallel(&parallel_command);
+    }
+    if (lease.mode == LEASE_BENCH && (lease.bench.clients < 1 || lease.bench.allocations < 1)) {
+        fprintf(stderr, "macmasq: --bench-clients and --bench-allocs must be positive\n");
+        return EXIT_FAILURE;
+    }
+    if (lease.mode != LEASE_NONE) {
+        lease.interface = optind < argc ? argv[optind] : NULL;
+        return run_lease(&lease);
+    }
+    if (daemon) {
+        if (policy_path == NULL) {
+            fprintf(stderr, "macmasq: --daemon needs --policy FILE\n");
+            return EXIT_FAILURE;
+        }
+        daemon_options.policy_path = policy_path;
+        return run_daemon(&daemon_options) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (policy_path != NULL) {
+        return run_policy(policy_path, apply_policy_now);
+    }
+    if (all_physical) {
+        return rotate_all_physical();
+    }
+    if (udev) {
+        return handle_udev_event();
+    }
+    if (from_stdin) {
+        int result = run_command_stream(STDIN_FILENO, stdout, &stream_options);
+        if (result < 0) {
+            fprintf(stderr, "macmasq: %s\n", strerror(-result));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
     // Check if the required interface argument is provided
-    if (argc < 2) {     
-        // Print usage message to stderr               
-        fprintf(stderr, "Usage: %s INTERFACE\n", argv[0]);  
+    if (optind >= argc) {
+        // Print usage message to stderr
+        print_usage(argv[0]);
         // Exit with failure code if interface is not provided
-        return EXIT_FAILURE;           
+        return EXIT_FAILURE;
     }
 
-    // Seed the random number generator with the process ID
-    srand(getpid());                   
+    if (measure_ttff && max_outage_ns != 0) {
+        // The timeline is of a plain cycle: a budget could roll it back or turn it into a live change
+        fprintf(stderr, "macmasq: --measure-ttff cannot be combined with --max-outage\n");
+        return EXIT_FAILURE;
+    }
 
     // Generate a new random MAC address
-    MacAddress new_mac = generate_mac_address();  
-
+    MacAddress new_mac;
+    if (!random_local_mac(&new_mac)) {
+        perror("getrandom");
+        return EXIT_FAILURE;
+    }
+    int reserved = registry_reserve_random(registry, &new_mac);
+    if (reserved < 0) {
+        fprintf(stderr, "macmasq: registry: %s\n", strerror(-reserved));
+        return EXIT_FAILURE;
+    }
       // Attempt to change the MAC address of the specified interface
-    if (change_mac_address(argv[1], new_mac)) {
+    LinkRotation trace;
+    TtffTimeline timeline;
+    bool changed = measure_ttff ? change_mac_address_ttff(argv[optind], new_mac, ttff_timeout_ns, &trace, &timeline)
+                                : change_mac_address_budgeted(argv[optind], new_mac, max_outage_ns, capability_path,
+                                                              &trace);
+    int64 netns = registry_netns();
+    registry_settle(registry, &trace, netns);
+    journal_record(journal, &trace, netns);
+    if (json_mode) {
+        // Report the outcome, successful or not, as a single NDJSON record
+        json_write_rotation(&json_output, &trace);
+        json_writer_flush(&json_output);
+        if (measure_ttff && changed) {
+            print_ttff_timeline(stderr, &timeline, ttff_timeout_ns);   // stdout carries only NDJSON
+        }
+        return changed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (changed) {
         // Print the new MAC address in standard hexadecimal format
         printf("New MAC: %02X:%02X:%02X:%02X:%02X:%02X\n",
                new_mac.bytes[0], new_mac.bytes[1], new_mac.bytes[2],
                new_mac.bytes[3], new_mac.bytes[4], new_mac.bytes[5]);
+        if (measure_ttff) {
+            print_ttff_timeline(stdout, &timeline, ttff_timeout_ns);
+        }
     } else {
         // Print error message if MAC address change failed
         fprintf(stderr, "Failed to change MAC address.\n");  
@@ -175,4 +1953,4 @@ int main(int argc, char **argv) {
 
     // Exit with success code
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,65 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_H
+#define MACMASQ_H
+
+// Including required C Header files
+#include <stdbool.h>       // for Boolean type support
+#include <stddef.h>        // for size_t
+#include <net/if.h>        // for IFNAMSIZ
+
+// Defining required data types (for 64 bit systems)
+typedef unsigned char int8;                // Define int8 as unsigned char
+typedef unsigned short int int16;          // Define int16 as unsigned short int
+typedef unsigned int int32;                // Define int32 as unsigned int
+typedef unsigned long int int64;           // Define int64 as unsigned long int
+
+// Length of a MAC address in its textual "XX:XX:XX:XX:XX:XX" form (without terminator)
+#define MAC_STRING_LENGTH 17
+
+/**
+* @brief A structure to store a MAC address
+*/
+typedef struct store_mac {
+    unsigned char bytes[6];              // Array to store 6 bytes representing the MAC address
+} MacAddress;                            // Alias the structure to MacAddress
+
+/**
+* @brief The kernel interface used to apply a MAC address change.
+*/
+typedef enum mac_backend {
+    BACKEND_IOCTL,                       // SIOCSIFFLAGS / SIOCSIFHWADDR, one request at a time
+    BACKEND_NETLINK,                     // RTM_SETLINK requests sent one round trip per change
+    BACKEND_NETLINK_BATCH,               // RTM_SETLINK requests of many interfaces in one sendmsg()
+} MacBackend;
+
+/*
+ * Helpers shared by every build of the tool (see macutil.c).
+ * They never touch stdio, so they can be linked into the static-tiny binary.
+ */
+void mac_format(MacAddress mac, char out[MAC_STRING_LENGTH + 1]);
+bool mac_parse(const char *text, size_t length, MacAddress *mac);
+bool mac_equal(MacAddress a, MacAddress b);
+bool random_bytes(void *buffer, size_t length);
+bool random_local_mac(MacAddress *mac);
+int64 monotonic_ns(void);
+size_t format_uint(char *out, int64 value);
+const char *backend_name(MacBackend backend);
+int open_state_file(const char *path, int flags, int mode);
+
+#endif // MACMASQ_H
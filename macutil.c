@@ -0,0 +1,201 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <string.h>        // for memcmp, memcpy, strrchr
+#include <errno.h>         // for EINTR, ENOENT
+#include <fcntl.h>         // for open
+#include <time.h>          // for clock_gettime
+#include <sys/random.h>    // for getrandom
+#include <sys/stat.h>      // for mkdir
+#include "macmasq.h"       // for MacAddress and shared prototypes
+
+// Lookup table used when printing MAC addresses
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/**
+ * @brief Formats a MAC address as "XX:XX:XX:XX:XX:XX".
+ *
+ * @param mac The MAC address to format.
+ * @param out Buffer receiving the null-terminated text.
+ */
+void mac_format(MacAddress mac, char out[MAC_STRING_LENGTH + 1]) {
+    for (int i = 0; i < 6; i++) {                       // Loop through each of the 6 bytes
+        out[i * 3] = hex_digits[mac.bytes[i] >> 4];     // High nibble
+        out[i * 3 + 1] = hex_digits[mac.bytes[i] & 0xF];// Low nibble
+        out[i * 3 + 2] = (i < 5) ? ':' : '\0';          // Separator, or terminator after the last byte
+    }
+}
+
+/**
+ * @brief Converts one hexadecimal character to its value.
+ *
+ * @param c The character to convert.
+ * @return int The nibble value, or -1 if the character is not hexadecimal.
+ */
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @brief Parses a MAC address written as six colon (or dash) separated hex pairs.
+ *
+ * The text does not need to be null-terminated, which lets callers parse
+ * directly out of a larger input buffer.
+ *
+ * @param text Pointer to the first character of the address.
+ * @param length Number of characters available at text.
+ * @param mac Receives the parsed address on success.
+ * @return true if the text was a well-formed MAC address, false otherwise.
+ */
+bool mac_parse(const char *text, size_t length, MacAddress *mac) {
+    if (length != MAC_STRING_LENGTH) {                   // Only the canonical form is accepted
+        return false;
+    }
+    for (int i = 0; i < 6; i++) {
+        int high = hex_value(text[i * 3]);               // Decode the two digits of this byte
+        int low = hex_value(text[i * 3 + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        if (i < 5 && text[i * 3 + 2] != ':' && text[i * 3 + 2] != '-') {
+            return false;                                // Bytes must be separated by ':' or '-'
+        }
+        mac->bytes[i] = (unsigned char)((high << 4) | low);
+    }
+    return true;
+}
+
+/**
+ * @brief Compares two MAC addresses.
+ *
+ * @return true if both addresses are identical.
+ */
+bool mac_equal(MacAddress a, MacAddress b) {
+    return memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0;
+}
+
+/**
+ * @brief Fills a buffer from the kernel random number generator.
+ *
+ * Unlike rand(), getrandom() needs no seeding and is safe to call from
+ * early boot once the kernel pool is initialised.
+ *
+ * @param buffer Destination buffer.
+ * @param length Number of bytes to fill.
+ * @return true on success, false if the kernel call failed.
+ */
+bool random_bytes(void *buffer, size_t length) {
+    unsigned char *cursor = buffer;
+    while (length > 0) {
+        ssize_t got = getrandom(cursor, length, 0);     // Ask the kernel for the remaining bytes
+        if (got < 0) {
+            if (errno == EINTR) continue;               // Retry when interrupted by a signal
+            return false;
+        }
+        cursor += got;
+        length -= (size_t)got;
+    }
+    return true;
+}
+
+/**
+ * @brief Generates a random, locally administered unicast MAC address.
+ *
+ * @param mac Receives the generated MAC address.
+ * @return true on success, false if the kernel call failed (errno tells why).
+ */
+bool random_local_mac(MacAddress *mac) {
+    if (!random_bytes(mac->bytes, sizeof(mac->bytes))) {
+        return false;
+    }
+    // Set the locally administered bit and clear the multicast bit in the first byte
+    mac->bytes[0] = (mac->bytes[0] & 0xFE) | 0x02;
+    return true;
+}
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return int64 Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+int64 monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64)now.tv_sec * 1000000000UL + (int64)now.tv_nsec;
+}
+
+/**
+ * @brief Writes an unsigned integer in decimal without using stdio.
+ *
+ * @param out Destination buffer, at least 20 bytes long.
+ * @param value The value to print.
+ * @return size_t Number of characters written (no terminator is added).
+ */
+size_t format_uint(char *out, int64 value) {
+    char reversed[20];                                  // Digits are produced least significant first
+    size_t count = 0;
+    do {
+        reversed[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    for (size_t i = 0; i < count; i++) {                // Copy them back in reading order
+        out[i] = reversed[count - 1 - i];
+    }
+    return count;
+}
+
+/**
+ * @brief Returns the name under which a backend is reported.
+ */
+const char *backend_name(MacBackend backend) {
+    switch (backend) {
+    case BACKEND_IOCTL:         return "ioctl";
+    case BACKEND_NETLINK:       return "netlink";
+    case BACKEND_NETLINK_BATCH: return "netlink-batch";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Opens a state file, creating its directory (one level, as for /run/macmasq) if it is missing.
+ *
+ * @param path The file to open.
+ * @param flags Flags for open(); the directory is only created when they include O_CREAT.
+ * @param mode Permissions of a newly created file.
+ * @return int The file descriptor, or a negative errno.
+ */
+int open_state_file(const char *path, int flags, int mode) {
+    int fd = open(path, flags, mode);
+    if (fd < 0 && errno == ENOENT && (flags & O_CREAT)) {
+        char directory[4096];
+        const char *slash = strrchr(path, '/');
+        if (slash != NULL && slash != path && (size_t)(slash - path) < sizeof(directory)) {
+            memcpy(directory, path, slash - path);
+            directory[slash - path] = '\0';
+            mkdir(directory, 0755);
+        }
+        fd = open(path, flags, mode);
+    }
+    return fd < 0 ? -errno : fd;
+}
@@ -0,0 +1,196 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Metrics are published as a Prometheus text-format file (suitable for the
+ * node_exporter textfile collector). The page is rebuilt in memory and
+ * replaced atomically with rename(), so scrapers never see a partial file.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>         // for snprintf, vsnprintf
+#include <stdlib.h>        // for realloc, free
+#include <stdarg.h>        // for va_list
+#include <string.h>        // for strlen
+#include <errno.h>         // for errno
+#include <fcntl.h>         // for open
+#include <unistd.h>        // for write, close
+#include "metrics.h"       // for the metrics page declared here
+
+/**
+ * @brief Appends formatted text to the page, growing it as needed.
+ */
+static void append(MetricsPage *page, const char *format, ...) {
+    for (;;) {
+        va_list arguments;
+        va_start(arguments, format);
+        size_t room = page->capacity - page->length;
+        int needed = vsnprintf(page->buffer ? page->buffer + page->length : NULL, room, format, arguments);
+        va_end(arguments);
+        if (needed < 0) {
+            return;
+        }
+        if ((size_t)needed < room) {
+            page->length += (size_t)needed;
+            return;
+        }
+        size_t capacity = page->capacity ? page->capacity * 2 : 4096;
+        while (capacity - page->length <= (size_t)needed) {
+            capacity *= 2;
+        }
+        char *buffer = realloc(page->buffer, capacity);
+        if (buffer == NULL) {
+            return;                                        // Drop the line rather than the daemon
+        }
+        page->buffer = buffer;
+        page->capacity = capacity;
+    }
+}
+
+/**
+ * @brief Starts a new page, reusing the buffer of the previous one.
+ */
+void metrics_begin(MetricsPage *page) {
+    page->length = 0;
+}
+
+/**
+ * @brief Appends a monotonically increasing counter.
+ */
+void metrics_counter(MetricsPage *page, const char *name, const char *help, int64 value) {
+    append(page, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", name, help, name, name, value);
+}
+
+/**
+ * @brief Appends a gauge.
+ */
+void metrics_gauge(MetricsPage *page, const char *name, const char *help, int64 value) {
+    append(page, "# HELP %s %s\n# TYPE %s gauge\n%s %lu\n", name, help, name, name, value);
+}
+
+/**
+ * @brief Appends one metric with a single label and several values.
+ *
+ * @param page The page to append to.
+ * @param name Metric name.
+ * @param type "counter" or "gauge".
+ * @param help Description.
+ * @param label Label name.
+ * @param label_values Label value of each sample.
+ * @param values Value of each sample.
+ * @param count Number of samples.
+ */
+void metrics_labeled(MetricsPage *page, const char *name, const char *type, const char *help,
+                     const char *label, const char *const *label_values, const int64 *values, int count) {
+    append(page, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    for (int i = 0; i < count; i++) {
+        append(page, "%s{%s=\"%s\"} %lu\n", name, label, label_values[i], values[i]);
+    }
+}
+
+/**
+ * @brief Replaces the metrics file with the page.
+ *
+ * @param page The page to publish.
+ * @param path Destination file; a "PATH.tmp" file is written first.
+ * @return int 0 on success, or a negative errno on failure.
+ */
+int metrics_publish(MetricsPage *page, const char *path) {
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -errno;
+    }
+    size_t offset = 0;
+    while (offset < page->length) {
+        ssize_t written = write(fd, page->buffer + offset, page->length - offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;                  // Retry when interrupted by a signal
+            int error = errno;
+            close(fd);
+            unlink(temporary);
+            return -error;
+        }
+        offset += (size_t)written;
+    }
+    close(fd);
+    if (rename(temporary, path) < 0) {
+        int error = errno;
+        unlink(temporary);
+        return -error;
+    }
+    return 0;
+}
+
+/**
+ * @brief Releases the buffer of a page.
+ */
+void metrics_free(MetricsPage *page) {
+    free(page->buffer);
+    page->buffer = NULL;
+    page->length = page->capacity = 0;
+}
+
+/**
+ * @brief Returns the bucket of a value: exact below 16, then 8 buckets per power of two.
+ */
+static int histogram_bucket(int64 value) {
+    if (value < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return (int)value;
+    }
+    int exponent = 63 - __builtin_clzl(value);
+    int sub = (int)(value >> (exponent - 3)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (exponent - 2) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+/**
+ * @brief Records one duration.
+ */
+void histogram_add(LatencyHistogram *histogram, int64 value) {
+    histogram->buckets[histogram_bucket(value)]++;
+    histogram->count++;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+/**
+ * @brief Returns a percentile (upper bound of its bucket, never above the largest sample).
+ *
+ * @param fraction Between 0 and 1, e.g. 0.99.
+ * @return int64 The percentile, 0 if the histogram is empty.
+ */
+int64 histogram_percentile(const LatencyHistogram *histogram, double fraction) {
+    int64 rank = (int64)(fraction * (double)histogram->count);
+    int64 seen = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen > rank) {
+            if (bucket < 2 * HISTOGRAM_SUB_BUCKETS) {
+                return (int64)bucket;
+            }
+            int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+            int64 upper = ((int64)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1;
+            return upper < histogram->max ? upper : histogram->max;
+        }
+    }
+    return histogram->max;
+}
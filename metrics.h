@@ -0,0 +1,58 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_METRICS_H
+#define MACMASQ_METRICS_H
+
+// Including required C Header files
+#include "macmasq.h"       // for the integer typedefs
+
+/**
+* @brief A Prometheus text-format document being built in memory.
+*/
+typedef struct metrics_page {
+    char *buffer;                        // Text of the page
+    size_t length;                       // Bytes used in buffer
+    size_t capacity;                     // Allocated size of buffer
+} MetricsPage;
+
+// Sub-buckets per power of two in a latency histogram (relative error under 1/8)
+#define HISTOGRAM_SUB_BUCKETS 8
+// Buckets of a latency histogram, enough for every int64
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+/**
+* @brief Log-linear histogram of durations, for percentiles over unbounded sample counts.
+*/
+typedef struct latency_histogram {
+    int64 count;                         // Samples recorded
+    int64 max;                           // Largest sample
+    int64 buckets[HISTOGRAM_BUCKETS];    // Samples per bucket
+} LatencyHistogram;
+
+void metrics_begin(MetricsPage *page);
+void metrics_counter(MetricsPage *page, const char *name, const char *help, int64 value);
+void metrics_gauge(MetricsPage *page, const char *name, const char *help, int64 value);
+void metrics_labeled(MetricsPage *page, const char *name, const char *type, const char *help,
+                     const char *label, const char *const *label_values, const int64 *values, int count);
+int metrics_publish(MetricsPage *page, const char *path);
+void metrics_free(MetricsPage *page);
+
+void histogram_add(LatencyHistogram *histogram, int64 value);
+int64 histogram_percentile(const LatencyHistogram *histogram, double fraction);
+
+#endif // MACMASQ_METRICS_H
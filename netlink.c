@@ -0,0 +1,745 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <unistd.h>                // for close
+#include <string.h>                // for memset, memcpy, strncpy
+#include <errno.h>                 // for error number definitions
+#include <sys/socket.h>            // for socket, sendmsg, recv
+#include <net/if_arp.h>            // for ARPHRD_ETHER
+#include <linux/netlink.h>         // for netlink message definitions
+#include <linux/rtnetlink.h>       // for rtnetlink message definitions
+#include <linux/if_link.h>         // for IFLA_* attribute types
+#include <linux/veth.h>            // for VETH_INFO_PEER
+#include "netlink.h"               // for the netlink helpers declared here
+
+/*
+ * Everything in this file reports failures as negative errno values and never
+ * prints anything, so that the static-tiny build can use it without stdio.
+ */
+
+// Size of the buffer used to receive dump replies and acknowledgements
+#define NETLINK_RECEIVE_SIZE 65536
+
+/**
+ * @brief Opens an rtnetlink socket.
+ *
+ * Acknowledgements are capped to the message header, so a batch of hundreds
+ * of requests only needs a few kilobytes of receive buffer.
+ *
+ * @param groups Bitmask of RTMGRP_* multicast groups to join (0 for none).
+ * @return int The socket file descriptor, or a negative errno on failure.
+ */
+int netlink_open(int32 groups) {
+    int socket_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (socket_fd < 0) {
+        return -errno;
+    }
+
+    int one = 1;                                           // Option value used to enable flags
+    setsockopt(socket_fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+
+    if (groups == 0) {
+        return socket_fd;                                  // The kernel binds the socket on the first send
+    }
+    struct sockaddr_nl local = { .nl_family = AF_NETLINK, .nl_groups = groups };
+    if (bind(socket_fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        int error = errno;                                 // Preserve errno across close()
+        close(socket_fd);
+        return -error;
+    }
+    return socket_fd;
+}
+
+/**
+ * @brief Appends one attribute to a netlink message.
+ *
+ * @param header The message being built (must have room for the attribute).
+ * @param type Attribute type.
+ * @param data Attribute payload.
+ * @param length Payload length in bytes.
+ */
+static void add_attribute(struct nlmsghdr *header, int16 type, const void *data, size_t length) {
+    struct rtattr *attribute = (struct rtattr *)((char *)header + NLMSG_ALIGN(header->nlmsg_len));
+    attribute->rta_type = type;
+    attribute->rta_len = RTA_LENGTH(length);
+    memcpy(RTA_DATA(attribute), data, length);
+    header->nlmsg_len = NLMSG_ALIGN(header->nlmsg_len) + RTA_ALIGN(attribute->rta_len);
+}
+
+/**
+ * @brief Copies a null-terminated string attribute into a fixed size buffer.
+ */
+static void copy_string_attribute(char *out, size_t size, const struct rtattr *attribute) {
+    size_t length = RTA_PAYLOAD(attribute);
+    if (length >= size) {
+        length = size - 1;                                 // Truncate over-long values
+    }
+    memcpy(out, RTA_DATA(attribute), length);
+    out[length] = '\0';
+}
+
+/**
+ * @brief Decodes the attributes of one RTM_NEWLINK or RTM_DELLINK message.
+ *
+ * @param header The message to decode.
+ * @param link Receives the decoded fields.
+ */
+void netlink_parse_link(const struct nlmsghdr *header, LinkInfo *link) {
+    const struct ifinfomsg *info = NLMSG_DATA(header);
+    memset(link, 0, sizeof(*link));
+    link->ifindex = info->ifi_index;
+    link->flags = info->ifi_flags;
+    link->type = info->ifi_type;
+
+    int remaining = IFLA_PAYLOAD(header);
+    for (const struct rtattr *attribute = IFLA_RTA(info); RTA_OK(attribute, remaining);
+         attribute = RTA_NEXT(attribute, remaining)) {
+        switch (attribute->rta_type) {
+        case IFLA_IFNAME:
+            copy_string_attribute(link->name, sizeof(link->name), attribute);
+            break;
+        case IFLA_ADDRESS:
+            if (RTA_PAYLOAD(attribute) == sizeof(link->address.bytes)) {
+                memcpy(link->address.bytes, RTA_DATA(attribute), sizeof(link->address.bytes));
+                link->has_address = true;
+            }
+            break;
+        case IFLA_PERM_ADDRESS:
+            if (RTA_PAYLOAD(attribute) == sizeof(link->perm_address.bytes)) {
+                memcpy(link->perm_address.bytes, RTA_DATA(attribute), sizeof(link->perm_address.bytes));
+                link->has_perm_address = true;
+            }
+            break;
+        case IFLA_MASTER:
+            link->master = *(const int32 *)RTA_DATA(attribute);
+            break;
+        case IFLA_GROUP:
+            link->group = *(const int32 *)RTA_DATA(attribute);
+            break;
+        case IFLA_LINK:
+            link->link = *(const int32 *)RTA_DATA(attribute);
+            break;
+        case IFLA_LINKINFO: {
+            // The link kind is nested one level down
+            int nested_remaining = RTA_PAYLOAD(attribute);
+            for (const struct rtattr *nested = RTA_DATA(attribute); RTA_OK(nested, nested_remaining);
+                 nested = RTA_NEXT(nested, nested_remaining)) {
+                if (nested->rta_type == IFLA_INFO_KIND) {
+                    copy_string_attribute(link->kind, sizeof(link->kind), nested);
+                } else if (nested->rta_type == IFLA_INFO_SLAVE_KIND) {
+                    copy_string_attribute(link->slave_kind, sizeof(link->slave_kind), nested);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Sends one request and hands every reply message to a visitor.
+ *
+ * Reading stops at NLMSG_DONE (end of a dump) or NLMSG_ERROR (a failure,
+ * or the acknowledgement of a request sent with NLM_F_ACK).
+ *
+ * @param socket_fd A socket from netlink_open() (or any netlink socket).
+ * @param request The complete request.
+ * @param visit Called for every other message (may be NULL).
+ * @param context Passed to visit.
+ * @return int 0 on success, or a negative errno.
+ */
+int netlink_request(int socket_fd, const struct nlmsghdr *request, message_visitor visit, void *context) {
+    if (send(socket_fd, request, request->nlmsg_len, 0) < 0) {
+        return -errno;
+    }
+
+    static __thread char buffer[NETLINK_RECEIVE_SIZE] __attribute__((aligned(8)));
+    for (;;) {
+        ssize_t received = recv(socket_fd, buffer, sizeof(buffer), 0);
+        if (received < 0) {
+            if (errno == EINTR) continue;                  // Retry when interrupted by a signal
+            return -errno;
+        }
+        int remaining = (int)received;
+        for (struct nlmsghdr *header = (struct nlmsghdr *)buffer; NLMSG_OK(header, remaining);
+             header = NLMSG_NEXT(header, remaining)) {
+            if (header->nlmsg_type == NLMSG_DONE) {
+                return 0;                                  // End of the dump
+            }
+            if (header->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr *error = NLMSG_DATA(header);
+                return error->error;                       // Already a negative errno, 0 for an ACK
+            }
+            if (visit) {
+                visit(header, context);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Dumps one rtnetlink table (links, routes, neighbours, ...).
+ *
+ * The request carries a zeroed header of the largest family-prefixed
+ * message, which the kernel reads as "no filter" for every table.
+ *
+ * @param socket_fd A socket from netlink_open().
+ * @param type The RTM_GET* message type.
+ * @param family Address family to dump, AF_UNSPEC for all.
+ * @param visit Called for every message of the dump.
+ * @param context Passed to visit.
+ * @return int 0 on success, or a negative errno.
+ */
+int netlink_dump(int socket_fd, int16 type, int8 family, message_visitor visit, void *context) {
+    struct {
+        struct nlmsghdr header;
+        struct ifinfomsg info;
+    } request = {
+        .header = {
+            .nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+            .nlmsg_type = type,
+            .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+            .nlmsg_seq = 1,
+        },
+        .info = { .ifi_family = family },
+    };
+    return netlink_request(socket_fd, &request.header, visit, context);
+}
+
+/**
+* @brief A link visitor wrapped for netlink_dump().
+*/
+typedef struct link_dump {
+    link_visitor visit;                  // Called for every link
+    void *context;                       // Passed to visit
+} LinkDump;
+
+/**
+ * @brief Parses one RTM_NEWLINK message of a dump and passes the link on.
+ */
+static void link_dump_visit(const struct nlmsghdr *header, void *context) {
+    const LinkDump *dump = context;
+    if (header->nlmsg_type == RTM_NEWLINK) {
+        LinkInfo link;
+        netlink_parse_link(header, &link);
+        dump->visit(&link, dump->context);
+    }
+}
+
+/**
+ * @brief Dumps every network interface of the current namespace.
+ *
+ * @param socket_fd An rtnetlink socket with no outstanding requests.
+ * @param visit Called once for every interface.
+ * @param context Passed back to visit.
+ * @return int 0 on success, or a negative errno on failure.
+ */
+int netlink_dump_links(int socket_fd, link_visitor visit, void *context) {
+    LinkDump dump = { visit, context };
+    return netlink_dump(socket_fd, RTM_GETLINK, AF_UNSPEC, link_dump_visit, &dump);
+}
+
+/*
+ * Interface setup (benchmarks)
+ */
+
+// Room for a setup request and its attributes
+#define SETUP_REQUEST_SIZE 512
+
+/**
+ * @brief Starts an rtnetlink request in buffer, with a zeroed family header.
+ */
+static struct nlmsghdr *begin_request(char *buffer, int16 type, int16 flags, size_t family_size) {
+    struct nlmsghdr *header = (struct nlmsghdr *)buffer;
+    memset(buffer, 0, SETUP_REQUEST_SIZE);
+    header->nlmsg_len = NLMSG_LENGTH(family_size);
+    header->nlmsg_type = type;
+    header->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    header->nlmsg_seq = 1;
+    return header;
+}
+
+/**
+ * @brief Opens a nested attribute; close it with end_nest().
+ */
+static struct rtattr *begin_nest(struct nlmsghdr *header, int16 type) {
+    struct rtattr *nest = (struct rtattr *)((char *)header + NLMSG_ALIGN(header->nlmsg_len));
+    nest->rta_type = type;
+    nest->rta_len = RTA_LENGTH(0);
+    header->nlmsg_len = NLMSG_ALIGN(header->nlmsg_len) + RTA_LENGTH(0);
+    return nest;
+}
+
+/**
+ * @brief Closes a nested attribute, making it span everything added since begin_nest().
+ */
+static void end_nest(struct nlmsghdr *header, struct rtattr *nest) {
+    nest->rta_len = (char *)header + NLMSG_ALIGN(header->nlmsg_len) - (char *)nest;
+}
+
+/**
+ * @brief Creates a veth pair.
+ *
+ * @param socket_fd A socket from netlink_open().
+ * @param name Name of the end created in the current namespace.
+ * @param peer Name of the other end.
+ * @param peer_netns_fd Namespace the other end is created in, or -1 for the current one.
+ * @return int 0 on success, or a negative errno.
+ */
+int netlink_add_veth(int socket_fd, const char *name, const char *peer, int peer_netns_fd) {
+    char buffer[SETUP_REQUEST_SIZE] __attribute__((aligned(8)));
+    struct nlmsghdr *header = begin_request(buffer, RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, sizeof(struct ifinfomsg));
+    add_attribute(header, IFLA_IFNAME, name, strlen(name) + 1);
+    struct rtattr *info = begin_nest(header, IFLA_LINKINFO);
+    add_attribute(header, IFLA_INFO_KIND, "veth", 4);
+    struct rtattr *data = begin_nest(header, IFLA_INFO_DATA);
+    struct rtattr *peer_info = begin_nest(header, VETH_INFO_PEER);
+    header->nlmsg_len += NLMSG_ALIGN(sizeof(struct ifinfomsg));  // The peer's own (zeroed) ifinfomsg
+    add_attribute(header, IFLA_IFNAME, peer, strlen(peer) + 1);
+    if (peer_netns_fd >= 0) {
+        int32 fd = (int32)peer_netns_fd;
+        add_attribute(header, IFLA_NET_NS_FD, &fd, sizeof(fd));
+    }
+    end_nest(header, peer_info);
+    end_nest(header, data);
+    end_nest(header, info);
+    return netlink_request(socket_fd, header, NULL, NULL);
+}
+
+/**
+ * @brief Deletes an interface (for a veth, both ends).
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+int netlink_delete_link(int socket_fd, int32 ifindex) {
+    char buffer[SETUP_REQUEST_SIZE] __attribute__((aligned(8)));
+    struct nlmsghdr *header = begin_request(buffer, RTM_DELLINK, 0, sizeof(struct ifinfomsg));
+    ((struct ifinfomsg *)NLMSG_DATA(header))->ifi_index = (int)ifindex;
+    return netlink_request(socket_fd, header, NULL, NULL);
+}
+
+/**
+ * @brief Adds or removes an IPv4 address of an interface.
+ *
+ * @param type RTM_NEWADDR or RTM_DELADDR.
+ * @param address The address, in network byte order.
+ * @param prefix Prefix length of the connected subnet.
+ * @return int 0 on success, or a negative errno.
+ */
+int netlink_ipv4_address(int socket_fd, int16 type, int32 ifindex, const int8 address[4], int8 prefix) {
+    char buffer[SETUP_REQUEST_SIZE] __attribute__((aligned(8)));
+    struct nlmsghdr *header = begin_request(buffer, type, type == RTM_NEWADDR ? NLM_F_CREATE | NLM_F_REPLACE : 0,
+                                            sizeof(struct ifaddrmsg));
+    struct ifaddrmsg *message = NLMSG_DATA(header);
+    message->ifa_family = AF_INET;
+    message->ifa_prefixlen = prefix;
+    message->ifa_index = ifindex;
+    add_attribute(header, IFA_LOCAL, address, 4);
+    add_attribute(header, IFA_ADDRESS, address, 4);
+    return netlink_request(socket_fd, header, NULL, NULL);
+}
+
+/**
+ * @brief Adds or removes a directly connected IPv4 route (scope link) in the main table.
+ *
+ * @param type RTM_NEWROUTE or RTM_DELROUTE.
+ * @param destination The destination, in network byte order.
+ * @param prefix Prefix length of the destination.
+ * @param ifindex Output interface.
+ * @return int 0 on success, or a negative errno.
+ */
+int netlink_ipv4_route(int socket_fd, int16 type, const int8 destination[4], int8 prefix, int32 ifindex) {
+    char buffer[SETUP_REQUEST_SIZE] __attribute__((aligned(8)));
+    struct nlmsghdr *header = begin_request(buffer, type, type == RTM_NEWROUTE ? NLM_F_CREATE | NLM_F_EXCL : 0,
+                                            sizeof(struct rtmsg));
+    struct rtmsg *route = NLMSG_DATA(header);
+    route->rtm_family = AF_INET;
+    route->rtm_dst_len = prefix;
+    route->rtm_table = RT_TABLE_MAIN;
+    route->rtm_protocol = RTPROT_STATIC;
+    route->rtm_scope = RT_SCOPE_LINK;
+    route->rtm_type = RTN_UNICAST;
+    add_attribute(header, RTA_DST, destination, 4);
+    add_attribute(header, RTA_OIF, &ifindex, sizeof(ifindex));
+    return netlink_request(socket_fd, header, NULL, NULL);
+}
+
+/**
+ * @brief Tells whether an interface is backed by real (or emulated) hardware.
+ *
+ * Physical Ethernet devices carry no rtnetlink link kind, whereas every
+ * software device (veth, bridge, bond, macvlan, ...) reports one.
+ *
+ * @param link The interface to classify.
+ * @return true for Ethernet devices without a link kind.
+ */
+bool link_is_physical(const LinkInfo *link) {
+    return link->type == ARPHRD_ETHER && link->kind[0] == '\0' && !(link->flags & IFF_LOOPBACK);
+}
+
+/**
+ * @brief Prepares an empty batch.
+ *
+ * @param batch The batch to initialise.
+ * @param socket_fd The rtnetlink socket requests will be sent on.
+ * @param on_ack Receives the error of every rejected request (may be NULL).
+ * @param context Passed back to on_ack.
+ */
+void netlink_batch_init(NetlinkBatch *batch, int socket_fd, ack_handler on_ack, void *context) {
+    batch->socket_fd = socket_fd;
+    batch->next_seq = 1;
+    batch->first_seq = 1;
+    batch->count = 0;
+    batch->length = 0;
+    batch->on_ack = on_ack;
+    batch->context = context;
+}
+
+// Largest request queued by this file: header, ifinfomsg and a couple of small attributes
+#define SETLINK_WORST_CASE (NLMSG_SPACE(sizeof(struct ifinfomsg)) + 2 * RTA_SPACE(IFNAMSIZ))
+
+/**
+ * @brief Tells whether more requests can be queued without an automatic flush.
+ *
+ * @param batch The batch to check.
+ * @param messages Number of RTM_SETLINK requests about to be queued.
+ * @return true if they all fit.
+ */
+bool netlink_batch_has_room(const NetlinkBatch *batch, int messages) {
+    return batch->count + messages <= NETLINK_BATCH_MAX_MESSAGES &&
+           batch->length + (size_t)messages * SETLINK_WORST_CASE <= sizeof(batch->buffer);
+}
+
+/**
+ * @brief Reserves room for one RTM_SETLINK request at the end of the batch.
+ *
+ * Flushes the batch first if the request would not fit.
+ *
+ * @param batch The batch to append to.
+ * @param ifindex Interface the request targets.
+ * @param tag Caller tag reported back through on_ack.
+ * @param message Receives the request header.
+ * @return int 0 on success, or a negative errno if a flush failed.
+ */
+static int begin_setlink(NetlinkBatch *batch, int32 ifindex, int32 tag, struct nlmsghdr **message) {
+    if (!netlink_batch_has_room(batch, 1)) {
+        int result = netlink_batch_flush(batch);
+        if (result < 0) {
+            return result;
+        }
+    }
+
+    struct nlmsghdr *header = (struct nlmsghdr *)(batch->buffer + batch->length);
+    memset(header, 0, NLMSG_SPACE(sizeof(struct ifinfomsg)));
+    header->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    header->nlmsg_type = RTM_SETLINK;
+    header->nlmsg_flags = NLM_F_REQUEST;                  // Only the last request asks for an ACK
+    header->nlmsg_seq = batch->next_seq++;
+
+    struct ifinfomsg *info = NLMSG_DATA(header);
+    info->ifi_family = AF_UNSPEC;
+    info->ifi_index = (int)ifindex;
+
+    batch->last_offset = batch->length;
+    batch->tags[batch->count++] = tag;
+    *message = header;
+    return 0;
+}
+
+/**
+ * @brief Queues a change of interface flags.
+ *
+ * @param batch The batch to append to.
+ * @param ifindex Interface to change.
+ * @param flags New values of the flags selected by change.
+ * @param change Mask of the IFF_* flags to modify.
+ * @param tag Caller tag reported back through on_ack.
+ * @return int 0 on success, or a negative errno if a flush failed.
+ */
+int netlink_batch_set_flags(NetlinkBatch *batch, int32 ifindex, int32 flags, int32 change, int32 tag) {
+    struct nlmsghdr *header;
+    int result = begin_setlink(batch, ifindex, tag, &header);
+    if (result < 0) {
+        return result;
+    }
+    struct ifinfomsg *info = NLMSG_DATA(header);
+    info->ifi_flags = flags;
+    info->ifi_change = change;
+    batch->length += NLMSG_ALIGN(header->nlmsg_len);
+    return 0;
+}
+
+/**
+ * @brief Queues a change of hardware address.
+ *
+ * @param batch The batch to append to.
+ * @param ifindex Interface to change.
+ * @param mac The address to apply.
+ * @param tag Caller tag reported back through on_ack.
+ * @return int 0 on success, or a negative errno if a flush failed.
+ */
+int netlink_batch_set_address(NetlinkBatch *batch, int32 ifindex, MacAddress mac, int32 tag) {
+    struct nlmsghdr *header;
+    int result = begin_setlink(batch, ifindex, tag, &header);
+    if (result < 0) {
+        return result;
+    }
+    add_attribute(header, IFLA_ADDRESS, mac.bytes, sizeof(mac.bytes));
+    batch->length += NLMSG_ALIGN(header->nlmsg_len);
+    return 0;
+}
+
+/**
+ * @brief Sends every queued request with one sendmsg() and collects the replies.
+ *
+ * The kernel processes the requests in order, so a failed request does not
+ * prevent the following ones (for instance bringing an interface back up)
+ * from running. Only the last request asks for an acknowledgement: the
+ * kernel answers the others only when they fail, and the final ACK tells
+ * that every earlier reply has already been queued. This keeps the receive
+ * queue small even for hundreds of requests.
+ *
+ * @param batch The batch to send; it is empty again on return.
+ * @return int 0 if every request was delivered, or a negative errno if the
+ *             socket itself failed. Per-request errors go to on_ack.
+ */
+int netlink_batch_flush(NetlinkBatch *batch) {
+    if (batch->count == 0) {
+        return 0;                                          // Nothing queued
+    }
+
+    struct nlmsghdr *last = (struct nlmsghdr *)(batch->buffer + batch->last_offset);
+    last->nlmsg_flags |= NLM_F_ACK;
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    struct iovec vector = { .iov_base = batch->buffer, .iov_len = batch->length };
+    struct msghdr message = {
+        .msg_name = &kernel, .msg_namelen = sizeof(kernel),
+        .msg_iov = &vector, .msg_iovlen = 1,
+    };
+    int32 first_seq = batch->first_seq;
+    int32 last_seq = last->nlmsg_seq;
+    int expected = batch->count;
+    batch->first_seq = batch->next_seq;                    // The batch is reusable from here on
+    batch->count = 0;
+    batch->length = 0;
+
+    while (sendmsg(batch->socket_fd, &message, 0) < 0) {
+        if (errno != EINTR) {
+            return -errno;
+        }
+    }
+
+    static __thread char buffer[NETLINK_RECEIVE_SIZE] __attribute__((aligned(8)));
+    for (;;) {
+        ssize_t received = recv(batch->socket_fd, buffer, sizeof(buffer), 0);
+        if (received < 0) {
+            if (errno == EINTR) continue;                  // Retry when interrupted by a signal
+            return -errno;
+        }
+        bool done = false;
+        int remaining = (int)received;
+        for (struct nlmsghdr *header = (struct nlmsghdr *)buffer; NLMSG_OK(header, remaining);
+             header = NLMSG_NEXT(header, remaining)) {
+            if (header->nlmsg_type != NLMSG_ERROR) {
+                continue;                                  // Not an acknowledgement
+            }
+            int32 index = header->nlmsg_seq - first_seq;
+            if (index >= (int32)expected) {
+                continue;                                  // Stale reply from an earlier request
+            }
+            const struct nlmsgerr *error = NLMSG_DATA(header);
+            if (error->error != 0 && batch->on_ack) {
+                batch->on_ack(batch->context, batch->tags[index], -error->error);
+            }
+            done |= header->nlmsg_seq == last_seq;
+        }
+        if (done) {
+            return 0;
+        }
+    }
+}
+
+// Phases of a rotation, encoded in the low bits of the batch tag
+enum { PHASE_DOWN = 0, PHASE_ADDRESS = 1, PHASE_UP = 2, PHASE_BITS = 2 };
+
+/**
+ * @brief Records the first error reported for each rotation.
+ */
+static void rotation_ack(void *context, int32 tag, int error) {
+    LinkRotation *rotation = (LinkRotation *)context + (tag >> PHASE_BITS);
+    if (error != 0 && rotation->error == 0) {
+        rotation->error = error;
+    }
+}
+
+/**
+ * @brief Sends the queued part of a rotation and stamps its timing.
+ *
+ * The kernel handles the whole batch inside sendmsg(), so the phases of a
+ * single interface cannot be told apart: every rotation carried by the
+ * batch is charged with the time of the round trip.
+ */
+static int flush_rotations(NetlinkBatch *batch, LinkRotation *rotations, int first, int end) {
+    int64 started = monotonic_ns();
+    int result = netlink_batch_flush(batch);
+    int64 elapsed = monotonic_ns() - started;
+    for (int i = first; i < end; i++) {
+        if (rotations[i].ifindex != 0) {
+            rotations[i].total_ns = elapsed;               // Rejected entries never reached the kernel
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Changes the MAC address of many interfaces in as few round trips as possible.
+ *
+ * For every interface that is up, the batch carries three requests: bring
+ * it down, set the address, restore the original flags. Interfaces that are
+ * already down only need the address request, and so do entries marked
+ * live (for drivers that accept a change while running). Entries whose
+ * ifindex is 0 are skipped and keep the error the caller stored in them.
+ *
+ * A batch holds NETLINK_BATCH_MAX_MESSAGES requests, 64 interfaces that are
+ * up, so more interfaces take several round trips. The cap is what keeps
+ * the kernel's error replies within the socket's receive buffer; it is not
+ * raised with the count, since that buffer cannot grow past
+ * net.core.rmem_max without SO_RCVBUFFORCE. The round trips follow each
+ * other with no gap, and an interface's requests are never split across
+ * two of them.
+ *
+ * @param batch An empty batch; its ack handler is replaced for the duration of the call.
+ * @param rotations The interfaces to change; error and timing are filled in for each of them.
+ * @param count Number of entries in rotations.
+ * @return int 0 on success, or a negative errno if the socket failed.
+ */
+int netlink_rotate(NetlinkBatch *batch, LinkRotation *rotations, int count) {
+    ack_handler saved_handler = batch->on_ack;
+    void *saved_context = batch->context;
+    batch->on_ack = rotation_ack;
+    batch->context = rotations;
+
+    int result = 0;
+    int first_queued = 0;                                  // First rotation of the current batch
+    for (int i = 0; i < count && result == 0; i++) {
+        LinkRotation *rotation = &rotations[i];
+        int32 tag = (int32)i << PHASE_BITS;
+        bool was_up = (rotation->flags & IFF_UP) && !rotation->live;
+        if (rotation->ifindex == 0) {
+            continue;                                      // Rejected by the caller
+        }
+        rotation->error = 0;
+        rotation->backend = BACKEND_NETLINK_BATCH;
+        rotation->retries = 0;
+        rotation->down_ns = rotation->set_ns = rotation->up_ns = 0;
+        if (!netlink_batch_has_room(batch, 3)) {
+            // Keep the requests of one interface together in a single batch
+            result = flush_rotations(batch, rotations, first_queued, i);
+            first_queued = i;
+            if (result < 0) {
+                break;
+            }
+        }
+        if (was_up) {
+            result = netlink_batch_set_flags(batch, rotation->ifindex, 0, IFF_UP, tag | PHASE_DOWN);
+        }
+        if (result == 0) {
+            result = netlink_batch_set_address(batch, rotation->ifindex, rotation->new_mac, tag | PHASE_ADDRESS);
+        }
+        if (result == 0 && was_up) {
+            result = netlink_batch_set_flags(batch, rotation->ifindex, IFF_UP, IFF_UP, tag | PHASE_UP);
+        }
+    }
+    if (result == 0) {
+        result = flush_rotations(batch, rotations, first_queued, count);
+    }
+
+    batch->on_ack = saved_handler;
+    batch->context = saved_context;
+    return result;
+}
+
+/**
+* @brief State shared with collect_physical_visit() while dumping links.
+*/
+typedef struct physical_collection {
+    LinkRotation *rotations;             // Output array
+    int capacity;                        // Number of entries available in rotations
+    int count;                           // Number of entries filled so far
+    int skipped;                         // Physical interfaces found once rotations was full
+} PhysicalCollection;
+
+/**
+ * @brief Appends every physical interface to the collection.
+ */
+static void collect_physical_visit(const LinkInfo *link, void *context) {
+    PhysicalCollection *collection = context;
+    if (!link_is_physical(link)) {
+        return;
+    }
+    if (collection->count == collection->capacity) {
+        collection->skipped++;
+        return;
+    }
+    LinkRotation *rotation = &collection->rotations[collection->count++];
+    memset(rotation, 0, sizeof(*rotation));
+    rotation->ifindex = link->ifindex;
+    rotation->flags = link->flags;
+    rotation->old_mac = link->address;
+    memcpy(rotation->name, link->name, IFNAMSIZ);
+}
+
+/**
+ * @brief Prepares a rotation to a fresh random address for every physical interface.
+ *
+ * Random addresses are drawn 64 at a time, one getrandom() call per chunk
+ * of 64 interfaces, from a 384-byte buffer on the stack.
+ *
+ * @param socket_fd An rtnetlink socket with no outstanding requests.
+ * @param rotations Output array.
+ * @param capacity Number of entries available in rotations.
+ * @return int Number of interfaces found, or a negative errno on failure. Only the first
+ *             capacity of them are filled in, so a larger count means the list was cut short.
+ */
+int collect_physical_links(int socket_fd, LinkRotation *rotations, int capacity) {
+    PhysicalCollection collection = { .rotations = rotations, .capacity = capacity };
+    int result = netlink_dump_links(socket_fd, collect_physical_visit, &collection);
+    if (result < 0) {
+        return result;
+    }
+
+    unsigned char entropy[64 * 6];                         // Random bytes for up to 64 interfaces per call
+    for (int first = 0; first < collection.count; first += 64) {
+        int chunk = collection.count - first < 64 ? collection.count - first : 64;
+        if (!random_bytes(entropy, (size_t)chunk * 6)) {
+            return -EIO;
+        }
+        for (int i = 0; i < chunk; i++) {
+            MacAddress *mac = &rotations[first + i].new_mac;
+            memcpy(mac->bytes, entropy + i * 6, 6);
+            // Set the locally administered bit and clear the multicast bit in the first byte
+            mac->bytes[0] = (mac->bytes[0] & 0xFE) | 0x02;
+        }
+    }
+    return collection.count + collection.skipped;
+}
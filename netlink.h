@@ -0,0 +1,117 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_NETLINK_H
+#define MACMASQ_NETLINK_H
+
+// Including required C Header files
+#include "macmasq.h"       // for MacAddress and the integer typedefs
+
+// Maximum number of requests queued in a batch before it is flushed automatically. Every rejected
+// request comes back as its own error message, charged about 1 KiB of receive buffer: 192 of them
+// still fit in the default one (net.core.rmem_default), so a batch never loses an error to ENOBUFS
+#define NETLINK_BATCH_MAX_MESSAGES 192
+// Size of the buffer holding the queued requests (kept well under the default socket buffers)
+#define NETLINK_BATCH_BUFFER_SIZE 32768
+// Maximum length of an rtnetlink link kind ("veth", "bond", ...)
+#define LINK_KIND_SIZE 16
+
+struct nlmsghdr;
+
+/**
+* @brief A snapshot of one network interface as reported by RTM_GETLINK.
+*/
+typedef struct link_info {
+    int32 ifindex;                       // Interface index
+    char name[IFNAMSIZ];                 // Interface name
+    int32 flags;                         // IFF_* flags
+    int16 type;                          // ARPHRD_* hardware type
+    char kind[LINK_KIND_SIZE];           // IFLA_INFO_KIND, empty for physical devices
+    char slave_kind[LINK_KIND_SIZE];     // IFLA_INFO_SLAVE_KIND, empty unless enslaved
+    MacAddress address;                  // Current hardware address
+    MacAddress perm_address;             // Permanent (factory) hardware address
+    bool has_address;                    // True if IFLA_ADDRESS was reported
+    bool has_perm_address;               // True if IFLA_PERM_ADDRESS was reported
+    int32 master;                        // Ifindex of the master device, 0 if none
+    int32 group;                         // Interface group
+    int32 link;                          // Ifindex of the lower/peer device, 0 if none
+} LinkInfo;
+
+/**
+* @brief A pending MAC change for one interface, and its outcome.
+*/
+typedef struct link_rotation {
+    int32 ifindex;                       // Interface to change
+    char name[IFNAMSIZ];                 // Interface name, for reporting only
+    int32 flags;                         // IFF_* flags before the change
+    MacAddress old_mac;                  // Address before the change
+    MacAddress new_mac;                  // Address to apply
+    bool live;                           // Set the address without taking the interface down
+    int error;                           // First errno reported by the kernel, 0 on success
+    MacBackend backend;                  // How the change was applied
+    int retries;                         // Requests repeated after a transient error
+    int64 down_ns;                       // Time spent bringing the interface down (0 if not measured)
+    int64 set_ns;                        // Time spent setting the address (0 if not measured)
+    int64 up_ns;                         // Time spent bringing the interface up (0 if not measured)
+    int64 total_ns;                      // Wall time of the whole change
+} LinkRotation;
+
+// Called once for every link returned by a dump
+typedef void (*link_visitor)(const LinkInfo *link, void *context);
+// Called for every message of a netlink reply
+typedef void (*message_visitor)(const struct nlmsghdr *header, void *context);
+// Called once for every request of a batch the kernel rejected (error is a positive errno)
+typedef void (*ack_handler)(void *context, int32 tag, int error);
+
+/**
+* @brief Several rtnetlink requests sent to the kernel with a single sendmsg().
+*/
+typedef struct netlink_batch {
+    int socket_fd;                                   // rtnetlink socket used to send the batch
+    int32 next_seq;                                  // Sequence number of the next queued request
+    int32 first_seq;                                 // Sequence number of the first queued request
+    int count;                                       // Number of queued requests
+    size_t length;                                   // Bytes used in buffer
+    size_t last_offset;                              // Offset of the last queued request in buffer
+    ack_handler on_ack;                              // Receives the error of every rejected request
+    void *context;                                   // Passed back to on_ack
+    int32 tags[NETLINK_BATCH_MAX_MESSAGES];          // Caller supplied tag of every queued request
+    char buffer[NETLINK_BATCH_BUFFER_SIZE] __attribute__((aligned(8)));
+} NetlinkBatch;
+
+int netlink_open(int32 groups);
+void netlink_parse_link(const struct nlmsghdr *header, LinkInfo *link);
+int netlink_request(int socket_fd, const struct nlmsghdr *request, message_visitor visit, void *context);
+int netlink_dump(int socket_fd, int16 type, int8 family, message_visitor visit, void *context);
+int netlink_dump_links(int socket_fd, link_visitor visit, void *context);
+bool link_is_physical(const LinkInfo *link);
+
+int netlink_add_veth(int socket_fd, const char *name, const char *peer, int peer_netns_fd);
+int netlink_delete_link(int socket_fd, int32 ifindex);
+int netlink_ipv4_address(int socket_fd, int16 type, int32 ifindex, const int8 address[4], int8 prefix);
+int netlink_ipv4_route(int socket_fd, int16 type, const int8 destination[4], int8 prefix, int32 ifindex);
+
+void netlink_batch_init(NetlinkBatch *batch, int socket_fd, ack_handler on_ack, void *context);
+int netlink_batch_set_flags(NetlinkBatch *batch, int32 ifindex, int32 flags, int32 change, int32 tag);
+int netlink_batch_set_address(NetlinkBatch *batch, int32 ifindex, MacAddress mac, int32 tag);
+int netlink_batch_flush(NetlinkBatch *batch);
+bool netlink_batch_has_room(const NetlinkBatch *batch, int messages);
+
+int netlink_rotate(NetlinkBatch *batch, LinkRotation *rotations, int count);
+int collect_physical_links(int socket_fd, LinkRotation *rotations, int capacity);
+
+#endif // MACMASQ_NETLINK_H
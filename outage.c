@@ -0,0 +1,370 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Outage budget (--max-outage) and the driver capability cache.
+ *
+ * Before an address change, a watch subscribes to rtnetlink link events
+ * and arms a timerfd at the end of the budget. Once the change returns,
+ * it waits for the interface to report IFF_RUNNING again, or for the
+ * timer. The outage is counted from the start of the change, since the
+ * down event is only read once the synchronous ioctls are done; a driver
+ * blocking inside SIOCSIFHWADDR therefore spends the budget as well.
+ *
+ * Drivers that overran the budget are marked slow in a small file of
+ * fixed-size records, one per driver name, updated in place under flock.
+ * Later runs read the mark and try a live change first.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdlib.h>                // for calloc, free
+#include <string.h>                // for memcpy, strncpy, strncmp
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <unistd.h>                // for pread, pwrite, close
+#include <time.h>                  // for time
+#include <poll.h>                  // for poll
+#include <net/if.h>                // for struct ifreq, IFF_UP, IFF_RUNNING
+#include <sys/file.h>              // for flock
+#include <sys/ioctl.h>             // for ioctl
+#include <sys/socket.h>            // for socket, recv
+#include <sys/timerfd.h>           // for timerfd
+#include <linux/ethtool.h>         // for ETHTOOL_GDRVINFO
+#include <linux/sockios.h>         // for SIOCETHTOOL
+#include <linux/rtnetlink.h>       // for RTMGRP_LINK
+#include "outage.h"                // for the declarations implemented here
+
+// Identifies a capability cache ("MMQCAPAB")
+#define CAPABILITY_MAGIC 0x4241504143514D4DUL
+// Bumped whenever the layout of the records changes
+#define CAPABILITY_VERSION 1
+
+/**
+* @brief First bytes of the capability cache.
+*/
+typedef struct capability_header {
+    int64 magic;                         // CAPABILITY_MAGIC
+    int32 version;                       // CAPABILITY_VERSION
+    int32 record_size;                   // sizeof(CapabilityRecord)
+} CapabilityHeader;
+
+/**
+* @brief What the cache holds about one driver.
+*/
+typedef struct capability_record {
+    char driver[DRIVER_NAME_SIZE];       // Driver name, NUL padded
+    int64 outage_ns;                     // Longest outage seen before a roll back
+    int64 marked_s;                      // When it was last marked slow (CLOCK_REALTIME seconds)
+    int32 slow_count;                    // Changes rolled back for it
+    int32 reserved;
+} CapabilityRecord;
+
+/**
+* @brief An interface being watched while its address changes.
+*/
+struct outage_watch {
+    int32 ifindex;                       // The interface
+    bool was_running;                    // It passed traffic before the change (otherwise nothing is lost)
+    bool went_down;                      // A link event without IFF_RUNNING was seen
+    int netlink_fd;                      // rtnetlink socket subscribed to RTMGRP_LINK
+    int timer_fd;                        // Fires at the end of the budget
+    int64 started;                       // Start of the change (monotonic)
+    int64 deadline;                      // End of the budget (monotonic)
+    int64 back;                          // When IFF_RUNNING was seen again, 0 until then
+};
+
+/**
+ * @brief Reads the driver name of an interface (ETHTOOL_GDRVINFO).
+ *
+ * @param interface The interface name.
+ * @param driver Receives the driver name.
+ * @return int 0 on success, or a negative errno.
+ */
+int driver_name(const char *interface, char driver[DRIVER_NAME_SIZE]) {
+    struct ethtool_drvinfo info = { .cmd = ETHTOOL_GDRVINFO };
+    struct ifreq request;
+    memset(&request, 0, sizeof(request));
+    strncpy(request.ifr_name, interface, IFNAMSIZ - 1);
+    request.ifr_data = (char *)&info;
+    int socket_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0) {
+        return -errno;
+    }
+    int result = ioctl(socket_fd, SIOCETHTOOL, &request) < 0 ? -errno : 0;
+    close(socket_fd);
+    if (result == 0) {
+        memset(driver, 0, DRIVER_NAME_SIZE);
+        memcpy(driver, info.driver, DRIVER_NAME_SIZE - 1);
+    }
+    return result;
+}
+
+/*
+ * Capability cache
+ */
+
+/**
+ * @brief Opens the cache and takes its lock, writing the header of a new file.
+ *
+ * @return int The file descriptor, or a negative errno (-ENOENT when a lookup finds no cache).
+ */
+static int open_cache(const char *path, bool create) {
+    int fd = open_state_file(path, (create ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return fd;
+    }
+    while (flock(fd, create ? LOCK_EX : LOCK_SH) < 0) {
+        if (errno != EINTR) {
+            int result = -errno;
+            close(fd);
+            return result;
+        }
+    }
+
+    CapabilityHeader header;
+    ssize_t got = pread(fd, &header, sizeof(header), 0);
+    int result = 0;
+    if (got == 0 && create) {
+        header = (CapabilityHeader){ CAPABILITY_MAGIC, CAPABILITY_VERSION, sizeof(CapabilityRecord) };
+        if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+            result = -EIO;
+        }
+    } else if (got != sizeof(header) || header.magic != CAPABILITY_MAGIC || header.version != CAPABILITY_VERSION ||
+               header.record_size != sizeof(CapabilityRecord)) {
+        result = got < 0 ? -errno : -EINVAL;
+    }
+    if (result < 0) {
+        close(fd);
+        return result;
+    }
+    return fd;
+}
+
+/**
+ * @brief Finds the record of a driver.
+ *
+ * @return off_t Its offset, or the end of the file if there is none.
+ */
+static off_t find_record(int fd, const char *driver, CapabilityRecord *record) {
+    off_t offset = sizeof(CapabilityHeader);
+    while (pread(fd, record, sizeof(*record), offset) == sizeof(*record)) {
+        if (strncmp(record->driver, driver, DRIVER_NAME_SIZE) == 0) {
+            return offset;
+        }
+        offset += sizeof(*record);
+    }
+    memset(record, 0, sizeof(*record));
+    return offset;
+}
+
+/**
+ * @brief Looks a driver up in the capability cache.
+ *
+ * @param path The cache file.
+ * @param driver The driver name.
+ * @param capability Receives what is known; slow is false once the mark is older than CAPABILITY_SLOW_TTL_S.
+ * @return int 0 if the driver is known, or a negative errno (-ENOENT if it is not).
+ */
+int capability_lookup(const char *path, const char *driver, DriverCapability *capability) {
+    int fd = open_cache(path, false);
+    if (fd < 0) {
+        return fd;
+    }
+    CapabilityRecord record;
+    find_record(fd, driver, &record);
+    bool found = record.driver[0] != '\0';
+    close(fd);                                             // Also releases the lock
+    if (!found) {
+        return -ENOENT;
+    }
+    memset(capability, 0, sizeof(*capability));
+    memcpy(capability->driver, record.driver, DRIVER_NAME_SIZE);
+    capability->driver[DRIVER_NAME_SIZE - 1] = '\0';
+    capability->slow_count = record.slow_count;
+    capability->outage_ns = record.outage_ns;
+    capability->marked_s = record.marked_s;
+    capability->slow = record.marked_s != 0 && (int64)time(NULL) - record.marked_s < CAPABILITY_SLOW_TTL_S;
+    return 0;
+}
+
+/**
+ * @brief Marks a driver slow in the capability cache.
+ *
+ * @param path The cache file, created if missing.
+ * @param driver The driver name.
+ * @param outage_ns The outage that overran the budget.
+ * @return int 0 on success, or a negative errno.
+ */
+int capability_mark_slow(const char *path, const char *driver, int64 outage_ns) {
+    int fd = open_cache(path, true);
+    if (fd < 0) {
+        return fd;
+    }
+    CapabilityRecord record;
+    off_t offset = find_record(fd, driver, &record);
+    strncpy(record.driver, driver, DRIVER_NAME_SIZE - 1);
+    record.slow_count++;
+    record.outage_ns = outage_ns > record.outage_ns ? outage_ns : record.outage_ns;
+    record.marked_s = time(NULL);
+    int result = pwrite(fd, &record, sizeof(record), offset) == sizeof(record) ? 0 : -EIO;
+    close(fd);
+    return result;
+}
+
+/*
+ * Outage watch
+ */
+
+/**
+ * @brief Tells whether IFF_* flags describe an interface that passes traffic.
+ */
+static bool running(int32 flags) {
+    return (flags & IFF_UP) && (flags & IFF_RUNNING);
+}
+
+/**
+ * @brief Notes when the watched interface went down and came back.
+ */
+static void read_link_events(OutageWatch *watch) {
+    char buffer[16384] __attribute__((aligned(8)));
+    ssize_t length;
+    while ((length = recv(watch->netlink_fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0 && watch->back == 0) {
+        int64 now = monotonic_ns();
+        int remaining = (int)length;
+        for (struct nlmsghdr *header = (struct nlmsghdr *)buffer; NLMSG_OK(header, remaining);
+             header = NLMSG_NEXT(header, remaining)) {
+            if (header->nlmsg_type != RTM_NEWLINK) {
+                continue;
+            }
+            LinkInfo link;
+            netlink_parse_link(header, &link);
+            if (link.ifindex != watch->ifindex) {
+                continue;
+            }
+            if (!running(link.flags)) {
+                watch->went_down = true;
+            } else if (watch->went_down && watch->back == 0) {
+                watch->back = now;
+            }
+        }
+    }
+    if (length < 0 && errno == ENOBUFS) {
+        // Events were lost: the change did take the interface down, so ask for its flags now
+        struct ifreq request;
+        memset(&request, 0, sizeof(request));
+        int socket_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        watch->went_down = true;
+        if (socket_fd >= 0 && if_indextoname(watch->ifindex, request.ifr_name) != NULL &&
+            ioctl(socket_fd, SIOCGIFFLAGS, &request) == 0 && running(request.ifr_flags)) {
+            watch->back = monotonic_ns();
+        }
+        if (socket_fd >= 0) {
+            close(socket_fd);
+        }
+    }
+}
+
+/**
+ * @brief Starts watching an interface that is about to be taken down.
+ *
+ * @param interface The interface about to be changed.
+ * @param budget_ns Longest outage allowed.
+ * @param watch Receives the watch, to pass to outage_watch_finish().
+ * @return int 0 on success, or a negative errno.
+ */
+int outage_watch_start(const char *interface, int64 budget_ns, OutageWatch **watch) {
+    OutageWatch *state = calloc(1, sizeof(*state));
+    if (state == NULL) {
+        return -ENOMEM;
+    }
+    // Subscribe before reading the flags so that no event after them can be missed
+    state->netlink_fd = netlink_open(RTMGRP_LINK);
+    state->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    int result = state->netlink_fd < 0 ? state->netlink_fd : state->timer_fd < 0 ? -errno : 0;
+
+    struct ifreq request;
+    memset(&request, 0, sizeof(request));
+    strncpy(request.ifr_name, interface, IFNAMSIZ - 1);
+    int socket_fd = result == 0 ? socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0) : -1;
+    if (result == 0 && (socket_fd < 0 || ioctl(socket_fd, SIOCGIFINDEX, &request) < 0)) {
+        result = -errno;
+    }
+    state->ifindex = request.ifr_ifindex;
+    if (result == 0 && ioctl(socket_fd, SIOCGIFFLAGS, &request) < 0) {
+        result = -errno;
+    }
+    state->was_running = result == 0 && running(request.ifr_flags);
+    if (socket_fd >= 0) {
+        close(socket_fd);
+    }
+
+    state->started = monotonic_ns();
+    state->deadline = state->started + budget_ns;
+    struct itimerspec timer = { { 0, 0 }, { state->deadline / 1000000000, state->deadline % 1000000000 } };
+    if (result == 0 && timerfd_settime(state->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL) < 0) {
+        result = -errno;
+    }
+    if (result < 0) {
+        if (state->netlink_fd >= 0) close(state->netlink_fd);
+        if (state->timer_fd >= 0) close(state->timer_fd);
+        free(state);
+        return result;
+    }
+    *watch = state;
+    return 0;
+}
+
+/**
+ * @brief Waits until the changed interface runs again or the budget is spent.
+ *
+ * Returns at once if the change failed or if the interface was not running
+ * before it. The watch is freed.
+ *
+ * @param watch The watch returned by outage_watch_start().
+ * @param trace The outcome of the change.
+ * @param outage_ns Receives the outage measured from the start of the change, 0 if there was none.
+ * @return int 0 within the budget, or -ETIMEDOUT if it was spent.
+ */
+int outage_watch_finish(OutageWatch *watch, const LinkRotation *trace, int64 *outage_ns) {
+    *outage_ns = 0;
+    int result = 0;
+    if (trace->error == 0 && watch->was_running) {
+        struct pollfd fds[2] = {
+            { .fd = watch->netlink_fd, .events = POLLIN },
+            { .fd = watch->timer_fd, .events = POLLIN },
+        };
+        for (;;) {
+            read_link_events(watch);
+            if (watch->back != 0 || monotonic_ns() >= watch->deadline) {
+                break;
+            }
+            if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+                break;
+            }
+        }
+        int64 end = watch->back != 0 ? watch->back : monotonic_ns();
+        *outage_ns = end - watch->started;
+        result = watch->back == 0 || watch->back > watch->deadline ? -ETIMEDOUT : 0;
+    }
+    close(watch->netlink_fd);
+    close(watch->timer_fd);
+    free(watch);
+    return result;
+}
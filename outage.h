@@ -0,0 +1,51 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_OUTAGE_H
+#define MACMASQ_OUTAGE_H
+
+// Including required C Header files
+#include "netlink.h"       // for LinkRotation
+
+// Capability cache used when none is given on the command line (outlives reboots, as drivers do)
+#define CAPABILITY_DEFAULT_PATH "/var/lib/macmasq/capabilities"
+// Longest driver name kept (ETHTOOL_GDRVINFO reports 32 bytes)
+#define DRIVER_NAME_SIZE 32
+// Age after which a slow mark is forgotten and the driver measured again, in seconds
+#define CAPABILITY_SLOW_TTL_S (30 * 86400)
+
+/**
+* @brief What the capability cache knows about one driver.
+*/
+typedef struct driver_capability {
+    char driver[DRIVER_NAME_SIZE];       // Driver name (ETHTOOL_GDRVINFO)
+    bool slow;                           // Once took longer than the outage budget to come back
+    int32 slow_count;                    // Changes rolled back for it
+    int64 outage_ns;                     // Longest outage seen before a roll back
+    int64 marked_s;                      // When it was last marked slow (CLOCK_REALTIME seconds)
+} DriverCapability;
+
+typedef struct outage_watch OutageWatch;
+
+int driver_name(const char *interface, char driver[DRIVER_NAME_SIZE]);
+int capability_lookup(const char *path, const char *driver, DriverCapability *capability);
+int capability_mark_slow(const char *path, const char *driver, int64 outage_ns);
+
+int outage_watch_start(const char *interface, int64 budget_ns, OutageWatch **watch);
+int outage_watch_finish(OutageWatch *watch, const LinkRotation *trace, int64 *outage_ns);
+
+#endif // MACMASQ_OUTAGE_H
@@ -0,0 +1,553 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Plans: the rotation of every targeted interface in every namespace,
+ * computed ahead of a maintenance window and applied during it.
+ *
+ * A plan file is a header, a table of namespace names and one fixed-size
+ * entry per interface (ifindex, name, namespace, strategy, expected old
+ * address and new address), grouped by namespace. It is written to a
+ * temporary file and renamed into place, so a plan on disk is always
+ * whole.
+ *
+ * Applying maps the file read-only and streams its entries, one chunk at a
+ * time, into netlink_rotate(), which packs as many interfaces as fit into
+ * every sendmsg(). rtnetlink handles a batch within the sendmsg() that
+ * carries it, so consecutive batches keep the kernel busy without more
+ * than one in flight. Every namespace is dumped once first; entries whose
+ * interface already has the new address are skipped without a request,
+ * which makes re-running a partly applied plan nearly free. Interfaces
+ * whose address is neither the expected old one nor the new one were
+ * changed by someone else since the plan was made and are left alone.
+ * Rolling members of the same master never share a chunk.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdlib.h>                // for malloc, realloc, free
+#include <string.h>                // for memcpy, strncmp
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <fnmatch.h>               // for fnmatch
+#include <sched.h>                 // for setns
+#include <time.h>                  // for time
+#include <unistd.h>                // for write, close, fsync
+#include <net/if_arp.h>            // for ARPHRD_ETHER
+#include <sys/mman.h>              // for mmap
+#include <sys/stat.h>              // for fstat
+#include "linktable.h"             // for the dump of every namespace
+#include "workpool.h"              // for the namespaces of a work set
+#include "plan.h"                  // for the declarations implemented here
+
+// Identifies a plan file ("MMQ_PLAN")
+#define PLAN_MAGIC 0x4E414C505F514D4DUL
+// Bumped whenever the layout of the file changes
+#define PLAN_VERSION 1
+// Bytes of a namespace name in the table ("" for the namespace the plan was made in)
+#define PLAN_NETNS_NAME 256
+
+/**
+* @brief First bytes of a plan file.
+*/
+typedef struct plan_header {
+    int64 magic;                         // PLAN_MAGIC
+    int32 version;                       // PLAN_VERSION
+    int32 netns_count;                   // Entries of the namespace table
+    int32 entry_count;                   // Entries following the namespace table
+    int32 entry_size;                    // sizeof(PlanEntry)
+    int64 created_s;                     // When the plan was made (CLOCK_REALTIME)
+} PlanHeader;
+
+/**
+* @brief The planned rotation of one interface.
+*/
+typedef struct plan_entry {
+    int32 ifindex;                       // Interface index within its namespace
+    int16 netns;                         // Position in the namespace table
+    int8 strategy;                       // RotationStrategy
+    int8 reserved;
+    char name[IFNAMSIZ];                 // Interface name when the plan was made
+    MacAddress old_mac;                  // Address expected before the change
+    MacAddress new_mac;                  // Address to apply
+} PlanEntry;
+
+/**
+* @brief A plan file mapped into memory.
+*/
+typedef struct plan_map {
+    const PlanHeader *header;            // Start of the mapping
+    const char (*names)[PLAN_NETNS_NAME];// Namespace table
+    const PlanEntry *entries;            // The entries
+    size_t size;                         // Bytes mapped
+} PlanMap;
+
+/**
+* @brief Entries collected while a plan is made.
+*/
+typedef struct plan_builder {
+    const PlanOptions *options;          // Targets and address policy
+    PlanEntry *entries;                  // Collected entries
+    int count;                           // Entries used
+    int capacity;                        // Entries allocated
+    int16 netns;                         // Namespace being dumped
+    int error;                           // -ENOMEM once memory ran out
+} PlanBuilder;
+
+/**
+ * @brief Adds one dumped interface to a plan if it is a target.
+ */
+static void plan_visit(const LinkInfo *link, void *context) {
+    PlanBuilder *builder = context;
+    const PlanOptions *options = builder->options;
+    if (builder->error || link->type != ARPHRD_ETHER ||
+        (options->pattern != NULL && fnmatch(options->pattern, link->name, 0) != 0) ||
+        (options->pattern == NULL && options->policy == NULL && !link_is_physical(link))) {
+        return;
+    }
+    const PolicyRule *rule = NULL;
+    if (options->policy != NULL) {
+        int match = policy_lookup(options->policy, link);
+        if (match < 0 || options->policy->rules[match].action == POLICY_NEVER) {
+            return;
+        }
+        rule = &options->policy->rules[match];
+    }
+    if (builder->count == builder->capacity) {
+        int capacity = builder->capacity ? builder->capacity * 2 : 256;
+        PlanEntry *entries = realloc(builder->entries, capacity * sizeof(*entries));
+        if (entries == NULL) {
+            builder->error = -ENOMEM;
+            return;
+        }
+        builder->entries = entries;
+        builder->capacity = capacity;
+    }
+    PlanEntry *entry = &builder->entries[builder->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->ifindex = link->ifindex;
+    entry->netns = builder->netns;
+    entry->strategy = rule ? rule->strategy : STRATEGY_CYCLE;
+    memcpy(entry->name, link->name, IFNAMSIZ);
+    entry->old_mac = link->address;
+    if (rule ? !policy_new_address(rule, link, &entry->new_mac) : !random_local_mac(&entry->new_mac)) {
+        builder->error = -EIO;
+        return;
+    }
+    builder->count++;
+}
+
+/**
+ * @brief Writes a whole buffer, resuming after short writes.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+static int write_all(int fd, const void *data, size_t length) {
+    for (const char *cursor = data; length > 0;) {
+        ssize_t written = write(fd, cursor, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0) {
+            return -errno;
+        }
+        cursor += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Adds the namespaces of a plan (or the current one) to a work set.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+static int add_plan_netns(WorkSet *set, const PlanOptions *options) {
+    int result = 0;
+    for (int i = 0; i < options->netns_count && result == 0; i++) {
+        result = work_set_add_netns(set, options->netns[i]);
+    }
+    if (result == 0 && options->netns_all) {
+        result = work_set_add_all_netns(set);
+    }
+    if (result == 0 && set->netns_count == 0) {
+        result = work_set_add_netns(set, NULL);            // The current namespace
+    }
+    return result;
+}
+
+/**
+ * @brief Computes the rotation of every targeted interface and writes it as a plan.
+ *
+ * @param options Targets, address policy and the file to write.
+ * @param entries Receives the number of interfaces planned.
+ * @param namespaces Receives the number of namespaces dumped.
+ * @return int 0 on success, or a negative errno.
+ */
+int plan_write(const PlanOptions *options, int *entries, int *namespaces) {
+    WorkSet set = { 0 };
+    PlanBuilder builder = { .options = options };
+    int result = add_plan_netns(&set, options);
+    int home = result == 0 ? open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC) : -1;
+    if (result == 0 && home < 0) {
+        result = -errno;
+    }
+    if (result == 0 && set.netns_count > INT16_MAX) {
+        result = -E2BIG;
+    }
+    for (int netns = 0; netns < set.netns_count && result == 0; netns++) {
+        if (setns(set.netns_fds[netns], CLONE_NEWNET) < 0) {
+            result = -errno;
+            break;
+        }
+        int socket_fd = netlink_open(0);
+        builder.netns = (int16)netns;
+        result = socket_fd < 0 ? socket_fd : netlink_dump_links(socket_fd, plan_visit, &builder);
+        if (result == 0) {
+            result = builder.error;
+        }
+        if (socket_fd >= 0) {
+            close(socket_fd);
+        }
+    }
+    if (home >= 0) {
+        setns(home, CLONE_NEWNET);
+        close(home);
+    }
+
+    // Write next to the target and rename, so that a plan on disk is never torn
+    char temporary[4096];
+    int fd = -1;
+    if (result == 0 && snprintf(temporary, sizeof(temporary), "%s.tmp", options->path) >= (int)sizeof(temporary)) {
+        result = -ENAMETOOLONG;
+    }
+    if (result == 0 && (fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        result = -errno;
+    }
+    if (result == 0) {
+        PlanHeader header = { .magic = PLAN_MAGIC, .version = PLAN_VERSION, .netns_count = set.netns_count,
+                              .entry_count = builder.count, .entry_size = sizeof(PlanEntry),
+                              .created_s = (int64)time(NULL) };
+        result = write_all(fd, &header, sizeof(header));
+        for (int netns = 0; netns < set.netns_count && result == 0; netns++) {
+            char name[PLAN_NETNS_NAME] = { 0 };
+            memcpy(name, set.netns_names[netns], sizeof(name) - 1);
+            result = write_all(fd, name, sizeof(name));
+        }
+        if (result == 0) {
+            result = write_all(fd, builder.entries, builder.count * sizeof(PlanEntry));
+        }
+        if (result == 0 && fsync(fd) < 0) {
+            result = -errno;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+        if (result == 0 && rename(temporary, options->path) < 0) {
+            result = -errno;
+        }
+        if (result < 0) {
+            unlink(temporary);
+        }
+    }
+    *entries = builder.count;
+    *namespaces = set.netns_count;
+    free(builder.entries);
+    work_set_free(&set);
+    return result;
+}
+
+/**
+ * @brief Maps a plan file and checks that its size matches its header.
+ *
+ * @return int 0 on success, or a negative errno (-EINVAL for a file that is not a plan).
+ */
+static int map_plan(const char *path, PlanMap *map) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    struct stat status;
+    int result = fstat(fd, &status) < 0 ? -errno : status.st_size < (off_t)sizeof(PlanHeader) ? -EINVAL : 0;
+    void *data = MAP_FAILED;
+    if (result == 0) {
+        data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        result = data == MAP_FAILED ? -errno : 0;
+    }
+    close(fd);
+    if (result < 0) {
+        return result;
+    }
+    const PlanHeader *header = data;
+    size_t expected = sizeof(PlanHeader) + (size_t)header->netns_count * PLAN_NETNS_NAME +
+                      (size_t)header->entry_count * sizeof(PlanEntry);
+    if (header->magic != PLAN_MAGIC || header->version != PLAN_VERSION ||
+        header->entry_size != sizeof(PlanEntry) || expected != (size_t)status.st_size) {
+        munmap(data, status.st_size);
+        return -EINVAL;
+    }
+    map->header = header;
+    map->names = (const void *)((const char *)data + sizeof(PlanHeader));
+    map->entries = (const void *)((const char *)map->names + (size_t)header->netns_count * PLAN_NETNS_NAME);
+    map->size = status.st_size;
+    madvise(data, map->size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+/**
+* @brief State of a plan being applied.
+*/
+typedef struct plan_run {
+    const PlanApplyOptions *options;     // Registry, journal and output
+    const PlanMap *map;                  // The plan
+    PlanReport *report;                  // Counters
+    NetlinkBatch *batch;                 // Reused for every chunk
+    LinkRotation *chunk;                 // Rotations of the current chunk
+    int *entry_of;                       // Plan entry of every rotation of the chunk
+    int count;                           // Rotations in chunk
+    int32 masters[PLAN_CHUNK];           // Masters with a rolling member in the chunk
+    int master_count;                    // Entries of masters
+    int64 netns_id;                      // Inode of the current namespace, tags registry and journal entries
+} PlanRun;
+
+/**
+ * @brief Sends the current chunk and records the outcome of each of its rotations.
+ *
+ * @return int 0 on success, or a negative errno if the socket failed.
+ */
+static int flush_chunk(PlanRun *run) {
+    int sendable = 0;
+    for (int i = 0; i < run->count; i++) {
+        sendable += run->chunk[i].ifindex != 0;
+    }
+    int result = sendable > 0 ? netlink_rotate(run->batch, run->chunk, run->count) : 0;
+    run->report->batches += sendable > 0;
+    for (int i = 0; i < run->count; i++) {
+        LinkRotation *rotation = &run->chunk[i];
+        const PlanEntry *entry = &run->map->entries[run->entry_of[i]];
+        const char *netns = run->map->names[entry->netns];
+        if (result < 0 && rotation->ifindex != 0) {
+            registry_release(run->options->registry, rotation->new_mac);
+            continue;
+        }
+        if (rotation->ifindex != 0) {
+            registry_settle(run->options->registry, rotation, run->netns_id);
+            journal_record(run->options->journal, rotation, run->netns_id);
+        }
+        if (rotation->error == 0) {
+            run->report->applied++;
+        } else if (rotation->error == ESTALE) {
+            run->report->stale++;
+        } else {
+            run->report->failed++;
+        }
+        if (run->options->json != NULL) {
+            json_write_rotation(run->options->json, rotation);
+        } else if (rotation->error != 0) {
+            fprintf(stderr, "%s%s%s%s: %s\n", entry->name, *netns ? " (netns " : "", netns, *netns ? ")" : "",
+                    rotation->error == ESTALE ? "address changed since the plan was made" : strerror(rotation->error));
+        }
+    }
+    run->count = 0;
+    run->master_count = 0;
+    return result;
+}
+
+/**
+ * @brief Queues one plan entry into the current chunk, unless its interface is already done.
+ *
+ * @return int 0 on success, or a negative errno if a full chunk could not be sent.
+ */
+static int queue_entry(PlanRun *run, const LinkTable *links, int index) {
+    const PlanEntry *entry = &run->map->entries[index];
+    const LinkInfo *link = link_table_find_ifindex(links, entry->ifindex);
+    if (link != NULL && strncmp(link->name, entry->name, IFNAMSIZ) == 0 && mac_equal(link->address, entry->new_mac)) {
+        run->report->skipped++;                            // Applied by an earlier run
+        return 0;
+    }
+
+    // Rolling members of one master go down one chunk at a time
+    bool rolling = link != NULL && entry->strategy == STRATEGY_ROLLING && link->master != 0;
+    for (int i = 0; rolling && i < run->master_count; i++) {
+        if (run->masters[i] == link->master) {
+            int result = flush_chunk(run);
+            if (result < 0) {
+                return result;
+            }
+            break;
+        }
+    }
+    if (run->count == PLAN_CHUNK) {
+        int result = flush_chunk(run);
+        if (result < 0) {
+            return result;
+        }
+    }
+
+    LinkRotation *rotation = &run->chunk[run->count];
+    memset(rotation, 0, sizeof(*rotation));
+    memcpy(rotation->name, entry->name, IFNAMSIZ);
+    rotation->new_mac = entry->new_mac;
+    run->entry_of[run->count++] = index;
+    if (link == NULL || strncmp(link->name, entry->name, IFNAMSIZ) != 0) {
+        rotation->error = ENODEV;                          // Gone, or its index reused (ifindex stays 0)
+        return 0;
+    }
+    rotation->old_mac = link->address;
+    if (!mac_equal(link->address, entry->old_mac)) {
+        rotation->error = ESTALE;
+        return 0;
+    }
+    int reserved = registry_reserve(run->options->registry, entry->new_mac);
+    if (reserved < 0) {
+        rotation->error = -reserved;                       // Not reserved, so not sent (ifindex stays 0)
+        return 0;
+    }
+    rotation->ifindex = link->ifindex;
+    rotation->flags = link->flags;
+    rotation->live = entry->strategy == STRATEGY_LIVE;
+    if (rolling) {
+        run->masters[run->master_count++] = link->master;
+    }
+    return 0;
+}
+
+/**
+ * @brief Applies every entry of one namespace, starting at first.
+ *
+ * @return int The first entry of the next namespace, or a negative errno.
+ */
+static int apply_namespace(PlanRun *run, int netns_fd, int first) {
+    const PlanEntry *entries = run->map->entries;
+    int count = run->map->header->entry_count;
+    int16 netns = entries[first].netns;
+    struct stat status;
+    if (setns(netns_fd, CLONE_NEWNET) < 0 || fstat(netns_fd, &status) < 0) {
+        return -errno;
+    }
+    run->netns_id = (int64)status.st_ino;
+    int socket_fd = netlink_open(0);
+    if (socket_fd < 0) {
+        return socket_fd;
+    }
+    LinkTable links = { 0 };
+    int result = link_table_load(&links, socket_fd);
+    netlink_batch_init(run->batch, socket_fd, NULL, NULL);
+    int index = first;
+    for (; result == 0 && index < count && entries[index].netns == netns; index++) {
+        result = queue_entry(run, &links, index);
+    }
+    if (result == 0) {
+        result = flush_chunk(run);
+    }
+    link_table_free(&links);
+    close(socket_fd);
+    return result < 0 ? result : index;
+}
+
+/**
+ * @brief Applies a plan, skipping the interfaces that already have their new address.
+ *
+ * @param options The plan, and where reservations, original addresses and results go.
+ * @param report Receives the counters of the run.
+ * @return int 0 when every entry was handled (some may have failed), or a negative errno.
+ */
+int plan_apply(const PlanApplyOptions *options, PlanReport *report) {
+    memset(report, 0, sizeof(*report));
+    int64 started = monotonic_ns();
+    PlanMap map;
+    int result = map_plan(options->path, &map);
+    if (result < 0) {
+        return result;
+    }
+    report->entries = map.header->entry_count;
+    report->namespaces = map.header->netns_count;
+
+    WorkSet set = { 0 };
+    for (int netns = 0; netns < (int)map.header->netns_count && result == 0; netns++) {
+        result = work_set_add_netns(&set, map.names[netns][0] ? map.names[netns] : NULL);
+    }
+    PlanRun run = { .options = options, .map = &map, .report = report };
+    run.batch = malloc(sizeof(*run.batch));
+    run.chunk = malloc(PLAN_CHUNK * sizeof(*run.chunk));
+    run.entry_of = malloc(PLAN_CHUNK * sizeof(*run.entry_of));
+    if (result == 0 && (run.batch == NULL || run.chunk == NULL || run.entry_of == NULL)) {
+        result = -ENOMEM;
+    }
+    int home = result == 0 ? open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC) : -1;
+    if (result == 0 && home < 0) {
+        result = -errno;
+    }
+    for (int index = 0; result == 0 && index < (int)map.header->entry_count;) {
+        int netns = map.entries[index].netns;
+        if (netns >= set.netns_count) {
+            result = -EINVAL;
+            break;
+        }
+        result = index = apply_namespace(&run, set.netns_fds[netns], index);
+        result = result < 0 ? result : 0;
+    }
+    if (home >= 0) {
+        setns(home, CLONE_NEWNET);
+        close(home);
+    }
+    if (options->json != NULL) {
+        json_writer_flush(options->json);
+    }
+    report->elapsed_ns = monotonic_ns() - started;
+
+    free(run.batch);
+    free(run.chunk);
+    free(run.entry_of);
+    work_set_free(&set);
+    munmap((void *)map.header, map.size);
+    return result;
+}
+
+/**
+ * @brief Prints a plan for review, one line per interface.
+ *
+ * @param path Plan file written by plan_write().
+ * @param output Where the lines go.
+ * @return int 0 on success, or a negative errno.
+ */
+int plan_show(const char *path, FILE *output) {
+    PlanMap map;
+    int result = map_plan(path, &map);
+    if (result < 0) {
+        return result;
+    }
+    time_t created = (time_t)map.header->created_s;
+    struct tm local;
+    char when[64];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&created, &local));
+    fprintf(output, "# %d interfaces in %d namespaces, planned %s\n",
+            map.header->entry_count, map.header->netns_count, when);
+    for (int i = 0; i < (int)map.header->entry_count; i++) {
+        const PlanEntry *entry = &map.entries[i];
+        const char *netns = entry->netns < map.header->netns_count ? map.names[entry->netns] : "?";
+        char old_mac[MAC_STRING_LENGTH + 1], new_mac[MAC_STRING_LENGTH + 1];
+        mac_format(entry->old_mac, old_mac);
+        mac_format(entry->new_mac, new_mac);
+        fprintf(output, "%-16s %-16s ifindex %-6u %s -> %s %s\n", *netns ? netns : "-", entry->name, entry->ifindex,
+                old_mac, new_mac, strategy_name((RotationStrategy)entry->strategy));
+    }
+    munmap((void *)map.header, map.size);
+    return 0;
+}
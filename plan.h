@@ -0,0 +1,71 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_PLAN_H
+#define MACMASQ_PLAN_H
+
+// Including required C Header files
+#include <stdio.h>         // for FILE
+#include "policy.h"        // for Policy
+#include "registry.h"      // for MacRegistry
+#include "journal.h"       // for Journal
+#include "json.h"          // for JsonWriter
+
+// Interfaces handed to the kernel per netlink_rotate() call while applying a plan
+#define PLAN_CHUNK 1024
+
+/**
+* @brief What goes into a plan.
+*/
+typedef struct plan_options {
+    const char *path;                    // Plan file to write
+    const char *pattern;                 // Interface name pattern, NULL for physical interfaces (or the policy's)
+    const Policy *policy;                // Draws addresses and strategies, NULL for random cycles
+    const char **netns;                  // Namespaces named with --netns
+    int netns_count;                     // Entries of netns
+    bool netns_all;                      // Every namespace of "ip netns"
+} PlanOptions;
+
+/**
+* @brief How a plan is applied.
+*/
+typedef struct plan_apply_options {
+    const char *path;                    // Plan file written by plan_write()
+    MacRegistry *registry;               // Host-wide address registry, NULL to reserve nothing
+    Journal *journal;                    // Journal of original addresses, NULL to record nothing
+    JsonWriter *json;                    // One NDJSON record per change, NULL for text
+} PlanApplyOptions;
+
+/**
+* @brief Outcome of applying a plan.
+*/
+typedef struct plan_report {
+    int entries;                         // Entries of the plan
+    int namespaces;                      // Namespaces of the plan
+    int applied;                         // Addresses changed
+    int skipped;                         // Interfaces that already had their new address
+    int stale;                           // Interfaces whose address changed since the plan was made
+    int failed;                          // Missing interfaces and refused changes
+    int batches;                         // netlink_rotate() calls
+    int64 elapsed_ns;                    // Wall time of the whole application
+} PlanReport;
+
+int plan_write(const PlanOptions *options, int *entries, int *namespaces);
+int plan_apply(const PlanApplyOptions *options, PlanReport *report);
+int plan_show(const char *path, FILE *output);
+
+#endif // MACMASQ_PLAN_H
@@ -0,0 +1,533 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Policy files.
+ *
+ * One rule per line: a name pattern followed by key=value settings, e.g.
+ *
+ *     # pattern   predicates / settings
+ *     ib*         action=never
+ *     veth*       interval=1h address=local strategy=live
+ *     eno*        interval=1d address=keep-oui
+ *     *           slave=bond interval=1h strategy=rolling
+ *
+ * Predicates restrict a rule beyond its name pattern (values are comma
+ * separated alternatives):
+ *     kind=veth,macvlan   link kind, "physical" for Ethernet devices without one,
+ *                         "none" for other devices without one (loopback, ...)
+ *     slave=bond          kind of the master the link is enslaved to, "none" if standalone
+ *     group=0,5           interface group
+ * Settings:
+ *     action=rotate|never           (default rotate)
+ *     interval=N[s|m|h|d]           (default 1d)
+ *     address=local|keep-oui        (default local)
+ *     strategy=cycle|live|rolling   (default cycle)
+ *     priority=critical|normal|bulk (default normal)
+ *
+ * The first rule that matches an interface decides for it.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>         // for fopen, getline, snprintf
+#include <stdlib.h>        // for calloc, malloc, free, strtoul
+#include <string.h>        // for strcmp, strchr, strtok_r, strncpy
+#include <errno.h>         // for errno
+#include <fnmatch.h>       // for fnmatch
+#include "policy.h"        // for the policy declared here
+
+// Rotation period used when a rule does not specify one
+#define POLICY_DEFAULT_INTERVAL_NS (86400UL * 1000000000UL)
+
+/**
+ * @brief Parses a duration such as "90", "15m", "1h" or "2d" into nanoseconds.
+ */
+static bool parse_duration(const char *text, int64 *ns) {
+    char *end;
+    unsigned long value = strtoul(text, &end, 10);
+    int64 unit = 1;
+    if (end == text) {
+        return false;
+    }
+    switch (*end) {
+    case '\0':
+    case 's': unit = 1; break;
+    case 'm': unit = 60; break;
+    case 'h': unit = 3600; break;
+    case 'd': unit = 86400; break;
+    default: return false;
+    }
+    if (*end != '\0' && end[1] != '\0') {
+        return false;                                      // Trailing characters after the unit
+    }
+    *ns = (int64)value * unit * 1000000000UL;
+    return value > 0;
+}
+
+/**
+ * @brief Finds (or adds) a value in a predicate table.
+ *
+ * @return int Position of the value, or -1 if the table is full.
+ */
+static int predicate_slot(PredicateTable *table, const char *name, int32 number) {
+    for (int i = 0; i < table->count; i++) {
+        if (name ? strcmp(table->names[i], name) == 0 : table->numbers[i] == number) {
+            return i;
+        }
+    }
+    if (table->count == POLICY_MAX_VALUES) {
+        return -1;
+    }
+    int slot = table->count++;
+    if (name) {
+        strncpy(table->names[slot], name, LINK_KIND_SIZE - 1);
+    }
+    table->numbers[slot] = number;
+    return slot;
+}
+
+/**
+ * @brief Records that a rule accepts the comma separated values of one predicate.
+ *
+ * @param table The predicate table.
+ * @param constrained Mask of rules that carry this predicate.
+ * @param rule Index of the rule.
+ * @param list Comma separated values.
+ * @param numeric True for numeric predicates (group).
+ * @return true on success, false if a value is malformed or the table is full.
+ */
+static bool add_predicate(PredicateTable *table, int64 *constrained, int rule, char *list, bool numeric) {
+    char *saved;
+    *constrained |= 1UL << rule;
+    for (char *value = strtok_r(list, ",", &saved); value; value = strtok_r(NULL, ",", &saved)) {
+        int slot;
+        if (numeric) {
+            char *end;
+            unsigned long number = strtoul(value, &end, 10);
+            if (*value == '\0' || *end != '\0') {
+                return false;
+            }
+            slot = predicate_slot(table, NULL, (int32)number);
+        } else {
+            if (strlen(value) >= LINK_KIND_SIZE) {
+                return false;
+            }
+            slot = predicate_slot(table, value, 0);
+        }
+        if (slot < 0) {
+            return false;
+        }
+        table->masks[slot] |= 1UL << rule;
+    }
+    return true;
+}
+
+/**
+ * @brief Lets rules without a predicate accept every value of it.
+ */
+static void finish_predicate(PredicateTable *table, int64 constrained, int64 all_rules) {
+    int64 unconstrained = all_rules & ~constrained;
+    for (int i = 0; i < table->count; i++) {
+        table->masks[i] |= unconstrained;
+    }
+    table->other_mask = unconstrained;
+}
+
+/**
+ * @brief Returns the mask of rules accepting a string value.
+ */
+static int64 predicate_mask(const PredicateTable *table, const char *name) {
+    for (int i = 0; i < table->count; i++) {
+        if (strcmp(table->names[i], name) == 0) {
+            return table->masks[i];
+        }
+    }
+    return table->other_mask;
+}
+
+/**
+ * @brief Returns the mask of rules accepting a numeric value.
+ */
+static int64 predicate_mask_number(const PredicateTable *table, int32 number) {
+    for (int i = 0; i < table->count; i++) {
+        if (table->numbers[i] == number) {
+            return table->masks[i];
+        }
+    }
+    return table->other_mask;
+}
+
+/**
+ * @brief Returns the length of the literal part of a pattern (up to the first wildcard).
+ */
+static size_t literal_length(const char *pattern) {
+    return strcspn(pattern, "*?[");
+}
+
+/**
+ * @brief Builds the name trie from the patterns of every rule.
+ *
+ * Bytes that appear in some literal prefix get their own class; every other
+ * byte falls into class 0, which has no transition. This keeps the table at
+ * a few dozen columns instead of 256.
+ *
+ * @return true on success, false if memory ran out.
+ */
+static bool compile_patterns(Policy *policy) {
+    size_t max_nodes = 1;
+    memset(policy->byte_class, 0, sizeof(policy->byte_class));
+    policy->class_count = 1;
+    for (int r = 0; r < policy->rule_count; r++) {
+        const char *pattern = policy->rules[r].pattern;
+        size_t literal = literal_length(pattern);
+        max_nodes += literal;
+        for (size_t i = 0; i < literal; i++) {
+            int8 *class = &policy->byte_class[(unsigned char)pattern[i]];
+            if (*class == 0) {
+                *class = (int8)policy->class_count++;
+            }
+        }
+    }
+
+    policy->transitions = malloc(max_nodes * policy->class_count * sizeof(int));
+    policy->prefix_masks = calloc(max_nodes, sizeof(int64));
+    policy->exact_masks = calloc(max_nodes, sizeof(int64));
+    policy->glob_masks = calloc(max_nodes, sizeof(int64));
+    if (!policy->transitions || !policy->prefix_masks || !policy->exact_masks || !policy->glob_masks) {
+        return false;
+    }
+    memset(policy->transitions, 0xFF, max_nodes * policy->class_count * sizeof(int));
+    policy->node_count = 1;
+
+    for (int r = 0; r < policy->rule_count; r++) {
+        const char *pattern = policy->rules[r].pattern;
+        size_t literal = literal_length(pattern);
+        int node = 0;
+        for (size_t i = 0; i < literal; i++) {
+            int *next = &policy->transitions[node * policy->class_count +
+                                               policy->byte_class[(unsigned char)pattern[i]]];
+            if (*next < 0) {
+                *next = policy->node_count++;
+            }
+            node = *next;
+        }
+        const char *rest = pattern + literal;
+        if (*rest == '\0') {
+            policy->exact_masks[node] |= 1UL << r;         // "eth0"
+        } else if (strcmp(rest, "*") == 0) {
+            policy->prefix_masks[node] |= 1UL << r;        // "veth*"
+        } else {
+            policy->glob_masks[node] |= 1UL << r;          // "en*s0", "eth?" ...: checked with fnmatch
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Applies one "key=value" word to a rule.
+ *
+ * @return const char* NULL on success, or a description of the problem.
+ */
+static const char *apply_setting(Policy *policy, int rule, char *word, int64 constrained[3]) {
+    PolicyRule *target = &policy->rules[rule];
+    char *value = strchr(word, '=');
+    if (value == NULL) {
+        return "expected key=value";
+    }
+    *value++ = '\0';
+
+    if (strcmp(word, "action") == 0) {
+        if (strcmp(value, "rotate") == 0) target->action = POLICY_ROTATE;
+        else if (strcmp(value, "never") == 0) target->action = POLICY_NEVER;
+        else return "action must be rotate or never";
+    } else if (strcmp(word, "interval") == 0) {
+        if (!parse_duration(value, &target->interval_ns)) return "malformed interval";
+    } else if (strcmp(word, "address") == 0) {
+        if (strcmp(value, "local") == 0) target->address = ADDRESS_LOCAL;
+        else if (strcmp(value, "keep-oui") == 0) target->address = ADDRESS_KEEP_OUI;
+        else return "address must be local or keep-oui";
+    } else if (strcmp(word, "strategy") == 0) {
+        if (strcmp(value, "cycle") == 0) target->strategy = STRATEGY_CYCLE;
+        else if (strcmp(value, "live") == 0) target->strategy = STRATEGY_LIVE;
+        else if (strcmp(value, "rolling") == 0) target->strategy = STRATEGY_ROLLING;
+        else return "strategy must be cycle, live or rolling";
+    } else if (strcmp(word, "priority") == 0) {
+        if (strcmp(value, "critical") == 0) target->priority = PRIORITY_CRITICAL;
+        else if (strcmp(value, "normal") == 0) target->priority = PRIORITY_NORMAL;
+        else if (strcmp(value, "bulk") == 0) target->priority = PRIORITY_BULK;
+        else return "priority must be critical, normal or bulk";
+    } else if (strcmp(word, "kind") == 0) {
+        if (!add_predicate(&policy->kinds, &constrained[0], rule, value, false)) return "malformed kind list";
+    } else if (strcmp(word, "slave") == 0) {
+        if (!add_predicate(&policy->slave_kinds, &constrained[1], rule, value, false)) return "malformed slave list";
+    } else if (strcmp(word, "group") == 0) {
+        if (!add_predicate(&policy->groups, &constrained[2], rule, value, true)) return "malformed group list";
+    } else {
+        return "unknown key";
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reads and compiles a policy from an open stream (closed on return).
+ *
+ * @param file The policy text.
+ * @param path Name used in error messages.
+ * @param error Receives a "file:line: problem" message on failure.
+ * @param error_size Size of error.
+ * @return Policy* The compiled policy, or NULL on failure.
+ */
+static Policy *policy_read(FILE *file, const char *path, char *error, size_t error_size) {
+    Policy *policy = calloc(1, sizeof(*policy));
+    if (policy == NULL) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        fclose(file);
+        return NULL;
+    }
+
+    int64 constrained[3] = { 0, 0, 0 };                    // Rules carrying a kind, slave, group predicate
+    char *line = NULL;
+    size_t line_size = 0;
+    const char *problem = NULL;
+    int line_number = 0;
+    while (problem == NULL && getline(&line, &line_size, file) >= 0) {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        char *saved;
+        char *pattern = strtok_r(line, " \t\r\n", &saved);
+        if (pattern == NULL) {
+            continue;                                      // Blank line
+        }
+        if (policy->rule_count == POLICY_MAX_RULES) {
+            problem = "too many rules";
+            break;
+        }
+        if (strlen(pattern) >= POLICY_PATTERN_SIZE) {
+            problem = "pattern too long";
+            break;
+        }
+        int rule = policy->rule_count++;
+        PolicyRule *target = &policy->rules[rule];
+        strcpy(target->pattern, pattern);
+        target->line = line_number;
+        target->action = POLICY_ROTATE;
+        target->interval_ns = POLICY_DEFAULT_INTERVAL_NS;
+        target->address = ADDRESS_LOCAL;
+        target->strategy = STRATEGY_CYCLE;
+        target->priority = PRIORITY_NORMAL;
+        for (char *word = strtok_r(NULL, " \t\r\n", &saved); word && problem == NULL;
+             word = strtok_r(NULL, " \t\r\n", &saved)) {
+            problem = apply_setting(policy, rule, word, constrained);
+        }
+    }
+    free(line);
+    fclose(file);
+
+    if (problem == NULL) {
+        int64 all_rules = policy->rule_count == 64 ? ~0UL : (1UL << policy->rule_count) - 1;
+        finish_predicate(&policy->kinds, constrained[0], all_rules);
+        finish_predicate(&policy->slave_kinds, constrained[1], all_rules);
+        finish_predicate(&policy->groups, constrained[2], all_rules);
+        if (!compile_patterns(policy)) {
+            problem = "out of memory";
+        }
+    }
+    if (problem != NULL) {
+        snprintf(error, error_size, "%s:%d: %s", path, line_number, problem);
+        policy_free(policy);
+        return NULL;
+    }
+    return policy;
+}
+
+/**
+ * @brief Reads and compiles a policy file.
+ *
+ * @param path The policy file.
+ * @param error Receives a "file:line: problem" message on failure.
+ * @param error_size Size of error.
+ * @return Policy* The compiled policy, or NULL on failure.
+ */
+Policy *policy_load(const char *path, char *error, size_t error_size) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        return NULL;
+    }
+    return policy_read(file, path, error, error_size);
+}
+
+/**
+ * @brief Compiles a policy held in memory (same syntax as a policy file).
+ *
+ * @param text The policy, NUL-terminated.
+ * @param name Name used in error messages.
+ * @param error Receives a "name:line: problem" message on failure.
+ * @param error_size Size of error.
+ * @return Policy* The compiled policy, or NULL on failure.
+ */
+Policy *policy_parse(const char *text, const char *name, char *error, size_t error_size) {
+    FILE *file = fmemopen((void *)text, strlen(text), "r");
+    if (file == NULL) {
+        snprintf(error, error_size, "%s: %s", name, strerror(errno));
+        return NULL;
+    }
+    return policy_read(file, name, error, error_size);
+}
+
+/**
+ * @brief Returns the value an interface has for the kind= predicate.
+ */
+const char *policy_kind_name(const LinkInfo *link) {
+    return link->kind[0] ? link->kind : link_is_physical(link) ? "physical" : "none";
+}
+
+/**
+ * @brief Finds the rule that decides for an interface.
+ *
+ * @param policy A compiled policy.
+ * @param link The interface.
+ * @return int Index of the first matching rule, or -1 if none matches.
+ */
+int policy_lookup(const Policy *policy, const LinkInfo *link) {
+    // Predicates first: they usually rule out most patterns before the name is even looked at
+    int64 allowed = predicate_mask(&policy->kinds, policy_kind_name(link)) &
+                    predicate_mask(&policy->slave_kinds, link->slave_kind[0] ? link->slave_kind : "none") &
+                    predicate_mask_number(&policy->groups, link->group);
+    if (allowed == 0) {
+        return -1;
+    }
+
+    int64 matched = 0;
+    int64 globs = 0;
+    int node = 0;
+    for (const char *cursor = link->name;; cursor++) {
+        matched |= policy->prefix_masks[node];
+        globs |= policy->glob_masks[node];
+        if (*cursor == '\0') {
+            matched |= policy->exact_masks[node];
+            break;
+        }
+        int8 class = policy->byte_class[(unsigned char)*cursor];
+        if (class == 0 || (node = policy->transitions[node * policy->class_count + class]) < 0) {
+            break;                                         // No literal prefix continues with this byte
+        }
+    }
+
+    matched &= allowed;
+    globs &= allowed;
+    // Only wildcard patterns that could beat the best plain match need fnmatch()
+    int64 better = matched ? (matched & -matched) - 1 : ~0UL;
+    for (globs &= better; globs; globs &= globs - 1) {
+        int rule = __builtin_ctzl(globs);
+        if (fnmatch(policy->rules[rule].pattern, link->name, 0) == 0) {
+            return rule;
+        }
+    }
+    return matched ? __builtin_ctzl(matched) : -1;
+}
+
+/**
+ * @brief Tells whether two rules decide the same thing (patterns and lines aside).
+ *
+ * Either rule may be NULL, meaning "no rule matched".
+ */
+bool policy_rule_equivalent(const PolicyRule *a, const PolicyRule *b) {
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return a->action == b->action && a->interval_ns == b->interval_ns &&
+           a->address == b->address && a->strategy == b->strategy && a->priority == b->priority;
+}
+
+/**
+ * @brief Draws the next address for an interface according to its rule.
+ *
+ * @param rule The rule deciding for the interface.
+ * @param link The interface.
+ * @param mac Receives a fresh address.
+ * @return true on success, false if no random bytes could be drawn (errno tells why).
+ */
+bool policy_new_address(const PolicyRule *rule, const LinkInfo *link, MacAddress *mac) {
+    if (!random_local_mac(mac)) {
+        return false;
+    }
+    if (rule->address == ADDRESS_KEEP_OUI) {
+        // Keep the vendor part of the factory address (or the current one if unknown)
+        const MacAddress *base = link->has_perm_address ? &link->perm_address : &link->address;
+        memcpy(mac->bytes, base->bytes, 3);
+    }
+    return true;
+}
+
+/**
+ * @brief Releases a compiled policy.
+ */
+void policy_free(Policy *policy) {
+    if (policy == NULL) {
+        return;
+    }
+    free(policy->transitions);
+    free(policy->prefix_masks);
+    free(policy->exact_masks);
+    free(policy->glob_masks);
+    free(policy);
+}
+
+/**
+ * @brief Returns the policy file spelling of an action.
+ */
+const char *policy_action_name(PolicyAction action) {
+    return action == POLICY_NEVER ? "never" : "rotate";
+}
+
+/**
+ * @brief Returns the policy file spelling of an address mode.
+ */
+const char *address_mode_name(AddressMode mode) {
+    return mode == ADDRESS_KEEP_OUI ? "keep-oui" : "local";
+}
+
+/**
+ * @brief Returns the policy file spelling of a strategy.
+ */
+const char *strategy_name(RotationStrategy strategy) {
+    switch (strategy) {
+    case STRATEGY_CYCLE:   return "cycle";
+    case STRATEGY_LIVE:    return "live";
+    case STRATEGY_ROLLING: return "rolling";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Returns the policy file spelling of a priority class.
+ */
+const char *priority_name(RotationPriority priority) {
+    switch (priority) {
+    case PRIORITY_CRITICAL: return "critical";
+    case PRIORITY_NORMAL:   return "normal";
+    case PRIORITY_BULK:     return "bulk";
+    }
+    return "unknown";
+}
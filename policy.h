@@ -0,0 +1,130 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_POLICY_H
+#define MACMASQ_POLICY_H
+
+// Including required C Header files
+#include "netlink.h"       // for LinkInfo
+
+// Maximum number of rules in a policy (one bit per rule in every predicate mask)
+#define POLICY_MAX_RULES 64
+// Maximum length of a name pattern
+#define POLICY_PATTERN_SIZE 64
+// Maximum number of distinct values listed across all rules for one predicate
+#define POLICY_MAX_VALUES 64
+
+/**
+* @brief What to do with the interfaces a rule matches.
+*/
+typedef enum policy_action {
+    POLICY_ROTATE,                       // Give the interface a new address every interval
+    POLICY_NEVER,                        // Never touch the interface
+} PolicyAction;
+
+/**
+* @brief How new addresses are drawn.
+*/
+typedef enum address_mode {
+    ADDRESS_LOCAL,                       // Fully random, locally administered
+    ADDRESS_KEEP_OUI,                    // Keep the vendor OUI, randomize the lower three bytes
+} AddressMode;
+
+/**
+* @brief How the change is applied to the interface.
+*/
+typedef enum rotation_strategy {
+    STRATEGY_CYCLE,                      // Down, set, up
+    STRATEGY_LIVE,                       // Set without taking the interface down
+    STRATEGY_ROLLING,                    // Down, set, up, never two members of the same master at once
+} RotationStrategy;
+
+/**
+* @brief Order in which the daemon serves rotations that are due at the same time.
+*/
+typedef enum rotation_priority {
+    PRIORITY_CRITICAL,                   // Served first, may spend the whole burst of the rate limit
+    PRIORITY_NORMAL,                     // Served once no critical rotation is due
+    PRIORITY_BULK,                       // Served last, leaves half the burst to the other classes
+} RotationPriority;
+
+// Number of priority classes
+#define PRIORITY_CLASSES 3
+
+/**
+* @brief One line of a policy file.
+*/
+typedef struct policy_rule {
+    char pattern[POLICY_PATTERN_SIZE];   // Interface name pattern ('*' and '?' wildcards)
+    int line;                            // Line of the policy file, for diagnostics
+    PolicyAction action;                 // What to do
+    int64 interval_ns;                   // Rotation period
+    AddressMode address;                 // How addresses are drawn
+    RotationStrategy strategy;           // How addresses are applied
+    RotationPriority priority;           // Class of its rotations in the daemon's queue
+} PolicyRule;
+
+/**
+* @brief Values of one predicate (link kind, group, ...) and the rules accepting each of them.
+*/
+typedef struct predicate_table {
+    int count;                           // Number of listed values
+    char names[POLICY_MAX_VALUES][LINK_KIND_SIZE];  // Listed values (string predicates)
+    int32 numbers[POLICY_MAX_VALUES];    // Listed values (numeric predicates)
+    int64 masks[POLICY_MAX_VALUES];      // Rules accepting each listed value
+    int64 other_mask;                    // Rules accepting any value that is not listed
+} PredicateTable;
+
+/**
+* @brief A policy compiled into a decision table.
+*
+* Every name pattern is folded into one trie over the literal part of the
+* patterns; walking the interface name through it yields the mask of rules
+* whose pattern can match. Every other predicate maps its value to a mask of
+* accepting rules. The decision is the lowest bit set in the AND of all masks,
+* i.e. the first matching rule of the file.
+*/
+typedef struct policy {
+    PolicyRule rules[POLICY_MAX_RULES];  // Rules in file order
+    int rule_count;                      // Number of rules
+    // Name matcher (a trie over byte classes)
+    int8 byte_class[256];                // Byte to class, 0 for bytes absent from every literal
+    int class_count;                     // Number of classes, including class 0
+    int node_count;                      // Number of trie nodes (node 0 is the root)
+    int *transitions;                    // node * class_count + class -> next node, or -1
+    int64 *prefix_masks;                 // Rules matched by any name having this node as prefix
+    int64 *exact_masks;                  // Rules matched by a name ending exactly at this node
+    int64 *glob_masks;                   // Rules with a wildcard past this node (verified with fnmatch)
+    // Other predicates
+    PredicateTable kinds;                // IFLA_INFO_KIND ("physical" for none)
+    PredicateTable slave_kinds;          // IFLA_INFO_SLAVE_KIND ("none" when not enslaved)
+    PredicateTable groups;               // Interface group
+} Policy;
+
+Policy *policy_load(const char *path, char *error, size_t error_size);
+Policy *policy_parse(const char *text, const char *name, char *error, size_t error_size);
+int policy_lookup(const Policy *policy, const LinkInfo *link);
+const char *policy_kind_name(const LinkInfo *link);
+void policy_free(Policy *policy);
+bool policy_new_address(const PolicyRule *rule, const LinkInfo *link, MacAddress *mac);
+bool policy_rule_equivalent(const PolicyRule *a, const PolicyRule *b);
+const char *policy_action_name(PolicyAction action);
+const char *address_mode_name(AddressMode mode);
+const char *strategy_name(RotationStrategy strategy);
+const char *priority_name(RotationPriority priority);
+
+#endif // MACMASQ_POLICY_H
@@ -0,0 +1,408 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host-wide registry of the addresses macmasq processes are about to apply
+ * or have applied, kept in one shared file under /dev/shm so that two
+ * processes drawing random addresses at the same moment never apply the
+ * same one.
+ *
+ * The file is an open-addressing table of 16-byte slots, each holding a
+ * 48-bit address and an owner word. A slot is free while its owner is zero.
+ * A reservation claims the first free slot along the linear probe sequence
+ * of its address with a compare-and-swap on the owner, then publishes the
+ * address. No lock is taken, so two processes can place the same address in
+ * different slots at once. To settle that, a reservation first raises the
+ * longest probe distance recorded in the header to its own, publishes the
+ * address, and then scans that many slots for another holder; if it finds
+ * one it backs off. All of these are sequentially consistent, so of two
+ * racing reservations at least one sees the other: at most one succeeds
+ * (occasionally neither, and the caller draws another address).
+ *
+ * The owner word is the pid of a process whose reservation is pending, or
+ * the network namespace and ifindex of the interface the address was
+ * applied to. Reclamation needs no lock either: a slot whose process is
+ * gone, or whose interface no longer exists in the caller's namespace, is
+ * stale, and whoever meets it takes it over with a compare-and-swap and
+ * frees it. Applying a new address to an interface frees its previous one.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <signal.h>                // for kill
+#include <unistd.h>                // for close, ftruncate, getpid
+#include <net/if.h>                // for if_indextoname
+#include <sys/file.h>              // for flock
+#include <sys/mman.h>              // for mmap
+#include <sys/stat.h>              // for fstat, stat
+#include "registry.h"              // for the registry declared here
+
+// Identifies a registry file ("MMQREGST")
+#define REGISTRY_MAGIC 0x5453474552514D4DUL
+// Bumped whenever the layout of the file changes
+#define REGISTRY_VERSION 1
+// Wraps a slot index around the table
+#define REGISTRY_MASK (REGISTRY_SLOTS - 1)
+// Owner bit of an address applied to an interface (without it, the owner is a pid)
+#define OWNER_APPLIED (1UL << 63)
+
+/**
+* @brief First cache line of the registry file.
+*/
+typedef struct registry_header {
+    int64 magic;                         // REGISTRY_MAGIC once the file is initialised
+    int32 version;                       // REGISTRY_VERSION
+    int32 slots;                         // REGISTRY_SLOTS
+    int32 max_probe;                     // Longest probe distance a reservation has used
+    int32 reserved;
+} RegistryHeader;
+
+/**
+* @brief One address and who holds it.
+*/
+typedef struct registry_slot {
+    int64 key;                           // The address as a 48-bit number, 0 while free
+    int64 owner;                         // Pid, or OWNER_APPLIED | netns << 32 | ifindex, 0 if free
+} RegistrySlot;
+
+/**
+* @brief Layout of the registry file, mapped as a whole.
+*/
+typedef struct registry_file {
+    union {
+        RegistryHeader header;
+        char line[64];                   // Keeps the slots cache line aligned
+    };
+    RegistrySlot slots[REGISTRY_SLOTS];
+} RegistryFile;
+
+/**
+ * @brief Turns an address into the key stored in its slot.
+ */
+static int64 address_key(MacAddress mac) {
+    int64 key = 0;
+    for (int i = 0; i < 6; i++) {
+        key = key << 8 | mac.bytes[i];
+    }
+    return key;
+}
+
+/**
+ * @brief Returns the first slot of the probe sequence of a key.
+ */
+static int32 home_slot(int64 key) {
+    return (int32)((key * 0x9E3779B97F4A7C15UL) >> 32) & REGISTRY_MASK;
+}
+
+/**
+ * @brief Returns the owner word of an address applied to an interface.
+ */
+static int64 applied_owner(int64 netns, int32 ifindex) {
+    return OWNER_APPLIED | (netns & 0x7FFFFFFFUL) << 32 | ifindex;
+}
+
+/**
+ * @brief Tells whether the holder of a slot is gone. Interfaces of other
+ * namespaces cannot be checked and are assumed to exist.
+ */
+static bool owner_is_stale(int64 owner) {
+    if (owner & OWNER_APPLIED) {
+        char name[IFNAMSIZ];
+        if (((owner >> 32) & 0x7FFFFFFFUL) != (registry_netns() & 0x7FFFFFFFUL)) {
+            return false;
+        }
+        return if_indextoname((int32)owner, name) == NULL && (errno == ENXIO || errno == ENODEV);
+    }
+    return kill((pid_t)owner, 0) < 0 && errno == ESRCH;
+}
+
+/**
+ * @brief Frees a slot, provided it is still held by owner.
+ *
+ * The slot is taken over by self first, so that nobody can claim it while
+ * its key is cleared.
+ *
+ * @return bool true if the slot was freed.
+ */
+static bool free_slot(RegistrySlot *slot, int64 owner, int64 self) {
+    if (!__atomic_compare_exchange_n(&slot->owner, &owner, self, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return false;
+    }
+    __atomic_store_n(&slot->key, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&slot->owner, 0, __ATOMIC_SEQ_CST);
+    return true;
+}
+
+/**
+ * @brief Claims the first free slot of a probe sequence.
+ *
+ * @return int Distance of the slot from home, or -1 if the table is full.
+ */
+static int claim_slot(RegistryFile *file, int32 home, int64 owner) {
+    for (int distance = 0; distance < REGISTRY_SLOTS; distance++) {
+        RegistrySlot *slot = &file->slots[(home + distance) & REGISTRY_MASK];
+        int64 expected = 0;
+        if (__atomic_load_n(&slot->owner, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&slot->owner, &expected, owner, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return distance;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Finds the slot holding key for owner.
+ *
+ * @return RegistrySlot* The slot, or NULL if there is none.
+ */
+static RegistrySlot *find_slot(RegistryFile *file, int64 key, int64 owner) {
+    int32 home = home_slot(key);
+    int32 reach = __atomic_load_n(&file->header.max_probe, __ATOMIC_SEQ_CST);
+    for (int32 distance = 0; distance <= reach; distance++) {
+        RegistrySlot *slot = &file->slots[(home + distance) & REGISTRY_MASK];
+        if (__atomic_load_n(&slot->key, __ATOMIC_SEQ_CST) == key &&
+            __atomic_load_n(&slot->owner, __ATOMIC_SEQ_CST) == owner) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Frees every stale slot of the table; used only when it is full.
+ *
+ * @return int Number of slots freed.
+ */
+static int reclaim_stale(MacRegistry *registry) {
+    int freed = 0;
+    for (int index = 0; index < REGISTRY_SLOTS; index++) {
+        RegistrySlot *slot = &registry->file->slots[index];
+        int64 owner = __atomic_load_n(&slot->owner, __ATOMIC_SEQ_CST);
+        if (owner != 0 && owner != registry->owner && owner_is_stale(owner) &&
+            free_slot(slot, owner, registry->owner)) {
+            freed++;
+        }
+    }
+    return freed;
+}
+
+/**
+ * @brief Returns the network namespace of the calling thread, which tags applied addresses.
+ *
+ * @return int64 Inode of the namespace, 0 if unknown.
+ */
+int64 registry_netns(void) {
+    struct stat status;
+    return stat("/proc/thread-self/ns/net", &status) == 0 ? (int64)status.st_ino : 0;
+}
+
+/**
+ * @brief Opens (creating if needed) a registry file and maps it.
+ *
+ * @param registry Receives the open registry.
+ * @param path The registry file, normally REGISTRY_DEFAULT_PATH.
+ * @return int 0 on success, or a negative errno.
+ */
+int registry_open(MacRegistry *registry, const char *path) {
+    registry->file = NULL;
+    registry->owner = (int64)getpid();
+    registry->fd = open(path, O_RDWR | O_CLOEXEC | O_CREAT, 0644);
+    if (registry->fd < 0) {
+        return -errno;
+    }
+
+    // Only the creation of the file is serialized; reservations take no lock
+    int result = 0;
+    while (flock(registry->fd, LOCK_EX) < 0) {
+        if (errno != EINTR) {
+            result = -errno;
+            break;
+        }
+    }
+    struct stat status;
+    if (result == 0 && fstat(registry->fd, &status) < 0) {
+        result = -errno;
+    }
+    if (result == 0 && status.st_size == 0 && ftruncate(registry->fd, sizeof(RegistryFile)) < 0) {
+        result = -errno;
+    } else if (result == 0 && status.st_size != 0 && status.st_size != sizeof(RegistryFile)) {
+        result = -EINVAL;
+    }
+    if (result == 0) {
+        registry->file = mmap(NULL, sizeof(RegistryFile), PROT_READ | PROT_WRITE, MAP_SHARED, registry->fd, 0);
+        if (registry->file == MAP_FAILED) {
+            registry->file = NULL;
+            result = -errno;
+        }
+    }
+    if (result == 0) {
+        RegistryHeader *header = &registry->file->header;
+        if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != REGISTRY_MAGIC) {
+            // New file, or one whose creator died before finishing: the slots are still zero
+            header->version = REGISTRY_VERSION;
+            header->slots = REGISTRY_SLOTS;
+            __atomic_store_n(&header->magic, REGISTRY_MAGIC, __ATOMIC_RELEASE);
+        } else if (header->version != REGISTRY_VERSION || header->slots != REGISTRY_SLOTS) {
+            result = -EINVAL;
+        }
+    }
+    flock(registry->fd, LOCK_UN);
+    if (result < 0) {
+        registry_close(registry);
+    }
+    return result;
+}
+
+/**
+ * @brief Reserves an address for this process until it is settled or released.
+ *
+ * @param registry An open registry, or NULL to reserve nothing.
+ * @param mac The address about to be applied.
+ * @return int 0 if reserved, -EADDRINUSE if another process or interface
+ *             holds it, -ENOSPC if the table is full, -EINVAL for the zero address.
+ */
+int registry_reserve(MacRegistry *registry, MacAddress mac) {
+    if (registry == NULL || registry->file == NULL) {
+        return 0;
+    }
+    RegistryFile *file = registry->file;
+    int64 key = address_key(mac);
+    if (key == 0) {
+        return -EINVAL;
+    }
+    int32 home = home_slot(key);
+    int distance = claim_slot(file, home, registry->owner);
+    if (distance < 0 && reclaim_stale(registry) > 0) {
+        distance = claim_slot(file, home, registry->owner);
+    }
+    if (distance < 0) {
+        return -ENOSPC;
+    }
+
+    // Make the reach of this reservation visible before the address itself
+    int32 reach = __atomic_load_n(&file->header.max_probe, __ATOMIC_SEQ_CST);
+    while (reach < (int32)distance &&
+           !__atomic_compare_exchange_n(&file->header.max_probe, &reach, (int32)distance, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    }
+    RegistrySlot *mine = &file->slots[(home + distance) & REGISTRY_MASK];
+    __atomic_store_n(&mine->key, key, __ATOMIC_SEQ_CST);
+
+    // Back off if anybody else holds the address anywhere a reservation could have put it
+    reach = __atomic_load_n(&file->header.max_probe, __ATOMIC_SEQ_CST);
+    for (int32 other = 0; other <= reach; other++) {
+        RegistrySlot *slot = &file->slots[(home + other) & REGISTRY_MASK];
+        if (slot == mine || __atomic_load_n(&slot->key, __ATOMIC_SEQ_CST) != key) {
+            continue;
+        }
+        int64 owner = __atomic_load_n(&slot->owner, __ATOMIC_SEQ_CST);
+        if (owner == 0 || (owner != registry->owner && owner_is_stale(owner) &&
+                           free_slot(slot, owner, registry->owner))) {
+            continue;
+        }
+        __atomic_store_n(&mine->key, 0, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&mine->owner, 0, __ATOMIC_SEQ_CST);
+        return -EADDRINUSE;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reserves a random address, drawing the lower three bytes again while
+ * the candidate is taken. The first three bytes (and with them a kept OUI)
+ * are left alone.
+ *
+ * @param registry An open registry, or NULL to reserve nothing.
+ * @param mac The candidate; receives the address actually reserved.
+ * @return int 0 if reserved, -EIO if no random bytes could be drawn, or a negative errno as for registry_reserve().
+ */
+int registry_reserve_random(MacRegistry *registry, MacAddress *mac) {
+    int result = registry_reserve(registry, *mac);
+    for (int redraw = 0; redraw < REGISTRY_REDRAWS && result == -EADDRINUSE; redraw++) {
+        if (!random_bytes(&mac->bytes[3], 3)) {
+            return -EIO;
+        }
+        result = registry_reserve(registry, *mac);
+    }
+    return result;
+}
+
+/**
+ * @brief Gives up a reservation of this process that will not be applied.
+ */
+void registry_release(MacRegistry *registry, MacAddress mac) {
+    if (registry == NULL || registry->file == NULL) {
+        return;
+    }
+    RegistrySlot *slot = find_slot(registry->file, address_key(mac), registry->owner);
+    if (slot != NULL) {
+        __atomic_store_n(&slot->key, 0, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&slot->owner, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+/**
+ * @brief Records the outcome of a rotation whose new address was reserved.
+ *
+ * An applied address is handed from this process to the interface, and the
+ * previous address of the interface is freed. The reservation of a failed
+ * rotation is released, unless the registry itself refused the address
+ * (EADDRINUSE), in which case there is nothing of ours to release.
+ *
+ * @param registry An open registry, or NULL.
+ * @param rotation The rotation, after it was applied.
+ * @param netns Namespace of the interface, as returned by registry_netns().
+ */
+void registry_settle(MacRegistry *registry, const LinkRotation *rotation, int64 netns) {
+    if (registry == NULL || registry->file == NULL || rotation->error == EADDRINUSE) {
+        return;
+    }
+    if (rotation->error != 0) {
+        registry_release(registry, rotation->new_mac);
+        return;
+    }
+    int64 applied = applied_owner(netns, rotation->ifindex);
+    RegistrySlot *slot = find_slot(registry->file, address_key(rotation->new_mac), registry->owner);
+    if (slot != NULL) {
+        __atomic_store_n(&slot->owner, applied, __ATOMIC_SEQ_CST);
+    }
+    if (!mac_equal(rotation->old_mac, rotation->new_mac)) {
+        slot = find_slot(registry->file, address_key(rotation->old_mac), applied);
+        if (slot != NULL) {
+            free_slot(slot, applied, registry->owner);
+        }
+    }
+}
+
+/**
+ * @brief Unmaps and closes a registry. Reservations not yet settled become
+ * stale when the process exits.
+ */
+void registry_close(MacRegistry *registry) {
+    if (registry->file != NULL) {
+        munmap(registry->file, sizeof(RegistryFile));
+        registry->file = NULL;
+    }
+    if (registry->fd >= 0) {
+        close(registry->fd);
+        registry->fd = -1;
+    }
+}
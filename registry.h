@@ -0,0 +1,50 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_REGISTRY_H
+#define MACMASQ_REGISTRY_H
+
+// Including required C Header files
+#include "netlink.h"       // for LinkRotation
+
+// Registry shared by every macmasq process on the host when none is given
+#define REGISTRY_DEFAULT_PATH "/dev/shm/macmasq-registry"
+// Addresses the registry can hold at once (a power of two)
+#define REGISTRY_SLOTS (1 << 16)
+// Fresh candidates drawn before a random reservation gives up
+#define REGISTRY_REDRAWS 16
+
+struct registry_file;
+
+/**
+* @brief An open address registry, mapped into memory.
+*/
+typedef struct mac_registry {
+    int fd;                              // The registry file
+    struct registry_file *file;          // Shared mapping of the file
+    int64 owner;                         // Owner word of the reservations of this process
+} MacRegistry;
+
+int registry_open(MacRegistry *registry, const char *path);
+int registry_reserve(MacRegistry *registry, MacAddress mac);
+int registry_reserve_random(MacRegistry *registry, MacAddress *mac);
+void registry_release(MacRegistry *registry, MacAddress mac);
+void registry_settle(MacRegistry *registry, const LinkRotation *rotation, int64 netns);
+int64 registry_netns(void);
+void registry_close(MacRegistry *registry);
+
+#endif // MACMASQ_REGISTRY_H
@@ -0,0 +1,798 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated kernel (--bench-sim).
+ *
+ * An in-memory network namespace behind the kernel backend interface, with
+ * a virtual clock that only moves when the simulated kernel does work or
+ * the caller idles. Interfaces are spread over a table of driver models,
+ * each holding RTNL for its own down, set and up times; drivers without
+ * IFF_LIVE_ADDR_CHANGE answer EBUSY to an address change while up, and some
+ * answer EBUSY for a while after going down. RTNL is one global lock: every
+ * change acquires it in virtual time, and other tasks hold it for a seeded,
+ * jittered share of every millisecond. Link events are queued as the real
+ * kernel would send them, and a full queue reports ENOBUFS.
+ *
+ * A replay (trace.c) populates the namespace from a recorded snapshot
+ * instead, and feeds recorded events in at their recorded times: they
+ * change the simulated interfaces and are queued for the daemon like the
+ * ones its own rotations cause.
+ *
+ * Nothing depends on the wall clock or on getrandom(), so a run is repeated
+ * exactly by repeating its seed; only the CPU time the daemon itself spends
+ * varies. A million interfaces take about 20 MB here.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for printf, snprintf
+#include <stdlib.h>                // for calloc, malloc, free
+#include <string.h>                // for memset, strcpy
+#include <errno.h>                 // for error number definitions
+#include <net/if_arp.h>            // for ARPHRD_ETHER
+#include "policy.h"                // for policy_parse
+#include "daemon.h"                // for simulate_daemon
+#include "sim.h"                   // for the declarations implemented here
+
+// First ifindex handed out (1 is the loopback device)
+#define SIM_FIRST_IFINDEX 2
+// Period of the background RTNL holders
+#define SIM_RTNL_PERIOD_NS 1000000UL
+// Cost of entering and leaving the kernel for one ioctl
+#define SIM_SYSCALL_NS 1500
+// Cost of one netlink sendmsg() and the recv() of its acknowledgements
+#define SIM_ROUND_TRIP_NS 6000
+// Cost of parsing one rtnetlink request inside a batch
+#define SIM_MESSAGE_NS 400
+// RTNL held to reject an address change on a running device
+#define SIM_REJECT_NS 1000
+// Cost of one link in a dump
+#define SIM_DUMP_LINK_NS 700
+// Links filled into one dump message (RTNL is taken once per message)
+#define SIM_DUMP_CHUNK 32
+// Link events returned by one recv()
+#define SIM_EVENTS_PER_RECV 48
+// Flags of every simulated interface at start
+#define SIM_UP_FLAGS (IFF_UP | IFF_BROADCAST | IFF_RUNNING | IFF_MULTICAST)
+
+// Policy used when --bench-sim is not given one
+static const char builtin_policy[] =
+    "veth*  interval=1h strategy=live\n"
+    "*      interval=1h\n";
+
+/**
+* @brief Behaviour of one driver, in virtual time.
+*/
+typedef struct sim_driver {
+    const char *name;                    // Kernel driver
+    const char *prefix;                  // Interface name prefix
+    const char *kind;                    // IFLA_INFO_KIND, "" for physical devices
+    int weight;                          // Share of the simulated interfaces, in permille
+    int64 down_ns;                       // RTNL held to bring the device down
+    int64 set_ns;                        // RTNL held to program the address
+    int64 up_ns;                         // RTNL held to bring the device up
+    int64 busy_ns;                       // Window after a down where address changes may fail
+    int busy_permille;                   // Chance of EBUSY inside that window
+    bool live;                           // IFF_LIVE_ADDR_CHANGE: the address can change while up
+} SimDriver;
+
+// Illustrative costs, in the order of magnitude seen on real hardware; mostly virtual devices, as on a container host
+static const SimDriver sim_drivers[] = {
+    { "veth",       "veth", "veth", 600,    8000,   3000,    10000,       0,   0, true  },
+    { "virtio_net", "ens",  "",     300,   20000,   4000,    60000,       0,   0, true  },
+    { "ixgbe",      "enp",  "",      30, 2000000,  30000,  6000000,       0,   0, false },
+    { "e1000e",     "eno",  "",      25,  900000,  40000,  4000000,       0,   0, false },
+    { "mlx5_core",  "ens",  "",      25, 3000000,  10000,  8000000,       0,   0, false },
+    { "r8169",      "enp",  "",      15,  300000,  20000,  2000000, 5000000, 250, false },
+    { "iwlwifi",    "wlp",  "",       5, 5000000,  60000, 40000000,       0,   0, false },
+};
+#define SIM_DRIVER_COUNT (int)(sizeof(sim_drivers) / sizeof(sim_drivers[0]))
+
+/**
+* @brief The simulated namespace.
+*/
+typedef struct sim_kernel {
+    Kernel base;                         // Operations (no event fd)
+    SimOptions options;                  // Configuration
+    SimStats stats;                      // Counters
+    int64 now;                           // Virtual clock
+    int64 random;                        // State of the EBUSY draws
+    int count;                           // Interfaces (slots, including deleted ones in a replay)
+    int capacity;                        // Allocated slots
+    int8 *drivers;                       // Driver of every interface
+    int32 *flags;                        // IFF_* flags of every interface
+    MacAddress *addresses;               // Current address of every interface
+    int64 *down_at;                      // When every interface last went down
+    LinkEvent *events;                   // Ring of queued link events
+    int event_head;                      // Oldest queued event
+    int event_count;                     // Queued events
+    bool overrun;                        // Events were dropped since the last read
+    LinkInfo *links;                     // Recorded links of a replay, NULL for a generated namespace
+    int *slot_of;                        // Replay: ifindex -> slot, -1 if none
+    int32 ifindex_limit;                 // Entries in slot_of
+    event_source source;                 // Replay: supplies the recorded events
+    void *source_context;                // Passed to source
+    LinkEvent next_event;                // Next recorded event, valid while has_next_event
+    bool has_next_event;                 // The source is not exhausted
+} SimKernel;
+
+/**
+ * @brief Mixes a 64-bit value (splitmix64 finalizer).
+ */
+static int64 mix(int64 value) {
+    value += 0x9E3779B97F4A7C15UL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9UL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBUL;
+    return value ^ (value >> 31);
+}
+
+/**
+ * @brief Returns the next draw of the simulation's generator.
+ */
+static int64 next_random(SimKernel *sim) {
+    sim->random += 0x9E3779B97F4A7C15UL;
+    return mix(sim->random);
+}
+
+/**
+ * @brief Fills the link snapshot of one interface.
+ */
+static void describe(const SimKernel *sim, int index, LinkInfo *link) {
+    const SimDriver *driver = &sim_drivers[sim->drivers[index]];
+    if (sim->links != NULL) {
+        *link = sim->links[index];
+        link->flags = sim->flags[index];
+        link->address = sim->addresses[index];
+        return;
+    }
+    memset(link, 0, sizeof(*link));
+    link->ifindex = SIM_FIRST_IFINDEX + index;
+    snprintf(link->name, sizeof(link->name), "%s%d", driver->prefix, index);
+    link->flags = sim->flags[index];
+    link->type = ARPHRD_ETHER;
+    strcpy(link->kind, driver->kind);
+    link->address = sim->addresses[index];
+    link->has_address = true;
+    if (driver->kind[0] == '\0') {
+        // Factory address: a fixed OUI and the interface number
+        link->perm_address = (MacAddress){ { 0x00, 0x1B, 0x21, (int8)(index >> 16), (int8)(index >> 8), (int8)index } };
+        link->has_perm_address = true;
+    }
+}
+
+/**
+ * @brief Reserves the next entry of the event queue, or records an overrun.
+ *
+ * @return LinkEvent* The entry, or NULL if the queue is full and the event is lost.
+ */
+static LinkEvent *queue_event(SimKernel *sim) {
+    sim->stats.events++;
+    if (sim->event_count == sim->options.event_queue) {
+        sim->overrun = true;                               // The socket buffer is full: the event is lost
+        sim->stats.overruns++;
+        return NULL;
+    }
+    LinkEvent *event = &sim->events[(sim->event_head + sim->event_count++) % sim->options.event_queue];
+    event->time_ns = sim->now;
+    return event;
+}
+
+/**
+ * @brief Queues the RTM_NEWLINK the kernel sends after a change.
+ */
+static void notify(SimKernel *sim, int index) {
+    LinkEvent *event = queue_event(sim);
+    if (event != NULL) {
+        describe(sim, index, &event->link);
+        event->deleted = false;
+    }
+}
+
+/**
+ * @brief Takes RTNL at the current virtual time, holds it for hold_ns, and releases it.
+ *
+ * Other tasks take RTNL at the start of every SIM_RTNL_PERIOD_NS for a
+ * jittered share of it averaging rtnl_load percent; the caller waits for
+ * them to finish first.
+ */
+static void rtnl_section(SimKernel *sim, int64 hold_ns) {
+    int64 period = sim->now / SIM_RTNL_PERIOD_NS;
+    int64 busy = 2 * SIM_RTNL_PERIOD_NS * sim->options.rtnl_load / 100;
+    busy = busy ? mix(sim->options.seed ^ period) % busy : 0;
+    int64 phase = sim->now % SIM_RTNL_PERIOD_NS;
+    if (phase < busy) {
+        sim->stats.rtnl_wait_ns += busy - phase;
+        sim->now += busy - phase;
+    }
+    sim->stats.rtnl_hold_ns += hold_ns;
+    sim->now += hold_ns;
+}
+
+/**
+ * @brief Changes the flags of an interface (dev_change_flags).
+ *
+ * @return int 0, as no driver refuses a down or an up.
+ */
+static int set_flags(SimKernel *sim, int index, int32 flags) {
+    const SimDriver *driver = &sim_drivers[sim->drivers[index]];
+    bool going_up = (flags & IFF_UP) && !(sim->flags[index] & IFF_UP);
+    bool going_down = !(flags & IFF_UP) && (sim->flags[index] & IFF_UP);
+    if (!going_up && !going_down) {
+        return 0;                                          // Nothing changes, nothing is sent
+    }
+    rtnl_section(sim, going_up ? driver->up_ns : driver->down_ns);
+    sim->flags[index] = going_up ? flags | IFF_RUNNING : flags & ~IFF_RUNNING;
+    if (going_down) {
+        sim->down_at[index] = sim->now;
+    }
+    notify(sim, index);
+    return 0;
+}
+
+/**
+ * @brief Changes the address of an interface (dev_set_mac_address).
+ *
+ * @return int 0, or EBUSY when the driver refuses.
+ */
+static int set_address(SimKernel *sim, int index, MacAddress address) {
+    const SimDriver *driver = &sim_drivers[sim->drivers[index]];
+    bool running = sim->flags[index] & IFF_UP;
+    bool settling = !running && driver->busy_ns && sim->now - sim->down_at[index] < driver->busy_ns &&
+                    (int)(next_random(sim) % 1000) < driver->busy_permille;
+    if ((running && !driver->live) || settling) {
+        rtnl_section(sim, SIM_REJECT_NS);
+        sim->stats.busy_errors++;
+        return EBUSY;
+    }
+    rtnl_section(sim, driver->set_ns);
+    sim->addresses[index] = address;
+    notify(sim, index);
+    return 0;
+}
+
+/**
+ * @brief Returns the interface of an ifindex, or -1.
+ */
+static int index_of(const SimKernel *sim, int32 ifindex) {
+    if (sim->links != NULL) {
+        return ifindex < sim->ifindex_limit ? sim->slot_of[ifindex] : -1;
+    }
+    return ifindex >= SIM_FIRST_IFINDEX && ifindex - SIM_FIRST_IFINDEX < (int32)sim->count
+           ? (int)(ifindex - SIM_FIRST_IFINDEX) : -1;
+}
+
+/**
+ * @brief Returns the virtual clock.
+ */
+static int64 sim_now(Kernel *kernel) {
+    return ((SimKernel *)kernel)->now;
+}
+
+/**
+ * @brief Dumps every interface, taking RTNL once per dump message.
+ */
+static int sim_dump_links(Kernel *kernel, link_visitor visit, void *context) {
+    SimKernel *sim = (SimKernel *)kernel;
+    sim->stats.syscalls++;
+    sim->now += SIM_ROUND_TRIP_NS;
+    for (int index = 0; index < sim->count; index++) {
+        if (index % SIM_DUMP_CHUNK == 0) {
+            int chunk = sim->count - index < SIM_DUMP_CHUNK ? sim->count - index : SIM_DUMP_CHUNK;
+            rtnl_section(sim, (int64)chunk * SIM_DUMP_LINK_NS);
+            sim->stats.syscalls++;                         // One recv() per message
+        }
+        if (sim->links != NULL && sim->links[index].ifindex == 0) {
+            continue;                                      // Deleted during a replay
+        }
+        LinkInfo link;
+        describe(sim, index, &link);
+        visit(&link, context);
+    }
+    return 0;
+}
+
+/**
+ * @brief Applies one rotation as its requests reach the kernel: down, set, up (or set alone).
+ *
+ * @param syscall_ns Cost charged before each request (ioctl), 0 when they arrive in a batch.
+ */
+static void apply_rotation(SimKernel *sim, LinkRotation *rotation, int64 syscall_ns) {
+    int index = index_of(sim, rotation->ifindex);
+    if (index < 0) {
+        rotation->error = ENODEV;
+        return;
+    }
+    bool cycle = !rotation->live && (rotation->flags & IFF_UP);
+    int requests = cycle ? 3 : 1;
+    int64 mark = sim->now;
+    if (cycle) {
+        sim->now += syscall_ns;
+        set_flags(sim, index, rotation->flags & ~IFF_UP);
+        rotation->down_ns = sim->now - mark;
+        mark = sim->now;
+    }
+    sim->now += syscall_ns;
+    int error = set_address(sim, index, rotation->new_mac);
+    rotation->set_ns = sim->now - mark;
+    mark = sim->now;
+    if (error != 0 && rotation->error == 0) {
+        rotation->error = error;
+    }
+    if (cycle) {
+        sim->now += syscall_ns;
+        set_flags(sim, index, rotation->flags);           // Back up even if the change failed
+        rotation->up_ns = sim->now - mark;
+    }
+    if (syscall_ns) {
+        sim->stats.syscalls += requests;
+    } else {
+        sim->now += (int64)requests * SIM_MESSAGE_NS;
+    }
+}
+
+/**
+ * @brief Applies rotations with the cost structure of the requested backend.
+ */
+static int sim_rotate(Kernel *kernel, LinkRotation *rotations, int count, MacBackend backend) {
+    SimKernel *sim = (SimKernel *)kernel;
+    int64 started = sim->now;
+    int messages = 0;
+    for (int i = 0; i < count; i++) {
+        LinkRotation *rotation = &rotations[i];
+        int64 rotation_started = sim->now;
+        rotation->backend = backend;
+        if (backend == BACKEND_IOCTL) {
+            apply_rotation(sim, rotation, SIM_SYSCALL_NS);
+        } else if (backend == BACKEND_NETLINK) {
+            sim->now += SIM_ROUND_TRIP_NS;                 // One round trip carries the three requests
+            sim->stats.syscalls += 2;
+            apply_rotation(sim, rotation, 0);
+        } else {
+            int requests = !rotation->live && (rotation->flags & IFF_UP) ? 3 : 1;
+            if (messages == 0 || messages + requests > NETLINK_BATCH_MAX_MESSAGES) {
+                sim->now += SIM_ROUND_TRIP_NS;             // The batch is flushed and a new one started
+                sim->stats.syscalls += 2;
+                messages = 0;
+            }
+            messages += requests;
+            apply_rotation(sim, rotation, 0);
+            rotation->down_ns = rotation->set_ns = rotation->up_ns = 0;  // Not measurable inside a batch
+        }
+        rotation->total_ns = sim->now - rotation_started;
+    }
+    if (backend == BACKEND_NETLINK_BATCH) {
+        for (int i = 0; i < count; i++) {
+            rotations[i].total_ns = sim->now - started;    // Every change waits for the whole batch
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Hands every queued event to visit, or reports the overrun first.
+ */
+static int sim_read_events(Kernel *kernel, link_event_visitor visit, void *context) {
+    SimKernel *sim = (SimKernel *)kernel;
+    if (sim->overrun) {
+        sim->overrun = false;
+        sim->stats.syscalls++;
+        return -ENOBUFS;
+    }
+    int64 recvs = 1 + sim->event_count / SIM_EVENTS_PER_RECV;
+    sim->stats.syscalls += recvs;
+    sim->now += recvs * SIM_SYSCALL_NS;
+    while (sim->event_count > 0) {
+        LinkEvent *event = &sim->events[sim->event_head];
+        sim->event_head = (sim->event_head + 1) % sim->options.event_queue;
+        sim->event_count--;
+        visit(event, context);
+    }
+    return 0;
+}
+
+/**
+ * @brief Makes room for one more slot.
+ *
+ * @return bool false if memory ran out.
+ */
+static bool grow_slots(SimKernel *sim) {
+    if (sim->count < sim->capacity) {
+        return true;
+    }
+    int capacity = sim->capacity ? sim->capacity * 2 : 256;
+    int8 *drivers = realloc(sim->drivers, capacity);
+    if (drivers) sim->drivers = drivers;
+    int32 *flags = drivers ? realloc(sim->flags, capacity * sizeof(int32)) : NULL;
+    if (flags) sim->flags = flags;
+    MacAddress *addresses = flags ? realloc(sim->addresses, capacity * sizeof(MacAddress)) : NULL;
+    if (addresses) sim->addresses = addresses;
+    int64 *down_at = addresses ? realloc(sim->down_at, capacity * sizeof(int64)) : NULL;
+    if (down_at) sim->down_at = down_at;
+    LinkInfo *links = down_at ? realloc(sim->links, capacity * sizeof(LinkInfo)) : NULL;
+    if (links == NULL) {
+        return false;
+    }
+    sim->links = links;
+    sim->capacity = capacity;
+    return true;
+}
+
+/**
+ * @brief Points an ifindex at a slot (-1 to forget it), growing the map as needed.
+ *
+ * @return bool false if memory ran out.
+ */
+static bool map_ifindex(SimKernel *sim, int32 ifindex, int slot) {
+    if (ifindex >= sim->ifindex_limit) {
+        int32 limit = sim->ifindex_limit ? sim->ifindex_limit : 256;
+        while (limit <= ifindex) {
+            limit *= 2;
+        }
+        int *slot_of = realloc(sim->slot_of, limit * sizeof(int));
+        if (slot_of == NULL) {
+            return false;
+        }
+        for (int32 i = sim->ifindex_limit; i < limit; i++) {
+            slot_of[i] = -1;
+        }
+        sim->slot_of = slot_of;
+        sim->ifindex_limit = limit;
+    }
+    sim->slot_of[ifindex] = slot;
+    return true;
+}
+
+/**
+ * @brief Adds a recorded link, or updates the one with its ifindex.
+ *
+ * Virtual devices get the veth model; physical ones a physical driver drawn by weight.
+ *
+ * @return int The slot, or -1 if memory ran out.
+ */
+static int record_link(SimKernel *sim, const LinkInfo *link) {
+    int index = index_of(sim, link->ifindex);
+    if (index < 0) {
+        if (!grow_slots(sim) || !map_ifindex(sim, link->ifindex, sim->count)) {
+            return -1;
+        }
+        index = sim->count++;
+        int8 driver = 0;
+        if (link->kind[0] == '\0') {
+            int total_weight = 0;
+            for (int physical = 1; physical < SIM_DRIVER_COUNT; physical++) {
+                total_weight += sim_drivers[physical].weight;
+            }
+            int pick = (int)(next_random(sim) % total_weight);
+            for (driver = 1; pick >= sim_drivers[driver].weight; driver++) {
+                pick -= sim_drivers[driver].weight;
+            }
+        }
+        sim->drivers[index] = driver;
+        sim->down_at[index] = 0;
+    }
+    sim->links[index] = *link;
+    sim->flags[index] = link->flags;
+    if (link->has_address) {
+        sim->addresses[index] = link->address;
+    }
+    return index;
+}
+
+/**
+ * @brief Applies one recorded event to the namespace and queues it for the daemon.
+ */
+static void replay_event(SimKernel *sim, const LinkEvent *recorded) {
+    sim->stats.replayed++;
+    if (recorded->deleted) {
+        int index = index_of(sim, recorded->link.ifindex);
+        if (index >= 0) {
+            sim->links[index].ifindex = 0;
+            sim->slot_of[recorded->link.ifindex] = -1;
+        }
+    } else if (record_link(sim, &recorded->link) < 0) {
+        return;                                            // Out of memory: the event is dropped
+    }
+    LinkEvent *event = queue_event(sim);
+    if (event != NULL) {
+        event->link = recorded->link;
+        event->deleted = recorded->deleted;
+    }
+}
+
+/**
+ * @brief Lets virtual time pass up to until_ns, or up to the next recorded event.
+ *
+ * Recorded events due by then are applied and queued. Events recorded with
+ * a zero time (replay as fast as possible) do not let time pass at all:
+ * they are queued as long as the queue has room.
+ */
+static int64 sim_idle(Kernel *kernel, int64 until_ns) {
+    SimKernel *sim = (SimKernel *)kernel;
+    if (sim->has_next_event && sim->next_event.time_ns == 0) {
+        while (sim->has_next_event && sim->next_event.time_ns == 0 &&
+               sim->event_count < sim->options.event_queue) {
+            replay_event(sim, &sim->next_event);
+            sim->has_next_event = sim->source(sim->source_context, &sim->next_event);
+        }
+        return sim->now;
+    }
+    if (sim->has_next_event && sim->next_event.time_ns < until_ns) {
+        until_ns = sim->next_event.time_ns;
+    }
+    if (until_ns > sim->now) {
+        sim->now = until_ns;
+    }
+    while (sim->has_next_event && sim->next_event.time_ns != 0 && sim->next_event.time_ns <= sim->now) {
+        replay_event(sim, &sim->next_event);
+        sim->has_next_event = sim->source(sim->source_context, &sim->next_event);
+    }
+    return sim->now;
+}
+
+/**
+ * @brief Tells whether recorded events remain to be replayed.
+ */
+static bool sim_pending(Kernel *kernel) {
+    return ((SimKernel *)kernel)->has_next_event;
+}
+
+/**
+ * @brief Names the simulated driver of an interface.
+ */
+static int sim_driver(Kernel *kernel, const LinkInfo *link, char *driver, int size) {
+    SimKernel *sim = (SimKernel *)kernel;
+    int index = index_of(sim, link->ifindex);
+    if (index < 0) {
+        return -ENODEV;
+    }
+    snprintf(driver, size, "%s", sim_drivers[sim->drivers[index]].name);
+    return 0;
+}
+
+/**
+ * @brief Releases the simulated namespace.
+ */
+static void sim_close(Kernel *kernel) {
+    SimKernel *sim = (SimKernel *)kernel;
+    free(sim->drivers);
+    free(sim->flags);
+    free(sim->addresses);
+    free(sim->down_at);
+    free(sim->events);
+    free(sim->links);
+    free(sim->slot_of);
+    free(sim);
+}
+
+static const KernelOps sim_ops = {
+    .name = "sim",
+    .now = sim_now,
+    .dump_links = sim_dump_links,
+    .rotate = sim_rotate,
+    .read_events = sim_read_events,
+    .idle = sim_idle,
+    .pending = sim_pending,
+    .driver = sim_driver,
+    .close = sim_close,
+};
+
+/**
+ * @brief Allocates a simulated kernel with no interface yet.
+ *
+ * @return SimKernel* The kernel (clock at 1 s), or NULL if memory ran out.
+ */
+static SimKernel *new_sim_kernel(const SimOptions *options) {
+    SimKernel *sim = calloc(1, sizeof(*sim));
+    if (sim == NULL) {
+        return NULL;
+    }
+    sim->base.ops = &sim_ops;
+    sim->base.event_fd = -1;
+    sim->options = *options;
+    sim->now = 1000000000UL;
+    sim->random = options->seed;
+    sim->events = malloc(options->event_queue * sizeof(LinkEvent));
+    if (sim->events == NULL) {
+        free(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+/**
+ * @brief Builds a simulated namespace.
+ *
+ * Drivers are drawn by weight from the seed, and every interface starts up
+ * with a random locally administered address. The clock starts at 1 s.
+ *
+ * @param options Population and load.
+ * @param kernel Receives the backend.
+ * @return int 0 on success, or a negative errno.
+ */
+int sim_kernel_open(const SimOptions *options, Kernel **kernel) {
+    if (options->interfaces < 1 || options->interfaces > SIM_MAX_INTERFACES || options->rtnl_load < 0 ||
+        options->rtnl_load > 90 || options->event_queue < 1) {
+        return -EINVAL;
+    }
+    SimKernel *sim = new_sim_kernel(options);
+    if (sim == NULL) {
+        return -ENOMEM;
+    }
+    sim->count = sim->capacity = options->interfaces;
+    sim->drivers = malloc(sim->count);
+    sim->flags = malloc(sim->count * sizeof(int32));
+    sim->addresses = malloc(sim->count * sizeof(MacAddress));
+    sim->down_at = calloc(sim->count, sizeof(int64));
+    if (!sim->drivers || !sim->flags || !sim->addresses || !sim->down_at) {
+        sim_close(&sim->base);
+        return -ENOMEM;
+    }
+
+    int total_weight = 0;
+    for (int driver = 0; driver < SIM_DRIVER_COUNT; driver++) {
+        total_weight += sim_drivers[driver].weight;
+    }
+    for (int index = 0; index < sim->count; index++) {
+        int64 draw = next_random(sim);
+        int pick = (int)(draw % total_weight);
+        int driver = 0;
+        while (pick >= sim_drivers[driver].weight) {
+            pick -= sim_drivers[driver++].weight;
+        }
+        sim->drivers[index] = (int8)driver;
+        sim->flags[index] = SIM_UP_FLAGS;
+        draw = next_random(sim);
+        memcpy(sim->addresses[index].bytes, &draw, 6);
+        sim->addresses[index].bytes[0] = (sim->addresses[index].bytes[0] & 0xFE) | 0x02;
+    }
+    *kernel = &sim->base;
+    return 0;
+}
+
+/**
+ * @brief Builds a simulated namespace holding recorded links, and attaches the recorded events.
+ *
+ * @param options Load (interfaces is ignored).
+ * @param links The links present when the recording started.
+ * @param count Entries in links.
+ * @param source Supplies the recorded events in time order, stamped in the
+ *               simulated clock (which starts at 1 s), or 0 for "as soon as possible".
+ * @param context Passed to source.
+ * @param kernel Receives the backend.
+ * @return int 0 on success, or a negative errno.
+ */
+int sim_kernel_open_replay(const SimOptions *options, const LinkInfo *links, int count,
+                           event_source source, void *context, Kernel **kernel) {
+    if (options->rtnl_load < 0 || options->rtnl_load > 90 || options->event_queue < 1) {
+        return -EINVAL;
+    }
+    SimKernel *sim = new_sim_kernel(options);
+    if (sim == NULL) {
+        return -ENOMEM;
+    }
+    for (int i = 0; i < count; i++) {
+        if (record_link(sim, &links[i]) < 0) {
+            sim_close(&sim->base);
+            return -ENOMEM;
+        }
+    }
+    if (sim->links == NULL && !grow_slots(sim)) {
+        sim_close(&sim->base);                             // An empty snapshot still replays
+        return -ENOMEM;
+    }
+    sim->source = source;
+    sim->source_context = context;
+    sim->has_next_event = source(context, &sim->next_event);
+    *kernel = &sim->base;
+    return 0;
+}
+
+/**
+ * @brief Returns the counters of a simulated kernel.
+ */
+const SimStats *sim_kernel_stats(Kernel *kernel) {
+    return &((SimKernel *)kernel)->stats;
+}
+
+/**
+ * @brief Parses the policy simulations use when none is given (veths live, everything hourly).
+ *
+ * @return Policy* The policy, or NULL with a message in error.
+ */
+Policy *sim_builtin_policy(char *error, size_t error_size) {
+    return policy_parse(builtin_policy, "built-in policy", error, error_size);
+}
+
+/**
+ * @brief Runs the daemon against a fresh simulated kernel with each backend and prints a table.
+ *
+ * Every backend sees the same interfaces, drivers and background RTNL load
+ * (same seed). Everything but the CPU column is in virtual time and
+ * identical from one run to the next.
+ *
+ * @param options Benchmark shape.
+ * @return int 0 on success, or a negative errno.
+ */
+int sim_bench(const SimBenchOptions *options) {
+    char error[256];
+    Policy *policy = options->policy_path ? policy_load(options->policy_path, error, sizeof(error))
+                                          : sim_builtin_policy(error, sizeof(error));
+    if (policy == NULL) {
+        fprintf(stderr, "macmasq: %s\n", error);
+        return -EINVAL;
+    }
+    DaemonReport *report = malloc(sizeof(*report));
+    if (report == NULL) {
+        policy_free(policy);
+        return -ENOMEM;
+    }
+
+    printf("%d virtual interfaces, %lu s simulated, seed %lu, RTNL held by other tasks %d%% of the time\n",
+           options->sim.interfaces, options->duration_ns / 1000000000UL, options->sim.seed, options->sim.rtnl_load);
+    printf("%-14s %9s %7s %7s %9s %9s %9s %9s %9s %8s %8s %8s %9s\n", "backend", "rotations", "failed", "EBUSY",
+           "batches", "events", "late p50", "late p99", "late max", "rtnl%", "wait%", "resyncs", "cpu ms");
+    int result = 0;
+    int64 state_bytes = 0, checkpoint_bytes = 0;
+    for (int backend = BACKEND_IOCTL; backend <= BACKEND_NETLINK_BATCH && result == 0; backend++) {
+        if (!options->all_backends && backend != (int)options->backend) {
+            continue;
+        }
+        Kernel *kernel;
+        if ((result = sim_kernel_open(&options->sim, &kernel)) < 0) {
+            break;
+        }
+        DaemonOptions daemon_options = { .backend = (MacBackend)backend, .seed = options->sim.seed, .quiet = true,
+                                         .rate_limit = options->rate_limit, .rate_burst = options->rate_burst };
+        result = simulate_daemon(&daemon_options, policy, kernel, options->duration_ns, report);
+        if (result == 0) {
+            const SimStats *stats = sim_kernel_stats(kernel);
+            double span = (double)options->duration_ns / 100.0;
+            printf("%-14s %9lu %7lu %7lu %9lu %9lu %7.2fms %7.2fms %7.2fms %7.2f%% %7.2f%% %8lu %9.0f\n",
+                   backend_name((MacBackend)backend), report->rotations, report->rotation_failures,
+                   stats->busy_errors, report->batches, report->link_events,
+                   histogram_percentile(&report->lateness, 0.50) / 1e6,
+                   histogram_percentile(&report->lateness, 0.99) / 1e6, report->lateness.max / 1e6,
+                   stats->rtnl_hold_ns / span, stats->rtnl_wait_ns / span, report->resyncs, report->loop_ns / 1e6);
+            for (int priority = 0; priority < PRIORITY_CLASSES && options->rate_limit > 0; priority++) {
+                const LatencyHistogram *wait = &report->wait[priority];
+                if (wait->count > 0) {
+                    printf("  %-12s %9lu rotations, late p50 %.2fms, p99 %.2fms, max %.2fms\n",
+                           priority_name(priority), wait->count, histogram_percentile(wait, 0.50) / 1e6,
+                           histogram_percentile(wait, 0.99) / 1e6, wait->max / 1e6);
+                }
+            }
+            if (report->packed_rotations > 0 || report->spread_rotations > 0) {
+                printf("  %-12s %9lu cheap ones sent early with another batch, %lu expensive ones spread apart\n",
+                       "cost model", report->packed_rotations, report->spread_rotations);
+            }
+            state_bytes = report->state_bytes;
+            checkpoint_bytes = report->checkpoint_bytes;
+        }
+        kernel_close(kernel);
+    }
+    if (result == 0) {
+        printf("daemon state: %.1f MB, %.1f bytes per interface, %.1f with the checkpoint (on by default)\n",
+               state_bytes / 1e6, (double)state_bytes / options->sim.interfaces,
+               (double)(state_bytes + checkpoint_bytes) / options->sim.interfaces);
+    }
+    free(report);
+    policy_free(policy);
+    return result;
+}
@@ -0,0 +1,82 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_SIM_H
+#define MACMASQ_SIM_H
+
+// Including required C Header files
+#include "kernel.h"        // for Kernel
+#include "policy.h"        // for Policy
+
+// Virtual interfaces when none is given on the command line
+#define SIM_DEFAULT_INTERFACES 1000000
+// Most virtual interfaces
+#define SIM_MAX_INTERFACES 16000000
+// Simulated time when none is given on the command line, in seconds
+#define SIM_DEFAULT_DURATION_S 3600
+// Share of the time other tasks hold RTNL when none is given, in percent
+#define SIM_DEFAULT_RTNL_LOAD 10
+// Link events the simulated event socket holds before it overruns
+#define SIM_DEFAULT_EVENT_QUEUE 4096
+
+/**
+* @brief How a simulated kernel is populated and loaded.
+*/
+typedef struct sim_options {
+    int interfaces;                      // Virtual Ethernet interfaces, all up
+    int64 seed;                          // Seeds drivers, EBUSY draws and background RTNL holds
+    int rtnl_load;                       // Percent of the time RTNL is held by other tasks
+    int event_queue;                     // Link events buffered before ENOBUFS
+} SimOptions;
+
+/**
+* @brief What happened inside a simulated kernel.
+*/
+typedef struct sim_stats {
+    int64 syscalls;                      // ioctl, sendmsg and recv calls
+    int64 rtnl_hold_ns;                  // RTNL held for the caller
+    int64 rtnl_wait_ns;                  // Time spent waiting for other RTNL holders
+    int64 busy_errors;                   // Address changes answered with EBUSY
+    int64 events;                        // Link events queued
+    int64 overruns;                      // Events dropped on a full queue
+    int64 replayed;                      // Recorded events fed in by a replay
+} SimStats;
+
+// Supplies the next recorded event of a replay; returns false once there are none left
+typedef bool (*event_source)(void *context, LinkEvent *event);
+
+/**
+* @brief Shape of a simulated daemon benchmark.
+*/
+typedef struct sim_bench_options {
+    SimOptions sim;                      // Simulated kernel
+    int64 duration_ns;                   // Simulated time per backend
+    const char *policy_path;             // Policy file, NULL for the built-in one
+    bool all_backends;                   // Run ioctl, netlink and netlink-batch in turn
+    MacBackend backend;                  // The backend when all_backends is false
+    int64 rate_limit;                    // Most link changes per second the daemon sends, 0 for no limit
+    int rate_burst;                      // Changes the limit lets through at once, 0 for one second's worth
+} SimBenchOptions;
+
+int sim_kernel_open(const SimOptions *options, Kernel **kernel);
+int sim_kernel_open_replay(const SimOptions *options, const LinkInfo *links, int count,
+                           event_source source, void *context, Kernel **kernel);
+Policy *sim_builtin_policy(char *error, size_t error_size);
+const SimStats *sim_kernel_stats(Kernel *kernel);
+int sim_bench(const SimBenchOptions *options);
+
+#endif // MACMASQ_SIM_H
@@ -0,0 +1,447 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sticky per-network addresses (--sticky).
+ *
+ * The network an interface is attached to is fingerprinted by, in order of
+ * preference, the MAC address of its default gateway, the DHCP server of
+ * its lease, or its SSID. The fingerprint (salted with the interface name,
+ * so two interfaces on one network never share an address) is hashed into
+ * a small fixed-size table on disk that maps it to the random address
+ * drawn the first time the network was seen.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for snprintf, fopen, fgets
+#include <string.h>                // for memcpy, memcmp, strncmp
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <unistd.h>                // for pread, pwrite, close
+#include <time.h>                  // for clock_gettime
+#include <arpa/inet.h>             // for inet_pton, inet_ntop
+#include <sys/file.h>              // for flock
+#include <sys/socket.h>            // for socket
+#include <linux/netlink.h>         // for netlink message definitions
+#include <linux/rtnetlink.h>       // for routes and neighbours
+#include <linux/neighbour.h>       // for NDA_* attributes
+#include <linux/genetlink.h>       // for the generic netlink controller
+#include <linux/nl80211.h>         // for NL80211_CMD_GET_INTERFACE
+#include "netlink.h"               // for netlink_dump and netlink_request
+#include "sticky.h"                // for the declarations implemented here
+
+// Identifies a sticky table ("MMQSTICK")
+#define STICKY_MAGIC 0x4B43495453514D4DUL
+// Bumped whenever the layout of the file changes
+#define STICKY_VERSION 1
+// Lease files of the DHCP clients that are consulted
+#define NETWORKD_LEASE_FORMAT "/run/systemd/netif/leases/%u"
+#define DHCLIENT_LEASE_FORMAT "/var/lib/dhcp/dhclient.%s.leases"
+
+/**
+* @brief One remembered network.
+*/
+typedef struct sticky_entry {
+    int64 key;                           // Hash of the interface name and fingerprint, 0 if free
+    int64 last_seen;                     // Last use, in CLOCK_REALTIME seconds
+    int8 mac[6];                         // Address used on that network
+    int8 reserved[2];
+} StickyEntry;
+
+/**
+* @brief Layout of the table file.
+*/
+typedef struct sticky_table {
+    int64 magic;                         // STICKY_MAGIC
+    int32 version;                       // STICKY_VERSION
+    int32 slots;                         // STICKY_SLOTS
+    int64 reserved;
+    StickyEntry entries[STICKY_SLOTS];   // Open addressing, linear probing
+} StickyTable;
+
+/*
+ * Default gateway (route and neighbour dumps)
+ */
+
+/**
+* @brief State of the gateway search.
+*/
+typedef struct gateway_search {
+    int32 ifindex;                       // Interface of interest
+    int8 family;                         // AF_INET or AF_INET6
+    int8 gateway[16];                    // Best default gateway found so far
+    int32 metric;                        // Its route metric
+    bool has_gateway;                    // A default route through ifindex was found
+    MacAddress mac;                      // Link-layer address of the gateway
+    bool has_mac;                        // The neighbour table knows it
+} GatewaySearch;
+
+/**
+ * @brief Keeps the main-table default route through the interface with the lowest metric.
+ */
+static void route_visit(const struct nlmsghdr *header, void *context) {
+    GatewaySearch *search = context;
+    const struct rtmsg *route = NLMSG_DATA(header);
+    if (header->nlmsg_type != RTM_NEWROUTE || route->rtm_dst_len != 0 || route->rtm_type != RTN_UNICAST) {
+        return;
+    }
+    int32 table = route->rtm_table, oif = 0, metric = 0;
+    const void *gateway = NULL;
+    int length = RTM_PAYLOAD(header);
+    for (const struct rtattr *attribute = RTM_RTA(route); RTA_OK(attribute, length);
+         attribute = RTA_NEXT(attribute, length)) {
+        switch (attribute->rta_type) {
+        case RTA_TABLE:    table = *(const int32 *)RTA_DATA(attribute); break;
+        case RTA_OIF:      oif = *(const int32 *)RTA_DATA(attribute); break;
+        case RTA_PRIORITY: metric = *(const int32 *)RTA_DATA(attribute); break;
+        case RTA_GATEWAY:  gateway = RTA_DATA(attribute); break;
+        }
+    }
+    if (table != RT_TABLE_MAIN || oif != search->ifindex || gateway == NULL ||
+        (search->has_gateway && metric >= search->metric)) {
+        return;
+    }
+    memcpy(search->gateway, gateway, search->family == AF_INET ? 4 : 16);
+    search->metric = metric;
+    search->has_gateway = true;
+}
+
+/**
+ * @brief Picks the link-layer address of the gateway out of the neighbour table.
+ */
+static void neighbour_visit(const struct nlmsghdr *header, void *context) {
+    GatewaySearch *search = context;
+    const struct ndmsg *neighbour = NLMSG_DATA(header);
+    if (header->nlmsg_type != RTM_NEWNEIGH || (int32)neighbour->ndm_ifindex != search->ifindex ||
+        (neighbour->ndm_state & (NUD_INCOMPLETE | NUD_FAILED | NUD_NONE))) {
+        return;
+    }
+    const struct rtattr *destination = NULL, *address = NULL;
+    int length = header->nlmsg_len - NLMSG_LENGTH(sizeof(*neighbour));
+    for (const struct rtattr *attribute = (const struct rtattr *)((const char *)neighbour + NLMSG_ALIGN(sizeof(*neighbour)));
+         RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length)) {
+        if (attribute->rta_type == NDA_DST) destination = attribute;
+        if (attribute->rta_type == NDA_LLADDR) address = attribute;
+    }
+    size_t size = search->family == AF_INET ? 4 : 16;
+    if (destination != NULL && address != NULL && RTA_PAYLOAD(destination) == size &&
+        RTA_PAYLOAD(address) == 6 && memcmp(RTA_DATA(destination), search->gateway, size) == 0) {
+        memcpy(search->mac.bytes, RTA_DATA(address), 6);
+        search->has_mac = true;
+    }
+}
+
+/**
+ * @brief Finds the MAC address of the interface's default gateway (IPv4 first, then IPv6).
+ *
+ * @return bool true if the gateway and its neighbour entry were found.
+ */
+static bool find_gateway(int socket_fd, int32 ifindex, MacAddress *mac) {
+    const int8 families[] = { AF_INET, AF_INET6 };
+    for (size_t i = 0; i < sizeof(families); i++) {
+        GatewaySearch search = { .ifindex = ifindex, .family = families[i] };
+        if (netlink_dump(socket_fd, RTM_GETROUTE, search.family, route_visit, &search) < 0 || !search.has_gateway) {
+            continue;
+        }
+        if (netlink_dump(socket_fd, RTM_GETNEIGH, search.family, neighbour_visit, &search) == 0 && search.has_mac) {
+            *mac = search.mac;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * DHCP server identifier (lease files)
+ */
+
+/**
+ * @brief Reads the DHCP server of the interface's lease, from systemd-networkd or dhclient.
+ *
+ * @return bool true if a lease named its server.
+ */
+static bool find_dhcp_server(int32 ifindex, const char *ifname, int8 server[4]) {
+    char path[128], line[256], address[64] = "";
+    snprintf(path, sizeof(path), NETWORKD_LEASE_FORMAT, ifindex);
+    FILE *file = fopen(path, "re");
+    if (file != NULL) {
+        while (fgets(line, sizeof(line), file)) {
+            if (strncmp(line, "SERVER_ADDRESS=", 15) == 0) {
+                sscanf(line + 15, "%63[0-9.]", address);
+            }
+        }
+        fclose(file);
+    }
+    snprintf(path, sizeof(path), DHCLIENT_LEASE_FORMAT, ifname);
+    if (address[0] == '\0' && (file = fopen(path, "re")) != NULL) {
+        // Leases are appended: the last one is the current one
+        while (fgets(line, sizeof(line), file)) {
+            sscanf(line, " option dhcp-server-identifier %63[0-9.]", address);
+        }
+        fclose(file);
+    }
+    return address[0] != '\0' && inet_pton(AF_INET, address, server) == 1;
+}
+
+/*
+ * SSID (nl80211)
+ */
+
+/**
+* @brief A generic netlink request with room for a few attributes.
+*/
+typedef struct genl_request {
+    struct nlmsghdr header;
+    struct genlmsghdr genl;
+    char attributes[64];
+} GenlRequest;
+
+/**
+ * @brief Appends an attribute to a generic netlink request.
+ */
+static void genl_put(GenlRequest *request, int16 type, const void *data, size_t length) {
+    struct rtattr *attribute = (struct rtattr *)((char *)request + NLMSG_ALIGN(request->header.nlmsg_len));
+    attribute->rta_type = type;
+    attribute->rta_len = RTA_LENGTH(length);
+    memcpy(RTA_DATA(attribute), data, length);
+    request->header.nlmsg_len = NLMSG_ALIGN(request->header.nlmsg_len) + RTA_ALIGN(attribute->rta_len);
+}
+
+/**
+* @brief Attribute wanted from a generic netlink reply.
+*/
+typedef struct genl_lookup {
+    int16 type;                          // Attribute type
+    int8 value[NETWORK_ID_SIZE];         // Its payload
+    int32 length;                        // Payload bytes copied (0 if absent)
+} GenlLookup;
+
+/**
+ * @brief Copies one attribute out of a generic netlink reply.
+ */
+static void genl_visit(const struct nlmsghdr *header, void *context) {
+    GenlLookup *lookup = context;
+    int length = header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    for (const struct rtattr *attribute = (const struct rtattr *)((const char *)NLMSG_DATA(header) + GENL_HDRLEN);
+         RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length)) {
+        if (attribute->rta_type == lookup->type) {
+            lookup->length = RTA_PAYLOAD(attribute) < NETWORK_ID_SIZE ? RTA_PAYLOAD(attribute) : NETWORK_ID_SIZE;
+            memcpy(lookup->value, RTA_DATA(attribute), lookup->length);
+        }
+    }
+}
+
+/**
+ * @brief Reads the SSID a wireless interface is associated with.
+ *
+ * @return int32 Length of the SSID, 0 if the interface is not associated (or not wireless).
+ */
+static int32 find_ssid(int32 ifindex, int8 ssid[NETWORK_ID_SIZE]) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (fd < 0) {
+        return 0;
+    }
+    GenlRequest request = {
+        .header = { .nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN), .nlmsg_type = GENL_ID_CTRL,
+                    .nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK, .nlmsg_seq = 1 },
+        .genl = { .cmd = CTRL_CMD_GETFAMILY, .version = 1 },
+    };
+    genl_put(&request, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, sizeof(NL80211_GENL_NAME));
+    GenlLookup family = { .type = CTRL_ATTR_FAMILY_ID };
+    int32 length = 0;
+    if (netlink_request(fd, &request.header, genl_visit, &family) == 0 && family.length == 2) {
+        request = (GenlRequest){
+            .header = { .nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN), .nlmsg_type = *(int16 *)family.value,
+                        .nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK, .nlmsg_seq = 2 },
+            .genl = { .cmd = NL80211_CMD_GET_INTERFACE },
+        };
+        genl_put(&request, NL80211_ATTR_IFINDEX, &ifindex, sizeof(ifindex));
+        GenlLookup lookup = { .type = NL80211_ATTR_SSID };
+        if (netlink_request(fd, &request.header, genl_visit, &lookup) == 0) {
+            memcpy(ssid, lookup.value, lookup.length);
+            length = lookup.length;
+        }
+    }
+    close(fd);
+    return length;
+}
+
+/*
+ * Fingerprints
+ */
+
+/**
+ * @brief Fingerprints the network an interface is attached to.
+ *
+ * @param socket_fd A socket from netlink_open().
+ * @param ifindex The interface.
+ * @param ifname Its name (used to find dhclient leases).
+ * @param fingerprint Receives the fingerprint.
+ * @return int 0 on success, or -ENOENT if no gateway, DHCP lease or SSID identifies the network.
+ */
+int network_fingerprint(int socket_fd, int32 ifindex, const char *ifname, NetworkFingerprint *fingerprint) {
+    MacAddress gateway;
+    memset(fingerprint, 0, sizeof(*fingerprint));
+    if (find_gateway(socket_fd, ifindex, &gateway)) {
+        fingerprint->source = NETWORK_GATEWAY;
+        fingerprint->length = 6;
+        memcpy(fingerprint->id, gateway.bytes, 6);
+        return 0;
+    }
+    if (find_dhcp_server(ifindex, ifname, fingerprint->id)) {
+        fingerprint->source = NETWORK_DHCP_SERVER;
+        fingerprint->length = 4;
+        return 0;
+    }
+    if ((fingerprint->length = find_ssid(ifindex, fingerprint->id)) > 0) {
+        fingerprint->source = NETWORK_SSID;
+        return 0;
+    }
+    return -ENOENT;
+}
+
+/**
+ * @brief Describes a fingerprint, e.g. "gateway 52:54:00:12:34:56".
+ */
+void network_fingerprint_format(const NetworkFingerprint *fingerprint, char *out, size_t size) {
+    char text[4 * NETWORK_ID_SIZE + 1];
+    switch (fingerprint->source) {
+    case NETWORK_GATEWAY: {
+        MacAddress mac;
+        memcpy(mac.bytes, fingerprint->id, 6);
+        mac_format(mac, text);
+        snprintf(out, size, "gateway %s", text);
+        break;
+    }
+    case NETWORK_DHCP_SERVER:
+        inet_ntop(AF_INET, fingerprint->id, text, sizeof(text));
+        snprintf(out, size, "DHCP server %s", text);
+        break;
+    case NETWORK_SSID: {
+        size_t length = 0;
+        for (int32 i = 0; i < fingerprint->length; i++) {
+            int8 c = fingerprint->id[i];
+            length += c >= 0x20 && c < 0x7F && c != '\\' ? (size_t)snprintf(text + length, 2, "%c", c)
+                                                         : (size_t)snprintf(text + length, 5, "\\x%02x", c);
+        }
+        snprintf(out, size, "SSID \"%s\"", text);
+        break;
+    }
+    }
+}
+
+/**
+ * @brief Hashes an interface name and a fingerprint (FNV-1a, never 0).
+ */
+static int64 fingerprint_key(const char *ifname, const NetworkFingerprint *fingerprint) {
+    int64 hash = 14695981039346656037UL;
+    for (const char *c = ifname; ; c++) {
+        hash = (hash ^ (int8)*c) * 1099511628211UL;       // The terminator separates the name
+        if (*c == '\0') break;
+    }
+    hash = (hash ^ fingerprint->source) * 1099511628211UL;
+    for (int32 i = 0; i < fingerprint->length; i++) {
+        hash = (hash ^ fingerprint->id[i]) * 1099511628211UL;
+    }
+    return hash ? hash : 1;
+}
+
+/*
+ * Table
+ */
+
+/**
+ * @brief Returns the address an interface uses on a network, drawing and remembering one for a new network.
+ *
+ * @param path The table file; created (with its directory) if missing.
+ * @param ifname The interface.
+ * @param fingerprint The network.
+ * @param mac Receives the address.
+ * @param known Set to true if the network was in the table.
+ * @return int 0 on success, or a negative errno (-EINVAL if the file is not a sticky table).
+ */
+int sticky_address(const char *path, const char *ifname, const NetworkFingerprint *fingerprint,
+                   MacAddress *mac, bool *known) {
+    int fd = open_state_file(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return fd;
+    }
+    while (flock(fd, LOCK_EX) < 0) {
+        if (errno != EINTR) {
+            int result = -errno;
+            close(fd);
+            return result;
+        }
+    }
+
+    static StickyTable table;
+    int result = 0;
+    ssize_t size = pread(fd, &table, sizeof(table), 0);
+    if (size == 0) {
+        memset(&table, 0, sizeof(table));                  // New table
+        table.magic = STICKY_MAGIC;
+        table.version = STICKY_VERSION;
+        table.slots = STICKY_SLOTS;
+        if (pwrite(fd, &table, sizeof(table), 0) != sizeof(table)) {
+            result = -EIO;
+        }
+    } else if (size != sizeof(table) || table.magic != STICKY_MAGIC || table.version != STICKY_VERSION ||
+               table.slots != STICKY_SLOTS) {
+        result = size < 0 ? -errno : -EINVAL;
+    }
+
+    if (result == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        int64 key = fingerprint_key(ifname, fingerprint);
+        int32 home = key & (STICKY_SLOTS - 1), chosen = home;
+        *known = false;
+        for (int32 probe = 0; probe < STICKY_PROBE; probe++) {
+            int32 slot = (home + probe) & (STICKY_SLOTS - 1);
+            const StickyEntry *entry = &table.entries[slot];
+            if (entry->key == key) {
+                chosen = slot;
+                *known = true;
+                break;
+            }
+            // Otherwise use the first free slot, or evict the least recently used one
+            const StickyEntry *best = &table.entries[chosen];
+            if (best->key != 0 && (entry->key == 0 || entry->last_seen < best->last_seen)) {
+                chosen = slot;
+            }
+        }
+        StickyEntry *entry = &table.entries[chosen];
+        if (*known) {
+            memcpy(mac->bytes, entry->mac, 6);
+        } else if (random_local_mac(mac)) {
+            memcpy(entry->mac, mac->bytes, 6);
+            entry->key = key;
+        } else {
+            result = -EIO;                                 // No address to remember
+        }
+        entry->last_seen = (int64)now.tv_sec;
+        off_t offset = (off_t)((char *)entry - (char *)&table);
+        if (result == 0 && pwrite(fd, entry, sizeof(*entry), offset) != sizeof(*entry)) {
+            result = -EIO;
+        }
+    }
+    close(fd);                                             // Also releases the lock
+    return result;
+}
@@ -0,0 +1,56 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_STICKY_H
+#define MACMASQ_STICKY_H
+
+// Including required C Header files
+#include "macmasq.h"       // for MacAddress and the integer typedefs
+
+// Table used when none is given on the command line
+#define STICKY_DEFAULT_PATH "/var/lib/macmasq/sticky"
+// Networks remembered by the table (a power of two)
+#define STICKY_SLOTS 1024
+// Slots searched from the home slot of a network before the oldest entry is evicted
+#define STICKY_PROBE 16
+// Longest network identifier (an SSID)
+#define NETWORK_ID_SIZE 32
+
+/**
+* @brief What identifies the network an interface is attached to.
+*/
+typedef enum network_source {
+    NETWORK_GATEWAY,                     // MAC address of the default gateway (neighbour table)
+    NETWORK_DHCP_SERVER,                 // DHCP server identifier of the current lease
+    NETWORK_SSID,                        // SSID of the wireless network
+} NetworkSource;
+
+/**
+* @brief Fingerprint of the network an interface is attached to.
+*/
+typedef struct network_fingerprint {
+    NetworkSource source;                // Where the identifier comes from
+    int32 length;                        // Bytes used in id
+    int8 id[NETWORK_ID_SIZE];            // The identifier
+} NetworkFingerprint;
+
+int network_fingerprint(int socket_fd, int32 ifindex, const char *ifname, NetworkFingerprint *fingerprint);
+void network_fingerprint_format(const NetworkFingerprint *fingerprint, char *out, size_t size);
+int sticky_address(const char *path, const char *ifname, const NetworkFingerprint *fingerprint,
+                   MacAddress *mac, bool *known);
+
+#endif // MACMASQ_STICKY_H
@@ -0,0 +1,330 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The --stdin command stream.
+ *
+ * Every input line reads "INTERFACE [XX:XX:XX:XX:XX:XX|random|restore]"
+ * (random is the default). Lines are parsed in place inside one large read
+ * buffer, queued, and sent to the kernel as a netlink batch once
+ * batch_size commands are pending or the oldest one has waited window_ns.
+ * One result line (or NDJSON record) per command is written in input order
+ * after each batch.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdlib.h>        // for malloc, free
+#include <string.h>        // for memchr, memmove, memcpy, strerror
+#include <errno.h>         // for error number definitions
+#include <unistd.h>        // for read, close
+#include <poll.h>          // for ppoll
+#include <time.h>          // for struct timespec
+#include "netlink.h"       // for the rtnetlink helpers
+#include "linktable.h"     // for the interface cache
+#include "stream.h"        // for the stream declared here
+
+// Size of the input buffer; also the longest accepted line
+#define STREAM_BUFFER_SIZE 65536
+
+/**
+* @brief State of a running command stream.
+*/
+typedef struct command_stream {
+    int socket_fd;                       // rtnetlink socket
+    FILE *output;                        // Where results are written
+    JsonWriter *json;                    // Where NDJSON records are written, NULL for text
+    MacRegistry *registry;               // Where new addresses are reserved, NULL for nowhere
+    Journal *journal;                    // Where original addresses are recorded, NULL for nowhere
+    int64 netns;                         // Namespace of the interfaces, tags registry and journal entries
+    LinkTable links;                     // Interfaces of the namespace
+    bool links_fresh;                    // The table was reloaded during the current batch
+    NetlinkBatch *batch;                 // Reused for every flush
+    LinkRotation *pending;               // Commands waiting to be sent
+    int pending_count;                   // Number of entries in pending
+    int64 oldest_ns;                     // When the first pending command was read
+} CommandStream;
+
+/**
+ * @brief Finds an interface, reloading the table once per batch on a miss.
+ */
+static LinkInfo *lookup_link(CommandStream *stream, const char *name, size_t length) {
+    LinkInfo *link = link_table_find_name(&stream->links, name, length);
+    if (link == NULL && !stream->links_fresh) {
+        stream->links_fresh = true;                        // Interfaces may have appeared since the last dump
+        if (link_table_load(&stream->links, stream->socket_fd) == 0) {
+            link = link_table_find_name(&stream->links, name, length);
+        }
+    }
+    return link;
+}
+
+/**
+ * @brief Sends the pending commands and prints their results in input order.
+ *
+ * If the netlink socket fails, every command without an outcome of its own
+ * is reported with the socket's error, so that each input line still gets
+ * its result line.
+ *
+ * @return int 0 on success, or a negative errno if the netlink socket failed.
+ */
+static int flush_commands(CommandStream *stream) {
+    if (stream->pending_count == 0) {
+        return 0;
+    }
+    int result = netlink_rotate(stream->batch, stream->pending, stream->pending_count);
+    for (int i = 0; result < 0 && i < stream->pending_count; i++) {
+        if (stream->pending[i].error == 0) {
+            stream->pending[i].error = -result;            // Its reservation is released below
+        }
+    }
+
+    for (int i = 0; i < stream->pending_count; i++) {
+        LinkRotation *rotation = &stream->pending[i];
+        if (rotation->ifindex != 0) {
+            registry_settle(stream->registry, rotation, stream->netns);
+            journal_record(stream->journal, rotation, stream->netns);
+        }
+        if (rotation->error == 0) {
+            // Keep the cache in step so that later commands see the current address
+            LinkInfo *link = link_table_find_ifindex(&stream->links, rotation->ifindex);
+            if (link != NULL) {
+                link->address = rotation->new_mac;
+            }
+        }
+        if (stream->json) {
+            json_write_rotation(stream->json, rotation);
+        } else if (rotation->error != 0) {
+            fprintf(stream->output, "%s ERR %s\n", rotation->name, strerror(rotation->error));
+        } else {
+            char mac[MAC_STRING_LENGTH + 1];
+            mac_format(rotation->new_mac, mac);
+            fprintf(stream->output, "%s OK %s\n", rotation->name, mac);
+        }
+    }
+    if (stream->json) {
+        json_writer_flush(stream->json);
+    } else {
+        fflush(stream->output);
+    }
+
+    stream->pending_count = 0;
+    stream->links_fresh = false;
+    return result;
+}
+
+/**
+ * @brief Returns the next whitespace separated token of a line.
+ *
+ * @param cursor In: where to start looking. Out: just past the token.
+ * @param end End of the line.
+ * @param length Receives the token length (0 if there is none).
+ * @return const char* The first character of the token.
+ */
+static const char *next_token(const char **cursor, const char *end, size_t *length) {
+    const char *start = *cursor;
+    while (start < end && (*start == ' ' || *start == '\t' || *start == '\r')) {
+        start++;
+    }
+    const char *stop = start;
+    while (stop < end && *stop != ' ' && *stop != '\t' && *stop != '\r') {
+        stop++;
+    }
+    *cursor = stop;
+    *length = (size_t)(stop - start);
+    return start;
+}
+
+/**
+ * @brief Turns one input line into a pending command.
+ *
+ * The line is parsed where it lies in the input buffer. Malformed lines
+ * still produce a pending entry (with ifindex 0 and an error set) so that
+ * results keep the input order.
+ */
+static void queue_command(CommandStream *stream, const char *line, const char *end) {
+    size_t name_length, action_length, extra_length;
+    const char *cursor = line;
+    const char *name = next_token(&cursor, end, &name_length);
+    const char *action = next_token(&cursor, end, &action_length);
+    next_token(&cursor, end, &extra_length);
+    if (name_length == 0 || *name == '#') {
+        return;                                            // Blank line or comment
+    }
+
+    if (stream->pending_count == 0) {
+        stream->oldest_ns = monotonic_ns();
+    }
+    LinkRotation *rotation = &stream->pending[stream->pending_count++];
+    memset(rotation, 0, sizeof(*rotation));
+    rotation->backend = BACKEND_NETLINK_BATCH;
+    size_t shown = name_length < IFNAMSIZ ? name_length : IFNAMSIZ - 1;
+    memcpy(rotation->name, name, shown);
+
+    LinkInfo *link = name_length < IFNAMSIZ ? lookup_link(stream, name, name_length) : NULL;
+    if (link == NULL) {
+        rotation->error = ENODEV;
+        return;
+    }
+    if (extra_length != 0) {
+        rotation->error = EINVAL;                          // Trailing garbage
+        return;
+    }
+
+    int reserved;
+    if (action_length == 0 || (action_length == 6 && memcmp(action, "random", 6) == 0)) {
+        if (!random_local_mac(&rotation->new_mac)) {
+            rotation->error = EIO;
+            return;
+        }
+        reserved = registry_reserve_random(stream->registry, &rotation->new_mac);
+    } else if (action_length == 7 && memcmp(action, "restore", 7) == 0) {
+        if (link->has_perm_address) {
+            rotation->new_mac = link->perm_address;
+        } else if (!journal_lookup(stream->journal, stream->netns, link->ifindex, link->name, &rotation->new_mac)) {
+            rotation->error = EADDRNOTAVAIL;               // Nothing known to restore to
+            return;
+        }
+        reserved = registry_reserve(stream->registry, rotation->new_mac);
+    } else if (!mac_parse(action, action_length, &rotation->new_mac)) {
+        rotation->error = EINVAL;
+        return;
+    } else {
+        reserved = registry_reserve(stream->registry, rotation->new_mac);
+    }
+    if (reserved < 0) {
+        rotation->error = -reserved;                       // EADDRINUSE: another process or interface holds it
+        return;
+    }
+
+    rotation->ifindex = link->ifindex;
+    rotation->flags = link->flags;
+    rotation->old_mac = link->address;
+}
+
+/**
+ * @brief Applies a stream of commands read from a file descriptor.
+ *
+ * @param input_fd Where commands are read from (typically stdin).
+ * @param output Where one result line per command is written.
+ * @param options Batch size and time window.
+ * @return int 0 when the input ended and every batch was sent, or a negative errno.
+ */
+int run_command_stream(int input_fd, FILE *output, const StreamOptions *options) {
+    CommandStream stream = { .output = output, .json = options->json, .registry = options->registry,
+                             .journal = options->journal };
+    stream.netns = options->registry || options->journal ? registry_netns() : 0;
+    int batch_size = options->batch_size > 0 ? options->batch_size : STREAM_DEFAULT_BATCH_SIZE;
+    char *buffer = malloc(STREAM_BUFFER_SIZE);
+    stream.batch = malloc(sizeof(*stream.batch));
+    stream.pending = malloc((size_t)batch_size * sizeof(*stream.pending));
+    if (buffer == NULL || stream.batch == NULL || stream.pending == NULL) {
+        free(buffer);
+        free(stream.batch);
+        free(stream.pending);
+        return -ENOMEM;
+    }
+
+    int result = stream.socket_fd = netlink_open(0);
+    if (result >= 0) {
+        netlink_batch_init(stream.batch, stream.socket_fd, NULL, NULL);
+        result = link_table_load(&stream.links, stream.socket_fd);
+        stream.links_fresh = true;
+    }
+
+    size_t start = 0;                                      // First unparsed byte of buffer
+    size_t end = 0;                                        // One past the last byte read
+    bool discarding = false;                               // Skipping the rest of an over-long line
+    while (result >= 0) {
+        // Consume every complete line already in the buffer
+        char *newline;
+        while ((newline = memchr(buffer + start, '\n', end - start)) != NULL) {
+            if (!discarding) {
+                queue_command(&stream, buffer + start, newline);
+            }
+            discarding = false;
+            start = (size_t)(newline - buffer) + 1;
+            if (stream.pending_count == batch_size && (result = flush_commands(&stream)) < 0) {
+                break;
+            }
+        }
+        if (result < 0) {
+            break;
+        }
+
+        // Keep the partial line at the front of the buffer
+        if (start == end) {
+            start = end = 0;
+        } else if (start > 0) {
+            memmove(buffer, buffer + start, end - start);
+            end -= start;
+            start = 0;
+        }
+        if (end == STREAM_BUFFER_SIZE) {
+            discarding = true;                             // Line too long: drop what we have
+            end = 0;
+        }
+
+        // Wait for more input, but no longer than the oldest pending command may wait
+        if (stream.pending_count > 0) {
+            int64 waited = monotonic_ns() - stream.oldest_ns;
+            int64 remaining = waited >= options->window_ns ? 0 : options->window_ns - waited;
+            struct timespec timeout = { .tv_sec = remaining / 1000000000, .tv_nsec = remaining % 1000000000 };
+            struct pollfd descriptor = { .fd = input_fd, .events = POLLIN };
+            int ready = ppoll(&descriptor, 1, &timeout, NULL);
+            if (ready < 0) {
+                if (errno == EINTR) continue;              // Wait again, for what is left of the window
+                result = -errno;
+                break;
+            }
+            if (ready == 0 || monotonic_ns() - stream.oldest_ns >= options->window_ns) {
+                if ((result = flush_commands(&stream)) < 0) {
+                    break;
+                }
+            }
+            if (ready == 0) {
+                continue;                                  // Still nothing to read
+            }
+        }
+
+        ssize_t got = read(input_fd, buffer + end, STREAM_BUFFER_SIZE - end);
+        if (got < 0) {
+            if (errno == EINTR) continue;                  // Retry when interrupted by a signal
+            result = -errno;
+            break;
+        }
+        if (got == 0) {
+            if (end > start && !discarding) {
+                queue_command(&stream, buffer + start, buffer + end);  // Last line without newline
+            }
+            result = flush_commands(&stream);
+            break;
+        }
+        end += (size_t)got;
+    }
+
+    if (stream.socket_fd >= 0) {
+        close(stream.socket_fd);
+    }
+    link_table_free(&stream.links);
+    free(stream.pending);
+    free(stream.batch);
+    free(buffer);
+    return result < 0 ? result : 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_STREAM_H
+#define MACMASQ_STREAM_H
+
+// Including required C Header files
+#include <stdio.h>         // for FILE
+#include "json.h"          // for JsonWriter
+#include "registry.h"      // for MacRegistry
+#include "journal.h"       // for Journal
+
+// Default number of commands sent to the kernel together
+#define STREAM_DEFAULT_BATCH_SIZE 256
+// Default time a command may wait for more input before its batch is sent
+#define STREAM_DEFAULT_WINDOW_US 1000
+
+/**
+* @brief Tuning of the --stdin command stream.
+*/
+typedef struct stream_options {
+    int batch_size;                      // Flush once this many commands are pending
+    int64 window_ns;                     // Flush once the oldest pending command waited this long
+    JsonWriter *json;                    // Print NDJSON records here instead of text lines (may be NULL)
+    MacRegistry *registry;               // Host-wide address registry, NULL to reserve nothing
+    Journal *journal;                    // Journal of original addresses, NULL to record nothing
+} StreamOptions;
+
+int run_command_stream(int input_fd, FILE *output, const StreamOptions *options);
+
+#endif // MACMASQ_STREAM_H
@@ -0,0 +1,208 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Entry point of the static-tiny build (see "make static-tiny").
+ *
+ * This binary is meant to run from an initramfs or as the very first
+ * systemd unit, before any frame leaves the host. It is statically linked,
+ * never touches stdio or malloc, and draws randomness from getrandom().
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdlib.h>        // for EXIT_SUCCESS, EXIT_FAILURE
+#include <unistd.h>        // for write, close
+#include <string.h>        // for strcmp, strlen, memcpy
+#include <errno.h>         // for errno, E2BIG
+#include "netlink.h"       // for the rtnetlink helpers
+#include "udev.h"          // for the udev event helpers
+
+// Maximum number of interfaces handled in one run
+#define TINY_MAX_LINKS 1024
+
+// Every buffer lives in .bss so that the binary performs no dynamic allocation
+static LinkRotation rotations[TINY_MAX_LINKS];
+static NetlinkBatch batch;
+static char output[TINY_MAX_LINKS * (IFNAMSIZ + MAC_STRING_LENGTH + 16) + 64];
+
+/**
+ * @brief Writes a null-terminated string to a file descriptor.
+ */
+static void write_string(int fd, const char *text) {
+    size_t length = strlen(text);
+    while (length > 0) {
+        ssize_t written = write(fd, text, length);
+        if (written <= 0) {
+            return;                                    // Nothing sensible left to do
+        }
+        text += written;
+        length -= (size_t)written;
+    }
+}
+
+/**
+ * @brief Writes "macmasq: <what>: error <errno>" to stderr.
+ */
+static void report_error(const char *what, int error) {
+    char number[24];
+    number[format_uint(number, (int64)(error < 0 ? -error : error))] = '\0';
+    write_string(2, "macmasq: ");
+    write_string(2, what);
+    write_string(2, ": error ");
+    write_string(2, number);
+    write_string(2, "\n");
+}
+
+/**
+ * @brief Appends text to the output buffer.
+ */
+static size_t append(size_t offset, const char *text, size_t length) {
+    memcpy(output + offset, text, length);
+    return offset + length;
+}
+
+/**
+ * @brief Randomizes every physical interface with one netlink batch.
+ *
+ * Prints one "INTERFACE XX:XX:XX:XX:XX:XX" line per changed interface with a
+ * single write(), followed by the time spent in microseconds.
+ *
+ * @return int EXIT_SUCCESS if every interface was changed, EXIT_FAILURE otherwise.
+ */
+static int rotate_all_physical(void) {
+    int64 started = monotonic_ns();
+
+    int socket_fd = netlink_open(0);
+    if (socket_fd < 0) {
+        report_error("netlink", socket_fd);
+        return EXIT_FAILURE;
+    }
+
+    int count = collect_physical_links(socket_fd, rotations, TINY_MAX_LINKS);
+    if (count < 0) {
+        report_error("link dump", count);
+        close(socket_fd);
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_SUCCESS;
+    if (count > TINY_MAX_LINKS) {
+        // Change the interfaces that fit, but do not report success
+        report_error("too many physical interfaces, some are left unchanged", E2BIG);
+        count = TINY_MAX_LINKS;
+        status = EXIT_FAILURE;
+    }
+
+    netlink_batch_init(&batch, socket_fd, NULL, NULL);
+    int result = netlink_rotate(&batch, rotations, count);
+    close(socket_fd);
+    if (result < 0) {
+        report_error("netlink batch", result);
+        return EXIT_FAILURE;
+    }
+
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        if (rotations[i].error != 0) {
+            report_error(rotations[i].name, rotations[i].error);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        char mac[MAC_STRING_LENGTH + 1];
+        mac_format(rotations[i].new_mac, mac);
+        length = append(length, rotations[i].name, strlen(rotations[i].name));
+        length = append(length, " ", 1);
+        length = append(length, mac, MAC_STRING_LENGTH);
+        length = append(length, "\n", 1);
+    }
+    output[length] = '\0';
+    write_string(1, output);
+
+    char elapsed[24];
+    elapsed[format_uint(elapsed, (monotonic_ns() - started) / 1000)] = '\0';
+    write_string(2, "macmasq: done in ");
+    write_string(2, elapsed);
+    write_string(2, " us\n");
+    return status;
+}
+
+/**
+ * @brief Handles one udev event for a network device.
+ *
+ * Reports "udev ACTION INTERFACE ifindex N XX:XX:XX:XX:XX:XX in N us" on
+ * stderr, which udev forwards to its log.
+ *
+ * @return int EXIT_SUCCESS if the event was handled or ignored, EXIT_FAILURE otherwise.
+ */
+static int handle_udev_event(void) {
+    UdevEvent event;
+    if (!udev_event_from_environment(&event)) {
+        write_string(2, "macmasq: IFINDEX and ACTION must be set by udev\n");
+        return EXIT_FAILURE;
+    }
+    if (!udev_event_wants_rotation(&event)) {
+        return EXIT_SUCCESS;                           // Only new devices are randomized
+    }
+
+    LinkRotation result;
+    MacAddress new_mac;
+    if (!random_local_mac(&new_mac)) {
+        report_error("getrandom", errno);
+        return EXIT_FAILURE;
+    }
+    udev_rotate(&event, new_mac, &result);
+    if (result.error != 0) {
+        report_error(event.interface, result.error);
+        return EXIT_FAILURE;
+    }
+
+    char mac[MAC_STRING_LENGTH + 1];
+    char ifindex[24];
+    char elapsed[24];
+    mac_format(result.new_mac, mac);
+    ifindex[format_uint(ifindex, event.ifindex)] = '\0';
+    elapsed[format_uint(elapsed, result.total_ns / 1000)] = '\0';
+    size_t length = 0;
+    const char *parts[] = { "macmasq: udev ", event.action, " ", event.interface, " ifindex ", ifindex,
+                            " ", mac, " in ", elapsed, " us\n" };
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        length = append(length, parts[i], strlen(parts[i]));
+    }
+    output[length] = '\0';
+    write_string(2, output);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Main function of the static-tiny build.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv Array of command-line argument strings.
+ * @return (int) EXIT_SUCCESS if successful, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char **argv) {
+    if (argc == 2 && strcmp(argv[1], "--all-physical") == 0) {
+        return rotate_all_physical();
+    }
+    if (argc == 2 && strcmp(argv[1], "--udev") == 0) {
+        return handle_udev_event();
+    }
+    write_string(2, "Usage: macmasq --all-physical\n       macmasq --udev\n");
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,537 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Link event traces (--record-trace, --replay-trace).
+ *
+ * Recording subscribes to RTMGRP_LINK, dumps the links, and writes the
+ * dump followed by every RTM_NEWLINK / RTM_DELLINK received to a file, so
+ * that the burst of events a real host produced (a CNI plugin creating
+ * hundreds of veths, a switch flapping every port) can be fed to the
+ * daemon again and again, off the host.
+ *
+ * The file is a header followed by records: a type byte, the time since
+ * the previous record and the message length as LEB128 varints, and the
+ * message. Messages keep only the ifinfomsg and the attributes
+ * netlink_parse_link() reads, which makes them about a tenth of what the
+ * kernel sends.
+ *
+ * Replay maps the file, builds a simulated kernel (sim.c) from the dump,
+ * and lets the simulated kernel send the recorded events at their
+ * recorded times (scaled by the speed), or as fast as the daemon drains
+ * them. The daemon runs unchanged on top, and the report gives how long
+ * events waited and how many it applies per second of CPU.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for printf, fopen, fwrite
+#include <stdlib.h>                // for realloc, free
+#include <string.h>                // for memcpy, memcmp
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <poll.h>                  // for poll
+#include <signal.h>                // for sigprocmask
+#include <time.h>                  // for time
+#include <unistd.h>                // for close
+#include <sys/mman.h>              // for mmap
+#include <sys/signalfd.h>          // for signalfd
+#include <sys/socket.h>            // for recv, setsockopt
+#include <sys/stat.h>              // for fstat
+#include <linux/netlink.h>         // for netlink message definitions
+#include <linux/rtnetlink.h>       // for RTMGRP_LINK, RTM_NEWLINK, RTM_DELLINK
+#include "daemon.h"                // for simulate_daemon
+#include "metrics.h"               // for histogram_percentile
+#include "trace.h"                 // for the declarations implemented here
+
+// Identifies a trace file ("MMQTRACE")
+#define TRACE_MAGIC 0x4543415254514D4DUL
+// Bumped whenever the layout of the file changes
+#define TRACE_VERSION 1
+// Largest compacted message
+#define TRACE_MESSAGE_SIZE 512
+// Receive buffer requested for the event socket (as the daemon's)
+#define TRACE_EVENT_BUFFER (4 << 20)
+
+/**
+* @brief What a record holds.
+*/
+typedef enum trace_record_type {
+    TRACE_SNAPSHOT,                      // A link of the dump taken when recording started
+    TRACE_EVENT,                         // A link event received afterwards
+} TraceRecordType;
+
+/**
+* @brief Layout of the start of the file.
+*/
+typedef struct trace_header {
+    int64 magic;                         // TRACE_MAGIC
+    int32 version;                       // TRACE_VERSION
+    int32 reserved;
+    int64 started;                       // When recording started, in CLOCK_REALTIME seconds
+} TraceHeader;
+
+/*
+ * Recording
+ */
+
+/**
+* @brief State of a recording.
+*/
+typedef struct trace_writer {
+    FILE *file;                          // The trace
+    int64 last_ns;                       // Time of the previous record
+    int64 links;                         // Snapshot records written
+    int64 events;                        // Event records written
+    char message[TRACE_MESSAGE_SIZE] __attribute__((aligned(8)));  // Compacted message
+} TraceWriter;
+
+/**
+ * @brief Appends one attribute to a compacted message, if it fits.
+ */
+static void keep_attribute(struct nlmsghdr *out, const struct rtattr *attribute) {
+    size_t length = RTA_ALIGN(attribute->rta_len);
+    if (NLMSG_ALIGN(out->nlmsg_len) + length <= TRACE_MESSAGE_SIZE) {
+        memcpy((char *)out + NLMSG_ALIGN(out->nlmsg_len), attribute, attribute->rta_len);
+        out->nlmsg_len = NLMSG_ALIGN(out->nlmsg_len) + length;
+    }
+}
+
+/**
+ * @brief Copies a link message, keeping only what netlink_parse_link() reads.
+ */
+static void compact_link(const struct nlmsghdr *header, struct nlmsghdr *out) {
+    const struct ifinfomsg *info = NLMSG_DATA(header);
+    *out = *header;
+    out->nlmsg_len = NLMSG_LENGTH(sizeof(*info));
+    memcpy(NLMSG_DATA(out), info, sizeof(*info));
+
+    int remaining = IFLA_PAYLOAD(header);
+    for (const struct rtattr *attribute = IFLA_RTA(info); RTA_OK(attribute, remaining);
+         attribute = RTA_NEXT(attribute, remaining)) {
+        switch (attribute->rta_type) {
+        case IFLA_IFNAME:
+        case IFLA_ADDRESS:
+        case IFLA_PERM_ADDRESS:
+        case IFLA_MASTER:
+        case IFLA_GROUP:
+        case IFLA_LINK:
+            keep_attribute(out, attribute);
+            break;
+        case IFLA_LINKINFO: {
+            // Only the kinds: the driver data below them can be larger than the rest of the message
+            if (NLMSG_ALIGN(out->nlmsg_len) + RTA_LENGTH(0) > TRACE_MESSAGE_SIZE) {
+                break;
+            }
+            struct rtattr *nest = (struct rtattr *)((char *)out + NLMSG_ALIGN(out->nlmsg_len));
+            nest->rta_type = IFLA_LINKINFO;
+            out->nlmsg_len = NLMSG_ALIGN(out->nlmsg_len) + RTA_LENGTH(0);
+            int nested_remaining = RTA_PAYLOAD(attribute);
+            for (const struct rtattr *nested = RTA_DATA(attribute); RTA_OK(nested, nested_remaining);
+                 nested = RTA_NEXT(nested, nested_remaining)) {
+                if (nested->rta_type == IFLA_INFO_KIND || nested->rta_type == IFLA_INFO_SLAVE_KIND) {
+                    keep_attribute(out, nested);
+                }
+            }
+            nest->rta_len = (char *)out + NLMSG_ALIGN(out->nlmsg_len) - (char *)nest;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Writes an unsigned LEB128 varint.
+ */
+static void write_varint(FILE *file, int64 value) {
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+/**
+ * @brief Appends one record holding the compacted message.
+ */
+static void write_record(TraceWriter *writer, TraceRecordType type, int64 time_ns, const struct nlmsghdr *header) {
+    struct nlmsghdr *out = (struct nlmsghdr *)writer->message;
+    compact_link(header, out);
+    fputc(type, writer->file);
+    write_varint(writer->file, time_ns - writer->last_ns);
+    write_varint(writer->file, out->nlmsg_len);
+    fwrite(out, 1, out->nlmsg_len, writer->file);
+    writer->last_ns = time_ns;
+}
+
+/**
+ * @brief Writes one link of the initial dump.
+ */
+static void snapshot_visit(const struct nlmsghdr *header, void *context) {
+    TraceWriter *writer = context;
+    if (header->nlmsg_type == RTM_NEWLINK && header->nlmsg_len >= NLMSG_LENGTH(sizeof(struct ifinfomsg))) {
+        write_record(writer, TRACE_SNAPSHOT, monotonic_ns(), header);
+        writer->links++;
+    }
+}
+
+/**
+ * @brief Records the links and the link events of the current namespace to a file.
+ *
+ * The event socket is subscribed before the dump, so that no change falls
+ * between the two. Stops on SIGINT or SIGTERM, or after duration_ns.
+ *
+ * @param path Trace file to write (replaced).
+ * @param duration_ns Length of the recording, 0 to record until interrupted.
+ * @return int 0 on success, or a negative errno.
+ */
+int trace_record(const char *path, int64 duration_ns) {
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, &previous);
+    int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    int event_fd = netlink_open(RTMGRP_LINK);
+    int request_fd = netlink_open(0);
+    TraceWriter *writer = calloc(1, sizeof(*writer));
+    int result = signal_fd < 0 ? -errno : event_fd < 0 ? event_fd : request_fd < 0 ? request_fd
+               : writer == NULL ? -ENOMEM : 0;
+    if (result == 0 && (writer->file = fopen(path, "we")) == NULL) {
+        result = -errno;
+    }
+    if (result < 0) {
+        goto done;
+    }
+    int size = TRACE_EVENT_BUFFER;
+    if (setsockopt(event_fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(event_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    int64 started = monotonic_ns();
+    TraceHeader header = { .magic = TRACE_MAGIC, .version = TRACE_VERSION, .started = (int64)time(NULL) };
+    fwrite(&header, sizeof(header), 1, writer->file);
+    writer->last_ns = started;
+    if ((result = netlink_dump(request_fd, RTM_GETLINK, AF_UNSPEC, snapshot_visit, writer)) < 0) {
+        goto done;
+    }
+    fprintf(stderr, "macmasq: recording link events to %s (%lu links)%s\n", path, writer->links,
+            duration_ns ? "" : ", interrupt to stop");
+
+    static char buffer[65536] __attribute__((aligned(8)));
+    int64 lost = 0, end = started + duration_ns;
+    for (;;) {
+        int timeout = -1;
+        if (duration_ns) {
+            int64 now = monotonic_ns();
+            if (now >= end) {
+                break;
+            }
+            timeout = (int)((end - now + 999999) / 1000000);
+        }
+        struct pollfd fds[] = { { .fd = event_fd, .events = POLLIN }, { .fd = signal_fd, .events = POLLIN } };
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+            result = -errno;
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            break;                                         // SIGINT or SIGTERM
+        }
+        ssize_t received;
+        while ((received = recv(event_fd, buffer, sizeof(buffer), MSG_DONTWAIT)) != 0) {
+            if (received < 0) {
+                if (errno == ENOBUFS) {
+                    lost++;                                // The kernel dropped events: the replay will miss them
+                    continue;
+                }
+                break;                                     // EAGAIN: drained
+            }
+            int64 now = monotonic_ns();
+            int remaining = (int)received;
+            for (struct nlmsghdr *message = (struct nlmsghdr *)buffer; NLMSG_OK(message, remaining);
+                 message = NLMSG_NEXT(message, remaining)) {
+                if ((message->nlmsg_type == RTM_NEWLINK || message->nlmsg_type == RTM_DELLINK) &&
+                    message->nlmsg_len >= NLMSG_LENGTH(sizeof(struct ifinfomsg))) {
+                    write_record(writer, TRACE_EVENT, now, message);
+                    writer->events++;
+                }
+            }
+        }
+    }
+    if (lost) {
+        fprintf(stderr, "macmasq: warning: the event socket overran %lu times, some events are missing\n", lost);
+    }
+    printf("recorded %lu links and %lu events over %.3f s to %s\n", writer->links, writer->events,
+           (monotonic_ns() - started) / 1e9, path);
+
+done:
+    if (writer != NULL && writer->file != NULL) {
+        if (ferror(writer->file) && result == 0) {
+            result = -EIO;
+        }
+        if (fclose(writer->file) != 0 && result == 0) {
+            result = -errno;
+        }
+    }
+    free(writer);
+    int fds[] = { signal_fd, event_fd, request_fd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+    return result;
+}
+
+/*
+ * Replay
+ */
+
+/**
+* @brief A mapped trace, read one record at a time.
+*/
+typedef struct trace_reader {
+    const int8 *data;                    // The mapped file
+    size_t size;                         // Its length
+    size_t offset;                       // Start of the next record
+    int64 time_ns;                       // Time of the last record read, from the start of the recording
+    char message[TRACE_MESSAGE_SIZE] __attribute__((aligned(8)));  // The last message, aligned for parsing
+} TraceReader;
+
+/**
+ * @brief Reads an unsigned LEB128 varint.
+ *
+ * @return bool false if the file ends inside it.
+ */
+static bool read_varint(TraceReader *reader, int64 *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && reader->offset < reader->size; shift += 7) {
+        int8 byte = reader->data[reader->offset++];
+        *value |= (int64)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Reads the next record.
+ *
+ * @param reader The trace.
+ * @param type Receives the type of the record.
+ * @param link Receives the link it describes.
+ * @param deleted Receives whether it was an RTM_DELLINK.
+ * @return int 1 if a record was read, 0 at the end of the file, or -EINVAL if the file is damaged.
+ */
+static int read_record(TraceReader *reader, TraceRecordType *type, LinkInfo *link, bool *deleted) {
+    if (reader->offset == reader->size) {
+        return 0;
+    }
+    *type = reader->data[reader->offset++];
+    int64 delta, length;
+    if (*type > TRACE_EVENT || !read_varint(reader, &delta) || !read_varint(reader, &length) ||
+        length < NLMSG_LENGTH(sizeof(struct ifinfomsg)) || length > TRACE_MESSAGE_SIZE ||
+        length > reader->size - reader->offset) {
+        return -EINVAL;
+    }
+    memcpy(reader->message, reader->data + reader->offset, length);
+    reader->offset += length;
+    reader->time_ns += delta;
+    struct nlmsghdr *header = (struct nlmsghdr *)reader->message;
+    if (header->nlmsg_len != length) {
+        return -EINVAL;
+    }
+    netlink_parse_link(header, link);
+    *deleted = header->nlmsg_type == RTM_DELLINK;
+    return 1;
+}
+
+/**
+* @brief The events of a trace, as the simulated kernel asks for them.
+*/
+typedef struct trace_source {
+    TraceReader reader;                  // The trace
+    double speed;                        // Replay speed, 0 for as fast as possible
+    int64 start_ns;                      // Simulated time the recording started at
+    LinkEvent first;                     // Event read while looking for the end of the dump
+    bool has_first;                      // first has not been handed out yet
+    int64 events;                        // Events handed out
+    int64 span_ns;                       // Recorded time of the last event
+    int error;                           // Negative errno if the file turned out to be damaged
+} TraceSource;
+
+/**
+ * @brief Hands the next recorded event to the simulated kernel.
+ */
+static bool next_trace_event(void *context, LinkEvent *event) {
+    TraceSource *source = context;
+    if (source->has_first) {
+        *event = source->first;
+        source->has_first = false;
+    } else {
+        TraceRecordType type;
+        int result = read_record(&source->reader, &type, &event->link, &event->deleted);
+        if (result <= 0) {
+            source->error = result;
+            return false;
+        }
+        event->time_ns = source->reader.time_ns;
+    }
+    source->events++;
+    source->span_ns = event->time_ns;
+    event->time_ns = source->speed == 0 ? 0 : source->start_ns + (int64)(event->time_ns / source->speed);
+    return true;
+}
+
+/**
+ * @brief Maps a trace and checks its header.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+static int open_trace(const char *path, TraceReader *reader) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    struct stat status;
+    int result = fstat(fd, &status) < 0 ? -errno : (size_t)status.st_size < sizeof(TraceHeader) ? -EINVAL : 0;
+    if (result == 0) {
+        reader->data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        result = reader->data == MAP_FAILED ? -errno : 0;
+    }
+    close(fd);                                             // The mapping outlives the descriptor
+    if (result < 0) {
+        return result;
+    }
+    reader->size = status.st_size;
+    madvise((void *)reader->data, reader->size, MADV_SEQUENTIAL);
+    TraceHeader header;
+    memcpy(&header, reader->data, sizeof(header));
+    if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) {
+        munmap((void *)reader->data, reader->size);
+        return -EINVAL;
+    }
+    reader->offset = sizeof(header);
+    reader->time_ns = 0;
+    return 0;
+}
+
+/**
+ * @brief Replays a trace into the daemon running on a simulated kernel, and prints what it took.
+ *
+ * @param options Trace, speed, policy and load.
+ * @return int 0 on success, or a negative errno.
+ */
+int trace_replay(const TraceReplayOptions *options) {
+    TraceSource *source = calloc(1, sizeof(*source));
+    if (source == NULL) {
+        return -ENOMEM;
+    }
+    int result = open_trace(options->trace_path, &source->reader);
+    if (result < 0) {
+        free(source);
+        return result;
+    }
+    source->speed = options->speed;
+
+    // The dump comes first; the first event ends it
+    LinkInfo *links = NULL;
+    int count = 0, capacity = 0;
+    TraceRecordType type;
+    LinkEvent event;
+    while ((result = read_record(&source->reader, &type, &event.link, &event.deleted)) > 0) {
+        if (type == TRACE_EVENT) {
+            event.time_ns = source->reader.time_ns;
+            source->first = event;
+            source->has_first = true;
+            break;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            LinkInfo *grown = realloc(links, capacity * sizeof(LinkInfo));
+            if (grown == NULL) {
+                result = -ENOMEM;
+                break;
+            }
+            links = grown;
+        }
+        links[count++] = event.link;
+    }
+
+    char error[256];
+    Policy *policy = NULL;
+    DaemonReport *report = malloc(sizeof(*report));
+    Kernel *kernel = NULL;
+    if (result >= 0 && report == NULL) {
+        result = -ENOMEM;
+    }
+    if (result >= 0) {
+        policy = options->policy_path ? policy_load(options->policy_path, error, sizeof(error))
+                                      : sim_builtin_policy(error, sizeof(error));
+        if (policy == NULL) {
+            fprintf(stderr, "macmasq: %s\n", error);
+            result = -EINVAL;
+        }
+    }
+    if (result >= 0) {
+        source->start_ns = 1000000000UL;                   // The simulated clock starts at 1 s
+        result = sim_kernel_open_replay(&options->sim, links, count, next_trace_event, source, &kernel);
+    }
+    if (result >= 0) {
+        DaemonOptions daemon_options = { .backend = options->backend, .seed = options->sim.seed, .quiet = true,
+                                         .opportunistic_ns = options->opportunistic_ns };
+        result = simulate_daemon(&daemon_options, policy, kernel, 0, report);
+    }
+    if (result >= 0 && source->error < 0) {
+        fprintf(stderr, "macmasq: %s is damaged after %lu events\n", options->trace_path, source->events);
+    }
+    if (result >= 0) {
+        const SimStats *stats = sim_kernel_stats(kernel);
+        char speed[64];
+        if (options->speed == 0) {
+            snprintf(speed, sizeof(speed), "as fast as possible");
+        } else {
+            snprintf(speed, sizeof(speed), "%gx the recorded speed", options->speed);
+        }
+        printf("%s: %d links, %lu events over %.3f s, replayed %s with %s\n", options->trace_path, count,
+               source->events, source->span_ns / 1e9, speed, backend_name(options->backend));
+        printf("%-22s %lu sent, %lu processed (including echoes of its rotations), %lu lost, %lu resyncs\n", "events",
+               stats->replayed, report->link_events, stats->overruns, report->resyncs);
+        printf("%-22s p50 %.3f ms, p99 %.3f ms, max %.3f ms (simulated)\n", "event delay",
+               histogram_percentile(&report->event_delay, 0.50) / 1e6,
+               histogram_percentile(&report->event_delay, 0.99) / 1e6, report->event_delay.max / 1e6);
+        printf("%-22s %.1f ms for events, %.0f events/s; %.1f ms in all\n", "cpu", report->event_cpu_ns / 1e6,
+               report->event_cpu_ns ? report->link_events * 1e9 / report->event_cpu_ns : 0.0, report->loop_ns / 1e6);
+        printf("%-22s %lu done (%lu while the link was down anyway), %lu failed, %lu batches, %lu interfaces at the end\n",
+               "rotations", report->rotations, report->free_rotations, report->rotation_failures, report->batches,
+               report->interfaces);
+        result = 0;
+    }
+    kernel_close(kernel);
+    policy_free(policy);
+    free(report);
+    free(links);
+    munmap((void *)source->reader.data, source->reader.size);
+    free(source);
+    return result;
+}
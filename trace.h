@@ -0,0 +1,39 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_TRACE_H
+#define MACMASQ_TRACE_H
+
+// Including required C Header files
+#include "sim.h"           // for SimOptions
+
+/**
+* @brief Shape of a replay.
+*/
+typedef struct trace_replay_options {
+    const char *trace_path;              // Trace written by trace_record()
+    const char *policy_path;             // Policy file, NULL for the built-in one
+    double speed;                        // Replay speed (1 = as recorded), 0 for as fast as possible
+    MacBackend backend;                  // How the daemon applies rotations
+    int64 opportunistic_ns;              // Window of opportunistic rotations (see DaemonOptions)
+    SimOptions sim;                      // Load of the simulated kernel (interfaces is ignored)
+} TraceReplayOptions;
+
+int trace_record(const char *path, int64 duration_ns);
+int trace_replay(const TraceReplayOptions *options);
+
+#endif // MACMASQ_TRACE_H
@@ -0,0 +1,341 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Time to first frame (--measure-ttff).
+ *
+ * Before the address is changed, a thread opens an AF_PACKET capture with
+ * a TPACKET_V3 ring on the interface (or, for a veth, on its peer, where
+ * the frames arrive as ingress) and an rtnetlink socket subscribed to link
+ * events. A classic BPF filter only lets frames whose source is the new
+ * address into the ring, so the thread wakes for the frame it is after and
+ * not for the background traffic. Frames carry the kernel's software
+ * timestamp (CLOCK_REALTIME), converted to CLOCK_MONOTONIC with an offset
+ * sampled at the start; the carrier is the first IFF_LOWER_UP after the
+ * interface went down, stamped when the event is read.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdlib.h>                // for calloc, free
+#include <string.h>                // for memcpy, strcmp
+#include <errno.h>                 // for error number definitions
+#include <unistd.h>                // for close, read, write
+#include <time.h>                  // for clock_gettime
+#include <poll.h>                  // for poll
+#include <pthread.h>               // for the capture thread
+#include <arpa/inet.h>             // for htons
+#include <sys/mman.h>              // for mmap
+#include <sys/socket.h>            // for socket, setsockopt
+#include <sys/eventfd.h>           // for eventfd
+#include <linux/if_packet.h>       // for TPACKET_V3
+#include <linux/if_ether.h>        // for ETH_P_ALL
+#include <linux/filter.h>          // for the classic BPF filter
+#include <linux/rtnetlink.h>       // for RTMGRP_LINK
+#include "linktable.h"             // for finding the veth peer
+#include "ttff.h"                  // for the declarations implemented here
+
+// Geometry of the capture ring: few frames are expected once the filter is attached
+#define TTFF_BLOCK_SIZE 65536
+#define TTFF_BLOCK_COUNT 8
+#define TTFF_FRAME_SIZE 2048
+// Longest a partly filled block is held back by the kernel, in milliseconds
+#define TTFF_BLOCK_TIMEOUT_MS 1
+// Bytes of every matching frame copied into the ring (the Ethernet header is enough)
+#define TTFF_SNAPLEN 64
+// Carrier flag of rtnetlink (linux/if.h, which clashes with net/if.h)
+#ifndef IFF_LOWER_UP
+#define IFF_LOWER_UP 0x10000
+#endif
+
+/**
+* @brief A running capture.
+*/
+struct ttff_capture {
+    MacAddress new_mac;                  // Address the first frame must carry
+    int32 ifindex;                       // Interface being changed
+    char capture[IFNAMSIZ];              // Interface captured on
+    int packet_fd;                       // AF_PACKET socket
+    int netlink_fd;                      // rtnetlink socket subscribed to RTMGRP_LINK
+    int stop_fd;                         // eventfd that ends the capture early
+    char *ring;                          // The mmap'd TPACKET_V3 ring
+    int64 realtime_offset;               // CLOCK_REALTIME minus CLOCK_MONOTONIC
+    int64 deadline;                      // Give up waiting for a frame at this time (monotonic)
+    int64 carrier;                       // When the carrier came back, 0 if not seen
+    int64 first_frame;                   // When the first frame was sent, 0 if not seen
+    bool went_down;                      // The interface has been reported without carrier
+    pthread_t thread;                    // Runs capture_main()
+};
+
+/**
+ * @brief Returns CLOCK_REALTIME minus CLOCK_MONOTONIC, in nanoseconds.
+ */
+static int64 realtime_offset(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64)now.tv_sec * 1000000000 + now.tv_nsec - monotonic_ns();
+}
+
+/**
+ * @brief Opens the TPACKET_V3 capture for frames whose source is mac.
+ *
+ * @return int The socket, or a negative errno.
+ */
+static int open_ring(int32 ifindex, MacAddress mac, char **ring) {
+    // Created without a protocol so nothing is queued before the filter is attached
+    int fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    int32 high = (int32)mac.bytes[0] << 24 | mac.bytes[1] << 16 | mac.bytes[2] << 8 | mac.bytes[3];
+    int32 low = (int32)mac.bytes[4] << 8 | mac.bytes[5];
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 6),             // Source address, first four bytes
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, high, 0, 3),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 10),            // Last two bytes
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, low, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, TTFF_SNAPLEN),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog filter = { .len = sizeof(code) / sizeof(code[0]), .filter = code };
+    int version = TPACKET_V3;
+    struct tpacket_req3 request = {
+        .tp_block_size = TTFF_BLOCK_SIZE,
+        .tp_block_nr = TTFF_BLOCK_COUNT,
+        .tp_frame_size = TTFF_FRAME_SIZE,
+        .tp_frame_nr = TTFF_BLOCK_SIZE / TTFF_FRAME_SIZE * TTFF_BLOCK_COUNT,
+        .tp_retire_blk_tov = TTFF_BLOCK_TIMEOUT_MS,
+    };
+    struct sockaddr_ll address = { .sll_family = AF_PACKET, .sll_protocol = htons(ETH_P_ALL), .sll_ifindex = (int)ifindex };
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) < 0 ||
+        setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ||
+        setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) < 0) {
+        int error = errno;
+        close(fd);
+        return -error;
+    }
+    *ring = mmap(NULL, TTFF_BLOCK_SIZE * TTFF_BLOCK_COUNT, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (*ring == MAP_FAILED || bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        int error = errno;
+        if (*ring != MAP_FAILED) {
+            munmap(*ring, TTFF_BLOCK_SIZE * TTFF_BLOCK_COUNT);
+        }
+        *ring = NULL;
+        close(fd);
+        return -error;
+    }
+    return fd;
+}
+
+/**
+ * @brief Hands every filled block back to the kernel, noting the first matching frame.
+ *
+ * @param block Index of the next block to look at; advanced past the blocks consumed.
+ */
+static void drain_ring(TtffCapture *capture, int *block) {
+    for (;;) {
+        struct tpacket_block_desc *descriptor = (void *)(capture->ring + (size_t)*block * TTFF_BLOCK_SIZE);
+        if (!(__atomic_load_n(&descriptor->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            return;
+        }
+        struct tpacket3_hdr *frame = (void *)((char *)descriptor + descriptor->hdr.bh1.offset_to_first_pkt);
+        for (int32 i = 0; i < descriptor->hdr.bh1.num_pkts; i++) {
+            const int8 *ethernet = (const int8 *)frame + frame->tp_mac;
+            if (capture->first_frame == 0 && frame->tp_snaplen >= 12 &&
+                memcmp(ethernet + 6, capture->new_mac.bytes, 6) == 0) {
+                capture->first_frame = (int64)frame->tp_sec * 1000000000 + frame->tp_nsec - capture->realtime_offset;
+            }
+            frame = (void *)((char *)frame + frame->tp_next_offset);
+        }
+        __atomic_store_n(&descriptor->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        *block = (*block + 1) % TTFF_BLOCK_COUNT;
+    }
+}
+
+/**
+ * @brief Notes when the changed interface lost and regained its carrier.
+ */
+static void read_link_events(TtffCapture *capture) {
+    char buffer[16384] __attribute__((aligned(8)));
+    ssize_t length;
+    while ((length = recv(capture->netlink_fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+        int64 now = monotonic_ns();
+        int remaining = (int)length;
+        for (struct nlmsghdr *header = (struct nlmsghdr *)buffer; NLMSG_OK(header, remaining);
+             header = NLMSG_NEXT(header, remaining)) {
+            if (header->nlmsg_type != RTM_NEWLINK) {
+                continue;
+            }
+            LinkInfo link;
+            netlink_parse_link(header, &link);
+            if (link.ifindex != capture->ifindex) {
+                continue;
+            }
+            if (!(link.flags & IFF_LOWER_UP)) {
+                capture->went_down = true;
+            } else if (capture->went_down && capture->carrier == 0) {
+                capture->carrier = now;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Capture thread: runs until the first frame, the deadline or a stop request.
+ */
+static void *capture_main(void *argument) {
+    TtffCapture *capture = argument;
+    struct pollfd fds[3] = {
+        { .fd = capture->packet_fd, .events = POLLIN },
+        { .fd = capture->netlink_fd, .events = POLLIN },
+        { .fd = capture->stop_fd, .events = POLLIN },
+    };
+    int block = 0;
+    while (capture->first_frame == 0) {
+        int64 now = monotonic_ns();
+        if (now >= capture->deadline || fds[2].revents) {
+            break;
+        }
+        if (poll(fds, 3, (int)((capture->deadline - now) / 1000000) + 1) < 0 && errno != EINTR) {
+            break;
+        }
+        if (fds[1].revents) {
+            read_link_events(capture);
+        }
+        if (fds[0].revents) {
+            drain_ring(capture, &block);
+        }
+    }
+    read_link_events(capture);                             // The carrier may be reported after the frame
+    return NULL;
+}
+
+/**
+ * @brief Starts watching an interface for the first frame with its new address.
+ *
+ * The capture runs on the veth peer when the interface is one end of a
+ * veth pair whose other end is in the same namespace.
+ *
+ * @param interface The interface about to be changed.
+ * @param new_mac The address it is about to get.
+ * @param timeout_ns Longest wait for the first frame.
+ * @param capture Receives the running capture, to pass to ttff_finish().
+ * @return int 0 on success, or a negative errno.
+ */
+int ttff_start(const char *interface, MacAddress new_mac, int64 timeout_ns, TtffCapture **capture) {
+    // Subscribe before the dump so that no event after it can be missed
+    int socket_fd = netlink_open(RTMGRP_LINK);
+    int dump_fd = netlink_open(0);
+    LinkTable links = { 0 };
+    int result = socket_fd < 0 ? socket_fd : dump_fd < 0 ? dump_fd : link_table_load(&links, dump_fd);
+    if (dump_fd >= 0) {
+        close(dump_fd);
+    }
+    const LinkInfo *link = result == 0 ? link_table_find_name(&links, interface, strlen(interface)) : NULL;
+    if (result == 0 && link == NULL) {
+        result = -ENODEV;
+    }
+    TtffCapture *state = result == 0 ? calloc(1, sizeof(*state)) : NULL;
+    if (result == 0 && state == NULL) {
+        result = -ENOMEM;
+    }
+    if (result < 0) {
+        link_table_free(&links);
+        if (socket_fd >= 0) {
+            close(socket_fd);
+        }
+        return result;
+    }
+
+    const LinkInfo *target = link;
+    const LinkInfo *peer = strcmp(link->kind, "veth") == 0 ? link_table_find_ifindex(&links, link->link) : NULL;
+    if (peer != NULL && strcmp(peer->kind, "veth") == 0 && peer->link == link->ifindex) {
+        target = peer;                                     // Frames sent by the interface arrive on the peer
+    }
+    state->new_mac = new_mac;
+    state->ifindex = link->ifindex;
+    memcpy(state->capture, target->name, IFNAMSIZ);
+    state->netlink_fd = socket_fd;
+    state->packet_fd = open_ring(target->ifindex, new_mac, &state->ring);
+    state->stop_fd = eventfd(0, EFD_CLOEXEC);
+    state->realtime_offset = realtime_offset();
+    state->deadline = monotonic_ns() + timeout_ns;
+    link_table_free(&links);
+
+    result = state->packet_fd < 0 ? state->packet_fd : state->stop_fd < 0 ? -errno : 0;
+    if (result == 0) {
+        result = -pthread_create(&state->thread, NULL, capture_main, state);
+    }
+    if (result < 0) {
+        if (state->ring != NULL) {
+            munmap(state->ring, TTFF_BLOCK_SIZE * TTFF_BLOCK_COUNT);
+        }
+        if (state->packet_fd >= 0) close(state->packet_fd);
+        if (state->stop_fd >= 0) close(state->stop_fd);
+        close(socket_fd);
+        free(state);
+        return result;
+    }
+    *capture = state;
+    return 0;
+}
+
+/**
+ * @brief Waits for the capture to end and lays out the timeline of the change.
+ *
+ * A failed change stops the capture at once; otherwise it lasts until the
+ * first frame or the timeout. The capture is freed.
+ *
+ * @param capture The capture returned by ttff_start().
+ * @param invoked When the change was started (monotonic_ns()).
+ * @param trace The outcome of the change.
+ * @param timeline Receives the offsets of every event from invoked.
+ */
+void ttff_finish(TtffCapture *capture, int64 invoked, const LinkRotation *trace, TtffTimeline *timeline) {
+    if (trace->error != 0) {
+        int64 one = 1;
+        write(capture->stop_fd, &one, sizeof(one));
+    }
+    pthread_join(capture->thread, NULL);
+
+    // The phases end one after another, the last at the end of the change
+    memset(timeline, 0, sizeof(*timeline));
+    memcpy(timeline->capture, capture->capture, IFNAMSIZ);
+    if (trace->up_ns) {
+        timeline->up_ns = trace->total_ns;
+    }
+    if (trace->set_ns) {
+        timeline->set_ns = trace->total_ns - trace->up_ns;
+    }
+    if (trace->down_ns) {
+        timeline->down_ns = trace->total_ns - trace->up_ns - trace->set_ns;
+    }
+    if (capture->carrier) {
+        timeline->carrier_ns = capture->carrier - invoked;
+    }
+    if (capture->first_frame) {
+        timeline->first_frame_ns = capture->first_frame - invoked;
+    }
+
+    munmap(capture->ring, TTFF_BLOCK_SIZE * TTFF_BLOCK_COUNT);
+    close(capture->packet_fd);
+    close(capture->netlink_fd);
+    close(capture->stop_fd);
+    free(capture);
+}
@@ -0,0 +1,46 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_TTFF_H
+#define MACMASQ_TTFF_H
+
+// Including required C Header files
+#include "netlink.h"       // for LinkRotation
+
+// How long to wait for the first frame when none is given on the command line
+#define TTFF_DEFAULT_TIMEOUT_S 10
+
+/**
+* @brief What happened after a MAC change, as offsets from the invocation.
+*
+* An offset of 0 means the event was not seen.
+*/
+typedef struct ttff_timeline {
+    char capture[IFNAMSIZ];              // Interface the capture ran on (the veth peer, if any)
+    int64 down_ns;                       // Interface down
+    int64 set_ns;                        // Address set
+    int64 up_ns;                         // Interface up again
+    int64 carrier_ns;                    // Carrier back (IFF_LOWER_UP reported by rtnetlink)
+    int64 first_frame_ns;                // First frame with the new source address
+} TtffTimeline;
+
+typedef struct ttff_capture TtffCapture;
+
+int ttff_start(const char *interface, MacAddress new_mac, int64 timeout_ns, TtffCapture **capture);
+void ttff_finish(TtffCapture *capture, int64 invoked, const LinkRotation *trace, TtffTimeline *timeline);
+
+#endif // MACMASQ_TTFF_H
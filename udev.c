@@ -0,0 +1,132 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * One-shot handling of udev "add" events for network devices.
+ *
+ * The device is addressed by IFINDEX rather than by name, so a rename racing
+ * with the RUN program cannot make us change the wrong interface. On "add"
+ * the device has not been brought up yet, which lets the address be set with
+ * a single RTM_SETLINK; the down/set/up cycle is only used as a fallback.
+ * Like netlink.c, this file never touches stdio.
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdlib.h>        // for getenv, strtoul
+#include <string.h>        // for strcmp, strncpy, memset
+#include <errno.h>         // for EBUSY, EINVAL
+#include <unistd.h>        // for close
+#include <net/if.h>        // for IFF_UP
+#include "netlink.h"       // for the rtnetlink helpers
+#include "udev.h"          // for the udev helpers declared here
+
+// One-shot process: the batch can live in .bss instead of on the stack
+static NetlinkBatch batch;
+
+/**
+ * @brief Reads IFINDEX, INTERFACE and ACTION from the environment.
+ *
+ * @param event Receives the event description.
+ * @return true if IFINDEX and ACTION are present and well formed.
+ */
+bool udev_event_from_environment(UdevEvent *event) {
+    const char *ifindex = getenv("IFINDEX");
+    event->interface = getenv("INTERFACE");
+    event->action = getenv("ACTION");
+    if (ifindex == NULL || event->action == NULL) {
+        return false;
+    }
+    char *end;
+    unsigned long value = strtoul(ifindex, &end, 10);
+    if (*ifindex == '\0' || *end != '\0' || value == 0 || value > 0x7FFFFFFF) {
+        return false;
+    }
+    event->ifindex = (int32)value;
+    if (event->interface == NULL) {
+        event->interface = "";
+    }
+    return true;
+}
+
+/**
+ * @brief Tells whether the event announces a new device.
+ */
+bool udev_event_wants_rotation(const UdevEvent *event) {
+    return strcmp(event->action, "add") == 0;
+}
+
+/**
+ * @brief Stores the error of the first failed request.
+ */
+static void record_error(void *context, int32 tag, int error) {
+    (void)tag;
+    int *first_error = context;
+    if (error != 0 && *first_error == 0) {
+        *first_error = error;
+    }
+}
+
+/**
+ * @brief Gives the device of a udev event a fresh address.
+ *
+ * The common case costs five system calls: socket, setsockopt, sendmsg,
+ * recvmsg and close. If the device is already up and its driver refuses a
+ * live change (EBUSY), it is cycled down and up within one extra batch.
+ *
+ * @param event The event to handle.
+ * @param new_mac The address to apply, normally random_local_mac().
+ * @param result Receives the applied address, the error and the latency. The
+ *               previous address is not queried and is left all zero.
+ */
+void udev_rotate(const UdevEvent *event, MacAddress new_mac, LinkRotation *result) {
+    int64 started = monotonic_ns();
+    memset(result, 0, sizeof(*result));
+    result->ifindex = event->ifindex;
+    strncpy(result->name, event->interface, IFNAMSIZ - 1);
+    result->new_mac = new_mac;
+    result->backend = BACKEND_NETLINK;
+
+    int socket_fd = netlink_open(0);
+    if (socket_fd < 0) {
+        result->error = -socket_fd;
+        result->total_ns = monotonic_ns() - started;
+        return;
+    }
+
+    int first_error = 0;
+    netlink_batch_init(&batch, socket_fd, record_error, &first_error);
+    netlink_batch_set_address(&batch, event->ifindex, result->new_mac, 0);
+    int status = netlink_batch_flush(&batch);
+    result->set_ns = monotonic_ns() - started;
+
+    if (status == 0 && first_error == EBUSY) {
+        // Somebody brought the device up already: down, set, up in one round trip
+        first_error = 0;
+        netlink_batch_set_flags(&batch, event->ifindex, 0, IFF_UP, 0);
+        netlink_batch_set_address(&batch, event->ifindex, result->new_mac, 0);
+        netlink_batch_set_flags(&batch, event->ifindex, IFF_UP, IFF_UP, 0);
+        status = netlink_batch_flush(&batch);
+        result->retries = 1;
+    }
+
+    close(socket_fd);
+    result->error = status < 0 ? -status : first_error;
+    result->total_ns = monotonic_ns() - started;
+}
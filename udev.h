@@ -0,0 +1,37 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_UDEV_H
+#define MACMASQ_UDEV_H
+
+// Including required C Header files
+#include "netlink.h"       // for LinkRotation
+
+/**
+* @brief A network device event as passed by udev to RUN programs.
+*/
+typedef struct udev_event {
+    int32 ifindex;                       // IFINDEX, the stable handle of the device
+    const char *interface;               // INTERFACE, for reporting only (may be renamed meanwhile)
+    const char *action;                  // ACTION ("add", "remove", "move", ...)
+} UdevEvent;
+
+bool udev_event_from_environment(UdevEvent *event);
+bool udev_event_wants_rotation(const UdevEvent *event);
+void udev_rotate(const UdevEvent *event, MacAddress new_mac, LinkRotation *result);
+
+#endif // MACMASQ_UDEV_H
@@ -0,0 +1,585 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Adaptive-concurrency worker pool (--parallel).
+ *
+ * Every address change takes the kernel's RTNL lock, so past a few
+ * threads more parallelism only adds queueing. The pool starts one
+ * operation at a time and lets an AIMD controller find the knee: after
+ * each window of completions it compares the window's mean latency with
+ * the lowest mean seen so far (the uncontended cost). While latency stays
+ * within twice that floor the in-flight limit grows by one; beyond it the
+ * limit shrinks by a quarter.
+ *
+ * Work is split into one contiguous range per worker, which keeps the
+ * interfaces of a namespace together on one thread; a worker that runs dry
+ * steals from the front of another worker's range. Workers keep one socket
+ * per namespace, created by entering the namespace once, so an operation
+ * never needs setns().
+ */
+
+// Constant to enable GNU extensions
+#define _GNU_SOURCE
+
+// Including required C Header files
+#include <stdio.h>                 // for snprintf
+#include <stdlib.h>                // for malloc, calloc, realloc, free, qsort
+#include <string.h>                // for memcpy, strcmp
+#include <errno.h>                 // for error number definitions
+#include <fcntl.h>                 // for open
+#include <unistd.h>                // for close
+#include <fnmatch.h>               // for fnmatch
+#include <dirent.h>                // for opendir
+#include <sched.h>                 // for setns
+#include <pthread.h>               // for the workers
+#include <sys/ioctl.h>             // for SIOCSIFFLAGS, SIOCSIFHWADDR
+#include <sys/socket.h>            // for socket
+#include <sys/stat.h>              // for fstat
+#include <net/if_arp.h>            // for ARPHRD_ETHER
+#include "workpool.h"              // for the declarations implemented here
+
+// Completions per controller window, at least (scaled up with the limit)
+#define WORK_POOL_WINDOW 16
+// Latency over the floor that counts as congestion
+#define WORK_POOL_TOLERANCE 2
+
+/*
+ * Work sets
+ */
+
+/**
+ * @brief Adds a network namespace to a work set.
+ *
+ * @param name Name under /run/netns, or NULL for the current namespace.
+ * @return int 0 on success, or a negative errno.
+ */
+int work_set_add_netns(WorkSet *set, const char *name) {
+    char path[300];
+    snprintf(path, sizeof(path), name ? NETNS_RUN_DIR "/%s" : "/proc/self/ns/net", name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    int *fds = realloc(set->netns_fds, (set->netns_count + 1) * sizeof(int));
+    char (*names)[256] = fds ? realloc(set->netns_names, (set->netns_count + 1) * sizeof(*names)) : NULL;
+    if (fds) set->netns_fds = fds;
+    if (names == NULL) {
+        close(fd);
+        return -ENOMEM;
+    }
+    set->netns_names = names;
+    set->netns_fds[set->netns_count] = fd;
+    snprintf(set->netns_names[set->netns_count], sizeof(names[0]), "%s", name ? name : "");
+    set->netns_count++;
+    return 0;
+}
+
+/**
+ * @brief Creates an anonymous network namespace, leaving the calling thread where it was.
+ *
+ * The namespace lives as long as the returned descriptor (or a thread in it).
+ *
+ * @return int A descriptor for setns(), or a negative errno.
+ */
+int netns_create(void) {
+    int home = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (home < 0) {
+        return -errno;
+    }
+    int fd = unshare(CLONE_NEWNET) < 0 ? -1 : open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    int error = errno;
+    setns(home, CLONE_NEWNET);
+    close(home);
+    return fd < 0 ? -error : fd;
+}
+
+/**
+ * @brief Adds every named network namespace (those of "ip netns") to a work set.
+ *
+ * @return int 0 on success, or a negative errno.
+ */
+int work_set_add_all_netns(WorkSet *set) {
+    DIR *directory = opendir(NETNS_RUN_DIR);
+    if (directory == NULL) {
+        return -errno;
+    }
+    int result = 0;
+    for (struct dirent *entry; result == 0 && (entry = readdir(directory)) != NULL;) {
+        if (entry->d_name[0] != '.') {
+            result = work_set_add_netns(set, entry->d_name);
+        }
+    }
+    closedir(directory);
+    return result;
+}
+
+/**
+* @brief State of the link dump of one namespace.
+*/
+typedef struct collect_context {
+    WorkSet *set;                        // Receives the interfaces
+    const char *pattern;                 // Name pattern, NULL for physical interfaces
+    int netns;                           // Namespace being dumped
+    int error;                           // -ENOMEM once memory ran out
+} CollectContext;
+
+/**
+ * @brief Adds one dumped interface to the work set if it is a target.
+ */
+static void collect_visit(const LinkInfo *link, void *context) {
+    CollectContext *collect = context;
+    WorkSet *set = collect->set;
+    bool wanted = collect->pattern ? link->type == ARPHRD_ETHER && fnmatch(collect->pattern, link->name, 0) == 0
+                                   : link_is_physical(link);
+    if (!wanted || collect->error) {
+        return;
+    }
+    if (set->count == set->capacity) {
+        int capacity = set->capacity ? set->capacity * 2 : 256;
+        LinkRotation *rotations = realloc(set->rotations, capacity * sizeof(*rotations));
+        int *netns_of = rotations ? realloc(set->netns_of, capacity * sizeof(int)) : NULL;
+        if (rotations) set->rotations = rotations;
+        if (netns_of == NULL) {
+            collect->error = -ENOMEM;
+            return;
+        }
+        set->netns_of = netns_of;
+        set->capacity = capacity;
+    }
+    LinkRotation *rotation = &set->rotations[set->count];
+    memset(rotation, 0, sizeof(*rotation));
+    rotation->ifindex = link->ifindex;
+    rotation->flags = link->flags;
+    rotation->old_mac = link->address;
+    if (!random_local_mac(&rotation->new_mac)) {
+        collect->error = -EIO;
+        return;
+    }
+    memcpy(rotation->name, link->name, IFNAMSIZ);
+    set->netns_of[set->count++] = collect->netns;
+}
+
+/**
+ * @brief Collects the target interfaces of every namespace of a work set.
+ *
+ * @param pattern Interface name pattern (fnmatch), or NULL for physical interfaces.
+ * @return int 0 on success, or a negative errno.
+ */
+int work_set_collect(WorkSet *set, const char *pattern) {
+    int home = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (home < 0) {
+        return -errno;
+    }
+    int result = 0;
+    for (int netns = 0; netns < set->netns_count && result == 0; netns++) {
+        if (setns(set->netns_fds[netns], CLONE_NEWNET) < 0) {
+            result = -errno;
+            break;
+        }
+        int socket_fd = netlink_open(0);
+        CollectContext collect = { .set = set, .pattern = pattern, .netns = netns };
+        result = socket_fd < 0 ? socket_fd : netlink_dump_links(socket_fd, collect_visit, &collect);
+        if (result == 0) {
+            result = collect.error;
+        }
+        if (socket_fd >= 0) {
+            close(socket_fd);
+        }
+    }
+    setns(home, CLONE_NEWNET);
+    close(home);
+    return result;
+}
+
+/**
+ * @brief Closes the namespaces and frees a work set.
+ */
+void work_set_free(WorkSet *set) {
+    for (int netns = 0; netns < set->netns_count; netns++) {
+        close(set->netns_fds[netns]);
+    }
+    free(set->netns_fds);
+    free(set->netns_names);
+    free(set->rotations);
+    free(set->netns_of);
+    memset(set, 0, sizeof(*set));
+}
+
+/*
+ * Pool
+ */
+
+/**
+* @brief A worker's range of items; the owner takes from the back, thieves from the front.
+*/
+typedef struct work_deque {
+    pthread_mutex_t lock;                // Guards front and back
+    int front;                           // First item not taken
+    int back;                            // One past the last item not taken
+} WorkDeque;
+
+/**
+* @brief State shared by the workers.
+*/
+typedef struct work_pool {
+    WorkSet *set;                        // The work
+    MacBackend backend;                  // How addresses are changed
+    int workers;                         // Threads
+    AuditLog *audit;                     // Audit log of every rotation, NULL if disabled
+    MacRegistry *registry;               // Host-wide address registry, NULL if disabled
+    Journal *journal;                    // Journal of original addresses, NULL if disabled
+    int64 *netns_ids;                    // Inode of every namespace, tags the applied addresses
+    WorkDeque *deques;                   // One per worker
+
+    pthread_mutex_t lock;                // Guards everything below
+    pthread_cond_t room;                 // Signalled when in_flight drops below limit
+    int limit;                           // Operations allowed in flight
+    int in_flight;                       // Operations running
+    int64 window_started;                // Start of the current controller window
+    int64 window_latency;                // Sum of the latencies of the window
+    int window_count;                    // Completions in the window
+    int64 floor_latency;                 // Lowest window mean seen (the uncontended cost)
+    int64 limit_since;                   // When limit last changed
+    double limit_time;                   // Integral of limit over time, in ns
+    WorkPoolReport *report;              // Counters
+} WorkPool;
+
+/**
+* @brief One worker thread.
+*/
+typedef struct worker {
+    WorkPool *pool;                      // Shared state
+    int index;                           // Position in pool->deques
+    int *sockets;                        // Socket per namespace, -1 until needed
+    int home;                            // Namespace the thread started in
+    NetlinkBatch *batch;                 // For the netlink backend
+    int64 steals;                        // Items stolen from other workers
+} Worker;
+
+/**
+ * @brief Takes the next item: from the back of the worker's range, else from the front of another's.
+ *
+ * @return int The item, or -1 when all work is taken.
+ */
+static int next_item(Worker *worker) {
+    WorkPool *pool = worker->pool;
+    WorkDeque *own = &pool->deques[worker->index];
+    pthread_mutex_lock(&own->lock);
+    int item = own->back > own->front ? --own->back : -1;
+    pthread_mutex_unlock(&own->lock);
+    for (int offset = 1; item < 0 && offset < pool->workers; offset++) {
+        WorkDeque *victim = &pool->deques[(worker->index + offset) % pool->workers];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->back > victim->front) {
+            item = victim->front++;
+            worker->steals++;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return item;
+}
+
+/**
+ * @brief Returns the worker's socket for a namespace, entering the namespace to create it.
+ *
+ * @return int The socket, or a negative errno.
+ */
+static int namespace_socket(Worker *worker, int netns) {
+    if (worker->sockets[netns] >= 0) {
+        return worker->sockets[netns];
+    }
+    if (setns(worker->pool->set->netns_fds[netns], CLONE_NEWNET) < 0) {
+        return -errno;
+    }
+    int fd = worker->pool->backend == BACKEND_IOCTL ? socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)
+                                                     : netlink_open(0);
+    if (fd < 0 && worker->pool->backend == BACKEND_IOCTL) {
+        fd = -errno;
+    }
+    setns(worker->home, CLONE_NEWNET);
+    if (fd >= 0) {
+        worker->sockets[netns] = fd;
+    }
+    return fd;
+}
+
+/**
+ * @brief Changes one address with SIOCSIFFLAGS / SIOCSIFHWADDR on a socket of the right namespace.
+ *
+ * @param socket_fd Any AF_INET socket of the interface's namespace.
+ * @param rotation The change; name, flags and new_mac are used, the outcome is stored back.
+ */
+void ioctl_rotate(int socket_fd, LinkRotation *rotation) {
+    struct ifreq request = { 0 };
+    memcpy(request.ifr_name, rotation->name, IFNAMSIZ);
+    bool was_up = rotation->flags & IFF_UP;
+    int64 started = monotonic_ns(), mark = started;
+    rotation->backend = BACKEND_IOCTL;
+    if (was_up) {
+        request.ifr_flags = (short)(rotation->flags & ~IFF_UP);
+        if (ioctl(socket_fd, SIOCSIFFLAGS, &request) < 0) {
+            rotation->error = errno;
+            return;
+        }
+        rotation->down_ns = monotonic_ns() - mark;
+        mark += rotation->down_ns;
+    }
+    request.ifr_hwaddr.sa_family = ARPHRD_ETHER;
+    memcpy(request.ifr_hwaddr.sa_data, rotation->new_mac.bytes, 6);
+    if (ioctl(socket_fd, SIOCSIFHWADDR, &request) < 0) {
+        rotation->error = errno;
+    }
+    rotation->set_ns = monotonic_ns() - mark;
+    mark += rotation->set_ns;
+    if (was_up) {
+        request.ifr_flags = (short)rotation->flags;        // Bring it back up even if the change failed
+        if (ioctl(socket_fd, SIOCSIFFLAGS, &request) < 0 && rotation->error == 0) {
+            rotation->error = errno;
+        }
+        rotation->up_ns = monotonic_ns() - mark;
+    }
+}
+
+/**
+ * @brief Records a change of the concurrency limit (pool lock held).
+ */
+static void set_limit(WorkPool *pool, int limit, int64 now) {
+    pool->limit_time += (double)pool->limit * (now - pool->limit_since);
+    pool->limit_since = now;
+    pool->limit = limit;
+    if (limit > pool->report->peak_limit) {
+        pool->report->peak_limit = limit;
+    }
+}
+
+/**
+ * @brief Accounts one completion and, at the end of a window, adjusts the limit (AIMD).
+ */
+static void complete(WorkPool *pool, int64 latency) {
+    int64 now = monotonic_ns();
+    pthread_mutex_lock(&pool->lock);
+    pool->in_flight--;
+    pool->window_latency += latency;
+    int window = WORK_POOL_WINDOW > pool->limit * 4 ? WORK_POOL_WINDOW : pool->limit * 4;
+    if (++pool->window_count >= window) {
+        int64 mean = pool->window_latency / pool->window_count;
+        if (pool->floor_latency == 0 || mean < pool->floor_latency) {
+            pool->floor_latency = mean;
+        }
+        if (mean <= pool->floor_latency * WORK_POOL_TOLERANCE) {
+            if (pool->limit < pool->workers) {
+                set_limit(pool, pool->limit + 1, now);     // Additive increase
+                pool->report->increases++;
+            }
+        } else if (pool->limit > 1) {
+            int reduced = pool->limit * 3 / 4;
+            set_limit(pool, reduced < pool->limit - 1 ? reduced : pool->limit - 1, now);
+            pool->report->decreases++;                     // Multiplicative decrease
+        }
+        pool->window_started = now;
+        pool->window_latency = 0;
+        pool->window_count = 0;
+    }
+    pthread_cond_broadcast(&pool->room);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Worker thread: takes items until none is left, within the concurrency limit.
+ */
+static void *worker_main(void *argument) {
+    Worker *worker = argument;
+    WorkPool *pool = worker->pool;
+    WorkSet *set = pool->set;
+    for (int item; (item = next_item(worker)) >= 0;) {
+        LinkRotation *rotation = &set->rotations[item];
+        int fd = namespace_socket(worker, set->netns_of[item]);
+        if (fd < 0) {
+            rotation->error = -fd;
+            audit_rotation(pool->audit, rotation, "parallel");
+            continue;
+        }
+
+        int reserved = registry_reserve_random(pool->registry, &rotation->new_mac);
+        if (reserved < 0) {
+            rotation->error = -reserved;                   // Not reserved, so not sent
+            audit_rotation(pool->audit, rotation, "parallel");
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->in_flight >= pool->limit) {
+            pthread_cond_wait(&pool->room, &pool->lock);
+        }
+        pool->in_flight++;
+        pthread_mutex_unlock(&pool->lock);
+
+        int64 started = monotonic_ns();
+        if (pool->backend == BACKEND_IOCTL) {
+            ioctl_rotate(fd, rotation);
+        } else {
+            netlink_batch_init(worker->batch, fd, NULL, NULL);
+            int result = netlink_rotate(worker->batch, rotation, 1);
+            if (result < 0) {
+                rotation->error = -result;
+            }
+            rotation->backend = BACKEND_NETLINK;
+        }
+        rotation->total_ns = monotonic_ns() - started;
+        registry_settle(pool->registry, rotation, pool->netns_ids[set->netns_of[item]]);
+        journal_record(pool->journal, rotation, pool->netns_ids[set->netns_of[item]]);
+        audit_rotation(pool->audit, rotation, "parallel");
+        complete(pool, rotation->total_ns);
+    }
+    return NULL;
+}
+
+/**
+ * @brief qsort() comparison of two latencies.
+ */
+static int compare_int64(const void *a, const void *b) {
+    int64 x = *(const int64 *)a, y = *(const int64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Fills in the latency percentiles of a finished run.
+ */
+static void report_latency(const WorkSet *set, WorkPoolReport *report) {
+    int64 *latencies = malloc((set->count + 1) * sizeof(int64));
+    int total = 0;
+    for (int i = 0; latencies && i < set->count; i++) {
+        if (set->rotations[i].error == 0) {
+            latencies[total++] = set->rotations[i].total_ns;
+        }
+    }
+    if (total > 0) {
+        qsort(latencies, total, sizeof(int64), compare_int64);
+        report->p50_ns = latencies[(total - 1) / 2];
+        report->p99_ns = latencies[(int)((total - 1) * 0.99)];
+    }
+    free(latencies);
+}
+
+/**
+ * @brief Rotates every interface of a work set with an adaptive number of workers.
+ *
+ * @param set The interfaces, with their new addresses; outcomes are stored back.
+ * @param workers Threads to start (the most operations ever in flight).
+ * @param backend BACKEND_IOCTL or BACKEND_NETLINK.
+ * @param audit Audit log the workers record every rotation in, NULL for none.
+ * @param registry Registry the new addresses are reserved in, NULL for none.
+ * @param journal Journal the original addresses are recorded in, NULL for none.
+ * @param report Receives the concurrency the controller chose and the run's counters.
+ * @return int 0 on success, or a negative errno if the pool could not start.
+ */
+int work_pool_run(WorkSet *set, int workers, MacBackend backend, AuditLog *audit, MacRegistry *registry,
+                  Journal *journal, WorkPoolReport *report) {
+    workers = workers < 1 ? 1 : workers > WORK_POOL_MAX_WORKERS ? WORK_POOL_MAX_WORKERS : workers;
+    memset(report, 0, sizeof(*report));
+    report->workers = workers;
+    report->backend = backend;
+    report->peak_limit = 1;
+
+    WorkPool pool = { .set = set, .backend = backend, .workers = workers, .audit = audit, .registry = registry,
+                     .journal = journal, .limit = 1, .report = report };
+    Worker *threads = calloc(workers, sizeof(*threads));
+    pthread_t *ids = calloc(workers, sizeof(*ids));
+    pool.deques = calloc(workers, sizeof(*pool.deques));
+    pool.netns_ids = calloc(set->netns_count, sizeof(int64));
+    int result = threads && ids && pool.deques && pool.netns_ids ? 0 : -ENOMEM;
+    for (int netns = 0; result == 0 && netns < set->netns_count; netns++) {
+        struct stat status;
+        pool.netns_ids[netns] = fstat(set->netns_fds[netns], &status) == 0 ? (int64)status.st_ino : 0;
+    }
+    // Every worker holds nothing before setup starts, so the cleanup below is safe wherever it stops
+    for (int i = 0; threads && i < workers; i++) {
+        threads[i] = (Worker){ .pool = &pool, .index = i, .home = -1 };
+    }
+    for (int i = 0; pool.deques && i < workers; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+    }
+    for (int i = 0; i < workers && result == 0; i++) {
+        threads[i].sockets = malloc(set->netns_count * sizeof(int));
+        for (int netns = 0; threads[i].sockets && netns < set->netns_count; netns++) {
+            threads[i].sockets[netns] = -1;
+        }
+        threads[i].batch = backend == BACKEND_IOCTL ? NULL : malloc(sizeof(NetlinkBatch));
+        if (threads[i].sockets == NULL || (backend != BACKEND_IOCTL && threads[i].batch == NULL)) {
+            result = -ENOMEM;
+        } else {
+            threads[i].home = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+            if (threads[i].home < 0) {
+                result = -errno;
+            }
+        }
+        // Contiguous ranges keep each namespace's interfaces on few workers
+        pool.deques[i].front = (int)((int64)set->count * i / workers);
+        pool.deques[i].back = (int)((int64)set->count * (i + 1) / workers);
+    }
+
+    if (result == 0) {
+        pthread_mutex_init(&pool.lock, NULL);
+        pthread_cond_init(&pool.room, NULL);
+        int64 started = monotonic_ns();
+        pool.window_started = pool.limit_since = started;
+        int running = 0;
+        for (; running < workers; running++) {
+            if (pthread_create(&ids[running], NULL, worker_main, &threads[running]) != 0) {
+                break;
+            }
+        }
+        if (running == 0) {
+            // Not even one thread: do the work here
+            worker_main(&threads[0]);
+        }
+        for (int i = 0; i < running; i++) {
+            pthread_join(ids[i], NULL);
+        }
+        int64 finished = monotonic_ns();
+        set_limit(&pool, pool.limit, finished);
+        report->final_limit = pool.limit;
+        report->elapsed_ns = finished - started;
+        report->mean_limit = report->elapsed_ns ? pool.limit_time / report->elapsed_ns : 1;
+        report_latency(set, report);
+        pthread_cond_destroy(&pool.room);
+        pthread_mutex_destroy(&pool.lock);
+    }
+
+    for (int i = 0; threads && i < workers; i++) {
+        report->steals += threads[i].steals;
+        for (int netns = 0; threads[i].sockets && netns < set->netns_count; netns++) {
+            if (threads[i].sockets[netns] >= 0) {
+                close(threads[i].sockets[netns]);
+            }
+        }
+        if (threads[i].home >= 0) {
+            close(threads[i].home);
+        }
+        free(threads[i].sockets);
+        free(threads[i].batch);
+        if (pool.deques) {
+            pthread_mutex_destroy(&pool.deques[i].lock);
+        }
+    }
+    free(threads);
+    free(ids);
+    free(pool.deques);
+    free(pool.netns_ids);
+    return result;
+}
@@ -0,0 +1,71 @@
+/*
+ * macmasq
+ * Copyright (C) 2025 Vasu Makadia
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MACMASQ_WORKPOOL_H
+#define MACMASQ_WORKPOOL_H
+
+// Including required C Header files
+#include "netlink.h"       // for LinkRotation
+#include "audit.h"         // for AuditLog
+#include "registry.h"      // for MacRegistry
+#include "journal.h"       // for Journal
+
+// Most worker threads in a pool
+#define WORK_POOL_MAX_WORKERS 64
+// Directory where "ip netns" keeps named network namespaces
+#define NETNS_RUN_DIR "/run/netns"
+
+/**
+* @brief Interfaces to rotate, spread over network namespaces.
+*/
+typedef struct work_set {
+    int *netns_fds;                      // One open namespace file per namespace
+    char (*netns_names)[256];            // Their names ("" for the current namespace)
+    int netns_count;                     // Entries of netns_fds and netns_names
+    LinkRotation *rotations;             // The interfaces, grouped by namespace
+    int *netns_of;                       // Namespace index of every rotation
+    int count;                           // Entries of rotations and netns_of
+    int capacity;                        // Allocated entries
+} WorkSet;
+
+/**
+* @brief How the pool runs, and what it found out.
+*/
+typedef struct work_pool_report {
+    int workers;                         // Threads started
+    MacBackend backend;                  // BACKEND_IOCTL or BACKEND_NETLINK
+    int final_limit;                     // Concurrency limit when the work ran out
+    int peak_limit;                      // Highest limit reached
+    double mean_limit;                   // Limit averaged over time
+    int increases;                       // Additive increases
+    int decreases;                       // Multiplicative decreases
+    int64 steals;                        // Items taken from another worker's queue
+    int64 elapsed_ns;                    // Wall time of the whole run
+    int64 p50_ns;                        // Median latency of one interface
+    int64 p99_ns;                        // 99th percentile latency of one interface
+} WorkPoolReport;
+
+int netns_create(void);
+int work_set_add_netns(WorkSet *set, const char *name);
+int work_set_add_all_netns(WorkSet *set);
+int work_set_collect(WorkSet *set, const char *pattern);
+void work_set_free(WorkSet *set);
+void ioctl_rotate(int socket_fd, LinkRotation *rotation);
+int work_pool_run(WorkSet *set, int workers, MacBackend backend, AuditLog *audit, MacRegistry *registry,
+                  Journal *journal, WorkPoolReport *report);
+
+#endif // MACMASQ_WORKPOOL_H